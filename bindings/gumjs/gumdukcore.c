@@ -1367,8 +1367,11 @@ GUMJS_DEFINE_FUNCTION (gumjs_send)
    *
    * This is very important for the RPC API.
    */
-  gum_interceptor_end_transaction (interceptor);
-  gum_interceptor_begin_transaction (interceptor);
+  if (gum_interceptor_has_pending_changes (interceptor))
+  {
+    gum_interceptor_end_transaction (interceptor);
+    gum_interceptor_begin_transaction (interceptor);
+  }
 
   self->message_emitter (self->script, message, data);
 
@@ -49,6 +49,7 @@ struct _GumDukScriptPrivate
   GBytes * bytecode;
   GMainContext * main_context;
   GumDukScriptBackend * backend;
+  GumScriptScheduler * scheduler;
 
   GumScriptState state;
   GSList * on_unload;
@@ -103,6 +104,7 @@ struct _GumPostMessageData
 
 static void gum_duk_script_iface_init (gpointer g_iface, gpointer iface_data);
 
+static void gum_duk_script_constructed (GObject * object);
 static void gum_duk_script_dispose (GObject * object);
 static void gum_duk_script_finalize (GObject * object);
 static void gum_duk_script_get_property (GObject * object, guint property_id,
@@ -145,6 +147,7 @@ static void gum_duk_script_do_post_message (GumPostMessageData * d);
 static void gum_duk_post_message_data_free (GumPostMessageData * d);
 
 static GumStalker * gum_duk_script_get_stalker (GumScript * script);
+static guint gum_duk_script_get_js_queue_depth (GumScript * script);
 
 static void gum_duk_script_emit_message (GumDukScript * self,
     const gchar * message, GBytes * data);
@@ -165,6 +168,7 @@ gum_duk_script_class_init (GumDukScriptClass * klass)
 
   g_type_class_add_private (klass, sizeof (GumDukScriptPrivate));
 
+  object_class->constructed = gum_duk_script_constructed;
   object_class->dispose = gum_duk_script_dispose;
   object_class->finalize = gum_duk_script_finalize;
   object_class->get_property = gum_duk_script_get_property;
@@ -213,6 +217,7 @@ gum_duk_script_iface_init (gpointer g_iface,
   iface->post_message = gum_duk_script_post_message;
 
   iface->get_stalker = gum_duk_script_get_stalker;
+  iface->get_js_queue_depth = gum_duk_script_get_js_queue_depth;
 }
 
 static void
@@ -227,6 +232,18 @@ gum_duk_script_init (GumDukScript * self)
   priv->on_unload = NULL;
 }
 
+static void
+gum_duk_script_constructed (GObject * object)
+{
+  GumDukScript * self = GUM_DUK_SCRIPT (object);
+  GumDukScriptPrivate * priv = self->priv;
+
+  G_OBJECT_CLASS (gum_duk_script_parent_class)->constructed (object);
+
+  priv->scheduler = gum_script_scheduler_obtain_for_script (
+      gum_duk_script_backend_get_scheduler (priv->backend));
+}
+
 static void
 gum_duk_script_dispose (GObject * object)
 {
@@ -243,6 +260,7 @@ gum_duk_script_dispose (GObject * object)
   }
   else
   {
+    g_clear_pointer (&priv->scheduler, g_object_unref);
     g_clear_pointer (&priv->main_context, g_main_context_unref);
     g_clear_pointer (&priv->backend, g_object_unref);
   }
@@ -380,8 +398,7 @@ gum_duk_script_create_context (GumDukScript * self,
   priv->ctx = ctx;
 
   _gum_duk_core_init (&priv->core, self, &priv->interceptor,
-      gum_duk_script_emit_message,
-      gum_duk_script_backend_get_scheduler (priv->backend), priv->ctx);
+      gum_duk_script_emit_message, priv->scheduler, priv->ctx);
 
   priv->core.current_ctx = priv->core.heap_ctx;
 
@@ -470,8 +487,7 @@ gum_duk_script_load (GumScript * script,
 
   task = gum_script_task_new (gum_duk_script_do_load, self, cancellable,
       callback, user_data);
-  gum_script_task_run_in_js_thread (task,
-      gum_duk_script_backend_get_scheduler (self->priv->backend));
+  gum_script_task_run_in_js_thread (task, self->priv->scheduler);
   g_object_unref (task);
 }
 
@@ -493,8 +509,7 @@ gum_duk_script_load_sync (GumScript * script,
 
   task = gum_script_task_new (gum_duk_script_do_load, self, cancellable, NULL,
       NULL);
-  gum_script_task_run_in_js_thread_sync (task,
-      gum_duk_script_backend_get_scheduler (self->priv->backend));
+  gum_script_task_run_in_js_thread_sync (task, self->priv->scheduler);
   gum_script_task_propagate_pointer (task, NULL);
   g_object_unref (task);
 }
@@ -569,8 +584,7 @@ gum_duk_script_unload (GumScript * script,
 
   task = gum_script_task_new (gum_duk_script_do_unload, self, cancellable,
       callback, user_data);
-  gum_script_task_run_in_js_thread (task,
-      gum_duk_script_backend_get_scheduler (self->priv->backend));
+  gum_script_task_run_in_js_thread (task, self->priv->scheduler);
   g_object_unref (task);
 }
 
@@ -592,8 +606,7 @@ gum_duk_script_unload_sync (GumScript * script,
 
   task = gum_script_task_new (gum_duk_script_do_unload, self, cancellable, NULL,
       NULL);
-  gum_script_task_run_in_js_thread_sync (task,
-      gum_duk_script_backend_get_scheduler (self->priv->backend));
+  gum_script_task_run_in_js_thread_sync (task, self->priv->scheduler);
   gum_script_task_propagate_pointer (task, NULL);
   g_object_unref (task);
 }
@@ -726,8 +739,7 @@ gum_duk_script_post_message (GumScript * script,
   g_object_ref (self);
   d->message = g_strdup (message);
 
-  gum_script_scheduler_push_job_on_js_thread (
-      gum_duk_script_backend_get_scheduler (self->priv->backend),
+  gum_script_scheduler_push_job_on_js_thread (self->priv->scheduler,
       G_PRIORITY_DEFAULT, (GumScriptJobFunc) gum_duk_script_do_post_message, d,
       (GDestroyNotify) gum_duk_post_message_data_free);
 }
@@ -755,6 +767,14 @@ gum_duk_script_get_stalker (GumScript * script)
   return _gum_duk_stalker_get (&self->priv->stalker);
 }
 
+static guint
+gum_duk_script_get_js_queue_depth (GumScript * script)
+{
+  GumDukScript * self = GUM_DUK_SCRIPT (script);
+
+  return gum_script_scheduler_get_js_queue_depth (self->priv->scheduler);
+}
+
 static void
 gum_duk_script_emit_message (GumDukScript * self,
                              const gchar * message,
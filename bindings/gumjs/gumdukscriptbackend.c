@@ -96,6 +96,9 @@ static void gum_duk_script_backend_set_debug_message_handler (
 static void gum_duk_script_backend_post_debug_message (
     GumScriptBackend * backend, const gchar * message);
 
+static void gum_duk_script_backend_set_dedicated_js_threads (
+    GumScriptBackend * backend, gboolean enabled);
+
 static void gum_duk_script_backend_on_fatal_error (duk_context * ctx,
     duk_errcode_t code, const char * msg);
 
@@ -143,6 +146,9 @@ gum_duk_script_backend_iface_init (gpointer g_iface,
   iface->set_debug_message_handler =
       gum_duk_script_backend_set_debug_message_handler;
   iface->post_debug_message = gum_duk_script_backend_post_debug_message;
+
+  iface->set_dedicated_js_threads =
+      gum_duk_script_backend_set_dedicated_js_threads;
 }
 
 static void
@@ -594,6 +600,15 @@ gum_duk_script_backend_post_debug_message (GumScriptBackend * backend,
   (void) message;
 }
 
+static void
+gum_duk_script_backend_set_dedicated_js_threads (GumScriptBackend * backend,
+                                                 gboolean enabled)
+{
+  gum_script_scheduler_set_dedicated_js_threads (
+      gum_duk_script_backend_get_scheduler (GUM_DUK_SCRIPT_BACKEND (backend)),
+      enabled);
+}
+
 static void
 gum_duk_script_backend_on_fatal_error (duk_context * ctx,
                                        duk_errcode_t code,
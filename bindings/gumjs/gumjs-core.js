@@ -35,12 +35,13 @@
 
     Object.defineProperty(engine, 'send', {
         enumerable: true,
-        value: function (payload, data) {
+        value: function (payload, data, options) {
             const message = {
                 type: 'send',
                 payload: payload
             };
-            engine._send(JSON.stringify(message), data || null);
+            const transfer = (options !== undefined) ? !!options.transfer : false;
+            engine._send(JSON.stringify(message), data || null, transfer);
         }
     });
 
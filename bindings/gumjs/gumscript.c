@@ -95,3 +95,9 @@ gum_script_get_stalker (GumScript * self)
 {
   return GUM_SCRIPT_GET_INTERFACE (self)->get_stalker (self);
 }
+
+guint
+gum_script_get_js_queue_depth (GumScript * self)
+{
+  return GUM_SCRIPT_GET_INTERFACE (self)->get_js_queue_depth (self);
+}
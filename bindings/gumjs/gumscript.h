@@ -46,6 +46,8 @@ struct _GumScriptIface
   void (* post_message) (GumScript * self, const gchar * message);
 
   GumStalker * (* get_stalker) (GumScript * self);
+
+  guint (* get_js_queue_depth) (GumScript * self);
 };
 
 G_BEGIN_DECLS
@@ -70,6 +72,8 @@ GUM_API void gum_script_post_message (GumScript * self, const gchar * message);
 
 GUM_API GumStalker * gum_script_get_stalker (GumScript * self);
 
+GUM_API guint gum_script_get_js_queue_depth (GumScript * self);
+
 G_END_DECLS
 
 #endif
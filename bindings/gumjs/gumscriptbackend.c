@@ -276,6 +276,14 @@ gum_script_backend_post_debug_message (GumScriptBackend * self,
   GUM_SCRIPT_BACKEND_GET_INTERFACE (self)->post_debug_message (self, message);
 }
 
+void
+gum_script_backend_set_dedicated_js_threads (GumScriptBackend * self,
+                                             gboolean enabled)
+{
+  GUM_SCRIPT_BACKEND_GET_INTERFACE (self)->set_dedicated_js_threads (self,
+      enabled);
+}
+
 void
 gum_script_backend_ignore (GumThreadId thread_id)
 {
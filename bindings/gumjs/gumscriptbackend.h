@@ -55,6 +55,9 @@ struct _GumScriptBackendIface
       GDestroyNotify data_destroy);
   void (* post_debug_message) (GumScriptBackend * self, const gchar * message);
 
+  void (* set_dedicated_js_threads) (GumScriptBackend * self,
+      gboolean enabled);
+
   void (* ignore) (GumScriptBackend * self, GumThreadId thread_id);
   void (* unignore) (GumScriptBackend * self, GumThreadId thread_id);
   void (* unignore_later) (GumScriptBackend * self, GumThreadId thread_id);
@@ -100,6 +103,9 @@ GUM_API void gum_script_backend_set_debug_message_handler (
 GUM_API void gum_script_backend_post_debug_message (GumScriptBackend * self,
     const gchar * message);
 
+GUM_API void gum_script_backend_set_dedicated_js_threads (
+    GumScriptBackend * self, gboolean enabled);
+
 GUM_API void gum_script_backend_ignore (GumThreadId thread_id);
 GUM_API void gum_script_backend_unignore (GumThreadId thread_id);
 GUM_API void gum_script_backend_unignore_later (GumThreadId thread_id);
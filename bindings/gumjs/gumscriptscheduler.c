@@ -9,10 +9,12 @@
 struct _GumScriptSchedulerPrivate
 {
   gboolean disposed;
+  gboolean dedicated_js_threads;
 
   GThread * js_thread;
   GMainLoop * js_loop;
   GMainContext * js_context;
+  volatile gint js_queue_depth;
 
   GThreadPool * thread_pool;
 };
@@ -28,6 +30,8 @@ struct _GumScriptJob
 
 static void gum_script_scheduler_dispose (GObject * obj);
 
+static void gum_script_scheduler_attach_js_job (GumScriptScheduler * self,
+    GumScriptJob * job, gint priority, GDestroyNotify job_destroy);
 static gboolean gum_script_scheduler_perform_js_job (
     GumScriptJob * job);
 static void gum_script_scheduler_perform_pool_job (GumScriptJob * job,
@@ -37,6 +41,9 @@ static gpointer gum_script_scheduler_run_js_loop (GumScriptScheduler * self);
 
 G_DEFINE_TYPE (GumScriptScheduler, gum_script_scheduler, G_TYPE_OBJECT);
 
+/* The scheduler whose pool job the current thread is running, if any. */
+static GPrivate gum_script_scheduler_current_pool_owner;
+
 static void
 gum_script_scheduler_class_init (GumScriptSchedulerClass * klass)
 {
@@ -56,8 +63,11 @@ gum_script_scheduler_init (GumScriptScheduler * self)
       GumScriptSchedulerPrivate);
   priv = self->priv;
 
+  priv->dedicated_js_threads = FALSE;
+
   priv->js_context = g_main_context_new ();
   priv->js_loop = g_main_loop_new (priv->js_context, TRUE);
+  priv->js_queue_depth = 0;
 
   priv->js_thread = g_thread_new ("gum-js-loop",
       (GThreadFunc) gum_script_scheduler_run_js_loop, self);
@@ -80,12 +90,33 @@ gum_script_scheduler_dispose (GObject * obj)
   {
     priv->disposed = TRUE;
 
-    g_thread_pool_free (priv->thread_pool, FALSE, TRUE);
+    /*
+     * A job running on our own pool may well be dropping the last reference,
+     * in which case waiting for the pool would mean waiting for ourselves.
+     * Let the pool wind down on its own instead; the jobs do not refer back
+     * to us, and the pool is freed once its last worker is done.
+     */
+    if (g_private_get (&gum_script_scheduler_current_pool_owner) == self)
+      g_thread_pool_free (priv->thread_pool, FALSE, FALSE);
+    else
+      g_thread_pool_free (priv->thread_pool, FALSE, TRUE);
     priv->thread_pool = NULL;
 
-    gum_script_scheduler_push_job_on_js_thread (self, G_PRIORITY_LOW,
-        (GumScriptJobFunc) g_main_loop_quit, priv->js_loop, NULL);
-    g_thread_join (priv->js_thread);
+    if (priv->js_thread != g_thread_self ())
+    {
+      gum_script_scheduler_push_job_on_js_thread (self, G_PRIORITY_LOW,
+          (GumScriptJobFunc) g_main_loop_quit, priv->js_loop, NULL);
+      g_thread_join (priv->js_thread);
+    }
+    else
+    {
+      /*
+       * A script's dedicated scheduler may lose its last reference on its
+       * own JS thread, so let the loop wind down once we return to it.
+       */
+      g_main_loop_quit (priv->js_loop);
+      g_thread_unref (priv->js_thread);
+    }
     priv->js_thread = NULL;
 
     g_main_loop_unref (priv->js_loop);
@@ -104,12 +135,40 @@ gum_script_scheduler_new (void)
   return g_object_new (GUM_TYPE_SCRIPT_SCHEDULER, NULL);
 }
 
+void
+gum_script_scheduler_set_dedicated_js_threads (GumScriptScheduler * self,
+                                               gboolean enabled)
+{
+  self->priv->dedicated_js_threads = enabled;
+}
+
+/*
+ * Returns the scheduler that a newly created script should use for its JS
+ * thread work: either this shared one, or, when dedicated JS threads are
+ * enabled, a fresh scheduler with its own thread, loop and context, so that
+ * one busy script cannot starve the timers and messages of the others.
+ */
+GumScriptScheduler *
+gum_script_scheduler_obtain_for_script (GumScriptScheduler * self)
+{
+  if (self->priv->dedicated_js_threads)
+    return gum_script_scheduler_new ();
+
+  return GUM_SCRIPT_SCHEDULER_CAST (g_object_ref (self));
+}
+
 GMainContext *
 gum_script_scheduler_get_js_context (GumScriptScheduler * self)
 {
   return self->priv->js_context;
 }
 
+guint
+gum_script_scheduler_get_js_queue_depth (GumScriptScheduler * self)
+{
+  return (guint) g_atomic_int_get (&self->priv->js_queue_depth);
+}
+
 void
 gum_script_scheduler_push_job_on_js_thread (GumScriptScheduler * self,
                                             gint priority,
@@ -117,19 +176,9 @@ gum_script_scheduler_push_job_on_js_thread (GumScriptScheduler * self,
                                             gpointer data,
                                             GDestroyNotify data_destroy)
 {
-  GumScriptJob * job;
-  GSource * source;
-
-  job = gum_script_job_new (self, func, data, data_destroy);
-
-  source = g_idle_source_new ();
-  g_source_set_priority (source, priority);
-  g_source_set_callback (source,
-      (GSourceFunc) gum_script_scheduler_perform_js_job,
-      job,
+  gum_script_scheduler_attach_js_job (self,
+      gum_script_job_new (self, func, data, data_destroy), priority,
       (GDestroyNotify) gum_script_job_free);
-  g_source_attach (source, self->priv->js_context);
-  g_source_unref (source);
 }
 
 void
@@ -143,9 +192,31 @@ gum_script_scheduler_push_job_on_thread_pool (GumScriptScheduler * self,
       NULL);
 }
 
+static void
+gum_script_scheduler_attach_js_job (GumScriptScheduler * self,
+                                    GumScriptJob * job,
+                                    gint priority,
+                                    GDestroyNotify job_destroy)
+{
+  GSource * source;
+
+  g_atomic_int_inc (&self->priv->js_queue_depth);
+
+  source = g_idle_source_new ();
+  g_source_set_priority (source, priority);
+  g_source_set_callback (source,
+      (GSourceFunc) gum_script_scheduler_perform_js_job,
+      job,
+      job_destroy);
+  g_source_attach (source, self->priv->js_context);
+  g_source_unref (source);
+}
+
 static gboolean
 gum_script_scheduler_perform_js_job (GumScriptJob * job)
 {
+  g_atomic_int_add (&job->scheduler->priv->js_queue_depth, -1);
+
   job->func (job->data);
 
   return FALSE;
@@ -155,21 +226,27 @@ static void
 gum_script_scheduler_perform_pool_job (GumScriptJob * job,
                                        GumScriptScheduler * self)
 {
-  (void) self;
+  g_private_set (&gum_script_scheduler_current_pool_owner, self);
 
   job->func (job->data);
 
   gum_script_job_free (job);
+
+  g_private_set (&gum_script_scheduler_current_pool_owner, NULL);
 }
 
 static gpointer
 gum_script_scheduler_run_js_loop (GumScriptScheduler * self)
 {
-  GumScriptSchedulerPrivate * priv = self->priv;
+  GMainContext * context = g_main_context_ref (self->priv->js_context);
+  GMainLoop * loop = g_main_loop_ref (self->priv->js_loop);
 
-  g_main_context_push_thread_default (priv->js_context);
-  g_main_loop_run (priv->js_loop);
-  g_main_context_pop_thread_default (priv->js_context);
+  g_main_context_push_thread_default (context);
+  g_main_loop_run (loop);
+  g_main_context_pop_thread_default (context);
+
+  g_main_loop_unref (loop);
+  g_main_context_unref (context);
 
   return NULL;
 }
@@ -204,23 +281,15 @@ gum_script_job_free (GumScriptJob * job)
 void
 gum_script_job_start_on_js_thread (GumScriptJob * job)
 {
-  GMainContext * js_context = job->scheduler->priv->js_context;
+  GumScriptScheduler * scheduler = job->scheduler;
 
-  if (g_main_context_is_owner (js_context))
+  if (g_main_context_is_owner (scheduler->priv->js_context))
   {
     job->func (job->data);
   }
   else
   {
-    GSource * source;
-
-    source = g_idle_source_new ();
-    g_source_set_priority (source, G_PRIORITY_DEFAULT);
-    g_source_set_callback (source,
-        (GSourceFunc) gum_script_scheduler_perform_js_job,
-        job,
+    gum_script_scheduler_attach_js_job (scheduler, job, G_PRIORITY_DEFAULT,
         NULL);
-    g_source_attach (source, js_context);
-    g_source_unref (source);
   }
 }
@@ -48,8 +48,15 @@ G_GNUC_INTERNAL GType gum_script_scheduler_get_type (void) G_GNUC_CONST;
 
 G_GNUC_INTERNAL GumScriptScheduler * gum_script_scheduler_new (void);
 
+G_GNUC_INTERNAL void gum_script_scheduler_set_dedicated_js_threads (
+    GumScriptScheduler * self, gboolean enabled);
+G_GNUC_INTERNAL GumScriptScheduler * gum_script_scheduler_obtain_for_script (
+    GumScriptScheduler * self);
+
 G_GNUC_INTERNAL GMainContext * gum_script_scheduler_get_js_context (
     GumScriptScheduler * self);
+G_GNUC_INTERNAL guint gum_script_scheduler_get_js_queue_depth (
+    GumScriptScheduler * self);
 
 G_GNUC_INTERNAL void gum_script_scheduler_push_job_on_js_thread (
     GumScriptScheduler * self, gint priority, GumScriptJobFunc func,
@@ -162,6 +162,7 @@ static GumV8ScheduledCallback * gum_v8_scheduled_callback_new (guint id,
 static void gum_v8_scheduled_callback_free (GumV8ScheduledCallback * callback);
 static gboolean gum_v8_scheduled_callback_invoke (gpointer user_data);
 static void gum_v8_core_on_send (const FunctionCallbackInfo<Value> & info);
+static GBytes * gum_v8_core_steal_array_buffer (Handle<Value> value);
 static void gum_v8_core_on_set_unhandled_exception_callback (
     const FunctionCallbackInfo<Value> & info);
 static void gum_v8_core_on_set_incoming_message_callback (
@@ -1358,10 +1359,12 @@ gum_v8_scheduled_callback_invoke (gpointer user_data)
 
 /*
  * Prototype:
- * [PRIVATE] _send(message[, array=null])
+ * [PRIVATE] _send(message[, array=null[, transfer=false]])
  *
  * Docs:
- * TBW
+ * When transfer is true and array is an ArrayBuffer, its backing store is
+ * handed over to the message without being copied, and the buffer is
+ * neutered.
  *
  * Example:
  * TBW
@@ -1379,7 +1382,11 @@ gum_v8_core_on_send (const FunctionCallbackInfo<Value> & info)
   GBytes * data = NULL;
   if (!data_value->IsUndefined () && !data_value->IsNull ())
   {
-    data = _gum_v8_byte_array_get (data_value, self);
+    if (info[2]->ToBoolean ()->BooleanValue ())
+      data = gum_v8_core_steal_array_buffer (data_value);
+
+    if (data == NULL)
+      data = _gum_v8_byte_array_get (data_value, self);
     if (data == NULL)
       return;
   }
@@ -1390,14 +1397,37 @@ gum_v8_core_on_send (const FunctionCallbackInfo<Value> & info)
    *
    * This is very important for the RPC API.
    */
-  gum_interceptor_end_transaction (interceptor);
-  gum_interceptor_begin_transaction (interceptor);
+  if (gum_interceptor_has_pending_changes (interceptor))
+  {
+    gum_interceptor_end_transaction (interceptor);
+    gum_interceptor_begin_transaction (interceptor);
+  }
 
   self->message_emitter (self->script, *message, data);
 
   g_bytes_unref (data);
 }
 
+static GBytes *
+gum_v8_core_steal_array_buffer (Handle<Value> value)
+{
+  if (!value->IsArrayBuffer ())
+    return NULL;
+
+  Local<ArrayBuffer> buffer = value.As<ArrayBuffer> ();
+  if (buffer->IsExternal () || !buffer->IsNeuterable ())
+    return NULL;
+
+  /*
+   * The backing store was allocated by GumArrayBufferAllocator, so once
+   * externalized it is ours to release with g_free().
+   */
+  ArrayBuffer::Contents contents = buffer->Externalize ();
+  buffer->Neuter ();
+
+  return g_bytes_new_take (contents.Data (), contents.ByteLength ());
+}
+
 /*
  * Prototype:
  * _setUnhandledExceptionCallback(callback)
@@ -18,12 +18,15 @@
 #endif
 
 #define GUM_MAX_JS_ARRAY_LENGTH (100 * 1024 * 1024)
+#define GUM_MEMORY_SCAN_CHUNK_SIZE (4 * 1024 * 1024)
 
 using namespace v8;
 
 typedef guint GumMemoryValueType;
 typedef struct _GumMemoryScanContext GumMemoryScanContext;
 typedef struct _GumMemoryScanSyncContext GumMemoryScanSyncContext;
+typedef struct _GumMemoryScanRangesContext GumMemoryScanRangesContext;
+typedef struct _GumMemoryScanChunk GumMemoryScanChunk;
 
 enum _GumMemoryValueType
 {
@@ -62,6 +65,27 @@ struct _GumMemoryScanSyncContext
   Local<Array> matches;
 };
 
+struct _GumMemoryScanRangesContext
+{
+  GumV8Core * core;
+  GumMatchPattern * pattern;
+  GArray * chunks;
+  volatile gint pending;
+  GumPersistent<Function>::type * on_match;
+  GumPersistent<Function>::type * on_error;
+  GumPersistent<Function>::type * on_complete;
+};
+
+struct _GumMemoryScanChunk
+{
+  GumMemoryRange range;
+  GumAddress scan_end;
+  gboolean continues_range;
+  GArray * matches;
+  gchar * error_message;
+  GumMemoryScanRangesContext * ctx;
+};
+
 static void gum_v8_memory_on_alloc (
     const FunctionCallbackInfo<Value> & info);
 static void gum_v8_memory_on_alloc_ansi_string (
@@ -83,6 +107,16 @@ static void gum_v8_memory_do_read (
     const FunctionCallbackInfo<Value> & info, GumMemoryValueType type);
 static void gum_v8_memory_do_write (
     const FunctionCallbackInfo<Value> & info, GumMemoryValueType type);
+static void gum_v8_memory_on_read_into (
+    const FunctionCallbackInfo<Value> & info);
+static void gum_v8_memory_on_write_from (
+    const FunctionCallbackInfo<Value> & info);
+static void gum_v8_memory_on_read_pointers (
+    const FunctionCallbackInfo<Value> & info);
+static void gum_v8_memory_on_gather (
+    const FunctionCallbackInfo<Value> & info);
+static gboolean gum_v8_memory_buffer_get (Handle<Value> value,
+    guint8 ** data, gsize * size, GumV8Core * core);
 
 static void gum_v8_memory_on_scan (
     const FunctionCallbackInfo<Value> & info);
@@ -96,6 +130,25 @@ static void gum_v8_memory_on_scan_sync (
 static gboolean gum_v8_process_sync_scan_match (GumAddress address, gsize size,
     gpointer user_data);
 
+static void gum_v8_memory_on_scan_ranges (
+    const FunctionCallbackInfo<Value> & info);
+static gboolean gum_v8_memory_collect_range (const GumRangeDetails * details,
+    gpointer user_data);
+static gint gum_memory_range_compare_base (const GumMemoryRange * a,
+    const GumMemoryRange * b);
+static void gum_memory_scan_ranges_context_add_range (
+    GumMemoryScanRangesContext * ctx, const GumMemoryRange * range);
+static void gum_memory_scan_ranges_context_free (
+    GumMemoryScanRangesContext * ctx);
+static void gum_v8_memory_scan_ranges_finish (gpointer user_data);
+static void gum_v8_memory_scan_chunk (gpointer user_data);
+static void gum_memory_scan_chunk_perform (GumMemoryScanChunk * chunk,
+    GumAddress start, GumExceptor * exceptor);
+static gboolean gum_memory_scan_chunk_collect_match (GumAddress address,
+    gsize size, gpointer user_data);
+static void gum_v8_memory_scan_ranges_deliver (
+    GumMemoryScanRangesContext * ctx);
+
 static void gum_v8_memory_access_monitor_on_enable (
     const FunctionCallbackInfo<Value> & info);
 static void gum_v8_memory_access_monitor_on_disable (
@@ -105,9 +158,9 @@ static void gum_v8_script_handle_memory_access (GumMemoryAccessMonitor * monitor
     const GumMemoryAccessDetails * details, gpointer user_data);
 static gboolean gum_v8_memory_ranges_get (GumV8Memory * self,
     Handle<Value> value, GumMemoryRange ** ranges, guint * num_ranges);
+#endif
 static gboolean gum_v8_memory_range_get (GumV8Memory * self,
     Handle<Value> obj, GumMemoryRange * range);
-#endif
 
 #define GUM_DEFINE_MEMORY_READ(T) \
     static void \
@@ -188,6 +241,15 @@ _gum_v8_memory_init (GumV8Memory * self,
   GUM_EXPORT_MEMORY_READ_WRITE ("Utf16String", UTF16_STRING);
   GUM_EXPORT_MEMORY_READ_WRITE ("AnsiString", ANSI_STRING);
 
+  memory->Set (String::NewFromUtf8 (isolate, "readInto"),
+      FunctionTemplate::New (isolate, gum_v8_memory_on_read_into, data));
+  memory->Set (String::NewFromUtf8 (isolate, "writeFrom"),
+      FunctionTemplate::New (isolate, gum_v8_memory_on_write_from, data));
+  memory->Set (String::NewFromUtf8 (isolate, "readPointers"),
+      FunctionTemplate::New (isolate, gum_v8_memory_on_read_pointers, data));
+  memory->Set (String::NewFromUtf8 (isolate, "gather"),
+      FunctionTemplate::New (isolate, gum_v8_memory_on_gather, data));
+
   memory->Set (String::NewFromUtf8 (isolate, "allocAnsiString"),
       FunctionTemplate::New (isolate, gum_v8_memory_on_alloc_ansi_string,
           data));
@@ -203,6 +265,9 @@ _gum_v8_memory_init (GumV8Memory * self,
   memory->Set (String::NewFromUtf8 (isolate, "scanSync"),
       FunctionTemplate::New (isolate, gum_v8_memory_on_scan_sync,
           data));
+  memory->Set (String::NewFromUtf8 (isolate, "scanRanges"),
+      FunctionTemplate::New (isolate, gum_v8_memory_on_scan_ranges,
+          data));
   scope->Set (String::NewFromUtf8 (isolate, "Memory"), memory);
 
   Handle<ObjectTemplate> monitor = ObjectTemplate::New ();
@@ -940,6 +1005,258 @@ gum_v8_memory_do_write (const FunctionCallbackInfo<Value> & info,
   }
 }
 
+/*
+ * Prototype:
+ * Memory.readInto(address, buffer)
+ *
+ * Docs:
+ * Fills an ArrayBuffer or typed array with buffer.byteLength bytes read from
+ * address, e.g. a Uint32Array with consecutive u32 values.
+ *
+ * Example:
+ * -> var values = new Uint32Array(1024);
+ * -> Memory.readInto(ptr("0x1000"), values);
+ */
+static void
+gum_v8_memory_on_read_into (const FunctionCallbackInfo<Value> & info)
+{
+  GumV8Memory * self = static_cast<GumV8Memory *> (
+      info.Data ().As<External> ()->Value ());
+  GumV8Core * core = self->core;
+  GumExceptor * exceptor = core->exceptor;
+  GumExceptorScope scope;
+
+  gpointer address;
+  if (!_gum_v8_native_pointer_get (info[0], &address, core))
+    return;
+
+  guint8 * data;
+  gsize size;
+  if (!gum_v8_memory_buffer_get (info[1], &data, &size, core))
+    return;
+
+  if (gum_exceptor_try (exceptor, &scope))
+  {
+    memcpy (data, address, size);
+  }
+
+  if (gum_exceptor_catch (exceptor, &scope))
+  {
+    _gum_v8_throw_native (&scope.exception, core);
+  }
+}
+
+/*
+ * Prototype:
+ * Memory.writeFrom(address, buffer)
+ *
+ * Docs:
+ * Writes the contents of an ArrayBuffer or typed array to address
+ *
+ * Example:
+ * -> Memory.writeFrom(ptr("0x1000"), new Uint32Array([1, 2, 3]));
+ */
+static void
+gum_v8_memory_on_write_from (const FunctionCallbackInfo<Value> & info)
+{
+  GumV8Memory * self = static_cast<GumV8Memory *> (
+      info.Data ().As<External> ()->Value ());
+  GumV8Core * core = self->core;
+  GumExceptor * exceptor = core->exceptor;
+  GumExceptorScope scope;
+
+  gpointer address;
+  if (!_gum_v8_native_pointer_get (info[0], &address, core))
+    return;
+
+  guint8 * data;
+  gsize size;
+  if (!gum_v8_memory_buffer_get (info[1], &data, &size, core))
+    return;
+
+  if (gum_exceptor_try (exceptor, &scope))
+  {
+    memcpy (address, data, size);
+  }
+
+  if (gum_exceptor_catch (exceptor, &scope))
+  {
+    _gum_v8_throw_native (&scope.exception, core);
+  }
+}
+
+/*
+ * Prototype:
+ * Memory.readPointers(address, count)
+ *
+ * Docs:
+ * Reads count consecutive pointers starting at address
+ *
+ * Example:
+ * -> Memory.readPointers(ptr("0x1000"), 2)
+ * [ "0x1337", "0x0" ]
+ */
+static void
+gum_v8_memory_on_read_pointers (const FunctionCallbackInfo<Value> & info)
+{
+  GumV8Memory * self = static_cast<GumV8Memory *> (
+      info.Data ().As<External> ()->Value ());
+  GumV8Core * core = self->core;
+  Isolate * isolate = core->isolate;
+  GumExceptor * exceptor = core->exceptor;
+  GumExceptorScope scope;
+
+  gpointer address;
+  if (!_gum_v8_native_pointer_get (info[0], &address, core))
+    return;
+
+  gsize count;
+  if (!_gum_v8_size_get (info[1], &count, core))
+    return;
+  if (count > GUM_MAX_JS_ARRAY_LENGTH)
+  {
+    isolate->ThrowException (Exception::TypeError (String::NewFromUtf8 (isolate,
+        "invalid count")));
+    return;
+  }
+
+  gpointer * pointers = g_new (gpointer, MAX (count, 1));
+
+  if (gum_exceptor_try (exceptor, &scope))
+  {
+    memcpy (pointers, address, count * sizeof (gpointer));
+  }
+
+  if (gum_exceptor_catch (exceptor, &scope))
+  {
+    _gum_v8_throw_native (&scope.exception, core);
+  }
+  else
+  {
+    Local<Array> result (Array::New (isolate, count));
+    for (gsize i = 0; i != count; i++)
+      result->Set (i, _gum_v8_native_pointer_new (pointers[i], core));
+    info.GetReturnValue ().Set (result);
+  }
+
+  g_free (pointers);
+}
+
+/*
+ * Prototype:
+ * Memory.gather(addresses, size)
+ *
+ * Docs:
+ * Reads size bytes from each address in the addresses array, returning the
+ * chunks back to back in a single ArrayBuffer. The whole batch either
+ * succeeds or throws on the first inaccessible address.
+ *
+ * Example:
+ * -> Memory.gather([ptr("0x1000"), ptr("0x2000")], 8)
+ */
+static void
+gum_v8_memory_on_gather (const FunctionCallbackInfo<Value> & info)
+{
+  GumV8Memory * self = static_cast<GumV8Memory *> (
+      info.Data ().As<External> ()->Value ());
+  GumV8Core * core = self->core;
+  Isolate * isolate = core->isolate;
+  GumExceptor * exceptor = core->exceptor;
+  GumExceptorScope scope;
+
+  Local<Value> addresses_value = info[0];
+  if (!addresses_value->IsArray ())
+  {
+    isolate->ThrowException (Exception::TypeError (String::NewFromUtf8 (isolate,
+        "expected an array of addresses")));
+    return;
+  }
+  Local<Array> addresses_array = addresses_value.As<Array> ();
+
+  gsize size;
+  if (!_gum_v8_size_get (info[1], &size, core))
+    return;
+
+  guint count = addresses_array->Length ();
+  if (size == 0 || count == 0)
+  {
+    info.GetReturnValue ().Set (ArrayBuffer::New (isolate, 0));
+    return;
+  }
+  if (count > GUM_MAX_JS_ARRAY_LENGTH ||
+      size > GUM_MAX_JS_ARRAY_LENGTH / count)
+  {
+    isolate->ThrowException (Exception::TypeError (String::NewFromUtf8 (isolate,
+        "invalid size")));
+    return;
+  }
+
+  gpointer * addresses = g_new (gpointer, count);
+  for (guint i = 0; i != count; i++)
+  {
+    if (!_gum_v8_native_pointer_get (addresses_array->Get (i), &addresses[i],
+        core))
+    {
+      g_free (addresses);
+      return;
+    }
+  }
+
+  guint8 * data = static_cast<guint8 *> (g_malloc (count * size));
+
+  if (gum_exceptor_try (exceptor, &scope))
+  {
+    guint8 * cursor = data;
+    for (guint i = 0; i != count; i++)
+    {
+      memcpy (cursor, addresses[i], size);
+      cursor += size;
+    }
+  }
+
+  g_free (addresses);
+
+  if (gum_exceptor_catch (exceptor, &scope))
+  {
+    g_free (data);
+    _gum_v8_throw_native (&scope.exception, core);
+  }
+  else
+  {
+    info.GetReturnValue ().Set (ArrayBuffer::New (isolate, data, count * size,
+        ArrayBufferCreationMode::kInternalized));
+  }
+}
+
+static gboolean
+gum_v8_memory_buffer_get (Handle<Value> value,
+                          guint8 ** data,
+                          gsize * size,
+                          GumV8Core * core)
+{
+  if (value->IsArrayBufferView ())
+  {
+    Local<ArrayBufferView> view = value.As<ArrayBufferView> ();
+    ArrayBuffer::Contents contents = view->Buffer ()->GetContents ();
+
+    *data = static_cast<guint8 *> (contents.Data ()) + view->ByteOffset ();
+    *size = view->ByteLength ();
+    return TRUE;
+  }
+  else if (value->IsArrayBuffer ())
+  {
+    ArrayBuffer::Contents contents = value.As<ArrayBuffer> ()->GetContents ();
+
+    *data = static_cast<guint8 *> (contents.Data ());
+    *size = contents.ByteLength ();
+    return TRUE;
+  }
+
+  core->isolate->ThrowException (Exception::TypeError (String::NewFromUtf8 (
+      core->isolate, "expected an ArrayBuffer or a typed array")));
+  return FALSE;
+}
+
 #ifdef _MSC_VER
 # pragma warning (pop)
 #endif
@@ -1187,6 +1504,362 @@ gum_v8_process_sync_scan_match (GumAddress address,
   return TRUE;
 }
 
+/*
+ * Prototype:
+ * Memory.scanRanges(ranges, match_str, callback)
+ *
+ * Docs:
+ * Scans many memory regions for a specific string, splitting them into
+ * chunks that are scanned in parallel on the thread pool. The ranges argument
+ * is either an array of range objects or a protection string like "rw-" that
+ * selects all matching ranges in the process. Matches are delivered in
+ * address order once all chunks have been scanned.
+ *
+ * Example:
+ * TBW
+ */
+static void
+gum_v8_memory_on_scan_ranges (const FunctionCallbackInfo<Value> & info)
+{
+  GumV8Memory * self = static_cast<GumV8Memory *> (
+      info.Data ().As<External> ()->Value ());
+  GumV8Core * core = self->core;
+  Isolate * isolate = core->isolate;
+
+  GArray * ranges = g_array_new (FALSE, FALSE, sizeof (GumMemoryRange));
+
+  Local<Value> ranges_value = info[0];
+  if (ranges_value->IsString ())
+  {
+    GumPageProtection prot;
+    if (!_gum_v8_page_protection_get (ranges_value, &prot, core))
+    {
+      g_array_free (ranges, TRUE);
+      return;
+    }
+
+    gum_process_enumerate_ranges (prot, gum_v8_memory_collect_range, ranges);
+  }
+  else if (ranges_value->IsArray ())
+  {
+    Local<Array> array = ranges_value.As<Array> ();
+    uint32_t length = array->Length ();
+
+    g_array_set_size (ranges, length);
+    for (uint32_t i = 0; i != length; i++)
+    {
+      if (!gum_v8_memory_range_get (self, array->Get (i),
+          &g_array_index (ranges, GumMemoryRange, i)))
+      {
+        g_array_free (ranges, TRUE);
+        return;
+      }
+    }
+  }
+  else
+  {
+    g_array_free (ranges, TRUE);
+    isolate->ThrowException (Exception::TypeError (String::NewFromUtf8 (isolate,
+        "Memory.scanRanges: first argument must be an array of ranges or a "
+        "protection string")));
+    return;
+  }
+
+  String::Utf8Value match_str (info[1]);
+
+  Local<Value> callbacks_value = info[2];
+  if (!callbacks_value->IsObject ())
+  {
+    g_array_free (ranges, TRUE);
+    isolate->ThrowException (Exception::TypeError (String::NewFromUtf8 (isolate,
+        "Memory.scanRanges: third argument must be a callback object")));
+    return;
+  }
+
+  Local<Object> callbacks = Local<Object>::Cast (callbacks_value);
+  Local<Function> on_match;
+  Local<Function> on_error;
+  Local<Function> on_complete;
+  if (!_gum_v8_callbacks_get (callbacks, "onMatch", &on_match, core) ||
+      !_gum_v8_callbacks_get_opt (callbacks, "onError", &on_error, core) ||
+      !_gum_v8_callbacks_get (callbacks, "onComplete", &on_complete, core))
+  {
+    g_array_free (ranges, TRUE);
+    return;
+  }
+
+  GumMatchPattern * pattern = gum_match_pattern_new_from_string (*match_str);
+  if (pattern == NULL)
+  {
+    g_array_free (ranges, TRUE);
+    isolate->ThrowException (Exception::Error (String::NewFromUtf8 (isolate,
+        "invalid match pattern")));
+    return;
+  }
+
+  GumMemoryScanRangesContext * ctx = g_slice_new0 (GumMemoryScanRangesContext);
+  ctx->core = core;
+  ctx->pattern = pattern;
+  ctx->chunks = g_array_new (FALSE, FALSE, sizeof (GumMemoryScanChunk));
+  ctx->on_match = new GumPersistent<Function>::type (isolate, on_match);
+  if (!on_error.IsEmpty ())
+    ctx->on_error = new GumPersistent<Function>::type (isolate, on_error);
+  ctx->on_complete = new GumPersistent<Function>::type (isolate, on_complete);
+
+  g_array_sort (ranges, (GCompareFunc) gum_memory_range_compare_base);
+  for (guint i = 0; i != ranges->len; i++)
+  {
+    gum_memory_scan_ranges_context_add_range (ctx,
+        &g_array_index (ranges, GumMemoryRange, i));
+  }
+  g_array_free (ranges, TRUE);
+
+  _gum_v8_core_pin (core);
+
+  guint num_chunks = ctx->chunks->len;
+  if (num_chunks == 0)
+  {
+    _gum_v8_core_push_job (core, gum_v8_memory_scan_ranges_finish, ctx,
+        reinterpret_cast<GDestroyNotify> (
+            gum_memory_scan_ranges_context_free));
+    return;
+  }
+
+  ctx->pending = num_chunks;
+  for (guint i = 0; i != num_chunks; i++)
+  {
+    _gum_v8_core_push_job (core, gum_v8_memory_scan_chunk,
+        &g_array_index (ctx->chunks, GumMemoryScanChunk, i), NULL);
+  }
+}
+
+static gboolean
+gum_v8_memory_collect_range (const GumRangeDetails * details,
+                             gpointer user_data)
+{
+  GArray * ranges = static_cast<GArray *> (user_data);
+
+  g_array_append_val (ranges, *details->range);
+
+  return TRUE;
+}
+
+static gint
+gum_memory_range_compare_base (const GumMemoryRange * a,
+                               const GumMemoryRange * b)
+{
+  if (a->base_address < b->base_address)
+    return -1;
+  else if (a->base_address > b->base_address)
+    return 1;
+  else
+    return 0;
+}
+
+static void
+gum_memory_scan_ranges_context_add_range (GumMemoryScanRangesContext * ctx,
+                                          const GumMemoryRange * range)
+{
+  guint pattern_size = gum_match_pattern_get_size (ctx->pattern);
+  GumAddress start = range->base_address;
+  GumAddress end = start + range->size;
+
+  for (GumAddress cur = start; cur < end; cur += GUM_MEMORY_SCAN_CHUNK_SIZE)
+  {
+    GumMemoryScanChunk chunk;
+
+    chunk.range.base_address = cur;
+    chunk.range.size = MIN (GUM_MEMORY_SCAN_CHUNK_SIZE, end - cur);
+    /*
+     * Let the chunk scan overlap into its successor so that matches starting
+     * near the end of the chunk are found, but never past the end of the
+     * range as that memory might not be mapped.
+     */
+    chunk.scan_end = MIN (cur + chunk.range.size + pattern_size - 1, end);
+    chunk.continues_range = cur != start;
+    chunk.matches = g_array_new (FALSE, FALSE, sizeof (GumAddress));
+    chunk.error_message = NULL;
+    chunk.ctx = ctx;
+
+    g_array_append_val (ctx->chunks, chunk);
+  }
+}
+
+static void
+gum_memory_scan_ranges_context_free (GumMemoryScanRangesContext * ctx)
+{
+  GumV8Core * core = ctx->core;
+
+  for (guint i = 0; i != ctx->chunks->len; i++)
+  {
+    GumMemoryScanChunk * chunk =
+        &g_array_index (ctx->chunks, GumMemoryScanChunk, i);
+
+    g_array_free (chunk->matches, TRUE);
+    g_free (chunk->error_message);
+  }
+  g_array_free (ctx->chunks, TRUE);
+
+  gum_match_pattern_free (ctx->pattern);
+
+  {
+    ScriptScope script_scope (core->script);
+
+    delete ctx->on_match;
+    delete ctx->on_error;
+    delete ctx->on_complete;
+
+    _gum_v8_core_unpin (core);
+  }
+
+  g_slice_free (GumMemoryScanRangesContext, ctx);
+}
+
+static void
+gum_v8_memory_scan_ranges_finish (gpointer user_data)
+{
+  gum_v8_memory_scan_ranges_deliver (
+      static_cast<GumMemoryScanRangesContext *> (user_data));
+}
+
+static void
+gum_v8_memory_scan_chunk (gpointer user_data)
+{
+  GumMemoryScanChunk * chunk = static_cast<GumMemoryScanChunk *> (user_data);
+  GumMemoryScanRangesContext * ctx = chunk->ctx;
+
+  gum_memory_scan_chunk_perform (chunk, chunk->range.base_address,
+      ctx->core->exceptor);
+
+  if (g_atomic_int_dec_and_test (&ctx->pending))
+  {
+    gum_v8_memory_scan_ranges_deliver (ctx);
+    gum_memory_scan_ranges_context_free (ctx);
+  }
+}
+
+static void
+gum_memory_scan_chunk_perform (GumMemoryScanChunk * chunk,
+                               GumAddress start,
+                               GumExceptor * exceptor)
+{
+  GumExceptorScope scope;
+
+  g_array_set_size (chunk->matches, 0);
+  g_clear_pointer (&chunk->error_message, g_free);
+
+  if (start >= chunk->scan_end)
+    return;
+
+  GumMemoryRange range;
+  range.base_address = start;
+  range.size = chunk->scan_end - start;
+
+  if (gum_exceptor_try (exceptor, &scope))
+  {
+    gum_memory_scan (&range, chunk->ctx->pattern,
+        gum_memory_scan_chunk_collect_match, chunk->matches);
+  }
+
+  if (gum_exceptor_catch (exceptor, &scope))
+  {
+    chunk->error_message = gum_exception_details_to_string (&scope.exception);
+  }
+}
+
+static gboolean
+gum_memory_scan_chunk_collect_match (GumAddress address,
+                                     gsize size,
+                                     gpointer user_data)
+{
+  GArray * matches = static_cast<GArray *> (user_data);
+
+  (void) size;
+
+  g_array_append_val (matches, address);
+
+  return TRUE;
+}
+
+static void
+gum_v8_memory_scan_ranges_deliver (GumMemoryScanRangesContext * ctx)
+{
+  GumV8Core * core = ctx->core;
+  guint pattern_size = gum_match_pattern_get_size (ctx->pattern);
+
+  /*
+   * A sequential scan skips past each match, so a match straddling a chunk
+   * boundary hides any overlapping candidates at the start of the next chunk.
+   * Such chunks are rare, and are simply rescanned from where the straddling
+   * match ends.
+   */
+  GumAddress previous_end = 0;
+  for (guint i = 0; i != ctx->chunks->len; i++)
+  {
+    GumMemoryScanChunk * chunk =
+        &g_array_index (ctx->chunks, GumMemoryScanChunk, i);
+
+    if (!chunk->continues_range)
+      previous_end = 0;
+
+    if (chunk->error_message == NULL &&
+        previous_end > chunk->range.base_address)
+    {
+      gum_memory_scan_chunk_perform (chunk, previous_end, core->exceptor);
+    }
+
+    if (chunk->matches->len != 0)
+    {
+      previous_end = g_array_index (chunk->matches, GumAddress,
+          chunk->matches->len - 1) + pattern_size;
+    }
+  }
+
+  ScriptScope script_scope (core->script);
+  Isolate * isolate = core->isolate;
+
+  Local<Value> receiver (Undefined (isolate));
+  Local<Function> on_match (Local<Function>::New (isolate, *ctx->on_match));
+
+  gboolean proceed = TRUE;
+  for (guint i = 0; i != ctx->chunks->len && proceed; i++)
+  {
+    GumMemoryScanChunk * chunk =
+        &g_array_index (ctx->chunks, GumMemoryScanChunk, i);
+
+    for (guint j = 0; j != chunk->matches->len && proceed; j++)
+    {
+      GumAddress address = g_array_index (chunk->matches, GumAddress, j);
+
+      Handle<Value> argv[] = {
+        _gum_v8_native_pointer_new (GSIZE_TO_POINTER (address), core),
+        Integer::NewFromUnsigned (isolate, pattern_size)
+      };
+      Local<Value> result = on_match->Call (receiver, 2, argv);
+
+      if (!result.IsEmpty () && result->IsString ())
+      {
+        String::Utf8Value str (result);
+        proceed = (strcmp (*str, "stop") != 0);
+      }
+    }
+
+    if (proceed && chunk->error_message != NULL && ctx->on_error != NULL)
+    {
+      Local<Function> on_error (Local<Function>::New (isolate,
+          *ctx->on_error));
+      Handle<Value> argv[] = {
+        String::NewFromUtf8 (isolate, chunk->error_message)
+      };
+      on_error->Call (receiver, 1, argv);
+    }
+  }
+
+  Local<Function> on_complete (Local<Function>::New (isolate,
+      *ctx->on_complete));
+  on_complete->Call (receiver, 0, 0);
+}
+
 #ifdef _MSC_VER
 # pragma warning (pop)
 #endif
@@ -1398,6 +2071,8 @@ gum_v8_memory_ranges_get (GumV8Memory * self,
   }
 }
 
+#endif
+
 static gboolean
 gum_v8_memory_range_get (GumV8Memory * self,
                          Handle<Value> value,
@@ -1437,5 +2112,3 @@ gum_v8_memory_range_get (GumV8Memory * self,
   return TRUE;
 }
 
-#endif
-
@@ -34,8 +34,10 @@ struct _GumV8ScriptPrivate
 {
   gchar * name;
   gchar * source;
+  GBytes * code_cache;
   GMainContext * main_context;
   GumV8ScriptBackend * backend;
+  GumScriptScheduler * scheduler;
 
   GumScriptState state;
   GSList * on_unload;
@@ -60,6 +62,10 @@ struct _GumV8ScriptPrivate
   GumScriptMessageHandler message_handler;
   gpointer message_handler_data;
   GDestroyNotify message_handler_data_destroy;
+
+  GMutex pending_messages_mutex;
+  GQueue pending_messages;
+  GSource * pending_messages_source;
 };
 
 G_END_DECLS
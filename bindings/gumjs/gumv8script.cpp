@@ -22,6 +22,7 @@ enum
   PROP_0,
   PROP_NAME,
   PROP_SOURCE,
+  PROP_CODE_CACHE,
   PROP_MAIN_CONTEXT,
   PROP_BACKEND
 };
@@ -42,7 +43,6 @@ struct _GumUnloadNotifyCallback
 
 struct _GumEmitMessageData
 {
-  GumV8Script * script;
   gchar * message;
   GBytes * data;
 };
@@ -98,10 +98,11 @@ static void gum_v8_script_do_post_message (GumPostMessageData * d);
 static void gum_v8_post_message_data_free (GumPostMessageData * d);
 
 static GumStalker * gum_v8_script_get_stalker (GumScript * script);
+static guint gum_v8_script_get_js_queue_depth (GumScript * script);
 
 static void gum_v8_script_emit_message (GumV8Script * self,
     const gchar * message, GBytes * data);
-static gboolean gum_v8_script_do_emit_message (GumEmitMessageData * d);
+static gboolean gum_v8_script_do_emit_messages (GumV8Script * self);
 static void gum_v8_emit_message_data_free (GumEmitMessageData * d);
 
 G_DEFINE_TYPE_EXTENDED (GumV8Script,
@@ -132,6 +133,11 @@ gum_v8_script_class_init (GumV8ScriptClass * klass)
       g_param_spec_string ("source", "Source", "Source code", NULL,
       (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
       G_PARAM_STATIC_STRINGS)));
+  g_object_class_install_property (object_class, PROP_CODE_CACHE,
+      g_param_spec_boxed ("code-cache", "CodeCache", "V8 code cache",
+      G_TYPE_BYTES,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
+      G_PARAM_STATIC_STRINGS)));
   g_object_class_install_property (object_class, PROP_MAIN_CONTEXT,
       g_param_spec_boxed ("main-context", "MainContext",
       "MainContext being used", G_TYPE_MAIN_CONTEXT,
@@ -163,6 +169,7 @@ gum_v8_script_iface_init (gpointer g_iface,
   iface->post_message = gum_v8_script_post_message;
 
   iface->get_stalker = gum_v8_script_get_stalker;
+  iface->get_js_queue_depth = gum_v8_script_get_js_queue_depth;
 }
 
 static void
@@ -175,6 +182,10 @@ gum_v8_script_init (GumV8Script * self)
 
   priv->state = GUM_SCRIPT_STATE_UNLOADED;
   priv->on_unload = NULL;
+
+  g_mutex_init (&priv->pending_messages_mutex);
+  g_queue_init (&priv->pending_messages);
+  priv->pending_messages_source = NULL;
 }
 
 static void
@@ -187,6 +198,8 @@ gum_v8_script_constructed (GObject * object)
 
   priv->isolate = static_cast<Isolate *> (
       gum_v8_script_backend_get_isolate (priv->backend));
+  priv->scheduler = gum_script_scheduler_obtain_for_script (
+      gum_v8_script_backend_get_scheduler (priv->backend));
 }
 
 static void
@@ -207,6 +220,7 @@ gum_v8_script_dispose (GObject * object)
   {
     priv->isolate = NULL;
 
+    g_clear_pointer (&priv->scheduler, g_object_unref);
     g_clear_pointer (&priv->main_context, g_main_context_unref);
     g_clear_pointer (&priv->backend, g_object_unref);
   }
@@ -220,8 +234,16 @@ gum_v8_script_finalize (GObject * object)
   GumV8Script * self = GUM_V8_SCRIPT (object);
   GumV8ScriptPrivate * priv = self->priv;
 
+  /* The idle source may have been destroyed without ever running. */
+  g_queue_foreach (&priv->pending_messages,
+      (GFunc) gum_v8_emit_message_data_free, NULL);
+  g_queue_clear (&priv->pending_messages);
+  g_mutex_clear (&priv->pending_messages_mutex);
+
   g_free (priv->name);
   g_free (priv->source);
+  if (priv->code_cache != NULL)
+    g_bytes_unref (priv->code_cache);
 
   G_OBJECT_CLASS (gum_v8_script_parent_class)->finalize (object);
 }
@@ -243,6 +265,9 @@ gum_v8_script_get_property (GObject * object,
     case PROP_SOURCE:
       g_value_set_string (value, priv->source);
       break;
+    case PROP_CODE_CACHE:
+      g_value_set_boxed (value, priv->code_cache);
+      break;
     case PROP_MAIN_CONTEXT:
       g_value_set_boxed (value, priv->main_context);
       break;
@@ -273,6 +298,11 @@ gum_v8_script_set_property (GObject * object,
       g_free (priv->source);
       priv->source = g_value_dup_string (value);
       break;
+    case PROP_CODE_CACHE:
+      if (priv->code_cache != NULL)
+        g_bytes_unref (priv->code_cache);
+      priv->code_cache = (GBytes *) g_value_dup_boxed (value);
+      break;
     case PROP_MAIN_CONTEXT:
       if (priv->main_context != NULL)
         g_main_context_unref (priv->main_context);
@@ -303,7 +333,7 @@ gum_v8_script_create_context (GumV8Script * self,
 
     Handle<ObjectTemplate> global_templ = ObjectTemplate::New ();
     _gum_v8_core_init (&priv->core, self, gum_v8_script_emit_message,
-        gum_v8_script_backend_get_scheduler (priv->backend), priv->isolate,
+        priv->scheduler, priv->isolate,
         global_templ);
     _gum_v8_kernel_init (&priv->kernel, &priv->core, global_templ);
     _gum_v8_memory_init (&priv->memory, &priv->core, global_templ);
@@ -349,9 +379,24 @@ gum_v8_script_create_context (GumV8Script * self,
     Local<String> source (String::NewFromUtf8 (priv->isolate,
         priv->source));
 
+    ScriptCompiler::CachedData * cached_data = NULL;
+    ScriptCompiler::CompileOptions options = ScriptCompiler::kNoCompileOptions;
+    if (priv->code_cache != NULL)
+    {
+      gsize size;
+      gconstpointer data = g_bytes_get_data (priv->code_cache, &size);
+
+      /* A rejected cache is not an error, V8 just compiles from source. */
+      cached_data = new ScriptCompiler::CachedData (
+          static_cast<const uint8_t *> (data), (int) size,
+          ScriptCompiler::CachedData::BufferNotOwned);
+      options = ScriptCompiler::kConsumeCodeCache;
+    }
+    ScriptCompiler::Source source_value (source, origin, cached_data);
+
     TryCatch trycatch;
     MaybeLocal<Script> maybe_code =
-        Script::Compile (context, source, &origin);
+        ScriptCompiler::Compile (context, &source_value, options);
     Local<Script> code;
     if (maybe_code.ToLocal (&code))
     {
@@ -435,8 +480,7 @@ gum_v8_script_load (GumScript * script,
 
   task = gum_script_task_new (gum_v8_script_do_load, self, cancellable,
       callback, user_data);
-  gum_script_task_run_in_js_thread (task,
-      gum_v8_script_backend_get_scheduler (self->priv->backend));
+  gum_script_task_run_in_js_thread (task, self->priv->scheduler);
   g_object_unref (task);
 }
 
@@ -458,8 +502,7 @@ gum_v8_script_load_sync (GumScript * script,
 
   task = gum_script_task_new (gum_v8_script_do_load, self, cancellable, NULL,
       NULL);
-  gum_script_task_run_in_js_thread_sync (task,
-      gum_v8_script_backend_get_scheduler (self->priv->backend));
+  gum_script_task_run_in_js_thread_sync (task, self->priv->scheduler);
   gum_script_task_propagate_pointer (task, NULL);
   g_object_unref (task);
 }
@@ -532,8 +575,7 @@ gum_v8_script_unload (GumScript * script,
 
   task = gum_script_task_new (gum_v8_script_do_unload, self, cancellable, callback,
       user_data);
-  gum_script_task_run_in_js_thread (task,
-      gum_v8_script_backend_get_scheduler (self->priv->backend));
+  gum_script_task_run_in_js_thread (task, self->priv->scheduler);
   g_object_unref (task);
 }
 
@@ -555,8 +597,7 @@ gum_v8_script_unload_sync (GumScript * script,
 
   task = gum_script_task_new (gum_v8_script_do_unload, self, cancellable, NULL,
       NULL);
-  gum_script_task_run_in_js_thread_sync (task,
-      gum_v8_script_backend_get_scheduler (self->priv->backend));
+  gum_script_task_run_in_js_thread_sync (task, self->priv->scheduler);
   gum_script_task_propagate_pointer (task, NULL);
   g_object_unref (task);
 }
@@ -683,8 +724,7 @@ gum_v8_script_post_message (GumScript * script,
   g_object_ref (self);
   d->message = g_strdup (message);
 
-  gum_script_scheduler_push_job_on_js_thread (
-      gum_v8_script_backend_get_scheduler (self->priv->backend),
+  gum_script_scheduler_push_job_on_js_thread (self->priv->scheduler,
       G_PRIORITY_DEFAULT, (GumScriptJobFunc) gum_v8_script_do_post_message, d,
       (GDestroyNotify) gum_v8_post_message_data_free);
 }
@@ -712,36 +752,68 @@ gum_v8_script_get_stalker (GumScript * script)
   return _gum_v8_stalker_get (&self->priv->stalker);
 }
 
+static guint
+gum_v8_script_get_js_queue_depth (GumScript * script)
+{
+  GumV8Script * self = GUM_V8_SCRIPT (script);
+
+  return gum_script_scheduler_get_js_queue_depth (self->priv->scheduler);
+}
+
 static void
 gum_v8_script_emit_message (GumV8Script * self,
                             const gchar * message,
                             GBytes * data)
 {
+  GumV8ScriptPrivate * priv = self->priv;
+
   GumEmitMessageData * d = g_slice_new (GumEmitMessageData);
-  d->script = self;
-  g_object_ref (self);
   d->message = g_strdup (message);
   d->data = (data != NULL) ? g_bytes_ref (data) : NULL;
 
-  GSource * source = g_idle_source_new ();
-  g_source_set_callback (source,
-      (GSourceFunc) gum_v8_script_do_emit_message,
-      d,
-      (GDestroyNotify) gum_v8_emit_message_data_free);
-  g_source_attach (source, self->priv->main_context);
-  g_source_unref (source);
+  /*
+   * Messages emitted in a burst are coalesced so that they're delivered by a
+   * single idle source instead of one GSource per message.
+   */
+  g_mutex_lock (&priv->pending_messages_mutex);
+  g_queue_push_tail (&priv->pending_messages, d);
+  if (priv->pending_messages_source == NULL)
+  {
+    GSource * source = g_idle_source_new ();
+    g_source_set_callback (source,
+        (GSourceFunc) gum_v8_script_do_emit_messages,
+        g_object_ref (self),
+        g_object_unref);
+    g_source_attach (source, priv->main_context);
+    g_source_unref (source);
+
+    priv->pending_messages_source = source;
+  }
+  g_mutex_unlock (&priv->pending_messages_mutex);
 }
 
 static gboolean
-gum_v8_script_do_emit_message (GumEmitMessageData * d)
+gum_v8_script_do_emit_messages (GumV8Script * self)
 {
-  GumV8Script * self = d->script;
   GumV8ScriptPrivate * priv = self->priv;
+  GQueue messages;
+  GumEmitMessageData * d;
+
+  g_mutex_lock (&priv->pending_messages_mutex);
+  messages = priv->pending_messages;
+  g_queue_init (&priv->pending_messages);
+  priv->pending_messages_source = NULL;
+  g_mutex_unlock (&priv->pending_messages_mutex);
 
-  if (priv->message_handler != NULL)
+  while ((d = (GumEmitMessageData *) g_queue_pop_head (&messages)) != NULL)
   {
-    priv->message_handler (GUM_SCRIPT (self), d->message, d->data,
-        priv->message_handler_data);
+    if (priv->message_handler != NULL)
+    {
+      priv->message_handler (GUM_SCRIPT (self), d->message, d->data,
+          priv->message_handler_data);
+    }
+
+    gum_v8_emit_message_data_free (d);
   }
 
   return FALSE;
@@ -752,7 +824,6 @@ gum_v8_emit_message_data_free (GumEmitMessageData * d)
 {
   g_bytes_unref (d->data);
   g_free (d->message);
-  g_object_unref (d->script);
 
   g_slice_free (GumEmitMessageData, d);
 }
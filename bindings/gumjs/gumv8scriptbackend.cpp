@@ -33,11 +33,14 @@
     "--harmony-destructuring " \
     "--expose-gc"
 
+#define GUM_V8_COMPILED_SCRIPT_MAGIC 0x38764d47
+
 using namespace v8;
 
 typedef struct _GumCreateScriptData GumCreateScriptData;
 typedef struct _GumCreateScriptFromBytesData GumCreateScriptFromBytesData;
 typedef struct _GumCompileScriptData GumCompileScriptData;
+typedef struct _GumV8CompiledScriptHeader GumV8CompiledScriptHeader;
 typedef struct _GumEmitDebugMessageData GumEmitDebugMessageData;
 
 template <typename T>
@@ -76,6 +79,18 @@ struct _GumCompileScriptData
   gchar * source;
 };
 
+/*
+ * Compiled scripts are laid out as this header followed by the source code,
+ * and then the V8 code cache for it. The source has to be kept as V8 checks
+ * the cache against it, and falls back to compiling it when the cache was
+ * produced by a different V8 version or with different flags.
+ */
+struct _GumV8CompiledScriptHeader
+{
+  guint32 magic;
+  guint32 source_size;
+};
+
 struct _GumEmitDebugMessageData
 {
   GumV8ScriptBackend * backend;
@@ -132,6 +147,10 @@ static GumScriptTask * gum_compile_script_task_new (
 static void gum_compile_script_task_run (GumScriptTask * task,
     gpointer source_object, gpointer task_data, GCancellable * cancellable);
 static void gum_compile_script_data_free (GumCompileScriptData * d);
+static GBytes * gum_v8_compiled_script_new (const gchar * source,
+    const ScriptCompiler::CachedData * code_cache);
+static gboolean gum_v8_compiled_script_parse (GBytes * bytes,
+    gchar ** source, GBytes ** code_cache);
 
 static void gum_v8_script_backend_set_debug_message_handler (
     GumScriptBackend * backend, GumScriptDebugMessageHandler handler,
@@ -145,6 +164,9 @@ static gboolean gum_v8_script_backend_do_emit_debug_message (
 static void gum_emit_debug_message_data_free (GumEmitDebugMessageData * d);
 static void gum_v8_script_backend_post_debug_message (
     GumScriptBackend * backend, const gchar * message);
+
+static void gum_v8_script_backend_set_dedicated_js_threads (
+    GumScriptBackend * backend, gboolean enabled);
 static void gum_v8_script_backend_do_process_debug_messages (
     GumV8ScriptBackend * self);
 
@@ -189,6 +211,9 @@ gum_v8_script_backend_iface_init (gpointer g_iface,
   iface->set_debug_message_handler =
       gum_v8_script_backend_set_debug_message_handler;
   iface->post_debug_message = gum_v8_script_backend_post_debug_message;
+
+  iface->set_dedicated_js_threads =
+      gum_v8_script_backend_set_dedicated_js_threads;
 }
 
 static void
@@ -461,14 +486,49 @@ gum_create_script_from_bytes_task_run (GumScriptTask * task,
   GumV8ScriptBackend * self = GUM_V8_SCRIPT_BACKEND (source_object);
   Isolate * isolate = GUM_V8_SCRIPT_BACKEND_GET_ISOLATE (self);
   GumCreateScriptFromBytesData * d = (GumCreateScriptFromBytesData *) task_data;
+  gchar * source;
+  GBytes * code_cache;
+  GumV8Script * script;
+  GError * error = NULL;
 
-  (void) isolate;
-  (void) d;
   (void) cancellable;
 
-  GError * error = g_error_new (G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
-      "Not yet supported by the V8 runtime");
-  gum_script_task_return_error (task, error);
+  if (!gum_v8_compiled_script_parse (d->bytes, &source, &code_cache))
+  {
+    gum_script_task_return_error (task, g_error_new (G_IO_ERROR,
+        G_IO_ERROR_INVALID_DATA, "Invalid compiled script"));
+    return;
+  }
+
+  script = GUM_V8_SCRIPT (g_object_new (GUM_V8_TYPE_SCRIPT,
+      "name", d->name,
+      "source", source,
+      "code-cache", code_cache,
+      "main-context", gum_script_task_get_context (task),
+      "backend", self,
+      NULL));
+
+  g_free (source);
+  if (code_cache != NULL)
+    g_bytes_unref (code_cache);
+
+  {
+    Locker locker (isolate);
+    Isolate::Scope isolate_scope (isolate);
+    HandleScope handle_scope (isolate);
+
+    gum_v8_script_create_context (script, &error);
+  }
+
+  if (error == NULL)
+  {
+    gum_script_task_return_pointer (task, script, g_object_unref);
+  }
+  else
+  {
+    gum_script_task_return_error (task, error);
+    g_object_unref (script);
+  }
 }
 
 static void
@@ -553,14 +613,51 @@ gum_compile_script_task_run (GumScriptTask * task,
   GumV8ScriptBackend * self = GUM_V8_SCRIPT_BACKEND (source_object);
   Isolate * isolate = GUM_V8_SCRIPT_BACKEND_GET_ISOLATE (self);
   GumCompileScriptData * d = (GumCompileScriptData *) task_data;
+  GBytes * bytes = NULL;
+  GError * error = NULL;
 
-  (void) isolate;
-  (void) d;
   (void) cancellable;
 
-  GError * error = g_error_new (G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
-      "Not yet supported by the V8 runtime");
-  gum_script_task_return_error (task, error);
+  {
+    Locker locker (isolate);
+    Isolate::Scope isolate_scope (isolate);
+    HandleScope handle_scope (isolate);
+    Local<Context> context (Context::New (isolate));
+    Context::Scope context_scope (context);
+
+    Local<String> resource_name (String::NewFromUtf8 (isolate, "agent.js"));
+    ScriptOrigin origin (resource_name);
+    Local<String> source (String::NewFromUtf8 (isolate, d->source));
+    ScriptCompiler::Source source_value (source, origin);
+
+    TryCatch trycatch;
+    MaybeLocal<UnboundScript> maybe_code =
+        ScriptCompiler::CompileUnboundScript (isolate, &source_value,
+        ScriptCompiler::kProduceCodeCache);
+    if (!maybe_code.IsEmpty ())
+    {
+      bytes = gum_v8_compiled_script_new (d->source,
+          source_value.GetCachedData ());
+    }
+    else
+    {
+      Handle<Message> message = trycatch.Message ();
+      Handle<Value> exception = trycatch.Exception ();
+      String::Utf8Value exception_str (exception);
+      g_set_error (&error, G_IO_ERROR, G_IO_ERROR_FAILED,
+          "Script(line %d): %s", message->GetLineNumber (), *exception_str);
+    }
+  }
+
+  if (error == NULL)
+  {
+    gum_script_task_return_pointer (task, bytes,
+        (GDestroyNotify) g_bytes_unref);
+  }
+  else
+  {
+    gum_script_task_return_error (task, error);
+  }
 }
 
 static void
@@ -571,6 +668,55 @@ gum_compile_script_data_free (GumCompileScriptData * d)
   g_slice_free (GumCompileScriptData, d);
 }
 
+static GBytes *
+gum_v8_compiled_script_new (const gchar * source,
+                            const ScriptCompiler::CachedData * code_cache)
+{
+  GumV8CompiledScriptHeader header;
+  GByteArray * result;
+
+  header.magic = GUM_V8_COMPILED_SCRIPT_MAGIC;
+  header.source_size = (guint32) strlen (source);
+
+  result = g_byte_array_sized_new (sizeof (header) + header.source_size +
+      ((code_cache != NULL) ? code_cache->length : 0));
+  g_byte_array_append (result, (const guint8 *) &header, sizeof (header));
+  g_byte_array_append (result, (const guint8 *) source, header.source_size);
+  if (code_cache != NULL)
+    g_byte_array_append (result, code_cache->data, code_cache->length);
+
+  return g_byte_array_free_to_bytes (result);
+}
+
+static gboolean
+gum_v8_compiled_script_parse (GBytes * bytes,
+                              gchar ** source,
+                              GBytes ** code_cache)
+{
+  gsize size, offset;
+  const guint8 * data;
+  GumV8CompiledScriptHeader header;
+
+  data = (const guint8 *) g_bytes_get_data (bytes, &size);
+  if (size < sizeof (header))
+    return FALSE;
+
+  memcpy (&header, data, sizeof (header));
+  if (header.magic != GUM_V8_COMPILED_SCRIPT_MAGIC ||
+      header.source_size > size - sizeof (header))
+    return FALSE;
+
+  offset = sizeof (header);
+  *source = g_strndup ((const gchar *) data + offset, header.source_size);
+
+  offset += header.source_size;
+  *code_cache = (offset != size)
+      ? g_bytes_new_from_bytes (bytes, offset, size - offset)
+      : NULL;
+
+  return TRUE;
+}
+
 static void
 gum_v8_script_backend_set_debug_message_handler (
     GumScriptBackend * backend,
@@ -742,3 +888,12 @@ gum_v8_script_backend_do_process_debug_messages (GumV8ScriptBackend * self)
 
   Debug::ProcessDebugMessages ();
 }
+
+static void
+gum_v8_script_backend_set_dedicated_js_threads (GumScriptBackend * backend,
+                                                gboolean enabled)
+{
+  gum_script_scheduler_set_dedicated_js_threads (
+      gum_v8_script_backend_get_scheduler (GUM_V8_SCRIPT_BACKEND (backend)),
+      enabled);
+}
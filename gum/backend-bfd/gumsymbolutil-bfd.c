@@ -21,6 +21,7 @@
 #endif
 
 typedef struct _GumSymbolCollection GumSymbolCollection;
+typedef struct _GumBfdModule GumBfdModule;
 
 struct _GumSymbolCollection
 {
@@ -30,6 +31,13 @@ struct _GumSymbolCollection
   guint num_dynamic_symbols;
 };
 
+struct _GumBfdModule
+{
+  bfd * abfd;
+  GumSymbolCollection sc;
+  gpointer base_address;
+};
+
 static gpointer do_init (gpointer data);
 static void do_deinit (void);
 
@@ -46,8 +54,26 @@ static bfd * gum_open_bfd_and_load_symbols (const gchar * path,
 static void gum_close_bfd_and_release_symbols (bfd * abfd,
     GumSymbolCollection * sc);
 
+static GumBfdModule * gum_bfd_module_obtain (const gchar * path,
+    gpointer base_address, gboolean * opened);
+static void gum_bfd_module_free (GumBfdModule * module);
+static void gum_bfd_module_resolve (GumBfdModule * module, gpointer address,
+    const Dl_info * dl_info, GumSymbolDetails * details);
+static void gum_bfd_prune_unloaded_modules (void);
+static gint gum_compare_address_indices (const guint * lhs, const guint * rhs,
+    const gpointer * addresses);
+
 static GHashTable * gum_function_address_by_name = NULL;
 
+/*
+ * Modules stay open once looked up, as BFD then keeps its parsed symbol
+ * and DWARF line tables around, making repeated lookups cheap. BFD is not
+ * thread-safe, so all lookups go through this lock. Whenever a lookup has
+ * to open a module, entries for modules no longer loaded are dropped.
+ */
+static GHashTable * gum_bfd_module_by_path = NULL;
+static GMutex gum_bfd_lock;
+
 static void
 gum_symbol_util_init (void)
 {
@@ -61,6 +87,8 @@ do_init (gpointer data)
 {
   gum_function_address_by_name = g_hash_table_new_full (g_str_hash,
       g_str_equal, g_free, NULL);
+  gum_bfd_module_by_path = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) gum_bfd_module_free);
 
   gum_build_symbols_database ();
 
@@ -72,6 +100,9 @@ do_init (gpointer data)
 static void
 do_deinit (void)
 {
+  g_hash_table_unref (gum_bfd_module_by_path);
+  gum_bfd_module_by_path = NULL;
+
   g_hash_table_unref (gum_function_address_by_name);
   gum_function_address_by_name = NULL;
 }
@@ -80,39 +111,146 @@ gboolean
 gum_symbol_details_from_address (gpointer address,
                                  GumSymbolDetails * details)
 {
-  gboolean result = FALSE;
   Dl_info dl_info;
-  const gchar * module_name;
-  bfd * abfd = NULL;
-  GumSymbolCollection sc = { 0, };
-  bfd_vma offset;
-  asection * section;
+  GumBfdModule * module;
+  gboolean opened = FALSE;
 
   gum_symbol_util_init ();
 
   if (!dladdr (address, &dl_info))
-    goto beach;
+    return FALSE;
+
+  g_mutex_lock (&gum_bfd_lock);
+
+  module = gum_bfd_module_obtain (dl_info.dli_fname, dl_info.dli_fbase,
+      &opened);
+  gum_bfd_module_resolve (module, address, &dl_info, details);
+
+  g_mutex_unlock (&gum_bfd_lock);
+
+  if (opened)
+    gum_bfd_prune_unloaded_modules ();
+
+  return TRUE;
+}
+
+guint
+gum_symbol_details_from_addresses (const gpointer * addresses,
+                                   guint n_addresses,
+                                   GumSymbolDetails * details)
+{
+  guint n_resolved = 0;
+  guint * order, i;
+  Dl_info * dl_infos;
+  GumBfdModule * module = NULL;
+  gpointer module_base = NULL;
+  const GumSymbolDetails * previous = NULL;
+  gboolean opened = FALSE;
+
+  gum_symbol_util_init ();
+
+  /*
+   * Resolving in address order lets consecutive lookups share the module,
+   * and lets duplicates be copied from the previous result.
+   */
+  order = g_new (guint, n_addresses);
+  for (i = 0; i != n_addresses; i++)
+    order[i] = i;
+  g_qsort_with_data (order, n_addresses, sizeof (guint),
+      (GCompareDataFunc) gum_compare_address_indices, (gpointer) addresses);
+
+  /*
+   * dladdr() takes the dynamic linker's lock, so do all of those calls up
+   * front rather than while holding ours.
+   */
+  dl_infos = g_new (Dl_info, n_addresses);
+  for (i = 0; i != n_addresses; i++)
+  {
+    if (i != 0 && addresses[order[i]] == addresses[order[i - 1]])
+    {
+      dl_infos[i] = dl_infos[i - 1];
+      continue;
+    }
+
+    if (!dladdr (addresses[order[i]], &dl_infos[i]))
+      dl_infos[i].dli_fname = NULL;
+  }
+
+  g_mutex_lock (&gum_bfd_lock);
+
+  for (i = 0; i != n_addresses; i++)
+  {
+    gpointer address = addresses[order[i]];
+    GumSymbolDetails * d = &details[order[i]];
+    const Dl_info * dl_info = &dl_infos[i];
+
+    if (previous != NULL && GUM_ADDRESS (address) == previous->address)
+    {
+      memcpy (d, previous, sizeof (GumSymbolDetails));
+      n_resolved++;
+      continue;
+    }
+
+    if (dl_info->dli_fname == NULL)
+    {
+      memset (d, 0, sizeof (GumSymbolDetails));
+      previous = NULL;
+      continue;
+    }
+
+    if (module == NULL || dl_info->dli_fbase != module_base)
+    {
+      module = gum_bfd_module_obtain (dl_info->dli_fname, dl_info->dli_fbase,
+          &opened);
+      module_base = dl_info->dli_fbase;
+    }
+
+    gum_bfd_module_resolve (module, address, dl_info, d);
+    n_resolved++;
+
+    previous = d;
+  }
+
+  g_mutex_unlock (&gum_bfd_lock);
+
+  if (opened)
+    gum_bfd_prune_unloaded_modules ();
+
+  g_free (dl_infos);
+  g_free (order);
+
+  return n_resolved;
+}
+
+static void
+gum_bfd_module_resolve (GumBfdModule * module,
+                        gpointer address,
+                        const Dl_info * dl_info,
+                        GumSymbolDetails * details)
+{
+  const gchar * module_name;
+  bfd * abfd;
+  bfd_vma offset;
+  asection * section;
 
   memset (details, 0, sizeof (GumSymbolDetails));
 
   details->address = GUM_ADDRESS (address);
 
-  module_name = g_strrstr (dl_info.dli_fname, "/");
+  module_name = g_strrstr (dl_info->dli_fname, "/");
   if (module_name != NULL)
     module_name++;
   else
-    module_name = dl_info.dli_fname;
+    module_name = dl_info->dli_fname;
   g_strlcpy (details->module_name, module_name, sizeof (details->module_name));
 
-  result = TRUE;
-
-  abfd = gum_open_bfd_and_load_symbols (dl_info.dli_fname, &sc);
+  abfd = module->abfd;
   if (abfd == NULL)
-    goto beach;
+    return;
 
   offset = GPOINTER_TO_SIZE (address);
   if (abfd->flags & BSF_KEEP_G)
-    offset -= GPOINTER_TO_SIZE (dl_info.dli_fbase);
+    offset -= GPOINTER_TO_SIZE (dl_info->dli_fbase);
 
   for (section = abfd->sections; section != NULL; section = section->next)
   {
@@ -130,9 +268,9 @@ gum_symbol_details_from_address (gpointer address,
     if (offset >= section_start + section_size)
       continue;
 
-    if (bfd_find_nearest_line (abfd, section, sc.static_symbols,
+    if (bfd_find_nearest_line (abfd, section, module->sc.static_symbols,
         offset - section_start, &file_name, &symbol_name, &line_number) ||
-        bfd_find_nearest_line (abfd, section, sc.dynamic_symbols,
+        bfd_find_nearest_line (abfd, section, module->sc.dynamic_symbols,
         offset - section_start, &file_name, &symbol_name, &line_number))
     {
       if (symbol_name != NULL)
@@ -149,10 +287,22 @@ gum_symbol_details_from_address (gpointer address,
       break;
     }
   }
+}
 
-beach:
-  gum_close_bfd_and_release_symbols (abfd, &sc);
-  return result;
+static gint
+gum_compare_address_indices (const guint * lhs,
+                             const guint * rhs,
+                             const gpointer * addresses)
+{
+  gsize lhs_address = GPOINTER_TO_SIZE (addresses[*lhs]);
+  gsize rhs_address = GPOINTER_TO_SIZE (addresses[*rhs]);
+
+  if (lhs_address < rhs_address)
+    return -1;
+  else if (lhs_address > rhs_address)
+    return 1;
+  else
+    return 0;
 }
 
 gchar *
@@ -374,4 +524,91 @@ gum_close_bfd_and_release_symbols (bfd * abfd,
 
   g_free (sc->static_symbols);
   g_free (sc->dynamic_symbols);
+
+  /* Modules that failed to open are cached too, and freed again later. */
+  memset (sc, 0, sizeof (GumSymbolCollection));
+}
+
+static GumBfdModule *
+gum_bfd_module_obtain (const gchar * path,
+                       gpointer base_address,
+                       gboolean * opened)
+{
+  GumBfdModule * module;
+
+  module = g_hash_table_lookup (gum_bfd_module_by_path, path);
+
+  /* A different base means the module was unloaded and loaded again. */
+  if (module != NULL && module->base_address == base_address)
+    return module;
+
+  module = g_slice_new (GumBfdModule);
+  module->abfd = gum_open_bfd_and_load_symbols (path, &module->sc);
+  module->base_address = base_address;
+
+  g_hash_table_insert (gum_bfd_module_by_path, g_strdup (path), module);
+
+  *opened = TRUE;
+
+  return module;
+}
+
+static void
+gum_bfd_module_free (GumBfdModule * module)
+{
+  gum_close_bfd_and_release_symbols (module->abfd, &module->sc);
+
+  g_slice_free (GumBfdModule, module);
+}
+
+static void
+gum_bfd_prune_unloaded_modules (void)
+{
+  GPtrArray * paths;
+  GArray * bases;
+  GHashTableIter iter;
+  const gchar * path;
+  GumBfdModule * module;
+  guint i;
+
+  paths = g_ptr_array_new_with_free_func (g_free);
+  bases = g_array_new (FALSE, FALSE, sizeof (gpointer));
+
+  g_mutex_lock (&gum_bfd_lock);
+  g_hash_table_iter_init (&iter, gum_bfd_module_by_path);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &path,
+      (gpointer *) &module))
+  {
+    g_ptr_array_add (paths, g_strdup (path));
+    g_array_append_val (bases, module->base_address);
+  }
+  g_mutex_unlock (&gum_bfd_lock);
+
+  /*
+   * dladdr() takes the loader lock, which must not be acquired while
+   * holding ours, as module constructors may well be looking up symbols.
+   */
+  for (i = 0; i != paths->len; i++)
+  {
+    gpointer base_address = g_array_index (bases, gpointer, i);
+    Dl_info dl_info;
+
+    path = g_ptr_array_index (paths, i);
+
+    if (dladdr (base_address, &dl_info) &&
+        dl_info.dli_fbase == base_address &&
+        strcmp (dl_info.dli_fname, path) == 0)
+    {
+      continue;
+    }
+
+    g_mutex_lock (&gum_bfd_lock);
+    module = g_hash_table_lookup (gum_bfd_module_by_path, path);
+    if (module != NULL && module->base_address == base_address)
+      g_hash_table_remove (gum_bfd_module_by_path, path);
+    g_mutex_unlock (&gum_bfd_lock);
+  }
+
+  g_array_free (bases, TRUE);
+  g_ptr_array_unref (paths);
 }
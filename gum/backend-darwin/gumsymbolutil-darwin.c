@@ -227,6 +227,25 @@ gum_symbol_details_from_address (gpointer address,
   return success;
 }
 
+guint
+gum_symbol_details_from_addresses (const gpointer * addresses,
+                                   guint n_addresses,
+                                   GumSymbolDetails * details)
+{
+  guint n_resolved = 0;
+  guint i;
+
+  for (i = 0; i != n_addresses; i++)
+  {
+    if (gum_symbol_details_from_address (addresses[i], &details[i]))
+      n_resolved++;
+    else
+      memset (&details[i], 0, sizeof (GumSymbolDetails));
+  }
+
+  return n_resolved;
+}
+
 gchar *
 gum_symbol_name_from_address (gpointer address)
 {
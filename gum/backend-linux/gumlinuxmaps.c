@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumlinuxmaps.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define GUM_PROC_MAPS_DELETED_SUFFIX " (deleted)"
+#define GUM_PROC_MAPS_DELETED_SUFFIX_LENGTH \
+    (sizeof (GUM_PROC_MAPS_DELETED_SUFFIX) - 1)
+
+static gchar * gum_proc_maps_iter_read_line (GumProcMapsIter * iter);
+
+static guint64 gum_parse_hex (gchar ** cursor);
+static guint64 gum_parse_decimal (gchar ** cursor);
+
+void
+gum_proc_maps_iter_init_for_self (GumProcMapsIter * iter)
+{
+  gum_proc_maps_iter_init_for_path (iter, "/proc/self/maps");
+}
+
+void
+gum_proc_maps_iter_init_for_pid (GumProcMapsIter * iter,
+                                 pid_t pid)
+{
+  gchar path[32];
+
+  g_snprintf (path, sizeof (path), "/proc/%d/maps", pid);
+
+  gum_proc_maps_iter_init_for_path (iter, path);
+}
+
+void
+gum_proc_maps_iter_init_for_path (GumProcMapsIter * iter,
+                                  const gchar * path)
+{
+  iter->fd = open (path, O_RDONLY | O_CLOEXEC);
+  g_assert (iter->fd != -1);
+
+  iter->read_cursor = iter->buffer;
+  iter->write_cursor = iter->buffer;
+}
+
+void
+gum_proc_maps_iter_destroy (GumProcMapsIter * iter)
+{
+  if (iter->fd != -1)
+    close (iter->fd);
+}
+
+gboolean
+gum_proc_maps_iter_next (GumProcMapsIter * iter,
+                         GumProcMapsEntry * entry)
+{
+  gchar * p;
+  gsize path_length;
+
+  p = gum_proc_maps_iter_read_line (iter);
+  if (p == NULL)
+    return FALSE;
+
+  /* 00400000-0040b000 r-xp 00000000 08:01 1234    /usr/bin/foo */
+  entry->start = gum_parse_hex (&p);
+  p++;
+  entry->end = gum_parse_hex (&p);
+  p++;
+
+  memcpy (entry->perms, p, 4);
+  entry->perms[4] = '\0';
+  p += 5;
+
+  entry->offset = gum_parse_hex (&p);
+  p++;
+
+  while (*p != ' ' && *p != '\0')
+    p++;
+  if (*p == ' ')
+    p++;
+
+  entry->inode = gum_parse_decimal (&p);
+
+  while (*p == ' ')
+    p++;
+
+  /*
+   * The kernel appends this to the path of a file that has been unlinked
+   * since it was mapped, so strip it like sscanf()'s %s used to.
+   */
+  path_length = strlen (p);
+  if (path_length >= GUM_PROC_MAPS_DELETED_SUFFIX_LENGTH)
+  {
+    gchar * suffix = p + path_length - GUM_PROC_MAPS_DELETED_SUFFIX_LENGTH;
+
+    if (strcmp (suffix, GUM_PROC_MAPS_DELETED_SUFFIX) == 0)
+      *suffix = '\0';
+  }
+
+  entry->path = p;
+
+  return TRUE;
+}
+
+/*
+ * Reads straight into the fixed buffer embedded in the iterator, so that
+ * entries can be parsed in place without any allocations or stdio overhead.
+ * Each read() fetches as much as the buffer has room for, and the buffer
+ * always fits at least one complete line, path included.
+ */
+static gchar *
+gum_proc_maps_iter_read_line (GumProcMapsIter * iter)
+{
+  gchar * line, * line_end;
+
+  while (TRUE)
+  {
+    gsize available;
+    gssize n;
+
+    available = iter->write_cursor - iter->read_cursor;
+
+    line_end = memchr (iter->read_cursor, '\n', available);
+    if (line_end != NULL)
+      break;
+
+    if (iter->fd == -1)
+    {
+      if (available == 0)
+        return NULL;
+      line_end = iter->write_cursor;
+      break;
+    }
+
+    memmove (iter->buffer, iter->read_cursor, available);
+    iter->read_cursor = iter->buffer;
+    iter->write_cursor = iter->buffer + available;
+
+    g_assert (available != sizeof (iter->buffer) - 1);
+
+    n = read (iter->fd, iter->write_cursor,
+        sizeof (iter->buffer) - 1 - available);
+    if (n == -1 && errno == EINTR)
+      continue;
+
+    if (n > 0)
+    {
+      iter->write_cursor += n;
+    }
+    else
+    {
+      close (iter->fd);
+      iter->fd = -1;
+    }
+  }
+
+  line = iter->read_cursor;
+
+  *line_end = '\0';
+  iter->read_cursor = (line_end != iter->write_cursor)
+      ? line_end + 1
+      : line_end;
+
+  return line;
+}
+
+static guint64
+gum_parse_hex (gchar ** cursor)
+{
+  guint64 value = 0;
+  gchar * p = *cursor;
+
+  while (TRUE)
+  {
+    gchar c = *p;
+    guint digit;
+
+    if (c >= '0' && c <= '9')
+      digit = c - '0';
+    else if (c >= 'a' && c <= 'f')
+      digit = 10 + (c - 'a');
+    else
+      break;
+
+    value = (value << 4) | digit;
+    p++;
+  }
+
+  *cursor = p;
+
+  return value;
+}
+
+static guint64
+gum_parse_decimal (gchar ** cursor)
+{
+  guint64 value = 0;
+  gchar * p = *cursor;
+
+  while (*p >= '0' && *p <= '9')
+  {
+    value = (value * 10) + (*p - '0');
+    p++;
+  }
+
+  *cursor = p;
+
+  return value;
+}
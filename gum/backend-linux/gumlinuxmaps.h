@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_LINUX_MAPS_H__
+#define __GUM_LINUX_MAPS_H__
+
+#include "gummemory.h"
+
+#include <limits.h>
+#include <sys/types.h>
+
+typedef struct _GumProcMapsIter GumProcMapsIter;
+typedef struct _GumProcMapsEntry GumProcMapsEntry;
+
+struct _GumProcMapsIter
+{
+  gint fd;
+  gchar buffer[(2 * PATH_MAX) + 1];
+  gchar * read_cursor;
+  gchar * write_cursor;
+};
+
+struct _GumProcMapsEntry
+{
+  GumAddress start;
+  GumAddress end;
+  gchar perms[5];
+  guint64 offset;
+  guint64 inode;
+  const gchar * path;
+};
+
+G_BEGIN_DECLS
+
+G_GNUC_INTERNAL void gum_proc_maps_iter_init_for_self (GumProcMapsIter * iter);
+G_GNUC_INTERNAL void gum_proc_maps_iter_init_for_pid (GumProcMapsIter * iter,
+    pid_t pid);
+G_GNUC_INTERNAL void gum_proc_maps_iter_init_for_path (GumProcMapsIter * iter,
+    const gchar * path);
+G_GNUC_INTERNAL void gum_proc_maps_iter_destroy (GumProcMapsIter * iter);
+
+G_GNUC_INTERNAL gboolean gum_proc_maps_iter_next (GumProcMapsIter * iter,
+    GumProcMapsEntry * entry);
+
+G_END_DECLS
+
+#endif
@@ -6,9 +6,9 @@
 
 #include "gummemory.h"
 
+#include "gumlinuxmaps.h"
 #include "gummemory-priv.h"
 
-#include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
@@ -122,8 +122,8 @@ gum_memory_get_protection (GumAddress address,
                            GumPageProtection * prot)
 {
   gboolean success;
-  FILE * fp;
-  gchar line[1024 + 1];
+  GumProcMapsIter iter;
+  GumProcMapsEntry entry;
 
   if (size == NULL || prot == NULL)
   {
@@ -175,36 +175,27 @@ gum_memory_get_protection (GumAddress address,
   *size = 0;
   *prot = GUM_PAGE_NO_ACCESS;
 
-  fp = fopen ("/proc/self/maps", "r");
-  g_assert (fp != NULL);
+  gum_proc_maps_iter_init_for_self (&iter);
 
-  while (fgets (line, sizeof (line), fp) != NULL)
+  while (gum_proc_maps_iter_next (&iter, &entry))
   {
-    gint n_items;
-    gpointer start, end;
-    gchar protection[16];
-
-    n_items = sscanf (line, "%p-%p %s ", &start, &end, protection);
-    g_assert_cmpint (n_items, ==, 3);
-
-    if (GUM_ADDRESS (start) > address)
+    if (entry.start > address)
       break;
-    else if (address >= GUM_ADDRESS (start) &&
-        address + n - 1 < GUM_ADDRESS (end))
+    else if (address >= entry.start && address + n - 1 < entry.end)
     {
       success = TRUE;
       *size = 1;
-      if (protection[0] == 'r')
+      if (entry.perms[0] == 'r')
         *prot |= GUM_PAGE_READ;
-      if (protection[1] == 'w')
+      if (entry.perms[1] == 'w')
         *prot |= GUM_PAGE_WRITE;
-      if (protection[2] == 'x')
+      if (entry.perms[2] == 'x')
         *prot |= GUM_PAGE_EXECUTE;
       break;
     }
   }
 
-  fclose (fp);
+  gum_proc_maps_iter_destroy (&iter);
 
   return success;
 }
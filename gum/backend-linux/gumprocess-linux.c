@@ -6,7 +6,11 @@
 
 #include "gumprocess.h"
 
+#include "gum-init.h"
+#include "gumexceptor.h"
 #include "gumlinux.h"
+#include "gumlinuxmaps.h"
+#include "gummemory-priv.h"
 #include "gummodulemap.h"
 
 #include <dlfcn.h>
@@ -37,7 +41,6 @@
 # include <link.h>
 #endif
 
-#define GUM_MAPS_LINE_SIZE (1024 + PATH_MAX)
 #define GUM_PSR_THUMB 0x20
 
 #if defined (HAVE_I386)
@@ -66,6 +69,38 @@
 #ifndef NT_PRSTATUS
 # define NT_PRSTATUS 1
 #endif
+#ifndef DT_GNU_HASH
+# define DT_GNU_HASH 0x6ffffef5
+#endif
+#ifndef DT_VERSYM
+# define DT_VERSYM 0x6ffffff0
+#endif
+#ifndef STT_GNU_IFUNC
+# define STT_GNU_IFUNC 10
+#endif
+
+#define GUM_ELF_VERSYM_HIDDEN 0x8000
+
+#define GUM_MALLOC_SIZE_SZ (sizeof (gsize))
+#define GUM_MALLOC_CHUNK_HEADER_SIZE (2 * GUM_MALLOC_SIZE_SZ)
+#define GUM_MALLOC_MIN_CHUNK_SIZE (4 * GUM_MALLOC_SIZE_SZ)
+#define GUM_MALLOC_PREV_INUSE 0x1
+#define GUM_MALLOC_IS_MMAPPED 0x2
+#define GUM_MALLOC_NON_MAIN_ARENA 0x4
+#define GUM_MALLOC_SIZE_BITS \
+    (GUM_MALLOC_PREV_INUSE | GUM_MALLOC_IS_MMAPPED | GUM_MALLOC_NON_MAIN_ARENA)
+#define GUM_MALLOC_MAX_HEADER_SIZE 4096
+#define GUM_MALLOC_WALK_BATCH_SIZE 64
+#if GLIB_SIZEOF_VOID_P == 8
+# define GUM_MALLOC_HEAP_MAX_SIZE (64 * 1024 * 1024)
+#else
+# define GUM_MALLOC_HEAP_MAX_SIZE (1024 * 1024)
+#endif
+
+#define GUM_MALLOC_CHUNK_SIZE_FIELD(p) \
+    (*((gsize *) GSIZE_TO_POINTER ((p) + GUM_MALLOC_SIZE_SZ)))
+#define GUM_MALLOC_CHUNK_SIZE(p) \
+    (GUM_MALLOC_CHUNK_SIZE_FIELD (p) & ~((gsize) GUM_MALLOC_SIZE_BITS))
 
 #define GUM_TEMP_FAILURE_RETRY(expression) \
   ({ \
@@ -77,15 +112,18 @@
     __result; \
   })
 
-typedef struct _GumModifyThreadContext GumModifyThreadContext;
+typedef struct _GumModifyThreadsContext GumModifyThreadsContext;
 typedef guint8 GumModifyThreadAck;
 
-typedef struct _GumEnumerateImportsContext GumEnumerateImportsContext;
-typedef struct _GumDependencyExport GumDependencyExport;
+typedef struct _GumEnumerateThreadsContext GumEnumerateThreadsContext;
 typedef struct _GumEnumerateModuleRangesContext GumEnumerateModuleRangesContext;
-typedef struct _GumResolveModuleNameContext GumResolveModuleNameContext;
+#ifdef HAVE_GLIBC
+typedef struct _GumFindLoadedObjectContext GumFindLoadedObjectContext;
+#endif
 
 typedef struct _GumElfModule GumElfModule;
+typedef struct _GumElfModuleInfo GumElfModuleInfo;
+typedef struct _GumElfLoadedModule GumElfLoadedModule;
 typedef struct _GumElfDependencyDetails GumElfDependencyDetails;
 typedef struct _GumElfEnumerateImportsContext GumElfEnumerateImportsContext;
 typedef struct _GumElfEnumerateExportsContext GumElfEnumerateExportsContext;
@@ -93,6 +131,9 @@ typedef struct _GumElfSymbolDetails GumElfSymbolDetails;
 
 typedef struct _GumUserDesc GumUserDesc;
 
+typedef struct _GumMallocWalk GumMallocWalk;
+typedef guint GumMallocWalkKind;
+
 typedef gboolean (* GumElfFoundDependencyFunc) (
     const GumElfDependencyDetails * details, gpointer user_data);
 typedef gboolean (* GumElfFoundSymbolFunc) (const GumElfSymbolDetails * details,
@@ -105,6 +146,7 @@ typedef guint GumElfSHeaderType;
 typedef guint GumElfSymbolType;
 typedef guint GumElfSymbolBind;
 #if GLIB_SIZEOF_VOID_P == 4
+typedef Elf32_Addr GumElfAddr;
 typedef Elf32_Ehdr GumElfEHeader;
 typedef Elf32_Phdr GumElfPHeader;
 typedef Elf32_Shdr GumElfSHeader;
@@ -113,6 +155,7 @@ typedef Elf32_Sym GumElfSymbol;
 # define GUM_ELF_ST_BIND(val) ELF32_ST_BIND(val)
 # define GUM_ELF_ST_TYPE(val) ELF32_ST_TYPE(val)
 #else
+typedef Elf64_Addr GumElfAddr;
 typedef Elf64_Ehdr GumElfEHeader;
 typedef Elf64_Phdr GumElfPHeader;
 typedef Elf64_Shdr GumElfSHeader;
@@ -135,27 +178,27 @@ enum _GumModifyThreadAck
   GUM_ACK_FAILED_TO_DETACH
 };
 
-struct _GumModifyThreadContext
+enum _GumMallocWalkKind
 {
-  gint fd[2];
-  GumThreadId thread_id;
-  GumCpuContext cpu_context;
+  GUM_MALLOC_WALK_MAIN_HEAP,
+  GUM_MALLOC_WALK_THREAD_HEAP,
+  GUM_MALLOC_WALK_MMAPPED_CHUNKS
 };
 
-struct _GumEnumerateImportsContext
+struct _GumModifyThreadsContext
 {
-  GumFoundImportFunc func;
-  gpointer user_data;
-
-  GHashTable * dependency_exports;
-  GumElfModule * current_dependency;
-  GumModuleMap * module_map;
+  gint fd[2];
+  const GumThreadId * thread_ids;
+  guint n_threads;
+  GumModifyThreadAck * statuses;
+  GumRegs * regs;
+  GumCpuContext * cpu_contexts;
 };
 
-struct _GumDependencyExport
+struct _GumEnumerateThreadsContext
 {
-  gchar * module;
-  GumAddress address;
+  GArray * threads;
+  gboolean * captured;
 };
 
 struct _GumEnumerateModuleRangesContext
@@ -165,11 +208,26 @@ struct _GumEnumerateModuleRangesContext
   gpointer user_data;
 };
 
-struct _GumResolveModuleNameContext
+#ifdef HAVE_GLIBC
+
+struct _GumFindLoadedObjectContext
+{
+  const gchar * name;
+  GumAddress address;
+};
+
+#endif
+
+struct _GumMallocWalk
 {
-  gchar * name;
-  gchar * path;
-  GumAddress base;
+  GumMallocWalkKind kind;
+  GumAddress start;
+  GumAddress end;
+  GumAddress chunk;
+  gboolean finished;
+
+  GumMemoryRange ranges[GUM_MALLOC_WALK_BATCH_SIZE];
+  guint n_ranges;
 };
 
 struct _GumElfModule
@@ -183,6 +241,39 @@ struct _GumElfModule
   GumAddress preferred_address;
 };
 
+struct _GumElfModuleInfo
+{
+  volatile gint ref_count;
+
+  gchar * path;
+  GumAddress base_address;
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  time_t mtime;
+
+  GStringChunk * strings;
+  GArray * imports;
+  GArray * exports;
+  GHashTable * export_by_name;
+  GPtrArray * dependency_names;
+
+  guint generation;
+
+  GPtrArray * dependencies;
+  guint dependencies_generation;
+};
+
+struct _GumElfLoadedModule
+{
+  GumAddress bias;
+  const GumElfSymbol * symtab;
+  const gchar * strtab;
+  const guint32 * gnu_hash;
+  const guint32 * sysv_hash;
+  const guint16 * versym;
+};
+
 struct _GumElfDependencyDetails
 {
   const gchar * name;
@@ -222,33 +313,79 @@ struct _GumUserDesc
   guint useable : 1;
 };
 
-static gint gum_do_modify_thread (gpointer data);
+static gboolean gum_modify_current_thread (GumModifyThreadFunc func,
+    gpointer user_data);
+static guint gum_modify_other_threads (const GumThreadId * thread_ids,
+    guint n_thread_ids, GumModifyThreadFunc func, gpointer user_data);
+static void gum_await_threads_stopped (GumModifyThreadsContext * ctx);
+static gint gum_do_modify_threads (gpointer data);
 static gboolean gum_await_ack (gint fd, GumModifyThreadAck expected_ack);
 static void gum_put_ack (gint fd, GumModifyThreadAck ack);
 
-static void gum_store_cpu_context (GumThreadId thread_id,
+static void gum_store_thread_cpu_context (GumThreadId thread_id,
     GumCpuContext * cpu_context, gpointer user_data);
-
-static gboolean gum_emit_import (const GumImportDetails * details,
-    gpointer user_data);
-static gboolean gum_collect_dependency_exports (
-    const GumElfDependencyDetails * details, gpointer user_data);
-static gboolean gum_collect_dependency_export (const GumExportDetails * details,
-    gpointer user_data);
-static GumDependencyExport * gum_dependency_export_new (const gchar * module,
-    GumAddress address);
-static void gum_dependency_export_free (GumDependencyExport * export);
+static gint gum_thread_details_compare_id (const GumThreadDetails * lhs,
+    const GumThreadDetails * rhs);
+
+static const GumExportDetails * gum_find_dependency_export (
+    GPtrArray * dependencies, const gchar * name,
+    const GumElfModuleInfo ** module);
+#ifdef HAVE_GLIBC
+static gboolean gum_emit_malloc_ranges_in_mapping (
+    const GumProcMapsEntry * entry, GumExceptor * exceptor,
+    GumFoundMallocRangeFunc func, gpointer user_data);
+static gboolean gum_malloc_walk_run (GumMallocWalk * walk,
+    GumExceptor * exceptor, GumFoundMallocRangeFunc func, gpointer user_data);
+static void gum_malloc_walk_collect (GumMallocWalk * walk);
+static void gum_malloc_walk_locate_first_chunk (GumMallocWalk * walk);
+static void gum_malloc_walk_collect_heap_chunks (GumMallocWalk * walk);
+static void gum_malloc_walk_collect_mmapped_chunks (GumMallocWalk * walk);
+static void gum_malloc_walk_add_range (GumMallocWalk * walk,
+    GumAddress base_address, gsize size);
+static GumAddress gum_malloc_heap_find_first_chunk (GumAddress start,
+    GumAddress end);
+static gboolean gum_malloc_chunks_span (GumAddress start, GumAddress end);
+#endif
 static gboolean gum_emit_range_if_module_name_matches (
     const GumRangeDetails * details, gpointer user_data);
 
 static gchar * gum_resolve_module_name (const gchar * name, GumAddress * base);
-static gboolean gum_store_module_path_and_base_if_name_matches (
-    const GumModuleDetails * details, gpointer user_data);
+static GumAddress gum_find_loaded_object_address (const gchar * name);
+#ifdef HAVE_GLIBC
+static int gum_store_loaded_object_address_if_name_matches (
+    struct dl_phdr_info * info, size_t size, void * data);
+#endif
 static gboolean gum_module_path_equals (const gchar * path,
     const gchar * name_or_path);
 
-static gboolean gum_elf_module_open (GumElfModule * module,
+static void gum_elf_module_cache_ensure_initialized (void);
+static gpointer gum_elf_module_cache_do_init (gpointer data);
+static void gum_elf_module_cache_do_deinit (void);
+static void gum_elf_module_cache_refresh_unlocked (void);
+static gchar * gum_elf_module_cache_find_module_path (GumAddress address);
+static gchar * gum_elf_module_cache_resolve_unlocked (const gchar * name,
+    GumAddress address, GumAddress * base);
+
+static GumElfModuleInfo * gum_elf_module_info_obtain (
     const gchar * module_name);
+static GumElfModuleInfo * gum_elf_module_info_new (GumElfModule * module);
+static GumElfModuleInfo * gum_elf_module_info_ref (GumElfModuleInfo * info);
+static void gum_elf_module_info_unref (GumElfModuleInfo * info);
+static gboolean gum_elf_module_info_is_current (GumElfModuleInfo * self,
+    GumAddress base_address, const struct stat * st);
+static gboolean gum_elf_module_info_is_loaded_at (GumElfModuleInfo * self,
+    GumAddress address);
+static GPtrArray * gum_elf_module_info_get_dependencies (
+    GumElfModuleInfo * self);
+static gboolean gum_collect_elf_import (const GumImportDetails * details,
+    gpointer user_data);
+static gboolean gum_collect_elf_export (const GumExportDetails * details,
+    gpointer user_data);
+static gboolean gum_collect_elf_dependency (
+    const GumElfDependencyDetails * details, gpointer user_data);
+
+static gboolean gum_elf_module_open (GumElfModule * module,
+    const gchar * path, GumAddress base_address);
 static void gum_elf_module_close (GumElfModule * module);
 static void gum_elf_module_enumerate_dependencies (GumElfModule * self,
     GumElfFoundDependencyFunc func, gpointer user_data);
@@ -267,6 +404,19 @@ static GumAddress gum_elf_module_compute_preferred_address (
 static GumElfSHeader * gum_elf_module_find_section_header (GumElfModule * self,
     GumElfSHeaderType type);
 
+static gboolean gum_elf_loaded_module_open (GumElfLoadedModule * module,
+    GumAddress base_address);
+static gboolean gum_elf_loaded_module_find_export (GumElfLoadedModule * self,
+    const gchar * name, GumAddress * address);
+static const GumElfSymbol * gum_elf_loaded_module_gnu_lookup (
+    GumElfLoadedModule * self, const gchar * name);
+static const GumElfSymbol * gum_elf_loaded_module_sysv_lookup (
+    GumElfLoadedModule * self, const gchar * name);
+static gboolean gum_elf_loaded_module_symbol_matches (
+    GumElfLoadedModule * self, guint index, const gchar * name);
+static guint32 gum_elf_gnu_hash (const gchar * name);
+static guint32 gum_elf_sysv_hash (const gchar * name);
+
 static gboolean gum_thread_read_state (GumThreadId tid, GumThreadState * state);
 static GumThreadState gum_thread_state_from_proc_status_character (gchar c);
 static GumPageProtection gum_page_protection_from_proc_perms_string (
@@ -296,6 +446,12 @@ static int setcontext (const ucontext_t * ucp);
 
 static gboolean gum_is_regset_supported = TRUE;
 
+static GHashTable * gum_elf_module_cache = NULL;
+static GHashTable * gum_elf_module_cache_by_name = NULL;
+static GumModuleMap * gum_elf_module_cache_map = NULL;
+static guint gum_elf_module_cache_generation = 0;
+static GMutex gum_elf_module_cache_lock;
+
 gboolean
 gum_process_is_debugger_attached (void)
 {
@@ -327,202 +483,302 @@ gum_process_modify_thread (GumThreadId thread_id,
                            GumModifyThreadFunc func,
                            gpointer user_data)
 {
-  gboolean success = FALSE;
+  return gum_process_modify_threads (&thread_id, 1, func, user_data) == 1;
+}
+
+/*
+ * Modifies a whole set of threads in one go: all of them are stopped
+ * together, func is called for each, and they are then resumed together.
+ * This is a lot cheaper than modifying them one by one, as only a single
+ * helper is needed and the waits for the threads to stop overlap. Returns
+ * the number of threads modified.
+ */
+guint
+gum_process_modify_threads (const GumThreadId * thread_ids,
+                            guint n_thread_ids,
+                            GumModifyThreadFunc func,
+                            gpointer user_data)
+{
+  guint n_modified;
+  GumThreadId current_thread_id;
+  GArray * others;
+  gboolean includes_current_thread = FALSE;
+  guint i;
+
+  current_thread_id = gum_process_get_current_thread_id ();
+
+  others = g_array_sized_new (FALSE, FALSE, sizeof (GumThreadId),
+      n_thread_ids);
+  for (i = 0; i != n_thread_ids; i++)
+  {
+    if (thread_ids[i] == current_thread_id)
+      includes_current_thread = TRUE;
+    else
+      g_array_append_val (others, thread_ids[i]);
+  }
+
+  n_modified = 0;
 
-  if (thread_id == gum_process_get_current_thread_id ())
+  if (others->len != 0)
   {
+    n_modified += gum_modify_other_threads ((GumThreadId *) others->data,
+        others->len, func, user_data);
+  }
+
+  if (includes_current_thread && gum_modify_current_thread (func, user_data))
+    n_modified++;
+
+  g_array_free (others, TRUE);
+
+  return n_modified;
+}
+
+static gboolean
+gum_modify_current_thread (GumModifyThreadFunc func,
+                           gpointer user_data)
+{
 #ifndef HAVE_ANDROID
-    ucontext_t uc;
-    volatile gboolean modified = FALSE;
+  ucontext_t uc;
+  volatile gboolean modified = FALSE;
 
-    getcontext (&uc);
-    if (!modified)
-    {
-      GumCpuContext cpu_context;
+  getcontext (&uc);
+  if (!modified)
+  {
+    GumCpuContext cpu_context;
 
-      gum_linux_parse_ucontext (&uc, &cpu_context);
-      func (thread_id, &cpu_context, user_data);
-      gum_linux_unparse_ucontext (&cpu_context, &uc);
+    gum_linux_parse_ucontext (&uc, &cpu_context);
+    func (gum_process_get_current_thread_id (), &cpu_context, user_data);
+    gum_linux_unparse_ucontext (&cpu_context, &uc);
 
-      modified = TRUE;
-      setcontext (&uc);
-    }
+    modified = TRUE;
+    setcontext (&uc);
+  }
 
-    success = TRUE;
+  return TRUE;
+#else
+  return FALSE;
 #endif
-  }
-  else
-  {
-    GumModifyThreadContext ctx;
-    gint res, fd;
-    gssize child;
-    gpointer stack, tls;
-    GumUserDesc * desc;
+}
+
+static guint
+gum_modify_other_threads (const GumThreadId * thread_ids,
+                          guint n_thread_ids,
+                          GumModifyThreadFunc func,
+                          gpointer user_data)
+{
+  guint n_modified = 0;
+  GumModifyThreadsContext ctx;
+  gint res, fd;
+  gssize child;
+  gpointer stack, tls;
+  GumUserDesc * desc;
+  guint i;
 
-    res = socketpair (AF_UNIX, SOCK_STREAM, 0, ctx.fd);
-    g_assert_cmpint (res, ==, 0);
-    ctx.thread_id = thread_id;
+  res = socketpair (AF_UNIX, SOCK_STREAM, 0, ctx.fd);
+  g_assert_cmpint (res, ==, 0);
+  ctx.thread_ids = thread_ids;
+  ctx.n_threads = n_thread_ids;
+  ctx.statuses = g_new0 (GumModifyThreadAck, n_thread_ids);
+  ctx.regs = g_new0 (GumRegs, n_thread_ids);
+  ctx.cpu_contexts = g_new0 (GumCpuContext, n_thread_ids);
 
-    fd = ctx.fd[0];
+  fd = ctx.fd[0];
 
-    stack = gum_alloc_n_pages (1, GUM_PAGE_RW);
-    tls = gum_alloc_n_pages (1, GUM_PAGE_RW);
+  stack = gum_alloc_n_pages (1, GUM_PAGE_RW);
+  tls = gum_alloc_n_pages (1, GUM_PAGE_RW);
 
 #if defined (HAVE_I386) && GLIB_SIZEOF_VOID_P == 4
-    GumUserDesc segment;
-    gint gs;
-
-    asm volatile (
-        "movw %%gs, %w0"
-        : "=q" (gs)
-    );
-
-    segment.entry_number = (gs & 0xffff) >> 3;
-    segment.base_addr = GPOINTER_TO_SIZE (tls);
-    segment.limit = 0xfffff;
-    segment.seg_32bit = 1;
-    segment.contents = 0;
-    segment.read_exec_only = 0;
-    segment.limit_in_pages = 1;
-    segment.seg_not_present = 0;
-    segment.useable = 1;
-
-    desc = &segment;
+  GumUserDesc segment;
+  gint gs;
+
+  asm volatile (
+      "movw %%gs, %w0"
+      : "=q" (gs)
+  );
+
+  segment.entry_number = (gs & 0xffff) >> 3;
+  segment.base_addr = GPOINTER_TO_SIZE (tls);
+  segment.limit = 0xfffff;
+  segment.seg_32bit = 1;
+  segment.contents = 0;
+  segment.read_exec_only = 0;
+  segment.limit_in_pages = 1;
+  segment.seg_not_present = 0;
+  segment.useable = 1;
+
+  desc = &segment;
 #else
-    desc = tls;
+  desc = tls;
 #endif
 
-    /*
-     * It seems like the only reliable way to read/write the registers of
-     * another thread is to use ptrace(). We used to accomplish this by
-     * hi-jacking the target thread by installing a signal handler and sending a
-     * real-time signal directed at the target thread, and thus relying on the
-     * signal handler getting called in that thread. The signal handler would
-     * then provide us with read/write access to its registers. This hack would
-     * however not work if a thread was for example blocking in poll(), as the
-     * signal would then just get queued and we'd end up waiting indefinitely.
-     *
-     * It is however not possible to ptrace() another thread when we're in the
-     * same process group. This used to be supported in old kernels, but it was
-     * buggy and eventually dropped. So in order to use ptrace() we will need to
-     * spawn a new thread in a different process group so that it can ptrace()
-     * the target thread inside our process group. This is also the solution
-     * recommended by Linus:
-     *
-     * https://lkml.org/lkml/2006/9/1/217
-     *
-     * Because libc implementations don't expose an API to do this, and the
-     * thread setup code is private, where the TLS part is crucial for even just
-     * the syscall wrappers - due to them accessing `errno` - we cannot make any
-     * libc calls in this thread. And because the libc's clone() syscall wrapper
-     * typically writes to the child thread's TLS structures, which we cannot
-     * portably set up correctly, we cannot use the libc clone() syscall wrapper
-     * either.
-     */
-    child = gum_libc_clone (
-        gum_do_modify_thread,
-        stack + gum_query_page_size (),
-        CLONE_VM | CLONE_SETTLS,
-        &ctx,
-        NULL,
-        desc,
-        NULL);
-    g_assert_cmpint (child, >, 0);
-
-    if (gum_await_ack (fd, GUM_ACK_ATTACHED))
+  /*
+   * It seems like the only reliable way to read/write the registers of
+   * another thread is to use ptrace(). We used to accomplish this by
+   * hi-jacking the target thread by installing a signal handler and sending a
+   * real-time signal directed at the target thread, and thus relying on the
+   * signal handler getting called in that thread. The signal handler would
+   * then provide us with read/write access to its registers. This hack would
+   * however not work if a thread was for example blocking in poll(), as the
+   * signal would then just get queued and we'd end up waiting indefinitely.
+   *
+   * It is however not possible to ptrace() another thread when we're in the
+   * same process group. This used to be supported in old kernels, but it was
+   * buggy and eventually dropped. So in order to use ptrace() we will need to
+   * spawn a new thread in a different process group so that it can ptrace()
+   * the target thread inside our process group. This is also the solution
+   * recommended by Linus:
+   *
+   * https://lkml.org/lkml/2006/9/1/217
+   *
+   * Because libc implementations don't expose an API to do this, and the
+   * thread setup code is private, where the TLS part is crucial for even just
+   * the syscall wrappers - due to them accessing `errno` - we cannot make any
+   * libc calls in this thread. And because the libc's clone() syscall wrapper
+   * typically writes to the child thread's TLS structures, which we cannot
+   * portably set up correctly, we cannot use the libc clone() syscall wrapper
+   * either.
+   */
+  child = gum_libc_clone (
+      gum_do_modify_threads,
+      stack + gum_query_page_size (),
+      CLONE_VM | CLONE_SETTLS,
+      &ctx,
+      NULL,
+      desc,
+      NULL);
+  g_assert_cmpint (child, >, 0);
+
+  if (gum_await_ack (fd, GUM_ACK_ATTACHED))
+  {
+    gum_await_threads_stopped (&ctx);
+    gum_put_ack (fd, GUM_ACK_STOPPED);
+
+    gum_await_ack (fd, GUM_ACK_READ_CONTEXT);
+    for (i = 0; i != n_thread_ids; i++)
     {
-      GumThreadState state;
-      gboolean still_alive;
+      if (ctx.statuses[i] == GUM_ACK_READ_CONTEXT)
+        func (thread_ids[i], &ctx.cpu_contexts[i], user_data);
+    }
+    gum_put_ack (fd, GUM_ACK_MODIFIED_CONTEXT);
 
-      while ((still_alive = gum_thread_read_state (thread_id, &state)) &&
-          state != GUM_THREAD_STOPPED)
+    if (gum_await_ack (fd, GUM_ACK_WROTE_CONTEXT))
+    {
+      for (i = 0; i != n_thread_ids; i++)
       {
-        g_usleep (G_USEC_PER_SEC / 100);
+        if (ctx.statuses[i] == GUM_ACK_WROTE_CONTEXT)
+          n_modified++;
       }
-      gum_put_ack (fd, GUM_ACK_STOPPED);
+    }
+  }
 
-      if (still_alive)
-      {
-        gum_await_ack (fd, GUM_ACK_READ_CONTEXT);
-        func (thread_id, &ctx.cpu_context, user_data);
-        gum_put_ack (fd, GUM_ACK_MODIFIED_CONTEXT);
+  waitpid (child, NULL, __WCLONE);
 
-        success = gum_await_ack (fd, GUM_ACK_WROTE_CONTEXT);
-      }
-    }
+  gum_free_pages (tls);
+  gum_free_pages (stack);
 
-    waitpid (child, NULL, __WCLONE);
+  g_free (ctx.cpu_contexts);
+  g_free (ctx.regs);
+  g_free (ctx.statuses);
 
-    gum_free_pages (tls);
-    gum_free_pages (stack);
+  close (ctx.fd[0]);
+  close (ctx.fd[1]);
 
-    close (ctx.fd[0]);
-    close (ctx.fd[1]);
-  }
+  return n_modified;
+}
 
-  return success;
+static void
+gum_await_threads_stopped (GumModifyThreadsContext * ctx)
+{
+  guint n_pending;
+
+  do
+  {
+    guint i;
+
+    n_pending = 0;
+
+    for (i = 0; i != ctx->n_threads; i++)
+    {
+      GumThreadState state;
+
+      if (ctx->statuses[i] != GUM_ACK_ATTACHED)
+        continue;
+
+      if (!gum_thread_read_state (ctx->thread_ids[i], &state))
+        ctx->statuses[i] = GUM_ACK_FAILED_TO_READ;
+      else if (state == GUM_THREAD_STOPPED)
+        ctx->statuses[i] = GUM_ACK_STOPPED;
+      else
+        n_pending++;
+    }
+
+    if (n_pending != 0)
+      g_usleep (G_USEC_PER_SEC / 100);
+  }
+  while (n_pending != 0);
 }
 
+/*
+ * Runs in the helper. Every step is applied to all of the threads before we
+ * report back, and the outcome for each is recorded in ctx->statuses, which
+ * lives in memory shared with the parent.
+ */
 static gint
-gum_do_modify_thread (gpointer data)
+gum_do_modify_threads (gpointer data)
 {
-  GumModifyThreadContext * ctx = data;
+  GumModifyThreadsContext * ctx = data;
   gint fd;
   gssize res;
-  GumRegs regs;
+  guint i;
 
   fd = ctx->fd[1];
 
-  res = gum_libc_ptrace (PTRACE_ATTACH, ctx->thread_id, NULL, NULL);
-  if (res < 0)
-    goto failed_to_attach;
+  for (i = 0; i != ctx->n_threads; i++)
+  {
+    res = gum_libc_ptrace (PTRACE_ATTACH, ctx->thread_ids[i], NULL, NULL);
+    ctx->statuses[i] =
+        (res >= 0) ? GUM_ACK_ATTACHED : GUM_ACK_FAILED_TO_ATTACH;
+  }
   gum_put_ack (fd, GUM_ACK_ATTACHED);
 
   gum_await_ack (fd, GUM_ACK_STOPPED);
-  res = gum_get_regs (ctx->thread_id, &regs);
-  if (res < 0)
-    goto failed_to_read;
-  gum_parse_regs (&regs, &ctx->cpu_context);
+  for (i = 0; i != ctx->n_threads; i++)
+  {
+    if (ctx->statuses[i] != GUM_ACK_STOPPED)
+      continue;
+
+    res = gum_get_regs (ctx->thread_ids[i], &ctx->regs[i]);
+    if (res < 0)
+    {
+      ctx->statuses[i] = GUM_ACK_FAILED_TO_READ;
+      continue;
+    }
+    gum_parse_regs (&ctx->regs[i], &ctx->cpu_contexts[i]);
+    ctx->statuses[i] = GUM_ACK_READ_CONTEXT;
+  }
   gum_put_ack (fd, GUM_ACK_READ_CONTEXT);
 
   gum_await_ack (fd, GUM_ACK_MODIFIED_CONTEXT);
-  gum_unparse_regs (&ctx->cpu_context, &regs);
-  res = gum_set_regs (ctx->thread_id, &regs);
-  if (res < 0)
-    goto failed_to_write;
+  for (i = 0; i != ctx->n_threads; i++)
+  {
+    if (ctx->statuses[i] == GUM_ACK_FAILED_TO_ATTACH)
+      continue;
 
-  res = gum_libc_ptrace (PTRACE_DETACH, ctx->thread_id, NULL, NULL);
-  if (res < 0)
-    goto failed_to_detach;
+    if (ctx->statuses[i] == GUM_ACK_READ_CONTEXT)
+    {
+      gum_unparse_regs (&ctx->cpu_contexts[i], &ctx->regs[i]);
+      res = gum_set_regs (ctx->thread_ids[i], &ctx->regs[i]);
+      ctx->statuses[i] =
+          (res >= 0) ? GUM_ACK_WROTE_CONTEXT : GUM_ACK_FAILED_TO_WRITE;
+    }
 
+    res = gum_libc_ptrace (PTRACE_DETACH, ctx->thread_ids[i], NULL, NULL);
+    if (res < 0 && ctx->statuses[i] == GUM_ACK_WROTE_CONTEXT)
+      ctx->statuses[i] = GUM_ACK_FAILED_TO_DETACH;
+  }
   gum_put_ack (fd, GUM_ACK_WROTE_CONTEXT);
 
-  goto beach;
-
-failed_to_attach:
-  {
-    gum_put_ack (fd, GUM_ACK_FAILED_TO_ATTACH);
-    goto beach;
-  }
-failed_to_read:
-  {
-    gum_put_ack (fd, GUM_ACK_FAILED_TO_READ);
-    goto beach;
-  }
-failed_to_write:
-  {
-    gum_put_ack (fd, GUM_ACK_FAILED_TO_WRITE);
-    goto beach;
-  }
-failed_to_detach:
-  {
-    gum_put_ack (fd, GUM_ACK_FAILED_TO_DETACH);
-    goto beach;
-  }
-beach:
-  {
-    return 0;
-  }
+  return 0;
 }
 
 static gboolean
@@ -553,106 +809,137 @@ void
 gum_process_enumerate_threads (GumFoundThreadFunc func,
                                gpointer user_data)
 {
+  GumEnumerateThreadsContext ctx;
+  GArray * thread_ids;
   GDir * dir;
   const gchar * name;
-  gboolean carry_on = TRUE;
+  guint i;
+
+  ctx.threads = g_array_new (FALSE, FALSE, sizeof (GumThreadDetails));
 
   dir = g_dir_open ("/proc/self/task", 0, NULL);
   g_assert (dir != NULL);
 
-  while (carry_on && (name = g_dir_read_name (dir)) != NULL)
+  while ((name = g_dir_read_name (dir)) != NULL)
   {
     GumThreadDetails details;
 
     details.id = atoi (name);
     if (gum_thread_read_state (details.id, &details.state))
-    {
-      if (gum_process_modify_thread (details.id, gum_store_cpu_context,
-            &details.cpu_context))
-      {
-        carry_on = func (&details, user_data);
-      }
-    }
+      g_array_append_val (ctx.threads, details);
   }
 
   g_dir_close (dir);
+
+  g_array_sort (ctx.threads, (GCompareFunc) gum_thread_details_compare_id);
+
+  thread_ids = g_array_sized_new (FALSE, FALSE, sizeof (GumThreadId),
+      ctx.threads->len);
+  for (i = 0; i != ctx.threads->len; i++)
+  {
+    g_array_append_val (thread_ids,
+        g_array_index (ctx.threads, GumThreadDetails, i).id);
+  }
+  ctx.captured = g_new0 (gboolean, ctx.threads->len);
+
+  gum_process_modify_threads ((GumThreadId *) thread_ids->data,
+      thread_ids->len, gum_store_thread_cpu_context, &ctx);
+
+  for (i = 0; i != ctx.threads->len; i++)
+  {
+    if (ctx.captured[i] &&
+        !func (&g_array_index (ctx.threads, GumThreadDetails, i), user_data))
+      break;
+  }
+
+  g_free (ctx.captured);
+  g_array_free (thread_ids, TRUE);
+  g_array_free (ctx.threads, TRUE);
 }
 
 static void
-gum_store_cpu_context (GumThreadId thread_id,
-                       GumCpuContext * cpu_context,
-                       gpointer user_data)
+gum_store_thread_cpu_context (GumThreadId thread_id,
+                              GumCpuContext * cpu_context,
+                              gpointer user_data)
+{
+  GumEnumerateThreadsContext * ctx = user_data;
+  GumThreadDetails key;
+  GumThreadDetails * details;
+  guint index;
+
+  key.id = thread_id;
+  details = bsearch (&key, ctx->threads->data, ctx->threads->len,
+      sizeof (GumThreadDetails), (GCompareFunc) gum_thread_details_compare_id);
+  g_assert (details != NULL);
+
+  memcpy (&details->cpu_context, cpu_context, sizeof (GumCpuContext));
+
+  index = details - (GumThreadDetails *) ctx->threads->data;
+  ctx->captured[index] = TRUE;
+}
+
+static gint
+gum_thread_details_compare_id (const GumThreadDetails * lhs,
+                               const GumThreadDetails * rhs)
 {
-  memcpy (user_data, cpu_context, sizeof (GumCpuContext));
+  if (lhs->id < rhs->id)
+    return -1;
+  if (lhs->id > rhs->id)
+    return 1;
+  return 0;
 }
 
 void
 gum_process_enumerate_modules (GumFoundModuleFunc func,
                                gpointer user_data)
 {
-  FILE * fp;
-  const guint line_size = GUM_MAPS_LINE_SIZE;
-  gchar * line, * path, * prev_path;
+  GumProcMapsIter iter;
+  GumProcMapsEntry entry;
+  gchar prev_path[PATH_MAX];
   gboolean carry_on = TRUE;
 
-  fp = fopen ("/proc/self/maps", "r");
-  g_assert (fp != NULL);
-
-  line = g_malloc (line_size);
-
-  path = g_malloc (PATH_MAX);
-  prev_path = g_malloc (PATH_MAX);
   prev_path[0] = '\0';
 
-  while (carry_on && fgets (line, line_size, fp) != NULL)
+  gum_proc_maps_iter_init_for_self (&iter);
+
+  while (carry_on && gum_proc_maps_iter_next (&iter, &entry))
   {
     const guint8 elf_magic[] = { 0x7f, 'E', 'L', 'F' };
-    guint8 * start, * end;
-    gchar perms[5] = { 0, };
-    gint n;
+    const gchar * path = entry.path;
     gboolean readable, shared;
-    gchar * name;
     GumMemoryRange range;
     GumModuleDetails details;
 
-    n = sscanf (line, "%p-%p %4c %*x %*s %*s %s", &start, &end, perms, path);
-    if (n == 3)
-      continue;
-    g_assert_cmpint (n, ==, 4);
-
-    readable = perms[0] == 'r';
-    shared = perms[3] == 's';
+    readable = entry.perms[0] == 'r';
+    shared = entry.perms[3] == 's';
     if (!readable || shared)
       continue;
-    else if (strcmp (path, prev_path) == 0)
+    else if (path[0] != '/' || strcmp (path, prev_path) == 0)
       continue;
-    else if (path[0] != '/' || g_str_has_prefix (path, "/dev/"))
+    else if (g_str_has_prefix (path, "/dev/"))
       continue;
-    else if (memcmp (start, elf_magic, sizeof (elf_magic)) != 0)
+    /*
+     * The ELF header need not be at file offset 0, e.g. on Android where
+     * libraries may be mapped straight out of an uncompressed APK, so we
+     * leave it to the magic check below.
+     */
+    else if (memcmp (GSIZE_TO_POINTER (entry.start), elf_magic,
+        sizeof (elf_magic)) != 0)
       continue;
 
-    name = g_path_get_basename (path);
-
-    range.base_address = GUM_ADDRESS (start);
-    range.size = end - start;
+    range.base_address = entry.start;
+    range.size = entry.end - entry.start;
 
-    details.name = name;
+    details.name = strrchr (path, '/') + 1;
     details.range = &range;
     details.path = path;
 
     carry_on = func (&details, user_data);
 
-    g_free (name);
-
-    strcpy (prev_path, path);
+    g_strlcpy (prev_path, path, sizeof (prev_path));
   }
 
-  g_free (path);
-  g_free (prev_path);
-
-  g_free (line);
-
-  fclose (fp);
+  gum_proc_maps_iter_destroy (&iter);
 }
 
 void
@@ -669,57 +956,31 @@ gum_linux_enumerate_ranges (pid_t pid,
                             GumFoundRangeFunc func,
                             gpointer user_data)
 {
-  gchar * maps_path;
-  FILE * fp;
-  const guint line_size = GUM_MAPS_LINE_SIZE;
-  gchar * line;
+  GumProcMapsIter iter;
+  GumProcMapsEntry entry;
   gboolean carry_on = TRUE;
 
-  maps_path = g_strdup_printf ("/proc/%d/maps", pid);
-
-  fp = fopen (maps_path, "r");
-  g_assert (fp != NULL);
+  gum_proc_maps_iter_init_for_pid (&iter, pid);
 
-  g_free (maps_path);
-
-  line = g_malloc (line_size);
-
-  while (carry_on && fgets (line, line_size, fp) != NULL)
+  while (carry_on && gum_proc_maps_iter_next (&iter, &entry))
   {
     GumRangeDetails details;
     GumMemoryRange range;
     GumFileMapping file;
-    GumAddress end;
-    gchar perms[5] = { 0, };
-    guint64 inode;
-    gint length, n;
-
-    n = sscanf (line,
-        "%" G_GINT64_MODIFIER "x-%" G_GINT64_MODIFIER "x "
-        "%4c "
-        "%" G_GINT64_MODIFIER "x %*s %" G_GINT64_MODIFIER "d"
-        "%n",
-        &range.base_address, &end,
-        perms,
-        &file.offset, &inode,
-        &length);
-    g_assert (n == 5 || n == 6);
-
-    range.size = end - range.base_address;
+
+    range.base_address = entry.start;
+    range.size = entry.end - entry.start;
 
     details.file = NULL;
-    if (inode != 0)
+    if (entry.inode != 0 && entry.path[0] == '/')
     {
-      file.path = strchr (line + length, '/');
-      if (file.path != NULL)
-      {
-        *strchr (file.path, '\n') = '\0';
-        details.file = &file;
-      }
+      file.path = entry.path;
+      file.offset = entry.offset;
+      details.file = &file;
     }
 
     details.range = &range;
-    details.prot = gum_page_protection_from_proc_perms_string (perms);
+    details.prot = gum_page_protection_from_proc_perms_string (entry.perms);
 
     if ((details.prot & prot) == prot)
     {
@@ -727,148 +988,457 @@ gum_linux_enumerate_ranges (pid_t pid,
     }
   }
 
-  g_free (line);
-
-  fclose (fp);
+  gum_proc_maps_iter_destroy (&iter);
 }
 
+/*
+ * Walks glibc's heaps without any help from the allocator: the brk heap of
+ * the main arena, the mmap()ed heaps of thread arenas, and chunks that were
+ * mmap()ed on their own. As malloc_state's layout differs between glibc
+ * versions we don't rely on it, and instead locate the first chunk of each
+ * heap by looking for the offset whose chain of chunks ends exactly where
+ * the heap does.
+ *
+ * This is best-effort, as other threads may be allocating while we walk.
+ * They may also unmap or shrink a heap under our feet, so chunk headers are
+ * only read inside an exceptor scope, a batch at a time, and the callback is
+ * invoked outside of it. Chunks cached in fastbins or tcache are marked as
+ * in use by glibc, and so are reported as such. Gum's own private heap is
+ * reported last, through dlmalloc's knowledge of it.
+ */
 void
 gum_process_enumerate_malloc_ranges (GumFoundMallocRangeFunc func,
                                      gpointer user_data)
 {
-  /* Not implemented */
-}
-
-gint
-gum_thread_get_system_error (void)
-{
-  return errno;
-}
-
-void
-gum_thread_set_system_error (gint value)
-{
-  errno = value;
-}
-
-void
-gum_module_enumerate_imports (const gchar * module_name,
-                              GumFoundImportFunc func,
-                              gpointer user_data)
-{
-  GumElfModule module;
-  GumEnumerateImportsContext ctx;
+  gboolean carry_on = TRUE;
+#ifdef HAVE_GLIBC
+  GumExceptor * exceptor;
+  GumProcMapsIter iter;
+  GumProcMapsEntry entry;
 
-  if (!gum_elf_module_open (&module, module_name))
-    return;
+  exceptor = gum_exceptor_obtain ();
 
-  ctx.func = func;
-  ctx.user_data = user_data;
+  gum_proc_maps_iter_init_for_self (&iter);
 
-  ctx.dependency_exports = g_hash_table_new_full (g_str_hash, g_str_equal,
-      g_free, (GDestroyNotify) gum_dependency_export_free);
-  ctx.current_dependency = NULL;
-  ctx.module_map = NULL;
+  while (carry_on && gum_proc_maps_iter_next (&iter, &entry))
+  {
+    if (entry.perms[0] != 'r' || entry.perms[1] != 'w' ||
+        entry.perms[3] != 'p')
+      continue;
 
-  gum_elf_module_enumerate_dependencies (&module,
-      gum_collect_dependency_exports, &ctx);
+    carry_on = gum_emit_malloc_ranges_in_mapping (&entry, exceptor, func,
+        user_data);
+  }
 
-  gum_elf_module_enumerate_imports (&module, gum_emit_import, &ctx);
+  gum_proc_maps_iter_destroy (&iter);
 
-  if (ctx.module_map != NULL)
-    g_object_unref (ctx.module_map);
-  g_hash_table_unref (ctx.dependency_exports);
+  g_object_unref (exceptor);
+#endif
 
-  gum_elf_module_close (&module);
+  if (carry_on)
+    _gum_memory_enumerate_private_malloc_ranges (func, user_data);
 }
 
+#ifdef HAVE_GLIBC
+
 static gboolean
-gum_emit_import (const GumImportDetails * details,
-                 gpointer user_data)
+gum_emit_malloc_ranges_in_mapping (const GumProcMapsEntry * entry,
+                                   GumExceptor * exceptor,
+                                   GumFoundMallocRangeFunc func,
+                                   gpointer user_data)
 {
-  GumEnumerateImportsContext * ctx = user_data;
-  GumImportDetails d;
-  GumDependencyExport * exp;
+  GumMallocWalk walk;
+  GumAddress heap, mmapped_start;
 
-  d.type = details->type;
-  d.name = details->name;
-
-  exp = g_hash_table_lookup (ctx->dependency_exports, details->name);
-  if (exp != NULL)
+  if (strcmp (entry->path, "[heap]") == 0)
   {
-    d.module = exp->module;
-    d.address = exp->address;
+    walk.kind = GUM_MALLOC_WALK_MAIN_HEAP;
+    walk.start = entry->start;
+    walk.end = entry->end;
+
+    return gum_malloc_walk_run (&walk, exceptor, func, user_data);
   }
-  else
+
+  if (entry->path[0] != '\0')
+    return TRUE;
+
+  /*
+   * Thread arenas allocate their heaps aligned to their maximum size, with
+   * the unused part mapped inaccessible. Neighbouring anonymous mappings may
+   * have been merged with them, so consider every aligned address, and look
+   * for chunks mmap()ed on their own in the gaps between the heaps found.
+   */
+  mmapped_start = entry->start;
+  for (heap = GUM_ALIGN_SIZE (entry->start, GUM_MALLOC_HEAP_MAX_SIZE);
+      heap < entry->end;
+      heap += GUM_MALLOC_HEAP_MAX_SIZE)
   {
-    d.module = NULL;
-    d.address = GUM_ADDRESS (dlsym (RTLD_DEFAULT, details->name));
+    GumAddress heap_end;
 
-    if (d.address != 0)
-    {
-      const GumModuleDetails * module;
+    if (entry->end - heap < GUM_MALLOC_MAX_HEADER_SIZE)
+      break;
 
-      if (ctx->module_map == NULL)
-        ctx->module_map = gum_module_map_new ();
-      module = gum_module_map_find (ctx->module_map, d.address);
-      if (module != NULL)
-        d.module = module->path;
-    }
+    walk.kind = GUM_MALLOC_WALK_THREAD_HEAP;
+    walk.start = heap;
+    walk.end = entry->end;
+
+    if (!gum_malloc_walk_run (&walk, exceptor, func, user_data))
+      return FALSE;
+
+    if (walk.chunk == 0)
+      continue;
+    heap_end = walk.end;
+
+    walk.kind = GUM_MALLOC_WALK_MMAPPED_CHUNKS;
+    walk.start = mmapped_start;
+    walk.end = heap;
+
+    if (!gum_malloc_walk_run (&walk, exceptor, func, user_data))
+      return FALSE;
+
+    mmapped_start = heap_end;
   }
 
-  return ctx->func (&d, ctx->user_data);
+  walk.kind = GUM_MALLOC_WALK_MMAPPED_CHUNKS;
+  walk.start = mmapped_start;
+  walk.end = entry->end;
+
+  return gum_malloc_walk_run (&walk, exceptor, func, user_data);
 }
 
 static gboolean
-gum_collect_dependency_exports (const GumElfDependencyDetails * details,
-                                gpointer user_data)
+gum_malloc_walk_run (GumMallocWalk * walk,
+                     GumExceptor * exceptor,
+                     GumFoundMallocRangeFunc func,
+                     gpointer user_data)
 {
-  GumEnumerateImportsContext * ctx = user_data;
-  GumElfModule module;
+  walk->chunk = 0;
+  walk->finished = FALSE;
 
-  if (!gum_elf_module_open (&module, details->name))
-    return TRUE;
-  ctx->current_dependency = &module;
-  gum_elf_module_enumerate_exports (&module, gum_collect_dependency_export,
-      ctx);
-  ctx->current_dependency = NULL;
-  gum_elf_module_close (&module);
+  do
+  {
+    GumExceptorScope scope;
+    guint i;
+
+    walk->n_ranges = 0;
+
+    if (gum_exceptor_try (exceptor, &scope))
+    {
+      gum_malloc_walk_collect (walk);
+    }
+
+    if (gum_exceptor_catch (exceptor, &scope))
+      walk->finished = TRUE;
+
+    for (i = 0; i != walk->n_ranges; i++)
+    {
+      GumMallocRangeDetails details;
+
+      details.range = &walk->ranges[i];
+
+      if (!func (&details, user_data))
+        return FALSE;
+    }
+  }
+  while (!walk->finished);
 
   return TRUE;
 }
 
-static gboolean
-gum_collect_dependency_export (const GumExportDetails * details,
-                               gpointer user_data)
+static void
+gum_malloc_walk_collect (GumMallocWalk * walk)
 {
-  GumEnumerateImportsContext * ctx = user_data;
-  GumElfModule * module = ctx->current_dependency;
+  if (walk->chunk == 0)
+  {
+    gum_malloc_walk_locate_first_chunk (walk);
+    if (walk->finished)
+      return;
+  }
+
+  if (walk->kind == GUM_MALLOC_WALK_MMAPPED_CHUNKS)
+    gum_malloc_walk_collect_mmapped_chunks (walk);
+  else
+    gum_malloc_walk_collect_heap_chunks (walk);
+}
 
-  g_hash_table_insert (ctx->dependency_exports,
-      g_strdup (details->name),
-      gum_dependency_export_new (module->path, details->address));
+static void
+gum_malloc_walk_locate_first_chunk (GumMallocWalk * walk)
+{
+  GumAddress first_chunk;
 
-  return TRUE;
+  switch (walk->kind)
+  {
+    case GUM_MALLOC_WALK_MAIN_HEAP:
+      first_chunk = gum_malloc_heap_find_first_chunk (walk->start, walk->end);
+      break;
+    case GUM_MALLOC_WALK_THREAD_HEAP:
+    {
+      const gsize * heap_info = GSIZE_TO_POINTER (walk->start);
+      gsize ar_ptr, heap_size;
+
+      ar_ptr = heap_info[0];
+      heap_size = heap_info[2];
+      if (ar_ptr == 0 || ar_ptr % GUM_MALLOC_SIZE_SZ != 0 ||
+          heap_size <= GUM_MALLOC_MAX_HEADER_SIZE ||
+          heap_size > walk->end - walk->start)
+      {
+        first_chunk = 0;
+        break;
+      }
+      walk->end = walk->start + heap_size;
+
+      first_chunk = gum_malloc_heap_find_first_chunk (
+          walk->start + GUM_MALLOC_SIZE_SZ, walk->end);
+      break;
+    }
+    case GUM_MALLOC_WALK_MMAPPED_CHUNKS:
+      first_chunk = GUM_ALIGN_SIZE (walk->start, gum_query_page_size ());
+      break;
+    default:
+      g_assert_not_reached ();
+  }
+
+  walk->chunk = first_chunk;
+  walk->finished = first_chunk == 0;
+}
+
+static void
+gum_malloc_walk_collect_heap_chunks (GumMallocWalk * walk)
+{
+  GumAddress chunk = walk->chunk;
+  GumAddress end = walk->end;
+
+  while (walk->n_ranges != GUM_MALLOC_WALK_BATCH_SIZE)
+  {
+    gsize size;
+    GumAddress next;
+
+    if (end - chunk < GUM_MALLOC_MIN_CHUNK_SIZE)
+    {
+      walk->finished = TRUE;
+      break;
+    }
+
+    size = GUM_MALLOC_CHUNK_SIZE (chunk);
+    next = chunk + size;
+
+    /* The top chunk, or the fenceposts at the end of an old heap. */
+    if (next == end || size < GUM_MALLOC_MIN_CHUNK_SIZE ||
+        end - next < GUM_MALLOC_CHUNK_HEADER_SIZE)
+    {
+      walk->finished = TRUE;
+      break;
+    }
+
+    if ((GUM_MALLOC_CHUNK_SIZE_FIELD (next) & GUM_MALLOC_PREV_INUSE) != 0)
+    {
+      gum_malloc_walk_add_range (walk, chunk + GUM_MALLOC_CHUNK_HEADER_SIZE,
+          size - GUM_MALLOC_SIZE_SZ);
+    }
+
+    chunk = next;
+  }
+
+  walk->chunk = chunk;
 }
 
-static GumDependencyExport *
-gum_dependency_export_new (const gchar * module,
-                           GumAddress address)
+/*
+ * Anonymous mappings next to each other get merged, so the chunks may be
+ * interleaved with other data. We therefore look for a chunk header at
+ * every page, and skip over each chunk found.
+ */
+static void
+gum_malloc_walk_collect_mmapped_chunks (GumMallocWalk * walk)
 {
-  GumDependencyExport * export;
+  GumAddress chunk = walk->chunk;
+  GumAddress end = walk->end;
+  gsize page_size;
 
-  export = g_slice_new (GumDependencyExport);
-  export->module = g_strdup (module);
-  export->address = address;
+  page_size = gum_query_page_size ();
+
+  while (walk->n_ranges != GUM_MALLOC_WALK_BATCH_SIZE)
+  {
+    gsize prev_size, size_field, size;
 
-  return export;
+    if (end <= chunk || end - chunk < page_size)
+    {
+      walk->finished = TRUE;
+      break;
+    }
+
+    prev_size = *((gsize *) GSIZE_TO_POINTER (chunk));
+    size_field = GUM_MALLOC_CHUNK_SIZE_FIELD (chunk);
+    size = size_field & ~((gsize) GUM_MALLOC_SIZE_BITS);
+
+    if (prev_size != 0 ||
+        (size_field & GUM_MALLOC_SIZE_BITS) != GUM_MALLOC_IS_MMAPPED ||
+        size == 0 || size % page_size != 0 || size > end - chunk)
+    {
+      chunk += page_size;
+      continue;
+    }
+
+    gum_malloc_walk_add_range (walk, chunk + GUM_MALLOC_CHUNK_HEADER_SIZE,
+        size - GUM_MALLOC_CHUNK_HEADER_SIZE);
+
+    chunk += size;
+  }
+
+  walk->chunk = chunk;
 }
 
 static void
-gum_dependency_export_free (GumDependencyExport * export)
+gum_malloc_walk_add_range (GumMallocWalk * walk,
+                           GumAddress base_address,
+                           gsize size)
+{
+  GumMemoryRange * range = &walk->ranges[walk->n_ranges++];
+
+  range->base_address = base_address;
+  range->size = size;
+}
+
+static GumAddress
+gum_malloc_heap_find_first_chunk (GumAddress start,
+                                  GumAddress end)
+{
+  GumAddress candidate, last_candidate;
+
+  candidate = GUM_ALIGN_SIZE (start, GUM_MALLOC_CHUNK_HEADER_SIZE);
+  last_candidate = MIN (start + GUM_MALLOC_MAX_HEADER_SIZE, end);
+
+  for (; candidate < last_candidate;
+      candidate += GUM_MALLOC_CHUNK_HEADER_SIZE)
+  {
+    if (gum_malloc_chunks_span (candidate, end))
+      return candidate;
+  }
+
+  return 0;
+}
+
+static gboolean
+gum_malloc_chunks_span (GumAddress start,
+                        GumAddress end)
+{
+  GumAddress chunk = start;
+
+  while (end - chunk >= GUM_MALLOC_CHUNK_HEADER_SIZE)
+  {
+    gsize size_field, size;
+
+    size_field = GUM_MALLOC_CHUNK_SIZE_FIELD (chunk);
+    size = size_field & ~((gsize) GUM_MALLOC_SIZE_BITS);
+
+    if ((size_field & GUM_MALLOC_IS_MMAPPED) != 0 ||
+        size % GUM_MALLOC_CHUNK_HEADER_SIZE != 0)
+      return FALSE;
+
+    /* Fenceposts left behind when a thread arena's heap was shrunk. */
+    if (size == GUM_MALLOC_CHUNK_HEADER_SIZE)
+      return chunk != start && end - chunk <= 2 * GUM_MALLOC_MIN_CHUNK_SIZE;
+
+    if (size < GUM_MALLOC_MIN_CHUNK_SIZE || size > end - chunk)
+      return FALSE;
+
+    chunk += size;
+    if (chunk == end)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+#endif
+
+gint
+gum_thread_get_system_error (void)
+{
+  return errno;
+}
+
+void
+gum_thread_set_system_error (gint value)
+{
+  errno = value;
+}
+
+void
+gum_module_enumerate_imports (const gchar * module_name,
+                              GumFoundImportFunc func,
+                              gpointer user_data)
+{
+  GumElfModuleInfo * info;
+  GPtrArray * dependencies;
+  guint i;
+  gboolean carry_on;
+
+  info = gum_elf_module_info_obtain (module_name);
+  if (info == NULL)
+    return;
+
+  dependencies = gum_elf_module_info_get_dependencies (info);
+
+  carry_on = TRUE;
+  for (i = 0; i != info->imports->len && carry_on; i++)
+  {
+    const GumImportDetails * import;
+    const GumExportDetails * exp;
+    const GumElfModuleInfo * dependency;
+    GumImportDetails d;
+    gchar * module_path = NULL;
+
+    import = &g_array_index (info->imports, GumImportDetails, i);
+
+    d.type = import->type;
+    d.name = import->name;
+
+    exp = gum_find_dependency_export (dependencies, import->name, &dependency);
+    if (exp != NULL)
+    {
+      d.module = dependency->path;
+      d.address = exp->address;
+    }
+    else
+    {
+      d.address = GUM_ADDRESS (dlsym (RTLD_DEFAULT, import->name));
+      if (d.address != 0)
+        module_path = gum_elf_module_cache_find_module_path (d.address);
+      d.module = module_path;
+    }
+
+    carry_on = func (&d, user_data);
+
+    g_free (module_path);
+  }
+
+  g_ptr_array_unref (dependencies);
+  gum_elf_module_info_unref (info);
+}
+
+static const GumExportDetails *
+gum_find_dependency_export (GPtrArray * dependencies,
+                            const gchar * name,
+                            const GumElfModuleInfo ** module)
 {
-  g_free (export->module);
-  g_slice_free (GumDependencyExport, export);
+  guint i;
+
+  for (i = 0; i != dependencies->len; i++)
+  {
+    const GumElfModuleInfo * dependency;
+    const GumExportDetails * exp;
+
+    dependency = g_ptr_array_index (dependencies, i);
+
+    exp = g_hash_table_lookup (dependency->export_by_name, name);
+    if (exp != NULL)
+    {
+      *module = dependency;
+      return exp;
+    }
+  }
+
+  return NULL;
 }
 
 void
@@ -876,12 +1446,20 @@ gum_module_enumerate_exports (const gchar * module_name,
                               GumFoundExportFunc func,
                               gpointer user_data)
 {
-  GumElfModule module;
+  GumElfModuleInfo * info;
+  guint i;
 
-  if (!gum_elf_module_open (&module, module_name))
+  info = gum_elf_module_info_obtain (module_name);
+  if (info == NULL)
     return;
-  gum_elf_module_enumerate_exports (&module, func, user_data);
-  gum_elf_module_close (&module);
+
+  for (i = 0; i != info->exports->len; i++)
+  {
+    if (!func (&g_array_index (info->exports, GumExportDetails, i), user_data))
+      break;
+  }
+
+  gum_elf_module_info_unref (info);
 }
 
 void
@@ -937,232 +1515,669 @@ gum_module_find_export_by_name (const gchar * module_name,
                                 const gchar * symbol_name)
 {
   GumAddress result;
+  gchar * name;
+  GumAddress base;
+  GumElfLoadedModule loaded;
   void * module;
 
-  if (module_name != NULL)
-  {
-    gchar * name;
+  if (module_name == NULL)
+    return GUM_ADDRESS (dlsym (RTLD_DEFAULT, symbol_name));
+
+  name = gum_resolve_module_name (module_name, &base);
+  if (name == NULL)
+    return 0;
+
+  if (gum_elf_loaded_module_open (&loaded, base) &&
+      gum_elf_loaded_module_find_export (&loaded, symbol_name, &result))
+  {
+    g_free (name);
+    return result;
+  }
+
+  /*
+   * Symbols that need the dynamic linker's help, like IFUNCs, TLS, versioned
+   * symbols without a default version and those re-exported from one of the
+   * module's dependencies, are left to dlsym(). We only get here on a miss,
+   * and the module is already loaded, so it is not promoted to global scope.
+   */
+  module = dlopen (name, RTLD_LAZY | RTLD_NOLOAD);
+  g_free (name);
+  if (module == NULL)
+    return 0;
+
+  result = GUM_ADDRESS (dlsym (module, symbol_name));
+
+  dlclose (module);
+
+  return result;
+}
+
+GumCpuType
+gum_linux_cpu_type_from_file (const gchar * path,
+                              GError ** error)
+{
+  GumCpuType result = -1;
+  GFile * file;
+  GFileInputStream * base_stream;
+  GDataInputStream * stream = NULL;
+  GError * read_error;
+  guint16 e_machine;
+
+  file = g_file_new_for_path (path);
+
+  base_stream = g_file_read (file, NULL, error);
+  if (base_stream == NULL)
+    goto beach;
+
+  if (!g_seekable_seek (G_SEEKABLE (base_stream), 0x12, G_SEEK_SET, NULL,
+      error))
+    goto beach;
+
+  stream = g_data_input_stream_new (G_INPUT_STREAM (base_stream));
+  g_data_input_stream_set_byte_order (stream,
+      G_DATA_STREAM_BYTE_ORDER_LITTLE_ENDIAN);
+
+  read_error = NULL;
+  e_machine = g_data_input_stream_read_uint16 (stream, NULL, &read_error);
+  if (read_error != NULL)
+  {
+    g_propagate_error (error, read_error);
+    goto beach;
+  }
+
+  switch (e_machine)
+  {
+    case 0x0003:
+      result = GUM_CPU_IA32;
+      break;
+    case 0x003e:
+      result = GUM_CPU_AMD64;
+      break;
+    case 0x0028:
+      result = GUM_CPU_ARM;
+      break;
+    case 0x00b7:
+      result = GUM_CPU_ARM64;
+      break;
+    case 0x0008:
+      result = GUM_CPU_MIPS;
+      break;
+    default:
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+          "Unsupported executable");
+      break;
+  }
+
+beach:
+  if (stream != NULL)
+    g_object_unref (stream);
+
+  if (base_stream != NULL)
+    g_object_unref (base_stream);
+
+  g_object_unref (file);
+
+  return result;
+}
+
+GumCpuType
+gum_linux_cpu_type_from_pid (pid_t pid,
+                             GError ** error)
+{
+  GumCpuType result = -1;
+  gchar * auxv_path;
+  guint8 * auxv;
+  gsize auxv_size, i;
+
+  auxv_path = g_strdup_printf ("/proc/%d/auxv", pid);
+
+  if (!g_file_get_contents (auxv_path, (gchar **) &auxv, &auxv_size, error))
+    goto beach;
+
+#if defined (HAVE_I386)
+  result = GUM_CPU_AMD64;
+#elif defined (HAVE_ARM) || defined (HAVE_ARM64)
+  result = GUM_CPU_ARM64;
+#elif defined (HAVE_MIPS)
+  result = GUM_CPU_MIPS;
+#else
+# error Unsupported architecture
+#endif
+
+  for (i = 0; i < auxv_size; i += 16)
+  {
+    if (auxv[4] != 0 || auxv[5] != 0 ||
+        auxv[6] != 0 || auxv[7] != 0)
+    {
+#if defined (HAVE_I386)
+      result = GUM_CPU_IA32;
+#elif defined (HAVE_ARM) || defined (HAVE_ARM64)
+      result = GUM_CPU_ARM;
+#elif defined (HAVE_MIPS)
+      result = GUM_CPU_MIPS;
+#else
+# error Unsupported architecture
+#endif
+      break;
+    }
+  }
+
+beach:
+  g_free (auxv_path);
+
+  return result;
+}
+
+/*
+ * Looks up the path and base address of a loaded module without dlopen(),
+ * which would take the loader lock and could promote the module to global
+ * scope. The dynamic linker's list of loaded objects tells us where an
+ * object by that name lives, which also covers names of symlinks such as
+ * sonames, and the module map kept by the ELF module cache maps that back
+ * to the module. Modules unknown to the dynamic linker are matched by path.
+ */
+static gchar *
+gum_resolve_module_name (const gchar * name,
+                         GumAddress * base)
+{
+  GumAddress address;
+  gchar * path;
+
+  address = gum_find_loaded_object_address (name);
+
+  gum_elf_module_cache_ensure_initialized ();
+
+  g_mutex_lock (&gum_elf_module_cache_lock);
+  path = gum_elf_module_cache_resolve_unlocked (name, address, base);
+  g_mutex_unlock (&gum_elf_module_cache_lock);
+
+  return path;
+}
+
+static GumAddress
+gum_find_loaded_object_address (const gchar * name)
+{
+#ifdef HAVE_GLIBC
+  GumFindLoadedObjectContext ctx;
+
+  ctx.name = name;
+  ctx.address = 0;
+
+  dl_iterate_phdr (gum_store_loaded_object_address_if_name_matches, &ctx);
+
+  return ctx.address;
+#else
+  return 0;
+#endif
+}
+
+#ifdef HAVE_GLIBC
+
+static int
+gum_store_loaded_object_address_if_name_matches (struct dl_phdr_info * info,
+                                                 size_t size,
+                                                 void * data)
+{
+  GumFindLoadedObjectContext * ctx = data;
+  guint i;
+
+  if (info->dlpi_name == NULL || info->dlpi_name[0] == '\0')
+    return 0;
+  if (!gum_module_path_equals (info->dlpi_name, ctx->name))
+    return 0;
+
+  for (i = 0; i != info->dlpi_phnum; i++)
+  {
+    const ElfW(Phdr) * phdr = &info->dlpi_phdr[i];
+
+    if (phdr->p_type == PT_LOAD && phdr->p_offset == 0)
+    {
+      ctx->address = info->dlpi_addr + phdr->p_vaddr;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+#endif
+
+static gboolean
+gum_module_path_equals (const gchar * path,
+                        const gchar * name_or_path)
+{
+  gchar * s;
+
+  if (name_or_path[0] == '/')
+    return strcmp (name_or_path, path) == 0;
+
+  if ((s = strrchr (path, '/')) != NULL)
+    return strcmp (name_or_path, s + 1) == 0;
+
+  return strcmp (name_or_path, path) == 0;
+}
+
+/*
+ * Parsing a module's dynamic symbol table means mapping the whole file and
+ * walking every symbol, and import enumeration has to do that for each of
+ * its dependencies as well. We therefore keep the parsed metadata around,
+ * keyed by path, and only throw it away once the file on disk or the address
+ * it is loaded at changes.
+ */
+static void
+gum_elf_module_cache_ensure_initialized (void)
+{
+  static GOnce init_once = G_ONCE_INIT;
+
+  g_once (&init_once, gum_elf_module_cache_do_init, NULL);
+}
+
+static gpointer
+gum_elf_module_cache_do_init (gpointer data)
+{
+  gum_elf_module_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+      NULL, (GDestroyNotify) gum_elf_module_info_unref);
+  gum_elf_module_cache_by_name = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, (GDestroyNotify) gum_elf_module_info_unref);
+
+  _gum_register_destructor (gum_elf_module_cache_do_deinit);
+
+  return NULL;
+}
+
+static void
+gum_elf_module_cache_do_deinit (void)
+{
+  g_clear_object (&gum_elf_module_cache_map);
+
+  g_hash_table_unref (gum_elf_module_cache_by_name);
+  gum_elf_module_cache_by_name = NULL;
+
+  g_hash_table_unref (gum_elf_module_cache);
+  gum_elf_module_cache = NULL;
+}
+
+static void
+gum_elf_module_cache_refresh_unlocked (void)
+{
+  gboolean changed;
+
+  if (gum_elf_module_cache_map == NULL)
+  {
+    gum_elf_module_cache_map = gum_module_map_new ();
+    changed = TRUE;
+  }
+  else
+  {
+    changed = gum_module_map_refresh (gum_elf_module_cache_map);
+  }
+
+  if (changed)
+    gum_elf_module_cache_generation++;
+}
+
+static gchar *
+gum_elf_module_cache_find_module_path (GumAddress address)
+{
+  gchar * path = NULL;
+  const GumModuleDetails * details;
+
+  g_mutex_lock (&gum_elf_module_cache_lock);
+
+  details = gum_module_map_find (gum_elf_module_cache_map, address);
+  if (details != NULL)
+    path = g_strdup (details->path);
+
+  g_mutex_unlock (&gum_elf_module_cache_lock);
+
+  return path;
+}
+
+/*
+ * Only re-reads /proc/self/maps if the dynamic linker has loaded or unloaded
+ * something since last time. Takes the address of the module if known.
+ */
+static gchar *
+gum_elf_module_cache_resolve_unlocked (const gchar * name,
+                                       GumAddress address,
+                                       GumAddress * base)
+{
+  const GumModuleDetails * details = NULL;
+
+  gum_elf_module_cache_refresh_unlocked ();
+
+  if (address != 0)
+    details = gum_module_map_find (gum_elf_module_cache_map, address);
+
+  if (details == NULL)
+  {
+    GArray * modules;
+    guint i;
+
+    modules = gum_module_map_get_values (gum_elf_module_cache_map);
+    for (i = 0; i != modules->len && details == NULL; i++)
+    {
+      const GumModuleDetails * d =
+          &g_array_index (modules, GumModuleDetails, i);
+
+      if (gum_module_path_equals (d->path, name))
+        details = d;
+    }
+  }
+
+  if (details == NULL)
+  {
+    if (base != NULL)
+      *base = 0;
+    return NULL;
+  }
+
+  if (base != NULL)
+    *base = details->range->base_address;
+
+  return g_strdup (details->path);
+}
+
+/*
+ * Only the hash table lookups happen under the cache lock. Locating the
+ * module through the dynamic linker, stat()ing it and parsing it are all done
+ * without holding it, and an entry found by name is trusted without a stat()
+ * for as long as nothing has been loaded or unloaded since it was validated.
+ */
+static GumElfModuleInfo *
+gum_elf_module_info_obtain (const gchar * module_name)
+{
+  GumElfModuleInfo * info;
+  GumAddress address, base;
+  gchar * path;
+  struct stat st;
+  GumElfModule module;
+
+  gum_elf_module_cache_ensure_initialized ();
+
+  address = gum_find_loaded_object_address (module_name);
+
+  g_mutex_lock (&gum_elf_module_cache_lock);
+
+  gum_elf_module_cache_refresh_unlocked ();
+
+  info = g_hash_table_lookup (gum_elf_module_cache_by_name, module_name);
+  if (info != NULL && info->generation == gum_elf_module_cache_generation &&
+      gum_elf_module_info_is_loaded_at (info, address))
+  {
+    gum_elf_module_info_ref (info);
+    g_mutex_unlock (&gum_elf_module_cache_lock);
+    return info;
+  }
+
+  path = gum_elf_module_cache_resolve_unlocked (module_name, address, &base);
+
+  g_mutex_unlock (&gum_elf_module_cache_lock);
+
+  if (path == NULL)
+    return NULL;
+
+  info = NULL;
+
+  if (stat (path, &st) != 0)
+    goto beach;
+
+  g_mutex_lock (&gum_elf_module_cache_lock);
+  info = g_hash_table_lookup (gum_elf_module_cache, path);
+  if (info != NULL && gum_elf_module_info_is_current (info, base, &st))
+  {
+    info->generation = gum_elf_module_cache_generation;
+    g_hash_table_replace (gum_elf_module_cache_by_name,
+        g_strdup (module_name), gum_elf_module_info_ref (info));
+    gum_elf_module_info_ref (info);
+  }
+  else
+  {
+    info = NULL;
+  }
+  g_mutex_unlock (&gum_elf_module_cache_lock);
+
+  if (info != NULL)
+    goto beach;
+
+  if (!gum_elf_module_open (&module, path, base))
+    goto beach;
+  info = gum_elf_module_info_new (&module);
+  gum_elf_module_close (&module);
+
+  g_mutex_lock (&gum_elf_module_cache_lock);
+  info->generation = gum_elf_module_cache_generation;
+  g_hash_table_replace (gum_elf_module_cache, info->path,
+      gum_elf_module_info_ref (info));
+  g_hash_table_replace (gum_elf_module_cache_by_name, g_strdup (module_name),
+      gum_elf_module_info_ref (info));
+  g_mutex_unlock (&gum_elf_module_cache_lock);
+
+beach:
+  g_free (path);
+
+  return info;
+}
+
+static GumElfModuleInfo *
+gum_elf_module_info_new (GumElfModule * module)
+{
+  GumElfModuleInfo * info;
+  struct stat st;
+  guint i;
+
+  info = g_slice_new (GumElfModuleInfo);
+  info->ref_count = 1;
+
+  info->path = g_strdup (module->path);
+  info->base_address = GUM_ADDRESS (module->address);
+  if (fstat (module->fd, &st) == 0)
+  {
+    info->device = st.st_dev;
+    info->inode = st.st_ino;
+    info->size = st.st_size;
+    info->mtime = st.st_mtime;
+  }
+  else
+  {
+    info->device = 0;
+    info->inode = 0;
+    info->size = -1;
+    info->mtime = 0;
+  }
+
+  info->strings = g_string_chunk_new (4096);
+  info->imports = g_array_new (FALSE, FALSE, sizeof (GumImportDetails));
+  info->exports = g_array_new (FALSE, FALSE, sizeof (GumExportDetails));
+  info->dependency_names = g_ptr_array_new ();
 
-    name = gum_resolve_module_name (module_name, NULL);
-    if (name == NULL)
-      return 0;
-    module = dlopen (name, RTLD_LAZY | RTLD_GLOBAL);
-    g_free (name);
+  gum_elf_module_enumerate_imports (module, gum_collect_elf_import, info);
+  gum_elf_module_enumerate_exports (module, gum_collect_elf_export, info);
+  gum_elf_module_enumerate_dependencies (module, gum_collect_elf_dependency,
+      info);
 
-    if (module == NULL)
-      return 0;
-  }
-  else
+  info->export_by_name = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; i != info->exports->len; i++)
   {
-    module = RTLD_DEFAULT;
+    GumExportDetails * d = &g_array_index (info->exports, GumExportDetails, i);
+
+    g_hash_table_insert (info->export_by_name, (gpointer) d->name, d);
   }
 
-  result = GUM_ADDRESS (dlsym (module, symbol_name));
+  info->generation = 0;
 
-  if (module != RTLD_DEFAULT)
-    dlclose (module);
+  info->dependencies = NULL;
+  info->dependencies_generation = 0;
 
-  return result;
+  return info;
 }
 
-GumCpuType
-gum_linux_cpu_type_from_file (const gchar * path,
-                              GError ** error)
+static GumElfModuleInfo *
+gum_elf_module_info_ref (GumElfModuleInfo * info)
 {
-  GumCpuType result = -1;
-  GFile * file;
-  GFileInputStream * base_stream;
-  GDataInputStream * stream = NULL;
-  GError * read_error;
-  guint16 e_machine;
+  g_atomic_int_inc (&info->ref_count);
 
-  file = g_file_new_for_path (path);
+  return info;
+}
 
-  base_stream = g_file_read (file, NULL, error);
-  if (base_stream == NULL)
-    goto beach;
+static void
+gum_elf_module_info_unref (GumElfModuleInfo * info)
+{
+  if (!g_atomic_int_dec_and_test (&info->ref_count))
+    return;
 
-  if (!g_seekable_seek (G_SEEKABLE (base_stream), 0x12, G_SEEK_SET, NULL,
-      error))
-    goto beach;
+  if (info->dependencies != NULL)
+    g_ptr_array_unref (info->dependencies);
 
-  stream = g_data_input_stream_new (G_INPUT_STREAM (base_stream));
-  g_data_input_stream_set_byte_order (stream,
-      G_DATA_STREAM_BYTE_ORDER_LITTLE_ENDIAN);
+  g_ptr_array_unref (info->dependency_names);
+  g_hash_table_unref (info->export_by_name);
+  g_array_free (info->exports, TRUE);
+  g_array_free (info->imports, TRUE);
+  g_string_chunk_free (info->strings);
 
-  read_error = NULL;
-  e_machine = g_data_input_stream_read_uint16 (stream, NULL, &read_error);
-  if (read_error != NULL)
-  {
-    g_propagate_error (error, read_error);
-    goto beach;
-  }
+  g_free (info->path);
 
-  switch (e_machine)
-  {
-    case 0x0003:
-      result = GUM_CPU_IA32;
-      break;
-    case 0x003e:
-      result = GUM_CPU_AMD64;
-      break;
-    case 0x0028:
-      result = GUM_CPU_ARM;
-      break;
-    case 0x00b7:
-      result = GUM_CPU_ARM64;
-      break;
-    case 0x0008:
-      result = GUM_CPU_MIPS;
-      break;
-    default:
-      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
-          "Unsupported executable");
-      break;
-  }
+  g_slice_free (GumElfModuleInfo, info);
+}
 
-beach:
-  if (stream != NULL)
-    g_object_unref (stream);
+static gboolean
+gum_elf_module_info_is_current (GumElfModuleInfo * self,
+                                GumAddress base_address,
+                                const struct stat * st)
+{
+  return self->base_address == base_address &&
+      self->device == st->st_dev &&
+      self->inode == st->st_ino &&
+      self->size == st->st_size &&
+      self->mtime == st->st_mtime;
+}
 
-  if (base_stream != NULL)
-    g_object_unref (base_stream);
+static gboolean
+gum_elf_module_info_is_loaded_at (GumElfModuleInfo * self,
+                                  GumAddress address)
+{
+  const GumModuleDetails * details;
 
-  g_object_unref (file);
+  if (address == 0)
+    return TRUE;
 
-  return result;
+  details = gum_module_map_find (gum_elf_module_cache_map, address);
+
+  return details != NULL &&
+      details->range->base_address == self->base_address;
 }
 
-GumCpuType
-gum_linux_cpu_type_from_pid (pid_t pid,
-                             GError ** error)
+/*
+ * Returns the loaded DT_NEEDED dependencies in lookup order. The list is
+ * kept until the dynamic linker reports that something was loaded or
+ * unloaded, so in the common case this does not touch /proc at all.
+ */
+static GPtrArray *
+gum_elf_module_info_get_dependencies (GumElfModuleInfo * self)
 {
-  GumCpuType result = -1;
-  gchar * auxv_path;
-  guint8 * auxv;
-  gsize auxv_size, i;
-
-  auxv_path = g_strdup_printf ("/proc/%d/auxv", pid);
+  GPtrArray * dependencies;
+  guint generation, i;
 
-  if (!g_file_get_contents (auxv_path, (gchar **) &auxv, &auxv_size, error))
-    goto beach;
+  g_mutex_lock (&gum_elf_module_cache_lock);
 
-#if defined (HAVE_I386)
-  result = GUM_CPU_AMD64;
-#elif defined (HAVE_ARM) || defined (HAVE_ARM64)
-  result = GUM_CPU_ARM64;
-#elif defined (HAVE_MIPS)
-  result = GUM_CPU_MIPS;
-#else
-# error Unsupported architecture
-#endif
+  gum_elf_module_cache_refresh_unlocked ();
 
-  for (i = 0; i < auxv_size; i += 16)
+  if (self->dependencies != NULL &&
+      self->dependencies_generation == gum_elf_module_cache_generation)
   {
-    if (auxv[4] != 0 || auxv[5] != 0 ||
-        auxv[6] != 0 || auxv[7] != 0)
-    {
-#if defined (HAVE_I386)
-      result = GUM_CPU_IA32;
-#elif defined (HAVE_ARM) || defined (HAVE_ARM64)
-      result = GUM_CPU_ARM;
-#elif defined (HAVE_MIPS)
-      result = GUM_CPU_MIPS;
-#else
-# error Unsupported architecture
-#endif
-      break;
-    }
+    dependencies = g_ptr_array_ref (self->dependencies);
+    g_mutex_unlock (&gum_elf_module_cache_lock);
+    return dependencies;
   }
 
-beach:
-  g_free (auxv_path);
-
-  return result;
-}
+  generation = gum_elf_module_cache_generation;
 
-static gchar *
-gum_resolve_module_name (const gchar * name,
-                         GumAddress * base)
-{
-  GumResolveModuleNameContext ctx;
+  g_mutex_unlock (&gum_elf_module_cache_lock);
 
-#if defined (HAVE_GLIBC)
-  struct link_map * map;
+  dependencies = g_ptr_array_new_full (self->dependency_names->len,
+      (GDestroyNotify) gum_elf_module_info_unref);
 
-  map = dlopen (name, RTLD_LAZY | RTLD_GLOBAL | RTLD_NOLOAD);
-  if (map != NULL)
+  for (i = 0; i != self->dependency_names->len; i++)
   {
-    ctx.name = g_file_read_link (map->l_name, NULL);
-    if (ctx.name == NULL)
-      ctx.name = g_strdup (map->l_name);
-    dlclose (map);
+    GumElfModuleInfo * dependency;
+
+    dependency = gum_elf_module_info_obtain (
+        g_ptr_array_index (self->dependency_names, i));
+    if (dependency != NULL)
+      g_ptr_array_add (dependencies, dependency);
   }
-  else
-#endif
-    ctx.name = g_strdup (name);
-  ctx.path = NULL;
-  ctx.base = 0;
 
-  gum_process_enumerate_modules (gum_store_module_path_and_base_if_name_matches,
-      &ctx);
+  g_mutex_lock (&gum_elf_module_cache_lock);
 
-  g_free (ctx.name);
+  if (self->dependencies != NULL)
+    g_ptr_array_unref (self->dependencies);
+  self->dependencies = g_ptr_array_ref (dependencies);
+  self->dependencies_generation = generation;
 
-  if (base != NULL)
-    *base = ctx.base;
+  g_mutex_unlock (&gum_elf_module_cache_lock);
 
-  return ctx.path;
+  return dependencies;
 }
 
 static gboolean
-gum_store_module_path_and_base_if_name_matches (const GumModuleDetails * details,
-                                                gpointer user_data)
+gum_collect_elf_import (const GumImportDetails * details,
+                        gpointer user_data)
 {
-  GumResolveModuleNameContext * ctx = user_data;
+  GumElfModuleInfo * info = user_data;
+  GumImportDetails d;
 
-  if (gum_module_path_equals (details->path, ctx->name))
-  {
-    ctx->path = g_strdup (details->path);
-    ctx->base = details->range->base_address;
-    return FALSE;
-  }
+  d.type = details->type;
+  d.name = g_string_chunk_insert (info->strings, details->name);
+  d.module = NULL;
+  d.address = 0;
+
+  g_array_append_val (info->imports, d);
 
   return TRUE;
 }
 
 static gboolean
-gum_module_path_equals (const gchar * path,
-                        const gchar * name_or_path)
+gum_collect_elf_export (const GumExportDetails * details,
+                        gpointer user_data)
 {
-  gchar * s;
+  GumElfModuleInfo * info = user_data;
+  GumExportDetails d;
 
-  if (name_or_path[0] == '/')
-    return strcmp (name_or_path, path) == 0;
+  d.type = details->type;
+  d.name = g_string_chunk_insert (info->strings, details->name);
+  d.address = details->address;
 
-  if ((s = strrchr (path, '/')) != NULL)
-    return strcmp (name_or_path, s + 1) == 0;
+  g_array_append_val (info->exports, d);
 
-  return strcmp (name_or_path, path) == 0;
+  return TRUE;
+}
+
+static gboolean
+gum_collect_elf_dependency (const GumElfDependencyDetails * details,
+                            gpointer user_data)
+{
+  GumElfModuleInfo * info = user_data;
+
+  g_ptr_array_add (info->dependency_names,
+      g_string_chunk_insert (info->strings, details->name));
+
+  return TRUE;
 }
 
 static gboolean
 gum_elf_module_open (GumElfModule * module,
-                     const gchar * module_name)
+                     const gchar * path,
+                     GumAddress base_address)
 {
   gboolean success = FALSE;
-  GumAddress base;
   guint type;
 
   module->fd = -1;
   module->file_size = 0;
   module->data = NULL;
   module->ehdr = NULL;
-  module->address = 0;
-  module->path = gum_resolve_module_name (module_name, &base);
-  if (module->path == NULL)
-    goto beach;
-  module->address = GSIZE_TO_POINTER (base);
+  module->path = g_strdup (path);
+  module->address = GSIZE_TO_POINTER (base_address);
 
   module->fd = open (module->path, O_RDONLY);
   if (module->fd == -1)
@@ -1385,6 +2400,265 @@ gum_elf_module_find_section_header (GumElfModule * self,
   return NULL;
 }
 
+/*
+ * Looks up symbols directly in the hash tables of an already loaded module,
+ * without involving the dynamic linker. We only read memory that the loader
+ * has already mapped, so this neither takes any locks nor has side-effects.
+ */
+static gboolean
+gum_elf_loaded_module_open (GumElfLoadedModule * module,
+                            GumAddress base_address)
+{
+  const GumElfEHeader * ehdr = GSIZE_TO_POINTER (base_address);
+  GumAddress preferred_address = 0;
+  GumAddress dynamic_address = 0;
+  guint32 dynamic_flags = 0;
+  GumAddress value_bias;
+  const GumElfDynamic * dyn;
+  guint i;
+
+  module->symtab = NULL;
+  module->strtab = NULL;
+  module->gnu_hash = NULL;
+  module->sysv_hash = NULL;
+  module->versym = NULL;
+
+  for (i = 0; i != ehdr->e_phnum; i++)
+  {
+    const GumElfPHeader * phdr;
+
+    phdr = GSIZE_TO_POINTER (base_address + ehdr->e_phoff +
+        (i * ehdr->e_phentsize));
+    if (phdr->p_type == PT_LOAD && phdr->p_offset == 0)
+      preferred_address = phdr->p_vaddr;
+    else if (phdr->p_type == PT_DYNAMIC)
+    {
+      dynamic_address = phdr->p_vaddr;
+      dynamic_flags = phdr->p_flags;
+    }
+  }
+  if (dynamic_address == 0)
+    return FALSE;
+
+  module->bias = base_address - preferred_address;
+  dyn = GSIZE_TO_POINTER (module->bias + dynamic_address);
+
+  /*
+   * Executables are linked at their final address. Shared objects are not,
+   * and glibc relocates their dynamic section in place, unless it is mapped
+   * read-only or the architecture keeps it that way. Other loaders leave it
+   * alone.
+   */
+  switch (ehdr->e_type)
+  {
+    case ET_EXEC:
+      value_bias = 0;
+      break;
+    case ET_DYN:
+#if defined (HAVE_GLIBC) && !defined (HAVE_MIPS)
+      value_bias = ((dynamic_flags & PF_W) != 0) ? 0 : module->bias;
+#else
+      value_bias = module->bias;
+#endif
+      break;
+    default:
+      return FALSE;
+  }
+
+  for (; dyn->d_tag != DT_NULL; dyn++)
+  {
+    GumAddress value = value_bias + dyn->d_un.d_ptr;
+
+    switch (dyn->d_tag)
+    {
+      case DT_SYMTAB:
+        module->symtab = GSIZE_TO_POINTER (value);
+        break;
+      case DT_STRTAB:
+        module->strtab = GSIZE_TO_POINTER (value);
+        break;
+      case DT_GNU_HASH:
+        module->gnu_hash = GSIZE_TO_POINTER (value);
+        break;
+      case DT_HASH:
+        module->sysv_hash = GSIZE_TO_POINTER (value);
+        break;
+      case DT_VERSYM:
+        module->versym = GSIZE_TO_POINTER (value);
+        break;
+      default:
+        break;
+    }
+  }
+
+  return module->symtab != NULL && module->strtab != NULL &&
+      (module->gnu_hash != NULL || module->sysv_hash != NULL);
+}
+
+/*
+ * Returns FALSE if the answer is better left to the dynamic linker, which
+ * includes names that the module does not define itself, as dlsym() also
+ * looks in its dependencies.
+ */
+static gboolean
+gum_elf_loaded_module_find_export (GumElfLoadedModule * self,
+                                   const gchar * name,
+                                   GumAddress * address)
+{
+  const GumElfSymbol * sym;
+  GumElfSymbolType type;
+
+  if (self->gnu_hash != NULL)
+    sym = gum_elf_loaded_module_gnu_lookup (self, name);
+  else
+    sym = gum_elf_loaded_module_sysv_lookup (self, name);
+  if (sym == NULL)
+    return FALSE;
+
+  type = GUM_ELF_ST_TYPE (sym->st_info);
+  if (type == STT_GNU_IFUNC || type == STT_TLS)
+    return FALSE;
+
+  *address = self->bias + sym->st_value;
+  return TRUE;
+}
+
+static const GumElfSymbol *
+gum_elf_loaded_module_gnu_lookup (GumElfLoadedModule * self,
+                                  const gchar * name)
+{
+  const guint32 * table = self->gnu_hash;
+  guint32 n_buckets, symbol_offset, bloom_size, bloom_shift;
+  const GumElfAddr * bloom;
+  const guint32 * buckets, * chain;
+  guint32 hash, index;
+  GumElfAddr word, mask;
+  const guint bits_per_word = sizeof (GumElfAddr) * 8;
+
+  n_buckets = table[0];
+  symbol_offset = table[1];
+  bloom_size = table[2];
+  bloom_shift = table[3];
+  bloom = (const GumElfAddr *) &table[4];
+  buckets = (const guint32 *) &bloom[bloom_size];
+  chain = &buckets[n_buckets];
+
+  if (n_buckets == 0 || bloom_size == 0)
+    return NULL;
+
+  hash = gum_elf_gnu_hash (name);
+
+  word = bloom[(hash / bits_per_word) % bloom_size];
+  mask = ((GumElfAddr) 1 << (hash % bits_per_word)) |
+      ((GumElfAddr) 1 << ((hash >> bloom_shift) % bits_per_word));
+  if ((word & mask) != mask)
+    return NULL;
+
+  index = buckets[hash % n_buckets];
+  if (index < symbol_offset)
+    return NULL;
+
+  while (TRUE)
+  {
+    guint32 chain_hash = chain[index - symbol_offset];
+
+    if ((hash | 1) == (chain_hash | 1) &&
+        gum_elf_loaded_module_symbol_matches (self, index, name))
+      return &self->symtab[index];
+
+    if ((chain_hash & 1) != 0)
+      break;
+
+    index++;
+  }
+
+  return NULL;
+}
+
+static const GumElfSymbol *
+gum_elf_loaded_module_sysv_lookup (GumElfLoadedModule * self,
+                                   const gchar * name)
+{
+  const guint32 * table = self->sysv_hash;
+  guint32 n_buckets;
+  const guint32 * buckets, * chain;
+  guint32 index;
+
+  n_buckets = table[0];
+  buckets = &table[2];
+  chain = &buckets[n_buckets];
+
+  if (n_buckets == 0)
+    return NULL;
+
+  for (index = buckets[gum_elf_sysv_hash (name) % n_buckets];
+      index != STN_UNDEF;
+      index = chain[index])
+  {
+    if (gum_elf_loaded_module_symbol_matches (self, index, name))
+      return &self->symtab[index];
+  }
+
+  return NULL;
+}
+
+static gboolean
+gum_elf_loaded_module_symbol_matches (GumElfLoadedModule * self,
+                                      guint index,
+                                      const gchar * name)
+{
+  const GumElfSymbol * sym = &self->symtab[index];
+  GumElfSymbolBind bind;
+
+  if (sym->st_shndx == SHN_UNDEF)
+    return FALSE;
+
+  bind = GUM_ELF_ST_BIND (sym->st_info);
+  if (bind != STB_GLOBAL && bind != STB_WEAK)
+    return FALSE;
+
+  if (strcmp (self->strtab + sym->st_name, name) != 0)
+    return FALSE;
+
+  if (self->versym != NULL &&
+      (self->versym[index] & GUM_ELF_VERSYM_HIDDEN) != 0)
+    return FALSE;
+
+  return TRUE;
+}
+
+static guint32
+gum_elf_gnu_hash (const gchar * name)
+{
+  guint32 hash = 5381;
+  const guint8 * p;
+
+  for (p = (const guint8 *) name; *p != '\0'; p++)
+    hash = (hash << 5) + hash + *p;
+
+  return hash;
+}
+
+static guint32
+gum_elf_sysv_hash (const gchar * name)
+{
+  guint32 hash = 0;
+  const guint8 * p;
+
+  for (p = (const guint8 *) name; *p != '\0'; p++)
+  {
+    guint32 high;
+
+    hash = (hash << 4) + *p;
+    high = hash & 0xf0000000;
+    if (high != 0)
+      hash ^= high >> 24;
+    hash &= ~high;
+  }
+
+  return hash;
+}
+
 void
 gum_linux_parse_ucontext (const ucontext_t * uc,
                           GumCpuContext * ctx)
@@ -1858,28 +3132,39 @@ gum_unparse_regs (const GumCpuContext * ctx,
 #endif
 }
 
+/*
+ * Also used while other threads are ptrace-stopped, where one of them may be
+ * holding the allocator lock, so this must not allocate.
+ */
 static gboolean
 gum_thread_read_state (GumThreadId tid,
                        GumThreadState * state)
 {
-  gboolean success = FALSE;
-  gchar * path, * info = NULL;
+  gchar path[64], info[256];
+  gint fd;
+  gssize n;
+  const gchar * p;
 
-  path = g_strdup_printf ("/proc/self/task/%" G_GSIZE_FORMAT "/stat", tid);
-  if (g_file_get_contents (path, &info, NULL, NULL))
-  {
-    gchar * p;
+  g_snprintf (path, sizeof (path), "/proc/self/task/%" G_GSIZE_FORMAT "/stat",
+      tid);
 
-    p = strrchr (info, ')') + 2;
+  fd = open (path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return FALSE;
+  n = GUM_TEMP_FAILURE_RETRY (read (fd, info, sizeof (info) - 1));
+  close (fd);
+  if (n <= 0)
+    return FALSE;
+  info[n] = '\0';
 
-    *state = gum_thread_state_from_proc_status_character (*p);
-    success = TRUE;
-  }
+  /* pid (comm) state ... */
+  p = strrchr (info, ')');
+  if (p == NULL || p[1] != ' ' || p[2] == '\0')
+    return FALSE;
 
-  g_free (info);
-  g_free (path);
+  *state = gum_thread_state_from_proc_status_character (p[2]);
 
-  return success;
+  return TRUE;
 }
 
 static GumThreadState
@@ -228,6 +228,16 @@ gum_code_allocator_commit (GumCodeAllocator * self)
   }
 }
 
+gboolean
+gum_code_allocator_has_pending_commit (GumCodeAllocator * self)
+{
+  if (self->uncommitted_pages != NULL ||
+      g_hash_table_size (self->dirty_pages) != 0)
+    return TRUE;
+
+  return !gum_query_is_rwx_supported () && self->free_slices != NULL;
+}
+
 static GumCodeSlice *
 gum_code_allocator_try_alloc_batch_near (GumCodeAllocator * self,
                                          const GumAddressSpec * spec)
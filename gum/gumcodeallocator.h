@@ -47,6 +47,7 @@ GumCodeSlice * gum_code_allocator_alloc_slice (GumCodeAllocator * self);
 GumCodeSlice * gum_code_allocator_try_alloc_slice_near (GumCodeAllocator * self,
     const GumAddressSpec * spec, gsize alignment);
 void gum_code_allocator_commit (GumCodeAllocator * self);
+gboolean gum_code_allocator_has_pending_commit (GumCodeAllocator * self);
 void gum_code_slice_free (GumCodeSlice * slice);
 
 GumCodeDeflector * gum_code_allocator_alloc_deflector (GumCodeAllocator * self,
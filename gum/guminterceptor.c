@@ -556,6 +556,24 @@ gum_interceptor_flush (GumInterceptor * self)
   return flushed;
 }
 
+gboolean
+gum_interceptor_has_pending_changes (GumInterceptor * self)
+{
+  GumInterceptorPrivate * priv = self->priv;
+  GumInterceptorTransaction * transaction = &priv->current_transaction;
+  gboolean has_changes;
+
+  GUM_INTERCEPTOR_LOCK ();
+
+  has_changes = !g_queue_is_empty (transaction->pending_destroy_tasks) ||
+      g_hash_table_size (transaction->pending_prologue_writes) != 0 ||
+      gum_code_allocator_has_pending_commit (&priv->allocator);
+
+  GUM_INTERCEPTOR_UNLOCK ();
+
+  return has_changes;
+}
+
 GumInvocationContext *
 gum_interceptor_get_current_invocation (void)
 {
@@ -8,6 +8,7 @@
 #define __GUM_MEMORY_PRIV_H__
 
 #include <gum/gumdefs.h>
+#include <gum/gumprocess.h>
 
 typedef struct _GumMatchToken GumMatchToken;
 typedef enum _GumMatchType GumMatchType;
@@ -16,23 +17,32 @@ struct _GumMatchPattern
 {
   GPtrArray * tokens;
   guint size;
+
+  guint8 * bytes;
+  guint8 * masks;
+  GumMatchToken * anchor;
+  guint * anchor_skips;
 };
 
 enum _GumMatchType
 {
   GUM_MATCH_EXACT,
-  GUM_MATCH_WILDCARD
+  GUM_MATCH_WILDCARD,
+  GUM_MATCH_MASK
 };
 
 struct _GumMatchToken
 {
   GumMatchType type;
   GArray * bytes;
+  GArray * masks;
   guint offset;
 };
 
 G_GNUC_INTERNAL guint _gum_memory_backend_query_page_size (void);
 G_GNUC_INTERNAL gint _gum_page_protection_to_posix (
     GumPageProtection page_prot);
+G_GNUC_INTERNAL void _gum_memory_enumerate_private_malloc_ranges (
+    GumFoundMallocRangeFunc func, gpointer user_data);
 
 #endif
@@ -39,12 +39,16 @@
 # pragma warning (pop)
 #endif
 
+#define GUM_MATCH_ANCHOR_SKIPS_MIN_SIZE 4
+
 static GumMatchPattern * gum_match_pattern_new (void);
 static void gum_match_pattern_update_computed_size (GumMatchPattern * self);
 static GumMatchToken * gum_match_pattern_get_longest_token (
     const GumMatchPattern * self, GumMatchType type);
+static const guint8 * gum_match_pattern_find_anchor (
+    const GumMatchPattern * self, const guint8 * cur, const guint8 * last);
 static gboolean gum_match_pattern_try_match_on (const GumMatchPattern * self,
-    guint8 * bytes);
+    const guint8 * bytes);
 static GumMatchToken * gum_match_pattern_push_token (GumMatchPattern * self,
     GumMatchType type);
 static gboolean gum_match_pattern_seal (GumMatchPattern * self);
@@ -52,6 +56,11 @@ static gboolean gum_match_pattern_seal (GumMatchPattern * self);
 static GumMatchToken * gum_match_token_new (GumMatchType type);
 static void gum_match_token_free (GumMatchToken * token);
 static void gum_match_token_append (GumMatchToken * self, guint8 byte);
+static void gum_match_token_append_masked (GumMatchToken * self, guint8 byte,
+    guint8 mask);
+
+static gsize gum_mspace_collect_inuse_chunks (mstate m,
+    GumMemoryRange * ranges, gsize capacity);
 
 static mspace gum_mspace = NULL;
 static guint gum_cached_page_size;
@@ -152,37 +161,122 @@ gum_memory_scan (const GumMemoryRange * range,
                  GumMemoryScanMatchFunc func,
                  gpointer user_data)
 {
-  GumMatchToken * needle;
-  guint8 * needle_data;
-  guint needle_len;
-  guint8 * cur, * end_address;
+  const guint8 * start, * cur, * last;
+  guint anchor_offset;
 
-  needle = gum_match_pattern_get_longest_token (pattern, GUM_MATCH_EXACT);
-  needle_data = (guint8 *) needle->bytes->data;
-  needle_len = needle->bytes->len;
+  if (range->size < pattern->size)
+    return;
 
-  cur = GSIZE_TO_POINTER (range->base_address);
-  end_address = cur + range->size - (pattern->size - needle->offset) + 1;
+  anchor_offset = (pattern->anchor != NULL) ? pattern->anchor->offset : 0;
 
-  for (; cur < end_address; cur++)
+  start = GSIZE_TO_POINTER (range->base_address);
+  cur = start + anchor_offset;
+  last = start + range->size - pattern->size + anchor_offset;
+
+  while (cur <= last)
   {
-    guint8 * start;
+    const guint8 * match;
 
-    if (cur[0] != needle_data[0] || memcmp (cur, needle_data, needle_len) != 0)
-      continue;
+    cur = gum_match_pattern_find_anchor (pattern, cur, last);
+    if (cur == NULL)
+      return;
 
-    start = cur - needle->offset;
+    match = cur - anchor_offset;
 
-    if (gum_match_pattern_try_match_on (pattern, start))
+    if (gum_match_pattern_try_match_on (pattern, match))
     {
-      if (!func (GUM_ADDRESS (start), pattern->size, user_data))
+      if (!func (GUM_ADDRESS (match), pattern->size, user_data))
         return;
 
-      cur = start + pattern->size - 1;
+      cur = match + pattern->size + anchor_offset;
+    }
+    else
+    {
+      cur++;
     }
   }
 }
 
+/*
+ * Scans the range once for all of the given patterns, dispatching on each
+ * byte through a table of the patterns whose first byte it could be. Every
+ * pattern's matches are non-overlapping, just like with gum_memory_scan(),
+ * and all matches are reported in order of address.
+ */
+void
+gum_memory_scan_multi (const GumMemoryRange * range,
+                       const GumMatchPattern * const * patterns,
+                       guint n_patterns,
+                       GumMemoryScanMultiMatchFunc func,
+                       gpointer user_data)
+{
+  guint first_candidate[256 + 1];
+  GArray * candidates;
+  const guint8 ** resume_at;
+  const guint8 * start, * end, * cur;
+  guint i;
+
+  if (n_patterns == 0)
+    return;
+
+  candidates = g_array_new (FALSE, FALSE, sizeof (guint));
+  for (i = 0; i != 256; i++)
+  {
+    guint pattern_index;
+
+    first_candidate[i] = candidates->len;
+
+    for (pattern_index = 0; pattern_index != n_patterns; pattern_index++)
+    {
+      const GumMatchPattern * pattern = patterns[pattern_index];
+
+      if ((i & pattern->masks[0]) == pattern->bytes[0])
+        g_array_append_val (candidates, pattern_index);
+    }
+  }
+  first_candidate[256] = candidates->len;
+
+  start = GSIZE_TO_POINTER (range->base_address);
+  end = start + range->size;
+
+  resume_at = g_new (const guint8 *, n_patterns);
+  for (i = 0; i != n_patterns; i++)
+    resume_at[i] = start;
+
+  for (cur = start; cur != end; cur++)
+  {
+    guint candidate, last_candidate;
+
+    candidate = first_candidate[cur[0]];
+    last_candidate = first_candidate[cur[0] + 1];
+
+    for (; candidate != last_candidate; candidate++)
+    {
+      guint pattern_index;
+      const GumMatchPattern * pattern;
+
+      pattern_index = g_array_index (candidates, guint, candidate);
+      pattern = patterns[pattern_index];
+
+      if (cur < resume_at[pattern_index] ||
+          pattern->size > (gsize) (end - cur) ||
+          !gum_match_pattern_try_match_on (pattern, cur))
+      {
+        continue;
+      }
+
+      if (!func (GUM_ADDRESS (cur), pattern->size, pattern_index, user_data))
+        goto beach;
+
+      resume_at[pattern_index] = cur + pattern->size;
+    }
+  }
+
+beach:
+  g_free (resume_at);
+  g_array_free (candidates, TRUE);
+}
+
 GumMatchPattern *
 gum_match_pattern_new_from_string (const gchar * match_str)
 {
@@ -195,7 +289,7 @@ gum_match_pattern_new_from_string (const gchar * match_str)
   for (ch = match_str; *ch != '\0'; ch++)
   {
     gint upper, lower;
-    guint8 value;
+    guint8 value, mask;
 
     if (ch[0] == ' ')
       continue;
@@ -210,15 +304,44 @@ gum_match_pattern_new_from_string (const gchar * match_str)
       continue;
     }
 
-    if ((upper = g_ascii_xdigit_value (ch[0])) == -1)
-      goto parse_error;
-    if ((lower = g_ascii_xdigit_value (ch[1])) == -1)
-      goto parse_error;
-    value = (upper << 4) | lower;
+    if (ch[0] == '?')
+    {
+      if ((lower = g_ascii_xdigit_value (ch[1])) == -1)
+        goto parse_error;
+      value = lower;
+      mask = 0x0f;
+    }
+    else
+    {
+      if ((upper = g_ascii_xdigit_value (ch[0])) == -1)
+        goto parse_error;
 
-    if (token == NULL || token->type != GUM_MATCH_EXACT)
-      token = gum_match_pattern_push_token (pattern, GUM_MATCH_EXACT);
-    gum_match_token_append (token, value);
+      if (ch[1] == '?')
+      {
+        value = upper << 4;
+        mask = 0xf0;
+      }
+      else
+      {
+        if ((lower = g_ascii_xdigit_value (ch[1])) == -1)
+          goto parse_error;
+        value = (upper << 4) | lower;
+        mask = 0xff;
+      }
+    }
+
+    if (mask == 0xff)
+    {
+      if (token == NULL || token->type != GUM_MATCH_EXACT)
+        token = gum_match_pattern_push_token (pattern, GUM_MATCH_EXACT);
+      gum_match_token_append (token, value);
+    }
+    else
+    {
+      if (token == NULL || token->type != GUM_MATCH_MASK)
+        token = gum_match_pattern_push_token (pattern, GUM_MATCH_MASK);
+      gum_match_token_append_masked (token, value, mask);
+    }
 
     ch++;
   }
@@ -246,17 +369,32 @@ gum_match_pattern_new (void)
       g_ptr_array_new_with_free_func ((GDestroyNotify) gum_match_token_free);
   pattern->size = 0;
 
+  pattern->bytes = NULL;
+  pattern->masks = NULL;
+  pattern->anchor = NULL;
+  pattern->anchor_skips = NULL;
+
   return pattern;
 }
 
 void
 gum_match_pattern_free (GumMatchPattern * pattern)
 {
+  g_free (pattern->anchor_skips);
+  g_free (pattern->masks);
+  g_free (pattern->bytes);
+
   g_ptr_array_free (pattern->tokens, TRUE);
 
   g_slice_free (GumMatchPattern, pattern);
 }
 
+guint
+gum_match_pattern_get_size (const GumMatchPattern * pattern)
+{
+  return pattern->size;
+}
+
 static void
 gum_match_pattern_update_computed_size (GumMatchPattern * self)
 {
@@ -295,29 +433,76 @@ gum_match_pattern_get_longest_token (const GumMatchPattern * self,
   return longest;
 }
 
-static gboolean
-gum_match_pattern_try_match_on (const GumMatchPattern * self,
-                                guint8 * bytes)
+/*
+ * Finds the first position in [cur, last] where the anchor, i.e. the longest
+ * exact token, occurs. Short anchors are located through memchr(), which
+ * libc implements with vector instructions on most platforms, and longer
+ * ones through Boyer-Moore-Horspool so that most bytes are never looked at.
+ */
+static const guint8 *
+gum_match_pattern_find_anchor (const GumMatchPattern * self,
+                               const guint8 * cur,
+                               const guint8 * last)
 {
-  guint i;
+  const guint8 * needle;
+  guint needle_len;
 
-  for (i = 0; i != self->tokens->len; i++)
+  if (self->anchor == NULL)
+    return cur;
+
+  needle = (const guint8 *) self->anchor->bytes->data;
+  needle_len = self->anchor->bytes->len;
+
+  if (self->anchor_skips != NULL)
   {
-    GumMatchToken * token;
+    guint8 needle_last = needle[needle_len - 1];
 
-    token = (GumMatchToken *) g_ptr_array_index (self->tokens, i);
-    if (token->type == GUM_MATCH_EXACT)
+    while (cur <= last)
     {
-      gchar * p;
+      guint8 c = cur[needle_len - 1];
 
-      p = (gchar *) bytes + token->offset;
-      if (p == token->bytes->data ||
-          memcmp (p, token->bytes->data, token->bytes->len) != 0)
-      {
-        return FALSE;
-      }
+      if (c == needle_last && memcmp (cur, needle, needle_len - 1) == 0)
+        return cur;
+
+      cur += self->anchor_skips[c];
     }
   }
+  else
+  {
+    while (cur <= last)
+    {
+      cur = memchr (cur, needle[0], last - cur + 1);
+      if (cur == NULL)
+        return NULL;
+
+      if (memcmp (cur + 1, needle + 1, needle_len - 1) == 0)
+        return cur;
+
+      cur++;
+    }
+  }
+
+  return NULL;
+}
+
+static gboolean
+gum_match_pattern_try_match_on (const GumMatchPattern * self,
+                                const guint8 * bytes)
+{
+  guint i;
+
+  /* Never report the pattern's own storage as a match */
+  if (bytes == self->bytes || (self->anchor != NULL &&
+      bytes + self->anchor->offset == (guint8 *) self->anchor->bytes->data))
+  {
+    return FALSE;
+  }
+
+  for (i = 0; i != self->size; i++)
+  {
+    if ((bytes[i] & self->masks[i]) != self->bytes[i])
+      return FALSE;
+  }
 
   return TRUE;
 }
@@ -341,6 +526,7 @@ static gboolean
 gum_match_pattern_seal (GumMatchPattern * self)
 {
   GumMatchToken * token;
+  guint i, j;
 
   gum_match_pattern_update_computed_size (self);
 
@@ -348,14 +534,60 @@ gum_match_pattern_seal (GumMatchPattern * self)
     return FALSE;
 
   token = (GumMatchToken *) g_ptr_array_index (self->tokens, 0);
-  if (token->type != GUM_MATCH_EXACT)
+  if (token->type == GUM_MATCH_WILDCARD)
     return FALSE;
 
   token = (GumMatchToken *) g_ptr_array_index (self->tokens,
       self->tokens->len - 1);
-  if (token->type != GUM_MATCH_EXACT)
+  if (token->type == GUM_MATCH_WILDCARD)
     return FALSE;
 
+  self->bytes = g_malloc (self->size);
+  self->masks = g_malloc (self->size);
+
+  for (i = 0; i != self->tokens->len; i++)
+  {
+    token = (GumMatchToken *) g_ptr_array_index (self->tokens, i);
+
+    for (j = 0; j != token->bytes->len; j++)
+    {
+      guint8 mask;
+
+      switch (token->type)
+      {
+        case GUM_MATCH_EXACT:
+          mask = 0xff;
+          break;
+        case GUM_MATCH_WILDCARD:
+          mask = 0x00;
+          break;
+        case GUM_MATCH_MASK:
+        default:
+          mask = g_array_index (token->masks, guint8, j);
+          break;
+      }
+
+      self->bytes[token->offset + j] =
+          g_array_index (token->bytes, guint8, j) & mask;
+      self->masks[token->offset + j] = mask;
+    }
+  }
+
+  self->anchor = gum_match_pattern_get_longest_token (self, GUM_MATCH_EXACT);
+
+  if (self->anchor != NULL &&
+      self->anchor->bytes->len >= GUM_MATCH_ANCHOR_SKIPS_MIN_SIZE)
+  {
+    const guint8 * needle = (const guint8 *) self->anchor->bytes->data;
+    guint needle_len = self->anchor->bytes->len;
+
+    self->anchor_skips = g_new (guint, 256);
+    for (i = 0; i != 256; i++)
+      self->anchor_skips[i] = needle_len;
+    for (i = 0; i != needle_len - 1; i++)
+      self->anchor_skips[needle[i]] = needle_len - 1 - i;
+  }
+
   return TRUE;
 }
 
@@ -367,6 +599,9 @@ gum_match_token_new (GumMatchType type)
   token = g_slice_new (GumMatchToken);
   token->type = type;
   token->bytes = g_array_new (FALSE, FALSE, sizeof (guint8));
+  token->masks = (type == GUM_MATCH_MASK)
+      ? g_array_new (FALSE, FALSE, sizeof (guint8))
+      : NULL;
   token->offset = 0;
 
   return token;
@@ -375,6 +610,8 @@ gum_match_token_new (GumMatchType type)
 static void
 gum_match_token_free (GumMatchToken * token)
 {
+  if (token->masks != NULL)
+    g_array_free (token->masks, TRUE);
   g_array_free (token->bytes, TRUE);
   g_slice_free (GumMatchToken, token);
 }
@@ -386,6 +623,15 @@ gum_match_token_append (GumMatchToken * self,
   g_array_append_val (self->bytes, byte);
 }
 
+static void
+gum_match_token_append_masked (GumMatchToken * self,
+                               guint8 byte,
+                               guint8 mask)
+{
+  g_array_append_val (self->bytes, byte);
+  g_array_append_val (self->masks, mask);
+}
+
 void
 gum_mprotect (gpointer address,
               gsize size,
@@ -407,6 +653,87 @@ gum_peek_private_memory_usage (void)
   return (guint) info.uordblks;
 }
 
+/*
+ * Reports the chunks in use in Gum's own heap. They are collected while
+ * holding the heap's lock, into storage allocated without holding it, as
+ * both GLib and the callback may allocate from this very heap. Chunks that
+ * dlmalloc mmap()s on their own are not tracked by it, and so are left out.
+ */
+void
+_gum_memory_enumerate_private_malloc_ranges (GumFoundMallocRangeFunc func,
+                                             gpointer user_data)
+{
+  GumMemoryRange * ranges = NULL;
+  gsize capacity = 0, count, i;
+
+  if (gum_mspace == NULL)
+    return;
+
+  while ((count = gum_mspace_collect_inuse_chunks ((mstate) gum_mspace,
+      ranges, capacity)) > capacity)
+  {
+    capacity = count + (count / 4) + 16;
+    ranges = g_renew (GumMemoryRange, ranges, capacity);
+  }
+
+  for (i = 0; i != count; i++)
+  {
+    GumMallocRangeDetails details;
+
+    details.range = &ranges[i];
+
+    if (!func (&details, user_data))
+      break;
+  }
+
+  g_free (ranges);
+}
+
+/*
+ * Stores up to capacity ranges and returns how many chunks are in use, so
+ * that the caller can tell whether it needs to try again with more room.
+ */
+static gsize
+gum_mspace_collect_inuse_chunks (mstate m,
+                                 GumMemoryRange * ranges,
+                                 gsize capacity)
+{
+  gsize count = 0;
+  msegmentptr s;
+
+  if (PREACTION (m))
+    return 0;
+
+  if (is_initialized (m))
+  {
+    for (s = &m->seg; s != NULL; s = s->next)
+    {
+      mchunkptr q = align_as_chunk (s->base);
+
+      while (segment_holds (s, q) && q != m->top &&
+          q->head != FENCEPOST_HEAD)
+      {
+        /* The first chunk holds the malloc_state itself */
+        if (cinuse (q) && chunk2mem (q) != (void *) m)
+        {
+          if (count < capacity)
+          {
+            ranges[count].base_address = GUM_ADDRESS (chunk2mem (q));
+            ranges[count].size = chunksize (q) - overhead_for (q);
+          }
+          count++;
+        }
+
+        q = next_chunk (q);
+      }
+    }
+  }
+
+  POSTACTION (m);
+
+  return count;
+}
+
 gpointer
 gum_malloc (gsize size)
 {
@@ -57,6 +57,8 @@ G_BEGIN_DECLS
 
 typedef gboolean (* GumMemoryScanMatchFunc) (GumAddress address, gsize size,
     gpointer user_data);
+typedef gboolean (* GumMemoryScanMultiMatchFunc) (GumAddress address,
+    gsize size, guint pattern_index, gpointer user_data);
 
 void gum_memory_init (void);
 void gum_memory_deinit (void);
@@ -70,9 +72,13 @@ gboolean gum_memory_write (GumAddress address, const guint8 * bytes, gsize len);
 void gum_memory_scan (const GumMemoryRange * range,
     const GumMatchPattern * pattern,
     GumMemoryScanMatchFunc func, gpointer user_data);
+void gum_memory_scan_multi (const GumMemoryRange * range,
+    const GumMatchPattern * const * patterns, guint n_patterns,
+    GumMemoryScanMultiMatchFunc func, gpointer user_data);
 
 GumMatchPattern * gum_match_pattern_new_from_string (const gchar * match_str);
 void gum_match_pattern_free (GumMatchPattern * pattern);
+guint gum_match_pattern_get_size (const GumMatchPattern * pattern);
 
 void gum_mprotect (gpointer address, gsize size, GumPageProtection page_prot);
 gboolean gum_try_mprotect (gpointer address, gsize size, GumPageProtection page_prot);
@@ -9,9 +9,14 @@
 #include "gumprocess.h"
 
 #include <gio/gio.h>
+#include <string.h>
 
 typedef struct _GumModuleMetadata GumModuleMetadata;
+typedef struct _GumFunctionIndex GumFunctionIndex;
 typedef struct _GumFunctionMetadata GumFunctionMetadata;
+typedef struct _GumCollectFunctionsContext GumCollectFunctionsContext;
+typedef struct _GumNameMatcher GumNameMatcher;
+typedef guint GumNameMatcherKind;
 
 struct _GumModuleApiResolver
 {
@@ -19,25 +24,52 @@ struct _GumModuleApiResolver
 
   GRegex * query_pattern;
 
-  GHashTable * module_by_name;
+  GPtrArray * modules;
 };
 
 struct _GumModuleMetadata
 {
-  gint ref_count;
-
   gchar * name;
   gchar * path;
 
-  GHashTable * import_by_name;
-  GHashTable * export_by_name;
+  GumFunctionIndex * imports;
+  GumFunctionIndex * exports;
+};
+
+struct _GumFunctionIndex
+{
+  GStringChunk * strings;
+  GArray * functions;
+  GHashTable * function_by_name;
 };
 
 struct _GumFunctionMetadata
 {
-  gchar * name;
+  const gchar * name;
+  const gchar * qualified_name;
   GumAddress address;
-  gchar * module;
+};
+
+struct _GumCollectFunctionsContext
+{
+  GumFunctionIndex * index;
+  const gchar * module_path;
+  GString * scratch;
+};
+
+enum _GumNameMatcherKind
+{
+  GUM_NAME_MATCHER_EXACT,
+  GUM_NAME_MATCHER_PREFIX,
+  GUM_NAME_MATCHER_GLOB
+};
+
+struct _GumNameMatcher
+{
+  GumNameMatcherKind kind;
+  gchar * text;
+  gsize text_length;
+  GPatternSpec * spec;
 };
 
 static void gum_module_api_resolver_iface_init (gpointer g_iface,
@@ -46,25 +78,38 @@ static void gum_module_api_resolver_finalize (GObject * object);
 static void gum_module_api_resolver_enumerate_matches (
     GumApiResolver * resolver, const gchar * query, GumFoundApiFunc func,
     gpointer user_data, GError ** error);
-
-static GPatternSpec * gum_pattern_spec_from_match_info (GMatchInfo * match_info,
-    gint match_num);
-
-static GHashTable * gum_module_api_resolver_create_snapshot (void);
+static gboolean gum_function_index_emit_matches (GumFunctionIndex * self,
+    const GumNameMatcher * matcher, GumFoundApiFunc func, gpointer user_data);
+static gboolean gum_emit_function (const GumFunctionMetadata * function,
+    GumFoundApiFunc func, gpointer user_data);
+
+static void gum_name_matcher_init_from_match_info (GumNameMatcher * matcher,
+    GMatchInfo * match_info, gint match_num);
+static void gum_name_matcher_destroy (GumNameMatcher * matcher);
+static gboolean gum_name_matcher_matches (const GumNameMatcher * self,
+    const gchar * name);
+
+static GPtrArray * gum_module_api_resolver_create_snapshot (void);
 static gboolean gum_module_api_resolver_collect_module (
     const GumModuleDetails * details, gpointer user_data);
 
-static void gum_module_metadata_unref (GumModuleMetadata * module);
-static GHashTable * gum_module_metadata_get_imports (GumModuleMetadata * self);
-static GHashTable * gum_module_metadata_get_exports (GumModuleMetadata * self);
+static void gum_module_metadata_free (GumModuleMetadata * module);
+static GumFunctionIndex * gum_module_metadata_get_imports (
+    GumModuleMetadata * self);
+static GumFunctionIndex * gum_module_metadata_get_exports (
+    GumModuleMetadata * self);
 static gboolean gum_module_metadata_collect_import (
     const GumImportDetails * details, gpointer user_data);
 static gboolean gum_module_metadata_collect_export (
     const GumExportDetails * details, gpointer user_data);
 
-static GumFunctionMetadata * gum_function_metadata_new (const gchar * name,
-    GumAddress address, const gchar * module);
-static void gum_function_metadata_free (GumFunctionMetadata * function);
+static GumFunctionIndex * gum_function_index_new (void);
+static void gum_function_index_free (GumFunctionIndex * index);
+static void gum_function_index_add (GumCollectFunctionsContext * ctx,
+    const gchar * name, GumAddress address, const gchar * module);
+static void gum_function_index_seal (GumFunctionIndex * self);
+static gint gum_function_metadata_compare (const GumFunctionMetadata * lhs,
+    const GumFunctionMetadata * rhs);
 
 G_DEFINE_TYPE_EXTENDED (GumModuleApiResolver,
                         gum_module_api_resolver,
@@ -97,7 +142,7 @@ gum_module_api_resolver_init (GumModuleApiResolver * self)
 {
   self->query_pattern = g_regex_new ("(imports|exports):(.+)!(.+)", 0, 0, NULL);
 
-  self->module_by_name = gum_module_api_resolver_create_snapshot ();
+  self->modules = gum_module_api_resolver_create_snapshot ();
 }
 
 static void
@@ -105,7 +150,7 @@ gum_module_api_resolver_finalize (GObject * object)
 {
   GumModuleApiResolver * self = GUM_MODULE_API_RESOLVER (object);
 
-  g_hash_table_unref (self->module_by_name);
+  g_ptr_array_unref (self->modules);
 
   g_regex_unref (self->query_pattern);
 
@@ -128,180 +173,310 @@ gum_module_api_resolver_enumerate_matches (GumApiResolver * resolver,
   GumModuleApiResolver * self = GUM_MODULE_API_RESOLVER (resolver);
   GMatchInfo * query_info;
   gchar * collection;
-  GPatternSpec * module_spec, * function_spec;
-  GHashTableIter module_iter;
+  GumNameMatcher module_matcher, function_matcher;
   gboolean carry_on;
-  GumModuleMetadata * module;
+  guint i;
 
   g_regex_match (self->query_pattern, query, 0, &query_info);
   if (!g_match_info_matches (query_info))
     goto invalid_query;
 
   collection = g_match_info_fetch (query_info, 1);
-  module_spec = gum_pattern_spec_from_match_info (query_info, 2);
-  function_spec = gum_pattern_spec_from_match_info (query_info, 3);
+  gum_name_matcher_init_from_match_info (&module_matcher, query_info, 2);
+  gum_name_matcher_init_from_match_info (&function_matcher, query_info, 3);
 
-  g_hash_table_iter_init (&module_iter, self->module_by_name);
   carry_on = TRUE;
-  while (carry_on &&
-      g_hash_table_iter_next (&module_iter, NULL, (gpointer *) &module))
+  for (i = 0; i != self->modules->len && carry_on; i++)
   {
-    if (g_pattern_match_string (module_spec, module->name) ||
-        g_pattern_match_string (module_spec, module->path))
+    GumModuleMetadata * module = g_ptr_array_index (self->modules, i);
+
+    if (gum_name_matcher_matches (&module_matcher, module->name) ||
+        gum_name_matcher_matches (&module_matcher, module->path))
     {
-      GHashTable * functions;
-      GHashTableIter function_iter;
-      GumFunctionMetadata * function;
+      GumFunctionIndex * functions;
 
       functions = (collection[0] == 'i')
           ? gum_module_metadata_get_imports (module)
           : gum_module_metadata_get_exports (module);
 
-      g_hash_table_iter_init (&function_iter, functions);
-      while (carry_on &&
-          g_hash_table_iter_next (&function_iter, NULL, (gpointer *) &function))
-      {
-        if (g_pattern_match_string (function_spec, function->name))
-        {
-          GumApiDetails details;
-
-          details.name = g_strconcat (
-              (function->module != NULL) ? function->module : module->path,
-              "!",
-              function->name,
-              NULL);
-          details.address = function->address;
-
-          carry_on = func (&details, user_data);
-
-          g_free ((gpointer) details.name);
-        }
-      }
+      carry_on = gum_function_index_emit_matches (functions,
+          &function_matcher, func, user_data);
     }
   }
 
-  g_pattern_spec_free (function_spec);
-  g_pattern_spec_free (module_spec);
+  gum_name_matcher_destroy (&function_matcher);
+  gum_name_matcher_destroy (&module_matcher);
   g_free (collection);
 
+  g_match_info_free (query_info);
+
   return;
 
 invalid_query:
   {
+    g_match_info_free (query_info);
+
     g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
         "invalid query; format is: "
         "exports:*!open*, exports:libc.so!* or imports:notepad.exe!*");
   }
 }
 
-static GPatternSpec *
-gum_pattern_spec_from_match_info (GMatchInfo * match_info,
-                                  gint match_num)
+static gboolean
+gum_function_index_emit_matches (GumFunctionIndex * self,
+                                 const GumNameMatcher * matcher,
+                                 GumFoundApiFunc func,
+                                 gpointer user_data)
+{
+  GArray * functions = self->functions;
+  guint i;
+
+  switch (matcher->kind)
+  {
+    case GUM_NAME_MATCHER_EXACT:
+    {
+      const GumFunctionMetadata * function;
+
+      function = g_hash_table_lookup (self->function_by_name, matcher->text);
+      if (function == NULL)
+        return TRUE;
+
+      return gum_emit_function (function, func, user_data);
+    }
+    case GUM_NAME_MATCHER_PREFIX:
+    {
+      guint lower, upper;
+
+      lower = 0;
+      upper = functions->len;
+      while (lower != upper)
+      {
+        guint mid = lower + ((upper - lower) / 2);
+        const gchar * name =
+            g_array_index (functions, GumFunctionMetadata, mid).name;
+
+        if (strncmp (name, matcher->text, matcher->text_length) < 0)
+          lower = mid + 1;
+        else
+          upper = mid;
+      }
+
+      for (i = lower; i != functions->len; i++)
+      {
+        const GumFunctionMetadata * function =
+            &g_array_index (functions, GumFunctionMetadata, i);
+
+        if (strncmp (function->name, matcher->text, matcher->text_length) != 0)
+          break;
+
+        if (!gum_emit_function (function, func, user_data))
+          return FALSE;
+      }
+
+      return TRUE;
+    }
+    case GUM_NAME_MATCHER_GLOB:
+    {
+      for (i = 0; i != functions->len; i++)
+      {
+        const GumFunctionMetadata * function =
+            &g_array_index (functions, GumFunctionMetadata, i);
+
+        if (g_pattern_match_string (matcher->spec, function->name) &&
+            !gum_emit_function (function, func, user_data))
+          return FALSE;
+      }
+
+      return TRUE;
+    }
+    default:
+      g_assert_not_reached ();
+      return FALSE;
+  }
+}
+
+static gboolean
+gum_emit_function (const GumFunctionMetadata * function,
+                   GumFoundApiFunc func,
+                   gpointer user_data)
+{
+  GumApiDetails details;
+
+  details.name = function->qualified_name;
+  details.address = function->address;
+
+  return func (&details, user_data);
+}
+
+/*
+ * Most queries either name a function exactly or ask for everything
+ * starting with a given prefix, so we recognize those up front and answer
+ * them from the sorted index instead of glob-matching every name.
+ */
+static void
+gum_name_matcher_init_from_match_info (GumNameMatcher * matcher,
+                                       GMatchInfo * match_info,
+                                       gint match_num)
 {
   gchar * pattern;
-  GPatternSpec * spec;
+  gsize length;
+  const gchar * first_wildcard;
 
   pattern = g_match_info_fetch (match_info, match_num);
-  spec = g_pattern_spec_new (pattern);
-  g_free (pattern);
+  length = strlen (pattern);
+  first_wildcard = strpbrk (pattern, "*?");
+
+  matcher->text = pattern;
+  matcher->spec = NULL;
+
+  if (first_wildcard == NULL)
+  {
+    matcher->kind = GUM_NAME_MATCHER_EXACT;
+    matcher->text_length = length;
+  }
+  else if (first_wildcard == pattern + length - 1 && *first_wildcard == '*')
+  {
+    matcher->kind = GUM_NAME_MATCHER_PREFIX;
+    matcher->text_length = length - 1;
+  }
+  else
+  {
+    matcher->kind = GUM_NAME_MATCHER_GLOB;
+    matcher->text_length = length;
+    matcher->spec = g_pattern_spec_new (pattern);
+  }
+}
 
-  return spec;
+static void
+gum_name_matcher_destroy (GumNameMatcher * matcher)
+{
+  if (matcher->spec != NULL)
+    g_pattern_spec_free (matcher->spec);
+
+  g_free (matcher->text);
 }
 
-static GHashTable *
+static gboolean
+gum_name_matcher_matches (const GumNameMatcher * self,
+                          const gchar * name)
+{
+  switch (self->kind)
+  {
+    case GUM_NAME_MATCHER_EXACT:
+      return strcmp (name, self->text) == 0;
+    case GUM_NAME_MATCHER_PREFIX:
+      return strncmp (name, self->text, self->text_length) == 0;
+    case GUM_NAME_MATCHER_GLOB:
+      return g_pattern_match_string (self->spec, name);
+    default:
+      g_assert_not_reached ();
+      return FALSE;
+  }
+}
+
+static GPtrArray *
 gum_module_api_resolver_create_snapshot (void)
 {
-  GHashTable * module_by_name;
+  GPtrArray * modules;
 
-  module_by_name = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
-      (GDestroyNotify) gum_module_metadata_unref);
+  modules = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gum_module_metadata_free);
 
   gum_process_enumerate_modules (gum_module_api_resolver_collect_module,
-      module_by_name);
+      modules);
 
-  return module_by_name;
+  return modules;
 }
 
 static gboolean
 gum_module_api_resolver_collect_module (const GumModuleDetails * details,
                                         gpointer user_data)
 {
-  GHashTable * module_by_name = user_data;
+  GPtrArray * modules = user_data;
   GumModuleMetadata * module;
 
   module = g_slice_new (GumModuleMetadata);
-  module->ref_count = 2;
   module->name = g_strdup (details->name);
   module->path = g_strdup (details->path);
-  module->import_by_name = NULL;
-  module->export_by_name = NULL;
+  module->imports = NULL;
+  module->exports = NULL;
 
-  g_hash_table_insert (module_by_name, g_strdup (module->name), module);
-  g_hash_table_insert (module_by_name, g_strdup (module->path), module);
+  g_ptr_array_add (modules, module);
 
   return TRUE;
 }
 
 static void
-gum_module_metadata_unref (GumModuleMetadata * module)
+gum_module_metadata_free (GumModuleMetadata * module)
 {
-  module->ref_count--;
-  if (module->ref_count == 0)
-  {
-    if (module->export_by_name != NULL)
-      g_hash_table_unref (module->export_by_name);
+  if (module->exports != NULL)
+    gum_function_index_free (module->exports);
 
-    if (module->import_by_name != NULL)
-      g_hash_table_unref (module->import_by_name);
+  if (module->imports != NULL)
+    gum_function_index_free (module->imports);
 
-    g_free (module->path);
-    g_free (module->name);
+  g_free (module->path);
+  g_free (module->name);
 
-    g_slice_free (GumModuleMetadata, module);
-  }
+  g_slice_free (GumModuleMetadata, module);
 }
 
-static GHashTable *
+static GumFunctionIndex *
 gum_module_metadata_get_imports (GumModuleMetadata * self)
 {
-  if (self->import_by_name == NULL)
+  if (self->imports == NULL)
   {
-    self->import_by_name = g_hash_table_new_full (g_str_hash, g_str_equal,
-        g_free, (GDestroyNotify) gum_function_metadata_free);
+    GumCollectFunctionsContext ctx;
+
+    ctx.index = gum_function_index_new ();
+    ctx.module_path = self->path;
+    ctx.scratch = g_string_new (NULL);
+
     gum_module_enumerate_imports (self->path,
-        gum_module_metadata_collect_import, self->import_by_name);
+        gum_module_metadata_collect_import, &ctx);
+
+    g_string_free (ctx.scratch, TRUE);
+
+    gum_function_index_seal (ctx.index);
+    self->imports = ctx.index;
   }
 
-  return self->import_by_name;
+  return self->imports;
 }
 
-static GHashTable *
+static GumFunctionIndex *
 gum_module_metadata_get_exports (GumModuleMetadata * self)
 {
-  if (self->export_by_name == NULL)
+  if (self->exports == NULL)
   {
-    self->export_by_name = g_hash_table_new_full (g_str_hash, g_str_equal,
-        g_free, (GDestroyNotify) gum_function_metadata_free);
+    GumCollectFunctionsContext ctx;
+
+    ctx.index = gum_function_index_new ();
+    ctx.module_path = self->path;
+    ctx.scratch = g_string_new (NULL);
+
     gum_module_enumerate_exports (self->path,
-        gum_module_metadata_collect_export, self->export_by_name);
+        gum_module_metadata_collect_export, &ctx);
+
+    g_string_free (ctx.scratch, TRUE);
+
+    gum_function_index_seal (ctx.index);
+    self->exports = ctx.index;
   }
 
-  return self->export_by_name;
+  return self->exports;
 }
 
 static gboolean
 gum_module_metadata_collect_import (const GumImportDetails * details,
                                     gpointer user_data)
 {
-  GHashTable * import_by_name = user_data;
+  GumCollectFunctionsContext * ctx = user_data;
 
   if (details->type == GUM_IMPORT_FUNCTION && details->address != 0)
   {
-    GumFunctionMetadata * function;
-
-    function = gum_function_metadata_new (details->name, details->address,
+    gum_function_index_add (ctx, details->name, details->address,
         details->module);
-    g_hash_table_insert (import_by_name, g_strdup (function->name), function);
   }
 
   return TRUE;
@@ -311,40 +486,101 @@ static gboolean
 gum_module_metadata_collect_export (const GumExportDetails * details,
                                     gpointer user_data)
 {
-  GHashTable * export_by_name = user_data;
+  GumCollectFunctionsContext * ctx = user_data;
 
   if (details->type == GUM_EXPORT_FUNCTION)
-  {
-    GumFunctionMetadata * function;
-
-    function = gum_function_metadata_new (details->name, details->address,
-        NULL);
-    g_hash_table_insert (export_by_name, g_strdup (function->name), function);
-  }
+    gum_function_index_add (ctx, details->name, details->address, NULL);
 
   return TRUE;
 }
 
-static GumFunctionMetadata *
-gum_function_metadata_new (const gchar * name,
-                           GumAddress address,
-                           const gchar * module)
+static GumFunctionIndex *
+gum_function_index_new (void)
+{
+  GumFunctionIndex * index;
+
+  index = g_slice_new (GumFunctionIndex);
+  index->strings = g_string_chunk_new (4096);
+  index->functions = g_array_new (FALSE, FALSE, sizeof (GumFunctionMetadata));
+  index->function_by_name = g_hash_table_new (g_str_hash, g_str_equal);
+
+  return index;
+}
+
+static void
+gum_function_index_free (GumFunctionIndex * index)
+{
+  g_hash_table_unref (index->function_by_name);
+  g_array_free (index->functions, TRUE);
+  g_string_chunk_free (index->strings);
+
+  g_slice_free (GumFunctionIndex, index);
+}
+
+static void
+gum_function_index_add (GumCollectFunctionsContext * ctx,
+                        const gchar * name,
+                        GumAddress address,
+                        const gchar * module)
 {
-  GumFunctionMetadata * function;
+  GString * scratch = ctx->scratch;
+  GumFunctionMetadata function;
+  gsize prefix_length;
 
-  function = g_slice_new (GumFunctionMetadata);
-  function->name = g_strdup (name);
-  function->address = address;
-  function->module = g_strdup (module);
+  g_string_assign (scratch, (module != NULL) ? module : ctx->module_path);
+  g_string_append_c (scratch, '!');
+  prefix_length = scratch->len;
+  g_string_append (scratch, name);
 
-  return function;
+  function.qualified_name = g_string_chunk_insert_len (ctx->index->strings,
+      scratch->str, scratch->len);
+  function.name = function.qualified_name + prefix_length;
+  function.address = address;
+
+  g_array_append_val (ctx->index->functions, function);
 }
 
+/*
+ * Sorts the functions by name so that prefix queries can be answered with
+ * a binary search, and builds the by-name index used for exact queries.
+ * Where a name occurs more than once the last one wins, just like it did
+ * back when the functions were collected straight into a hash table.
+ */
 static void
-gum_function_metadata_free (GumFunctionMetadata * function)
+gum_function_index_seal (GumFunctionIndex * self)
 {
-  g_free (function->module);
-  g_free (function->name);
+  GArray * functions = self->functions;
+  guint i, n;
+
+  g_array_sort (functions, (GCompareFunc) gum_function_metadata_compare);
 
-  g_slice_free (GumFunctionMetadata, function);
+  n = 0;
+  for (i = 0; i != functions->len; i++)
+  {
+    GumFunctionMetadata * function =
+        &g_array_index (functions, GumFunctionMetadata, i);
+
+    if (n != 0 && strcmp (function->name,
+        g_array_index (functions, GumFunctionMetadata, n - 1).name) == 0)
+      n--;
+
+    g_array_index (functions, GumFunctionMetadata, n++) = *function;
+  }
+  g_array_set_size (functions, n);
+
+  for (i = 0; i != functions->len; i++)
+  {
+    GumFunctionMetadata * function =
+        &g_array_index (functions, GumFunctionMetadata, i);
+
+    g_hash_table_insert (self->function_by_name, (gpointer) function->name,
+        function);
+  }
+}
+
+static gint
+gum_function_metadata_compare (const GumFunctionMetadata * lhs,
+                               const GumFunctionMetadata * rhs)
+{
+  return strcmp (lhs->name, rhs->name);
 }
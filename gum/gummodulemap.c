@@ -6,9 +6,15 @@
 
 #include "gummodulemap.h"
 
+#ifdef HAVE_GLIBC
+# include <link.h>
+#endif
+
 struct _GumModuleMapPrivate
 {
   GArray * modules;
+  const GumModuleDetails * last_hit;
+  guint64 generation;
 };
 
 static void gum_module_map_finalize (GObject * object);
@@ -16,6 +22,14 @@ static void gum_module_map_finalize (GObject * object);
 static void gum_module_map_clear (GumModuleMap * self);
 static gboolean gum_add_module (const GumModuleDetails * details,
     gpointer user_data);
+static gint gum_module_details_compare_base (const GumModuleDetails * lhs,
+    const GumModuleDetails * rhs);
+
+static guint64 gum_module_map_read_generation (void);
+#ifdef HAVE_GLIBC
+static int gum_module_map_collect_generation (struct dl_phdr_info * info,
+    size_t size, void * data);
+#endif
 
 G_DEFINE_TYPE (GumModuleMap, gum_module_map, G_TYPE_OBJECT);
 
@@ -36,6 +50,8 @@ gum_module_map_init (GumModuleMap * self)
       GumModuleMapPrivate);
 
   self->priv->modules = g_array_new (FALSE, FALSE, sizeof (GumModuleDetails));
+  self->priv->last_hit = NULL;
+  self->priv->generation = 0;
 }
 
 static void
@@ -66,23 +82,87 @@ gum_module_map_find (GumModuleMap * self,
                      GumAddress address)
 {
   GumModuleMapPrivate * priv = self->priv;
-  guint i;
-
-  for (i = 0; i < priv->modules->len; i++)
+  const GumModuleDetails * modules, * last_hit;
+  guint lower, upper;
+
+  /*
+   * Backtraces and import lookups tend to hit the same module repeatedly.
+   * Lookups may race each other, so the hint is only trusted if it points
+   * into the current array.
+   */
+  modules = (const GumModuleDetails *) priv->modules->data;
+  last_hit = g_atomic_pointer_get (&priv->last_hit);
+  if (last_hit >= modules && last_hit < modules + priv->modules->len &&
+      GUM_MEMORY_RANGE_INCLUDES (last_hit->range, address))
+    return last_hit;
+
+  lower = 0;
+  upper = priv->modules->len;
+  while (lower != upper)
   {
-    GumModuleDetails * d = &g_array_index (priv->modules, GumModuleDetails, i);
-    if (GUM_MEMORY_RANGE_INCLUDES (d->range, address))
+    guint mid;
+    const GumModuleDetails * d;
+
+    mid = lower + ((upper - lower) / 2);
+    d = &g_array_index (priv->modules, GumModuleDetails, mid);
+
+    if (address < d->range->base_address)
+    {
+      upper = mid;
+    }
+    else if (address >= d->range->base_address + d->range->size)
+    {
+      lower = mid + 1;
+    }
+    else
+    {
+      g_atomic_pointer_set (&priv->last_hit, d);
       return d;
+    }
   }
 
   return NULL;
 }
 
+/* Sorted by base address. Only valid until the next update. */
+GArray *
+gum_module_map_get_values (GumModuleMap * self)
+{
+  return self->priv->modules;
+}
+
 void
 gum_module_map_update (GumModuleMap * self)
 {
+  GumModuleMapPrivate * priv = self->priv;
+
+  priv->generation = gum_module_map_read_generation ();
+
   gum_module_map_clear (self);
-  gum_process_enumerate_modules (gum_add_module, self->priv);
+  gum_process_enumerate_modules (gum_add_module, priv);
+  g_array_sort (priv->modules,
+      (GCompareFunc) gum_module_details_compare_base);
+}
+
+/*
+ * Like gum_module_map_update(), but skips the re-enumeration when the
+ * dynamic linker reports that no objects have been loaded or unloaded since
+ * the last update. Only glibc exposes such a counter, so elsewhere this is
+ * the same as a full update. Modules mapped without going through the
+ * dynamic linker are not noticed by this check.
+ */
+gboolean
+gum_module_map_refresh (GumModuleMap * self)
+{
+  guint64 generation;
+
+  generation = gum_module_map_read_generation ();
+  if (generation != 0 && generation == self->priv->generation)
+    return FALSE;
+
+  gum_module_map_update (self);
+
+  return TRUE;
 }
 
 static void
@@ -99,6 +179,8 @@ gum_module_map_clear (GumModuleMap * self)
     g_free ((gchar *) d->path);
   }
   g_array_set_size (priv->modules, 0);
+
+  g_atomic_pointer_set (&priv->last_hit, NULL);
 }
 
 static gboolean
@@ -116,3 +198,51 @@ gum_add_module (const GumModuleDetails * details,
 
   return TRUE;
 }
+
+static gint
+gum_module_details_compare_base (const GumModuleDetails * lhs,
+                                 const GumModuleDetails * rhs)
+{
+  GumAddress lhs_base = lhs->range->base_address;
+  GumAddress rhs_base = rhs->range->base_address;
+
+  if (lhs_base < rhs_base)
+    return -1;
+  else if (lhs_base > rhs_base)
+    return 1;
+  else
+    return 0;
+}
+
+static guint64
+gum_module_map_read_generation (void)
+{
+  guint64 generation = 0;
+
+#ifdef HAVE_GLIBC
+  dl_iterate_phdr (gum_module_map_collect_generation, &generation);
+#endif
+
+  return generation;
+}
+
+#ifdef HAVE_GLIBC
+
+static int
+gum_module_map_collect_generation (struct dl_phdr_info * info,
+                                   size_t size,
+                                   void * data)
+{
+  guint64 * generation = data;
+
+  if (size >= G_STRUCT_OFFSET (struct dl_phdr_info, dlpi_subs) +
+      sizeof (info->dlpi_subs))
+  {
+    /* Offset by one so that a valid generation is never zero. */
+    *generation = info->dlpi_adds + info->dlpi_subs + 1;
+  }
+
+  return 1;
+}
+
+#endif
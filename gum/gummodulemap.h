@@ -49,7 +49,10 @@ GUM_API GumModuleMap * gum_module_map_new (void);
 GUM_API const GumModuleDetails * gum_module_map_find (GumModuleMap * self,
     GumAddress address);
 
+GUM_API GArray * gum_module_map_get_values (GumModuleMap * self);
+
 GUM_API void gum_module_map_update (GumModuleMap * self);
+GUM_API gboolean gum_module_map_refresh (GumModuleMap * self);
 
 G_END_DECLS
 
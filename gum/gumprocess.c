@@ -25,3 +25,25 @@ gum_process_get_native_os (void)
 # error Unknown OS
 #endif
 }
+
+#ifndef HAVE_LINUX
+
+guint
+gum_process_modify_threads (const GumThreadId * thread_ids,
+                            guint n_thread_ids,
+                            GumModifyThreadFunc func,
+                            gpointer user_data)
+{
+  guint n_modified = 0;
+  guint i;
+
+  for (i = 0; i != n_thread_ids; i++)
+  {
+    if (gum_process_modify_thread (thread_ids[i], func, user_data))
+      n_modified++;
+  }
+
+  return n_modified;
+}
+
+#endif
@@ -112,6 +112,8 @@ GUM_API gboolean gum_process_is_debugger_attached (void);
 GUM_API GumThreadId gum_process_get_current_thread_id (void);
 GUM_API gboolean gum_process_modify_thread (GumThreadId thread_id,
     GumModifyThreadFunc func, gpointer user_data);
+GUM_API guint gum_process_modify_threads (const GumThreadId * thread_ids,
+    guint n_thread_ids, GumModifyThreadFunc func, gpointer user_data);
 GUM_API void gum_process_enumerate_threads (GumFoundThreadFunc func,
     gpointer user_data);
 GUM_API void gum_process_enumerate_modules (GumFoundModuleFunc func,
@@ -16,6 +16,11 @@
 #include <gum/prof/gumprofiler.h>
 #include <gum/prof/gumprofilereport.h>
 #include <gum/prof/gumsampler.h>
+#include <gum/prof/gumtimestampsampler.h>
 #include <gum/prof/gumwallclocksampler.h>
+#ifdef __linux__
+# include <gum/prof/gumperfcountersampler.h>
+# include <gum/prof/gumsamplingprofiler.h>
+#endif
 
 #endif
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumallocationcallsite.h"
+
+GumAllocationCallSite *
+gum_allocation_call_site_new (guint trace_id)
+{
+  GumAllocationCallSite * site;
+
+  site = g_slice_new0 (GumAllocationCallSite);
+  site->trace_id = trace_id;
+
+  return site;
+}
+
+GumAllocationCallSite *
+gum_allocation_call_site_copy (const GumAllocationCallSite * site)
+{
+  return g_slice_dup (GumAllocationCallSite, site);
+}
+
+void
+gum_allocation_call_site_free (GumAllocationCallSite * site)
+{
+  g_slice_free (GumAllocationCallSite, site);
+}
+
+void
+gum_allocation_call_site_list_free (GList * sites)
+{
+  GList * cur;
+
+  for (cur = sites; cur != NULL; cur = cur->next)
+    gum_allocation_call_site_free (cur->data);
+
+  g_list_free (sites);
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_ALLOCATION_CALL_SITE_H__
+#define __GUM_ALLOCATION_CALL_SITE_H__
+
+#include <gum/gumdefs.h>
+#include <gum/gumreturnaddress.h>
+
+typedef struct _GumAllocationCallSite GumAllocationCallSite;
+
+struct _GumAllocationCallSite
+{
+  guint trace_id;
+  GumReturnAddressArray return_addresses;
+  guint alive_now;
+  guint alive_size;
+};
+
+G_BEGIN_DECLS
+
+GUM_API GumAllocationCallSite * gum_allocation_call_site_new (guint trace_id);
+GUM_API GumAllocationCallSite * gum_allocation_call_site_copy (
+    const GumAllocationCallSite * site);
+GUM_API void gum_allocation_call_site_free (GumAllocationCallSite * site);
+
+GUM_API void gum_allocation_call_site_list_free (GList * sites);
+
+G_END_DECLS
+
+#endif
@@ -6,17 +6,29 @@
 
 #include "gumallocationtracker.h"
 
+#include <math.h>
 #include <string.h>
 
 #include "gumallocationblock.h"
+#include "gumallocationcallsite.h"
 #include "gumallocationgroup.h"
 #include "gummemory.h"
 #include "gumreturnaddress.h"
 #include "gumbacktracer.h"
+#include "gumtls.h"
+
+#define GUM_ALLOCATION_TRACKER_SHARD_BITS 5
+#define GUM_ALLOCATION_TRACKER_N_SHARDS \
+    (1 << GUM_ALLOCATION_TRACKER_SHARD_BITS)
 
 G_DEFINE_TYPE (GumAllocationTracker, gum_allocation_tracker, G_TYPE_OBJECT);
 
+typedef struct _GumAllocationTrackerShard GumAllocationTrackerShard;
+typedef struct _GumAllocationTrackerTraceShard GumAllocationTrackerTraceShard;
 typedef struct _GumAllocationTrackerBlock GumAllocationTrackerBlock;
+typedef struct _GumAllocationTrackerGroup GumAllocationTrackerGroup;
+typedef struct _GumAllocationTrackerSiteEstimate
+    GumAllocationTrackerSiteEstimate;
 
 enum
 {
@@ -24,34 +36,109 @@ enum
   PROP_BACKTRACER,
 };
 
-struct _GumAllocationTrackerPrivate
+/*
+ * Blocks live in the shard picked by their address, and size groups in the
+ * shard picked by their size. This way threads allocating and freeing
+ * unrelated blocks rarely contend for the same lock.
+ *
+ * A block is counted in its group while its shard's mutex is still held, so
+ * that a free on another thread can never observe the block without its
+ * group having been updated. Hence a groups_mutex may be taken while holding
+ * any shard's mutex, but never the other way around.
+ */
+struct _GumAllocationTrackerShard
 {
-  gboolean disposed;
+  GMutex mutex;
+  GMutex groups_mutex;
+
+  GHashTable * known_blocks_ht;
+  GHashTable * block_groups_ht;
+};
 
+/*
+ * Backtraces are interned so that each block only refers to its backtrace
+ * by id. An id encodes the shard in its lowest bits and the index into that
+ * shard's traces array, plus one, in the remaining ones, which leaves zero
+ * to mean "no backtrace". These locks are never held while taking another.
+ *
+ * Each reset bumps the generation before clearing anything. A block is only
+ * inserted if the generation, checked while holding its shard's lock, is the
+ * one seen before its trace was interned. Otherwise the reset may already
+ * have dropped the trace that the block refers to.
+ */
+struct _GumAllocationTrackerTraceShard
+{
   GMutex mutex;
 
+  GHashTable * trace_ids_ht;
+  GPtrArray * traces;
+};
+
+struct _GumAllocationTrackerPrivate
+{
+  gboolean disposed;
+
   volatile gint enabled;
 
   GumAllocationTrackerFilterFunction filter_func;
   gpointer filter_func_user_data;
 
-  guint block_count;
-  guint block_total_size;
-  GHashTable * known_blocks_ht;
-  GHashTable * block_groups_ht;
+  guint sample_interval;
+  GumTlsKey sample_countdown;
+  GumTlsKey sample_rng_state;
+  volatile gint sample_rng_seed;
+  gboolean keeps_block_records;
+
+  volatile guint block_count;
+  volatile guint block_total_size;
+  volatile gint generation;
+  GumAllocationTrackerShard * shards;
+  GumAllocationTrackerTraceShard * trace_shards;
 
   GumBacktracerIface * backtracer_interface;
   GumBacktracer * backtracer_instance;
 };
 
+/*
+ * Blocks are kept as records whenever there is a backtracer or sampling is
+ * enabled, and as just their size otherwise. A sampled block remembers the
+ * size it was sampled at, as that is what decides its weight, even after it
+ * has been reallocated.
+ */
 struct _GumAllocationTrackerBlock
 {
   guint size;
-  GumReturnAddress return_addresses[1];
+  guint sampled_size;
+  guint trace_id;
+};
+
+/*
+ * Besides the exact counts of the blocks actually recorded, each group sums
+ * up the sample weights of those blocks. In sampling mode the latter are
+ * what gets reported.
+ */
+struct _GumAllocationTrackerGroup
+{
+  GumAllocationGroup group;
+
+  gdouble weighted_alive_now;
+  gdouble weighted_alive_peak;
+  gdouble weighted_total_peak;
+};
+
+struct _GumAllocationTrackerSiteEstimate
+{
+  guint trace_id;
+  gdouble alive_now;
+  gdouble alive_size;
 };
 
-#define GUM_ALLOCATION_TRACKER_LOCK(t) g_mutex_lock (&t->priv->mutex)
-#define GUM_ALLOCATION_TRACKER_UNLOCK(t) g_mutex_unlock (&t->priv->mutex)
+#define GUM_ALLOCATION_TRACKER_SHARD_LOCK(s) g_mutex_lock (&(s)->mutex)
+#define GUM_ALLOCATION_TRACKER_SHARD_UNLOCK(s) g_mutex_unlock (&(s)->mutex)
+#define GUM_ALLOCATION_TRACKER_GROUPS_LOCK(s) \
+    g_mutex_lock (&(s)->groups_mutex)
+#define GUM_ALLOCATION_TRACKER_GROUPS_UNLOCK(s) \
+    g_mutex_unlock (&(s)->groups_mutex)
 
 static void gum_allocation_tracker_constructed (GObject * object);
 static void gum_allocation_tracker_set_property (GObject * object,
@@ -61,10 +148,47 @@ static void gum_allocation_tracker_get_property (GObject * object,
 static void gum_allocation_tracker_dispose (GObject * object);
 static void gum_allocation_tracker_finalize (GObject * object);
 
-static void gum_allocation_tracker_size_stats_add_block (
+static void gum_allocation_tracker_reset (GumAllocationTracker * self,
+    gboolean include_groups);
+
+static gboolean gum_allocation_tracker_should_sample (
     GumAllocationTracker * self, guint size);
+static gsize gum_allocation_tracker_pick_sample_countdown (
+    GumAllocationTracker * self);
+static gdouble gum_allocation_tracker_next_random_double (
+    GumAllocationTracker * self);
+static gdouble gum_allocation_tracker_sample_weight (
+    GumAllocationTracker * self, guint sampled_size);
+
+static void gum_allocation_tracker_size_stats_add_block (
+    GumAllocationTracker * self, guint size, guint sampled_size);
 static void gum_allocation_tracker_size_stats_remove_block (
+    GumAllocationTracker * self, guint size, guint sampled_size);
+
+static GumAllocationTrackerShard * gum_allocation_tracker_shard_for_address (
+    GumAllocationTracker * self, gpointer address);
+static GumAllocationTrackerShard * gum_allocation_tracker_shard_for_size (
     GumAllocationTracker * self, guint size);
+static gboolean gum_allocation_tracker_shard_insert_block (
+    GumAllocationTracker * self, GumAllocationTrackerShard * shard,
+    gpointer address, gpointer value, gint generation);
+
+static guint gum_allocation_tracker_intern_trace (GumAllocationTracker * self,
+    const GumReturnAddressArray * return_addresses);
+static void gum_allocation_tracker_copy_trace (GumAllocationTracker * self,
+    guint trace_id, GumReturnAddressArray * return_addresses);
+static guint gum_allocation_tracker_hash_trace (
+    const GumReturnAddressArray * return_addresses);
+
+static GHashTable * gum_allocation_tracker_block_table_new (
+    gboolean keeps_block_records);
+static void gum_allocation_tracker_block_free (
+    GumAllocationTrackerBlock * block);
+
+static GumAllocationTrackerGroup * gum_allocation_tracker_group_new (
+    guint size);
+static void gum_allocation_tracker_group_free (
+    GumAllocationTrackerGroup * group);
 
 static void
 gum_allocation_tracker_class_init (GumAllocationTrackerClass * klass)
@@ -90,12 +214,37 @@ static void
 gum_allocation_tracker_init (GumAllocationTracker * self)
 {
   GumAllocationTrackerPrivate * priv;
+  guint i;
 
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, GUM_TYPE_ALLOCATION_TRACKER,
       GumAllocationTrackerPrivate);
   priv = self->priv;
 
-  g_mutex_init (&priv->mutex);
+  priv->shards = g_new0 (GumAllocationTrackerShard,
+      GUM_ALLOCATION_TRACKER_N_SHARDS);
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_N_SHARDS; i++)
+  {
+    g_mutex_init (&priv->shards[i].mutex);
+    g_mutex_init (&priv->shards[i].groups_mutex);
+  }
+
+  priv->sample_countdown = gum_tls_key_new ();
+  priv->sample_rng_state = gum_tls_key_new ();
+  priv->sample_rng_seed = (gint) g_random_int ();
+
+  priv->trace_shards = g_new0 (GumAllocationTrackerTraceShard,
+      GUM_ALLOCATION_TRACKER_N_SHARDS);
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_N_SHARDS; i++)
+  {
+    GumAllocationTrackerTraceShard * shard = &priv->trace_shards[i];
+
+    g_mutex_init (&shard->mutex);
+
+    shard->trace_ids_ht = g_hash_table_new (
+        (GHashFunc) gum_allocation_tracker_hash_trace,
+        (GEqualFunc) gum_return_address_array_is_equal);
+    shard->traces = g_ptr_array_new_with_free_func (g_free);
+  }
 }
 
 static void
@@ -103,18 +252,20 @@ gum_allocation_tracker_constructed (GObject * object)
 {
   GumAllocationTracker * self = GUM_ALLOCATION_TRACKER (object);
   GumAllocationTrackerPrivate * priv = self->priv;
+  guint i;
 
-  if (priv->backtracer_instance != NULL)
-  {
-    priv->known_blocks_ht = g_hash_table_new_full (NULL, NULL, NULL, g_free);
-  }
-  else
+  priv->keeps_block_records = priv->backtracer_instance != NULL;
+
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_N_SHARDS; i++)
   {
-    priv->known_blocks_ht = g_hash_table_new (NULL, NULL);
-  }
+    GumAllocationTrackerShard * shard = &priv->shards[i];
 
-  priv->block_groups_ht = g_hash_table_new_full (NULL, NULL, NULL,
-      (GDestroyNotify) gum_allocation_group_free);
+    shard->known_blocks_ht =
+        gum_allocation_tracker_block_table_new (priv->keeps_block_records);
+
+    shard->block_groups_ht = g_hash_table_new_full (NULL, NULL, NULL,
+        (GDestroyNotify) gum_allocation_tracker_group_free);
+  }
 }
 
 static void
@@ -173,6 +324,7 @@ gum_allocation_tracker_dispose (GObject * object)
 {
   GumAllocationTracker * self = GUM_ALLOCATION_TRACKER (object);
   GumAllocationTrackerPrivate * priv = self->priv;
+  guint i;
 
   if (!priv->disposed)
   {
@@ -185,11 +337,16 @@ gum_allocation_tracker_dispose (GObject * object)
     }
     priv->backtracer_interface = NULL;
 
-    g_hash_table_unref (priv->known_blocks_ht);
-    priv->known_blocks_ht = NULL;
+    for (i = 0; i != GUM_ALLOCATION_TRACKER_N_SHARDS; i++)
+    {
+      GumAllocationTrackerShard * shard = &priv->shards[i];
+
+      g_hash_table_unref (shard->known_blocks_ht);
+      shard->known_blocks_ht = NULL;
 
-    g_hash_table_unref (priv->block_groups_ht);
-    priv->block_groups_ht = NULL;
+      g_hash_table_unref (shard->block_groups_ht);
+      shard->block_groups_ht = NULL;
+    }
   }
 
   G_OBJECT_CLASS (gum_allocation_tracker_parent_class)->dispose (object);
@@ -199,8 +356,29 @@ static void
 gum_allocation_tracker_finalize (GObject * object)
 {
   GumAllocationTracker * self = GUM_ALLOCATION_TRACKER (object);
+  GumAllocationTrackerPrivate * priv = self->priv;
+  guint i;
 
-  g_mutex_clear (&self->priv->mutex);
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_N_SHARDS; i++)
+  {
+    GumAllocationTrackerTraceShard * shard = &priv->trace_shards[i];
+
+    g_ptr_array_unref (shard->traces);
+    g_hash_table_unref (shard->trace_ids_ht);
+
+    g_mutex_clear (&shard->mutex);
+  }
+  g_free (priv->trace_shards);
+
+  gum_tls_key_free (priv->sample_rng_state);
+  gum_tls_key_free (priv->sample_countdown);
+
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_N_SHARDS; i++)
+  {
+    g_mutex_clear (&priv->shards[i].groups_mutex);
+    g_mutex_clear (&priv->shards[i].mutex);
+  }
+  g_free (priv->shards);
 
   G_OBJECT_CLASS (gum_allocation_tracker_parent_class)->finalize (object);
 }
@@ -232,79 +410,178 @@ gum_allocation_tracker_set_filter_function (GumAllocationTracker * self,
   priv->filter_func_user_data = user_data;
 }
 
+/*
+ * Records on average one allocation per sample_interval bytes allocated,
+ * picking them as a Poisson process over the allocated bytes, like
+ * tcmalloc's heap profiler does. Counts and sizes reported through
+ * peek_block_count(), peek_block_total_size(), peek_block_groups() and
+ * peek_call_sites() are then unbiased estimates scaled up from the sampled
+ * blocks, while peek_block_list() only returns the sampled blocks. Zero,
+ * the default, records every allocation.
+ */
 void
-gum_allocation_tracker_begin (GumAllocationTracker * self)
+gum_allocation_tracker_set_sample_interval (GumAllocationTracker * self,
+                                            guint sample_interval)
 {
   GumAllocationTrackerPrivate * priv = self->priv;
+  gboolean keeps_block_records;
+
+  g_assert (g_atomic_int_get (&priv->enabled) == FALSE);
+
+  priv->sample_interval = sample_interval;
+
+  keeps_block_records =
+      priv->backtracer_instance != NULL || sample_interval != 0;
+  if (keeps_block_records != priv->keeps_block_records)
+  {
+    guint i;
+
+    for (i = 0; i != GUM_ALLOCATION_TRACKER_N_SHARDS; i++)
+    {
+      GumAllocationTrackerShard * shard = &priv->shards[i];
+
+      GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+      g_hash_table_unref (shard->known_blocks_ht);
+      shard->known_blocks_ht =
+          gum_allocation_tracker_block_table_new (keeps_block_records);
+      GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
+    }
 
-  GUM_ALLOCATION_TRACKER_LOCK (self);
-  priv->block_count = 0;
-  priv->block_total_size = 0;
-  g_hash_table_remove_all (priv->known_blocks_ht);
-  GUM_ALLOCATION_TRACKER_UNLOCK (self);
+    priv->keeps_block_records = keeps_block_records;
+  }
+}
+
+void
+gum_allocation_tracker_begin (GumAllocationTracker * self)
+{
+  gum_allocation_tracker_reset (self, FALSE);
 
-  g_atomic_int_set (&priv->enabled, TRUE);
+  g_atomic_int_set (&self->priv->enabled, TRUE);
 }
 
 void
 gum_allocation_tracker_end (GumAllocationTracker * self)
+{
+  g_atomic_int_set (&self->priv->enabled, FALSE);
+
+  gum_allocation_tracker_reset (self, TRUE);
+}
+
+static void
+gum_allocation_tracker_reset (GumAllocationTracker * self,
+                              gboolean include_groups)
 {
   GumAllocationTrackerPrivate * priv = self->priv;
+  guint i;
+
+  g_atomic_int_inc (&priv->generation);
+
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_N_SHARDS; i++)
+  {
+    GumAllocationTrackerShard * shard = &priv->shards[i];
+
+    GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+    g_hash_table_remove_all (shard->known_blocks_ht);
+    if (include_groups)
+    {
+      GUM_ALLOCATION_TRACKER_GROUPS_LOCK (shard);
+      g_hash_table_remove_all (shard->block_groups_ht);
+      GUM_ALLOCATION_TRACKER_GROUPS_UNLOCK (shard);
+    }
+    GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
+  }
+
+  if (include_groups)
+  {
+    for (i = 0; i != GUM_ALLOCATION_TRACKER_N_SHARDS; i++)
+    {
+      GumAllocationTrackerTraceShard * shard = &priv->trace_shards[i];
 
-  g_atomic_int_set (&priv->enabled, FALSE);
+      GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+      g_hash_table_remove_all (shard->trace_ids_ht);
+      g_ptr_array_set_size (shard->traces, 0);
+      GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
+    }
+  }
 
-  GUM_ALLOCATION_TRACKER_LOCK (self);
-  priv->block_count = 0;
-  priv->block_total_size = 0;
-  g_hash_table_remove_all (priv->known_blocks_ht);
-  g_hash_table_remove_all (priv->block_groups_ht);
-  GUM_ALLOCATION_TRACKER_UNLOCK (self);
+  g_atomic_int_set (&priv->block_count, 0);
+  g_atomic_int_set (&priv->block_total_size, 0);
 }
 
 guint
 gum_allocation_tracker_peek_block_count (GumAllocationTracker * self)
 {
-  return self->priv->block_count;
+  GList * groups, * cur;
+  guint count = 0;
+
+  if (self->priv->sample_interval == 0)
+    return g_atomic_int_get (&self->priv->block_count);
+
+  groups = gum_allocation_tracker_peek_block_groups (self);
+  for (cur = groups; cur != NULL; cur = cur->next)
+    count += ((GumAllocationGroup *) cur->data)->alive_now;
+  gum_allocation_group_list_free (groups);
+
+  return count;
 }
 
 guint
 gum_allocation_tracker_peek_block_total_size (GumAllocationTracker * self)
 {
-  return self->priv->block_total_size;
+  GList * groups, * cur;
+  guint total_size = 0;
+
+  if (self->priv->sample_interval == 0)
+    return g_atomic_int_get (&self->priv->block_total_size);
+
+  groups = gum_allocation_tracker_peek_block_groups (self);
+  for (cur = groups; cur != NULL; cur = cur->next)
+  {
+    GumAllocationGroup * group = (GumAllocationGroup *) cur->data;
+
+    total_size += group->alive_now * group->size;
+  }
+  gum_allocation_group_list_free (groups);
+
+  return total_size;
 }
 
 GList *
 gum_allocation_tracker_peek_block_list (GumAllocationTracker * self)
 {
+  GumAllocationTrackerPrivate * priv = self->priv;
   GList * blocks = NULL;
-  GHashTableIter iter;
-  gpointer key, value;
+  guint i;
 
-  GUM_ALLOCATION_TRACKER_LOCK (self);
-  g_hash_table_iter_init (&iter, self->priv->known_blocks_ht);
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_N_SHARDS; i++)
   {
-    if (self->priv->backtracer_instance != NULL)
-    {
-      GumAllocationTrackerBlock * tb = (GumAllocationTrackerBlock *) value;
-      GumAllocationBlock * block;
-      guint i;
+    GumAllocationTrackerShard * shard = &priv->shards[i];
+    GHashTableIter iter;
+    gpointer key, value;
 
-      block = gum_allocation_block_new (key, tb->size);
+    GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+    g_hash_table_iter_init (&iter, shard->known_blocks_ht);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      if (priv->keeps_block_records)
+      {
+        GumAllocationTrackerBlock * tb = (GumAllocationTrackerBlock *) value;
+        GumAllocationBlock * block;
 
-      for (i = 0; tb->return_addresses[i] != NULL; i++)
-        block->return_addresses.items[i] = tb->return_addresses[i];
-      block->return_addresses.len = i;
+        block = gum_allocation_block_new (key, tb->size);
+        gum_allocation_tracker_copy_trace (self, tb->trace_id,
+            &block->return_addresses);
 
-      blocks = g_list_prepend (blocks, block);
-    }
-    else
-    {
-      blocks = g_list_prepend (blocks,
-          gum_allocation_block_new (key, GPOINTER_TO_UINT (value)));
+        blocks = g_list_prepend (blocks, block);
+      }
+      else
+      {
+        blocks = g_list_prepend (blocks,
+            gum_allocation_block_new (key, GPOINTER_TO_UINT (value)));
+      }
     }
+    GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
   }
-  GUM_ALLOCATION_TRACKER_UNLOCK (self);
 
   return blocks;
 }
@@ -312,17 +589,106 @@ gum_allocation_tracker_peek_block_list (GumAllocationTracker * self)
 GList *
 gum_allocation_tracker_peek_block_groups (GumAllocationTracker * self)
 {
-  GList * groups, * cur;
+  GumAllocationTrackerPrivate * priv = self->priv;
+  GList * groups = NULL;
+  guint i;
 
-  GUM_ALLOCATION_TRACKER_LOCK (self);
-  groups = g_hash_table_get_values (self->priv->block_groups_ht);
-  for (cur = groups; cur != NULL; cur = cur->next)
-    cur->data = gum_allocation_group_copy ((GumAllocationGroup *) cur->data);
-  GUM_ALLOCATION_TRACKER_UNLOCK (self);
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_N_SHARDS; i++)
+  {
+    GumAllocationTrackerShard * shard = &priv->shards[i];
+    GHashTableIter iter;
+    gpointer value;
+
+    GUM_ALLOCATION_TRACKER_GROUPS_LOCK (shard);
+    g_hash_table_iter_init (&iter, shard->block_groups_ht);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GumAllocationTrackerGroup * tg = (GumAllocationTrackerGroup *) value;
+      GumAllocationGroup * group;
+
+      group = gum_allocation_group_copy (&tg->group);
+      if (priv->sample_interval != 0)
+      {
+        group->alive_now = (guint) (tg->weighted_alive_now + 0.5);
+        group->alive_peak = (guint) (tg->weighted_alive_peak + 0.5);
+        group->total_peak = (guint) (tg->weighted_total_peak + 0.5);
+      }
+
+      groups = g_list_prepend (groups, group);
+    }
+    GUM_ALLOCATION_TRACKER_GROUPS_UNLOCK (shard);
+  }
 
   return groups;
 }
 
+GList *
+gum_allocation_tracker_peek_call_sites (GumAllocationTracker * self)
+{
+  GumAllocationTrackerPrivate * priv = self->priv;
+  GHashTable * estimate_by_trace_id;
+  GHashTableIter iter;
+  gpointer value;
+  GList * sites = NULL;
+  guint i;
+
+  if (priv->backtracer_instance == NULL)
+    return NULL;
+
+  estimate_by_trace_id = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_N_SHARDS; i++)
+  {
+    GumAllocationTrackerShard * shard = &priv->shards[i];
+    GHashTableIter iter;
+    gpointer value;
+
+    GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+    g_hash_table_iter_init (&iter, shard->known_blocks_ht);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GumAllocationTrackerBlock * block = (GumAllocationTrackerBlock *) value;
+      GumAllocationTrackerSiteEstimate * estimate;
+      gdouble weight;
+
+      estimate = g_hash_table_lookup (estimate_by_trace_id,
+          GUINT_TO_POINTER (block->trace_id));
+      if (estimate == NULL)
+      {
+        estimate = g_new0 (GumAllocationTrackerSiteEstimate, 1);
+        estimate->trace_id = block->trace_id;
+        g_hash_table_insert (estimate_by_trace_id,
+            GUINT_TO_POINTER (block->trace_id), estimate);
+      }
+
+      weight =
+          gum_allocation_tracker_sample_weight (self, block->sampled_size);
+      estimate->alive_now += weight;
+      estimate->alive_size += weight * block->size;
+    }
+    GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
+  }
+
+  g_hash_table_iter_init (&iter, estimate_by_trace_id);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+  {
+    GumAllocationTrackerSiteEstimate * estimate = value;
+    GumAllocationCallSite * site;
+
+    site = gum_allocation_call_site_new (estimate->trace_id);
+    gum_allocation_tracker_copy_trace (self, site->trace_id,
+        &site->return_addresses);
+    site->alive_now = (guint) (estimate->alive_now + 0.5);
+    site->alive_size = (guint) (estimate->alive_size + 0.5);
+
+    sites = g_list_prepend (sites, site);
+  }
+
+  g_hash_table_unref (estimate_by_trace_id);
+
+  return sites;
+}
+
 void
 gum_allocation_tracker_on_malloc (GumAllocationTracker * self,
                                   gpointer address,
@@ -355,18 +721,26 @@ gum_allocation_tracker_on_malloc_full (GumAllocationTracker * self,
                                        const GumCpuContext * cpu_context)
 {
   GumAllocationTrackerPrivate * priv = self->priv;
+  GumAllocationTrackerShard * shard;
+  gint generation;
   gpointer value;
 
   if (!g_atomic_int_get (&priv->enabled))
     return;
 
-  if (priv->backtracer_instance != NULL)
+  if (priv->sample_interval != 0 &&
+      !gum_allocation_tracker_should_sample (self, size))
+    return;
+
+  generation = g_atomic_int_get (&priv->generation);
+
+  if (priv->keeps_block_records)
   {
-    gboolean do_backtrace = TRUE;
+    gboolean do_backtrace = priv->backtracer_instance != NULL;
     GumReturnAddressArray return_addresses;
     GumAllocationTrackerBlock * block;
 
-    if (priv->filter_func != NULL)
+    if (do_backtrace && priv->filter_func != NULL)
     {
       do_backtrace = priv->filter_func (self, address, size,
           priv->filter_func_user_data);
@@ -382,17 +756,12 @@ gum_allocation_tracker_on_malloc_full (GumAllocationTracker * self,
       return_addresses.len = 0;
     }
 
-    block = (GumAllocationTrackerBlock *)
-        g_malloc (sizeof (GumAllocationTrackerBlock) +
-            (return_addresses.len * sizeof (GumReturnAddress)));
+    block = g_slice_new (GumAllocationTrackerBlock);
     block->size = size;
-    block->return_addresses[return_addresses.len] = NULL;
-
-    if (return_addresses.len > 0)
-    {
-      memcpy (block->return_addresses, &return_addresses.items,
-          return_addresses.len * sizeof (GumReturnAddress));
-    }
+    block->sampled_size = size;
+    block->trace_id = (return_addresses.len > 0)
+        ? gum_allocation_tracker_intern_trace (self, &return_addresses)
+        : 0;
 
     value = block;
   }
@@ -401,13 +770,15 @@ gum_allocation_tracker_on_malloc_full (GumAllocationTracker * self,
     value = GUINT_TO_POINTER (size);
   }
 
-  GUM_ALLOCATION_TRACKER_LOCK (self);
-
-  g_hash_table_insert (priv->known_blocks_ht, address, value);
-
-  gum_allocation_tracker_size_stats_add_block (self, size);
+  shard = gum_allocation_tracker_shard_for_address (self, address);
 
-  GUM_ALLOCATION_TRACKER_UNLOCK (self);
+  GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+  if (gum_allocation_tracker_shard_insert_block (self, shard, address, value,
+      generation))
+  {
+    gum_allocation_tracker_size_stats_add_block (self, size, size);
+  }
+  GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
 }
 
 void
@@ -416,31 +787,40 @@ gum_allocation_tracker_on_free_full (GumAllocationTracker * self,
                                      const GumCpuContext * cpu_context)
 {
   GumAllocationTrackerPrivate * priv = self->priv;
+  GumAllocationTrackerShard * shard;
   gpointer value;
+  guint size = 0, sampled_size = 0;
 
   (void) cpu_context;
 
   if (!g_atomic_int_get (&priv->enabled))
     return;
 
-  GUM_ALLOCATION_TRACKER_LOCK (self);
+  shard = gum_allocation_tracker_shard_for_address (self, address);
 
-  value = g_hash_table_lookup (priv->known_blocks_ht, address);
+  GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+  value = g_hash_table_lookup (shard->known_blocks_ht, address);
   if (value != NULL)
   {
-    guint size;
+    if (priv->keeps_block_records)
+    {
+      GumAllocationTrackerBlock * block = (GumAllocationTrackerBlock *) value;
 
-    if (priv->backtracer_instance != NULL)
-      size = ((GumAllocationTrackerBlock *) value)->size;
+      size = block->size;
+      sampled_size = block->sampled_size;
+    }
     else
+    {
       size = GPOINTER_TO_UINT (value);
+      sampled_size = size;
+    }
 
-    gum_allocation_tracker_size_stats_remove_block (self, size);
+    g_hash_table_remove (shard->known_blocks_ht, address);
 
-    g_hash_table_remove (priv->known_blocks_ht, address);
+    gum_allocation_tracker_size_stats_remove_block (self, size,
+        sampled_size);
   }
-
-  GUM_ALLOCATION_TRACKER_UNLOCK (self);
+  GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
 }
 
 void
@@ -459,41 +839,54 @@ gum_allocation_tracker_on_realloc_full (GumAllocationTracker * self,
   {
     if (new_size != 0)
     {
+      GumAllocationTrackerShard * shard;
+      gint generation;
       gpointer value;
+      guint old_size, sampled_size;
 
-      GUM_ALLOCATION_TRACKER_LOCK (self);
+      generation = g_atomic_int_get (&priv->generation);
 
-      value = g_hash_table_lookup (priv->known_blocks_ht, old_address);
+      shard = gum_allocation_tracker_shard_for_address (self, old_address);
+
+      GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+      value = g_hash_table_lookup (shard->known_blocks_ht, old_address);
       if (value != NULL)
-      {
-        guint old_size;
+        g_hash_table_steal (shard->known_blocks_ht, old_address);
+      GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
 
-        g_hash_table_steal (priv->known_blocks_ht, old_address);
+      if (value == NULL)
+        return;
 
-        if (priv->backtracer_instance != NULL)
-        {
-          GumAllocationTrackerBlock * block;
+      if (priv->keeps_block_records)
+      {
+        GumAllocationTrackerBlock * block;
 
-          block = (GumAllocationTrackerBlock *) value;
+        block = (GumAllocationTrackerBlock *) value;
 
-          g_hash_table_insert (priv->known_blocks_ht, new_address, block);
+        old_size = block->size;
+        sampled_size = block->sampled_size;
+        block->size = new_size;
+      }
+      else
+      {
+        old_size = GPOINTER_TO_UINT (value);
+        sampled_size = old_size;
 
-          old_size = block->size;
-          block->size = new_size;
-        }
-        else
-        {
-          g_hash_table_insert (priv->known_blocks_ht, new_address,
-              GUINT_TO_POINTER (new_size));
+        value = GUINT_TO_POINTER (new_size);
+      }
 
-          old_size = GPOINTER_TO_UINT (value);
-        }
+      shard = gum_allocation_tracker_shard_for_address (self, new_address);
 
-        gum_allocation_tracker_size_stats_remove_block (self, old_size);
-        gum_allocation_tracker_size_stats_add_block (self, new_size);
+      GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+      if (gum_allocation_tracker_shard_insert_block (self, shard,
+          new_address, value, generation))
+      {
+        gum_allocation_tracker_size_stats_add_block (self, new_size,
+            sampled_size);
+        gum_allocation_tracker_size_stats_remove_block (self, old_size,
+            sampled_size);
       }
-
-      GUM_ALLOCATION_TRACKER_UNLOCK (self);
+      GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
     }
     else
     {
@@ -507,43 +900,330 @@ gum_allocation_tracker_on_realloc_full (GumAllocationTracker * self,
   }
 }
 
+static gboolean
+gum_allocation_tracker_should_sample (GumAllocationTracker * self,
+                                      guint size)
+{
+  GumAllocationTrackerPrivate * priv = self->priv;
+  gsize bytes_left;
+
+  bytes_left =
+      GPOINTER_TO_SIZE (gum_tls_key_get_value (priv->sample_countdown));
+  if (bytes_left == 0)
+    bytes_left = gum_allocation_tracker_pick_sample_countdown (self);
+
+  if (size < bytes_left)
+  {
+    gum_tls_key_set_value (priv->sample_countdown,
+        GSIZE_TO_POINTER (bytes_left - size));
+    return FALSE;
+  }
+
+  gum_tls_key_set_value (priv->sample_countdown,
+      GSIZE_TO_POINTER (gum_allocation_tracker_pick_sample_countdown (self)));
+
+  return TRUE;
+}
+
+/*
+ * The distance to the next sampled byte is exponentially distributed, so an
+ * allocation of size bytes gets sampled with probability
+ * 1 - exp (-size / sample_interval) regardless of what came before it.
+ */
+static gsize
+gum_allocation_tracker_pick_sample_countdown (GumAllocationTracker * self)
+{
+  gdouble u;
+
+  u = gum_allocation_tracker_next_random_double (self);
+
+  return (gsize) (-log (u) * self->priv->sample_interval) + 1;
+}
+
+/*
+ * Returns a number in the open interval (0, 1) from a per-thread xorshift
+ * generator, as g_random_double() would serialize all sampling threads on
+ * GLib's global lock. Each thread seeds its state from a per-tracker
+ * counter, which starts out random, scrambled by an odd multiplier.
+ */
+static gdouble
+gum_allocation_tracker_next_random_double (GumAllocationTracker * self)
+{
+  GumAllocationTrackerPrivate * priv = self->priv;
+  guint32 x;
+
+  x = GPOINTER_TO_UINT (gum_tls_key_get_value (priv->sample_rng_state));
+  if (x == 0)
+  {
+    x = (guint32) g_atomic_int_add (&priv->sample_rng_seed, 1) * 2654435761U;
+    if (x == 0)
+      x = 1;
+  }
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+
+  gum_tls_key_set_value (priv->sample_rng_state, GUINT_TO_POINTER (x));
+
+  return x / 4294967296.0;
+}
+
+static gdouble
+gum_allocation_tracker_sample_weight (GumAllocationTracker * self,
+                                      guint sampled_size)
+{
+  guint sample_interval = self->priv->sample_interval;
+
+  if (sample_interval == 0)
+    return 1.0;
+
+  return 1.0 / (1.0 - exp (-((gdouble) sampled_size / sample_interval)));
+}
+
+/* Must be called with the lock of the block's shard held. */
 static void
 gum_allocation_tracker_size_stats_add_block (GumAllocationTracker * self,
-                                             guint size)
+                                             guint size,
+                                             guint sampled_size)
 {
   GumAllocationTrackerPrivate * priv = self->priv;
+  GumAllocationTrackerShard * shard;
+  GumAllocationTrackerGroup * tg;
   GumAllocationGroup * group;
+  gdouble weight;
+
+  weight = gum_allocation_tracker_sample_weight (self, sampled_size);
+
+  g_atomic_int_inc (&priv->block_count);
+  g_atomic_int_add (&priv->block_total_size, size);
 
-  priv->block_count++;
-  priv->block_total_size += size;
+  shard = gum_allocation_tracker_shard_for_size (self, size);
 
-  group = (GumAllocationGroup *)
-      g_hash_table_lookup (priv->block_groups_ht, GUINT_TO_POINTER (size));
+  GUM_ALLOCATION_TRACKER_GROUPS_LOCK (shard);
 
-  if (group == NULL)
+  tg = (GumAllocationTrackerGroup *)
+      g_hash_table_lookup (shard->block_groups_ht, GUINT_TO_POINTER (size));
+
+  if (tg == NULL)
   {
-    group = gum_allocation_group_new (size);
-    g_hash_table_insert (priv->block_groups_ht, GUINT_TO_POINTER (size),
-        group);
+    tg = gum_allocation_tracker_group_new (size);
+    g_hash_table_insert (shard->block_groups_ht, GUINT_TO_POINTER (size), tg);
   }
 
+  group = &tg->group;
   group->alive_now++;
   if (group->alive_now > group->alive_peak)
     group->alive_peak = group->alive_now;
   group->total_peak++;
+
+  tg->weighted_alive_now += weight;
+  if (tg->weighted_alive_now > tg->weighted_alive_peak)
+    tg->weighted_alive_peak = tg->weighted_alive_now;
+  tg->weighted_total_peak += weight;
+
+  GUM_ALLOCATION_TRACKER_GROUPS_UNLOCK (shard);
 }
 
+/* Must be called with the lock of the block's shard held. */
 static void
 gum_allocation_tracker_size_stats_remove_block (GumAllocationTracker * self,
-                                                guint size)
+                                                guint size,
+                                                guint sampled_size)
 {
   GumAllocationTrackerPrivate * priv = self->priv;
-  GumAllocationGroup * group;
+  GumAllocationTrackerShard * shard;
+  GumAllocationTrackerGroup * tg;
+
+  g_atomic_int_add (&priv->block_count, -1);
+  g_atomic_int_add (&priv->block_total_size, -((gint) size));
+
+  shard = gum_allocation_tracker_shard_for_size (self, size);
+
+  GUM_ALLOCATION_TRACKER_GROUPS_LOCK (shard);
 
-  priv->block_count--;
-  priv->block_total_size -= size;
+  tg = (GumAllocationTrackerGroup *) g_hash_table_lookup (
+      shard->block_groups_ht, GUINT_TO_POINTER (size));
+  /* Only missing if reset() has dropped the groups while blocks remained. */
+  if (tg != NULL)
+  {
+    tg->group.alive_now--;
+    tg->weighted_alive_now -=
+        gum_allocation_tracker_sample_weight (self, sampled_size);
+  }
+
+  GUM_ALLOCATION_TRACKER_GROUPS_UNLOCK (shard);
+}
 
-  group = (GumAllocationGroup *) g_hash_table_lookup (priv->block_groups_ht,
-      GUINT_TO_POINTER (size));
-  group->alive_now--;
+static GumAllocationTrackerShard *
+gum_allocation_tracker_shard_for_address (GumAllocationTracker * self,
+                                          gpointer address)
+{
+  guint32 hash;
+
+  hash = (guint32) (GPOINTER_TO_SIZE (address) >> 4) * 2654435761U;
+
+  return &self->priv->shards[hash >> (32 - GUM_ALLOCATION_TRACKER_SHARD_BITS)];
+}
+
+static GumAllocationTrackerShard *
+gum_allocation_tracker_shard_for_size (GumAllocationTracker * self,
+                                       guint size)
+{
+  guint32 hash;
+
+  hash = (guint32) size * 2654435761U;
+
+  return &self->priv->shards[hash >> (32 - GUM_ALLOCATION_TRACKER_SHARD_BITS)];
+}
+
+/* Must be called with the shard's lock held. Takes ownership of value. */
+static gboolean
+gum_allocation_tracker_shard_insert_block (GumAllocationTracker * self,
+                                           GumAllocationTrackerShard * shard,
+                                           gpointer address,
+                                           gpointer value,
+                                           gint generation)
+{
+  GumAllocationTrackerPrivate * priv = self->priv;
+
+  if (g_atomic_int_get (&priv->generation) != generation)
+  {
+    if (priv->keeps_block_records)
+      gum_allocation_tracker_block_free (value);
+    return FALSE;
+  }
+
+  g_hash_table_insert (shard->known_blocks_ht, address, value);
+
+  return TRUE;
+}
+
+static guint
+gum_allocation_tracker_intern_trace (
+    GumAllocationTracker * self,
+    const GumReturnAddressArray * return_addresses)
+{
+  GumAllocationTrackerPrivate * priv = self->priv;
+  guint shard_index, trace_id;
+  GumAllocationTrackerTraceShard * shard;
+  gpointer value;
+
+  shard_index = (gum_allocation_tracker_hash_trace (return_addresses) *
+      2654435761U) >> (32 - GUM_ALLOCATION_TRACKER_SHARD_BITS);
+  shard = &priv->trace_shards[shard_index];
+
+  GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+
+  value = g_hash_table_lookup (shard->trace_ids_ht, return_addresses);
+  if (value != NULL)
+  {
+    trace_id = GPOINTER_TO_UINT (value);
+  }
+  else
+  {
+    gsize trace_size;
+    GumReturnAddressArray * trace;
+
+    trace_size = G_STRUCT_OFFSET (GumReturnAddressArray, items) +
+        (return_addresses->len * sizeof (GumReturnAddress));
+    trace = g_malloc (trace_size);
+    memcpy (trace, return_addresses, trace_size);
+
+    g_ptr_array_add (shard->traces, trace);
+    trace_id = (shard->traces->len << GUM_ALLOCATION_TRACKER_SHARD_BITS) |
+        shard_index;
+
+    g_hash_table_insert (shard->trace_ids_ht, trace,
+        GUINT_TO_POINTER (trace_id));
+  }
+
+  GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
+
+  return trace_id;
+}
+
+static void
+gum_allocation_tracker_copy_trace (GumAllocationTracker * self,
+                                   guint trace_id,
+                                   GumReturnAddressArray * return_addresses)
+{
+  GumAllocationTrackerTraceShard * shard;
+  guint index;
+  const GumReturnAddressArray * trace;
+
+  if (trace_id == 0)
+  {
+    return_addresses->len = 0;
+    return;
+  }
+
+  shard = &self->priv->trace_shards[trace_id &
+      (GUM_ALLOCATION_TRACKER_N_SHARDS - 1)];
+
+  index = (trace_id >> GUM_ALLOCATION_TRACKER_SHARD_BITS) - 1;
+
+  GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+  if (index < shard->traces->len)
+  {
+    trace = g_ptr_array_index (shard->traces, index);
+    memcpy (return_addresses, trace, G_STRUCT_OFFSET (GumReturnAddressArray,
+        items) + (trace->len * sizeof (GumReturnAddress)));
+  }
+  else
+  {
+    return_addresses->len = 0;
+  }
+  GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
+}
+
+static guint
+gum_allocation_tracker_hash_trace (
+    const GumReturnAddressArray * return_addresses)
+{
+  guint hash, i;
+
+  hash = return_addresses->len;
+  for (i = 0; i != return_addresses->len; i++)
+  {
+    hash = (hash << 5) - hash +
+        (guint) GPOINTER_TO_SIZE (return_addresses->items[i]);
+  }
+
+  return hash;
+}
+
+static GHashTable *
+gum_allocation_tracker_block_table_new (gboolean keeps_block_records)
+{
+  if (keeps_block_records)
+  {
+    return g_hash_table_new_full (NULL, NULL, NULL,
+        (GDestroyNotify) gum_allocation_tracker_block_free);
+  }
+
+  return g_hash_table_new (NULL, NULL);
+}
+
+static void
+gum_allocation_tracker_block_free (GumAllocationTrackerBlock * block)
+{
+  g_slice_free (GumAllocationTrackerBlock, block);
+}
+
+static GumAllocationTrackerGroup *
+gum_allocation_tracker_group_new (guint size)
+{
+  GumAllocationTrackerGroup * group;
+
+  group = g_slice_new0 (GumAllocationTrackerGroup);
+  group->group.size = size;
+
+  return group;
+}
+
+static void
+gum_allocation_tracker_group_free (GumAllocationTrackerGroup * group)
+{
+  g_slice_free (GumAllocationTrackerGroup, group);
 }
@@ -56,6 +56,9 @@ GUM_API void gum_allocation_tracker_set_filter_function (
     GumAllocationTracker * self, GumAllocationTrackerFilterFunction filter,
     gpointer user_data);
 
+GUM_API void gum_allocation_tracker_set_sample_interval (
+    GumAllocationTracker * self, guint sample_interval);
+
 GUM_API void gum_allocation_tracker_begin (GumAllocationTracker * self);
 GUM_API void gum_allocation_tracker_end (GumAllocationTracker * self);
 
@@ -67,6 +70,8 @@ GUM_API GList * gum_allocation_tracker_peek_block_list (
     GumAllocationTracker * self);
 GUM_API GList * gum_allocation_tracker_peek_block_groups (
     GumAllocationTracker * self);
+GUM_API GList * gum_allocation_tracker_peek_call_sites (
+    GumAllocationTracker * self);
 
 /*< Internal API */
 void gum_allocation_tracker_on_malloc (GumAllocationTracker * self,
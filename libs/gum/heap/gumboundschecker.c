@@ -16,6 +16,7 @@
 
 #define DEFAULT_POOL_SIZE       4096
 #define DEFAULT_FRONT_ALIGNMENT   16
+#define DEFAULT_QUARANTINE_SIZE    0
 
 #define GUM_BOUNDS_CHECKER_LOCK()   (g_mutex_lock (&self->priv->mutex))
 #define GUM_BOUNDS_CHECKER_UNLOCK() (g_mutex_unlock (&self->priv->mutex))
@@ -30,7 +31,8 @@ enum
   PROP_0,
   PROP_BACKTRACER,
   PROP_POOL_SIZE,
-  PROP_FRONT_ALIGNMENT
+  PROP_FRONT_ALIGNMENT,
+  PROP_QUARANTINE_SIZE
 };
 
 struct _GumBoundsCheckerPrivate
@@ -53,6 +55,7 @@ struct _GumBoundsCheckerPrivate
 
   guint pool_size;
   guint front_alignment;
+  guint quarantine_size;
   GumPagePool * page_pool;
 };
 
@@ -112,6 +115,12 @@ gum_bounds_checker_class_init (GumBoundsCheckerClass * klass)
       "Front alignment requirement",
       1, 64, DEFAULT_FRONT_ALIGNMENT,
       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_QUARANTINE_SIZE,
+      g_param_spec_uint ("quarantine-size", "Quarantine Size",
+      "Number of freed pages to keep inaccessible before reusing them",
+      0, G_MAXUINT, DEFAULT_QUARANTINE_SIZE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -130,6 +139,7 @@ gum_bounds_checker_init (GumBoundsChecker * self)
   priv->exceptor = gum_exceptor_obtain ();
   priv->pool_size = DEFAULT_POOL_SIZE;
   priv->front_alignment = DEFAULT_FRONT_ALIGNMENT;
+  priv->quarantine_size = DEFAULT_QUARANTINE_SIZE;
 
   gum_exceptor_add (priv->exceptor, gum_bounds_checker_on_exception, self);
 }
@@ -194,6 +204,9 @@ gum_bounds_checker_get_property (GObject * object,
     case PROP_FRONT_ALIGNMENT:
       g_value_set_uint (value, gum_bounds_checker_get_front_alignment (self));
       break;
+    case PROP_QUARANTINE_SIZE:
+      g_value_set_uint (value, gum_bounds_checker_get_quarantine_size (self));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
@@ -232,6 +245,9 @@ gum_bounds_checker_set_property (GObject * object,
     case PROP_FRONT_ALIGNMENT:
       gum_bounds_checker_set_front_alignment (self, g_value_get_uint (value));
       break;
+    case PROP_QUARANTINE_SIZE:
+      gum_bounds_checker_set_quarantine_size (self, g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
@@ -284,6 +300,20 @@ gum_bounds_checker_set_front_alignment (GumBoundsChecker * self,
   self->priv->front_alignment = pool_size;
 }
 
+guint
+gum_bounds_checker_get_quarantine_size (GumBoundsChecker * self)
+{
+  return self->priv->quarantine_size;
+}
+
+void
+gum_bounds_checker_set_quarantine_size (GumBoundsChecker * self,
+                                        guint quarantine_size)
+{
+  g_assert (self->priv->page_pool == NULL);
+  self->priv->quarantine_size = quarantine_size;
+}
+
 void
 gum_bounds_checker_attach (GumBoundsChecker * self)
 {
@@ -305,7 +335,9 @@ gum_bounds_checker_attach_to_apis (GumBoundsChecker * self,
   g_assert (priv->page_pool == NULL);
   priv->page_pool = gum_page_pool_new (GUM_PROTECT_MODE_ABOVE,
       priv->pool_size);
-  g_object_set (priv->page_pool, "front-alignment", priv->front_alignment,
+  g_object_set (priv->page_pool,
+      "front-alignment", priv->front_alignment,
+      "quarantine-size", priv->quarantine_size,
       NULL);
 
   gum_interceptor_begin_transaction (priv->interceptor);
@@ -538,27 +570,26 @@ gum_bounds_checker_try_free (GumBoundsChecker * self,
                              GumInvocationContext * ctx)
 {
   GumBoundsCheckerPrivate * priv = self->priv;
-  gboolean freed;
+  GumBlockDetails block;
 
-  freed = gum_page_pool_try_free (priv->page_pool, address);
+  if (!gum_page_pool_query_block_details (priv->page_pool, address, &block))
+    return FALSE;
 
-  if (freed && priv->backtracer_instance != NULL)
+  /*
+   * The guard is left open for the pool to close it again along with the
+   * rest of the block, saving a protection change per free.
+   */
+  if (block.allocated && priv->backtracer_instance != NULL)
   {
-    GumBlockDetails block;
-
-    gum_page_pool_query_block_details (priv->page_pool, address, &block);
-
     gum_mprotect (block.guard, block.guard_size, GUM_PAGE_RW);
 
     g_assert_cmpuint (block.guard_size / 2,
         >=, sizeof (GumReturnAddressArray));
     priv->backtracer_interface->generate (priv->backtracer_instance,
         ctx->cpu_context, BLOCK_FREE_RETADDRS (&block));
-
-    gum_mprotect (block.guard, block.guard_size, GUM_PAGE_NO_ACCESS);
   }
 
-  return freed;
+  return gum_page_pool_try_free (priv->page_pool, address);
 }
 
 static gboolean
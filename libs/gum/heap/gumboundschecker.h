@@ -57,6 +57,9 @@ GUM_API void gum_bounds_checker_set_pool_size (GumBoundsChecker * self,
 GUM_API guint gum_bounds_checker_get_front_alignment (GumBoundsChecker * self);
 GUM_API void gum_bounds_checker_set_front_alignment (GumBoundsChecker * self,
   guint pool_size);
+GUM_API guint gum_bounds_checker_get_quarantine_size (GumBoundsChecker * self);
+GUM_API void gum_bounds_checker_set_quarantine_size (GumBoundsChecker * self,
+  guint quarantine_size);
 
 GUM_API void gum_bounds_checker_attach (GumBoundsChecker * self);
 GUM_API void gum_bounds_checker_attach_to_apis (GumBoundsChecker * self,
@@ -12,6 +12,10 @@
 #define MAX_POOL_SIZE           G_MAXUINT32
 #define DEFAULT_POOL_SIZE       G_MAXUINT16
 #define DEFAULT_FRONT_ALIGNMENT 16
+#define DEFAULT_QUARANTINE_SIZE 0
+
+#define GUM_PAGE_POOL_N_BINS    32
+#define GUM_PAGE_POOL_NIL       G_MAXUINT
 
 enum
 {
@@ -19,13 +23,18 @@ enum
   PROP_PAGE_SIZE,
   PROP_PROTECT_MODE,
   PROP_SIZE,
-  PROP_FRONT_ALIGNMENT
+  PROP_FRONT_ALIGNMENT,
+  PROP_QUARANTINE_SIZE
 };
 
 G_DEFINE_TYPE (GumPagePool, gum_page_pool, G_TYPE_OBJECT);
 
+#define POOL_ADDRESS_FROM_PAGE_INDEX(n) \
+    (priv->pool + ((gsize) (n) * priv->page_size))
+
 typedef struct _AlignmentCriteria AlignmentCriteria;
 typedef struct _TailAlignResult   TailAlignResult;
+typedef struct _GumPageRun        GumPageRun;
 
 struct _GumPagePoolPrivate
 {
@@ -36,13 +45,39 @@ struct _GumPagePoolPrivate
   GumProtectMode protect_mode;
   guint size;
   guint front_alignment;
+  guint quarantine_size;
 
   /*< state */
   guint available;
-  guint cur_offset;
   guint8 * pool;
   guint8 * pool_end;
   GumBlockDetails * block_details;
+
+  GumPageRun * runs;
+  guint bin_heads[GUM_PAGE_POOL_N_BINS];
+  guint bin_tails[GUM_PAGE_POOL_N_BINS];
+  guint32 bin_bitmap;
+
+  guint * quarantine;
+  guint quarantine_capacity;
+  guint quarantine_head;
+  guint quarantine_length;
+  guint quarantined;
+};
+
+/*
+ * Free pages are tracked as maximal runs, each tagged with its length on
+ * both its first and last page so that a released block can be merged with
+ * its neighbors in O(1). Runs are kept in size-segregated bins: bin n - 1
+ * holds runs of exactly n pages, except for the last one, which holds all
+ * of the larger ones. A bitmap of non-empty bins lets us find the smallest
+ * bin that can satisfy a request without scanning the pool.
+ */
+struct _GumPageRun
+{
+  guint length;
+  guint prev;
+  guint next;
 };
 
 struct _AlignmentCriteria
@@ -76,8 +111,17 @@ static guint num_pages_needed_for (GumPagePool * self, guint size);
 
 static gpointer claim_n_pages_at (GumPagePool * self, guint n_pages,
     guint start_index);
-static gpointer release_n_pages_at (GumPagePool * self, guint n_pages,
+static void release_n_pages_at (GumPagePool * self, guint n_pages,
+    guint start_index);
+
+static void quarantine_n_pages_at (GumPagePool * self, guint n_pages,
     guint start_index);
+static gboolean evict_oldest_from_quarantine (GumPagePool * self);
+
+static void link_run (GumPagePool * self, guint start_index, guint n_pages,
+    gboolean reuse_first);
+static void unlink_run (GumPagePool * self, guint start_index);
+static guint bin_for_n_pages (guint n_pages);
 
 static void tail_align (gpointer ptr, gsize size,
     const AlignmentCriteria * criteria, TailAlignResult * result);
@@ -114,6 +158,12 @@ gum_page_pool_class_init (GumPagePoolClass * klass)
       "Front alignment requirement",
       1, 64, DEFAULT_FRONT_ALIGNMENT,
       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_QUARANTINE_SIZE,
+      g_param_spec_uint ("quarantine-size", "Quarantine Size",
+      "Number of freed pages to keep inaccessible before reusing them",
+      0, G_MAXUINT, DEFAULT_QUARANTINE_SIZE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -130,6 +180,7 @@ gum_page_pool_init (GumPagePool * self)
   priv->protect_mode = DEFAULT_PROTECT_MODE;
   priv->size = DEFAULT_POOL_SIZE;
   priv->front_alignment = DEFAULT_FRONT_ALIGNMENT;
+  priv->quarantine_size = DEFAULT_QUARANTINE_SIZE;
 }
 
 static void
@@ -137,11 +188,23 @@ gum_page_pool_constructed (GObject * object)
 {
   GumPagePool * self = GUM_PAGE_POOL (object);
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
+  guint i;
 
-  priv->available = priv->size;
   priv->pool = gum_alloc_n_pages (priv->size, GUM_PAGE_NO_ACCESS);
   priv->pool_end = priv->pool + (priv->size * priv->page_size);
   priv->block_details = g_malloc0 (priv->size * sizeof (GumBlockDetails));
+
+  priv->runs = g_malloc0 (priv->size * sizeof (GumPageRun));
+  for (i = 0; i != GUM_PAGE_POOL_N_BINS; i++)
+  {
+    priv->bin_heads[i] = GUM_PAGE_POOL_NIL;
+    priv->bin_tails[i] = GUM_PAGE_POOL_NIL;
+  }
+  release_n_pages_at (self, priv->size, 0);
+
+  /* every block spans at least two pages */
+  priv->quarantine_capacity = (priv->size / 2) + 1;
+  priv->quarantine = g_new (guint, priv->quarantine_capacity);
 }
 
 static void
@@ -150,6 +213,8 @@ gum_page_pool_finalize (GObject * object)
   GumPagePool * self = GUM_PAGE_POOL (object);
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
 
+  g_free (priv->quarantine);
+  g_free (priv->runs);
   g_free (priv->block_details);
   gum_free_pages (priv->pool);
 
@@ -179,6 +244,9 @@ gum_page_pool_get_property (GObject * object,
     case PROP_FRONT_ALIGNMENT:
       g_value_set_uint (value, priv->front_alignment);
       break;
+    case PROP_QUARANTINE_SIZE:
+      g_value_set_uint (value, priv->quarantine_size);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
@@ -204,6 +272,9 @@ gum_page_pool_set_property (GObject * object,
     case PROP_FRONT_ALIGNMENT:
       priv->front_alignment = g_value_get_uint (value);
       break;
+    case PROP_QUARANTINE_SIZE:
+      priv->quarantine_size = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
@@ -231,11 +302,14 @@ gum_page_pool_try_alloc (GumPagePool * self,
 
   n_pages = num_pages_needed_for (self, size);
 
-  if (n_pages <= priv->available)
+  if (n_pages <= priv->available + priv->quarantined)
   {
     gint start_index;
 
     start_index = find_start_index_with_n_free_pages (self, n_pages);
+    while (start_index < 0 && evict_oldest_from_quarantine (self))
+      start_index = find_start_index_with_n_free_pages (self, n_pages);
+
     if (start_index >= 0)
     {
       guint8 * page_start;
@@ -272,15 +346,37 @@ gum_page_pool_try_free (GumPagePool * self,
                         gpointer mem)
 {
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
-  gint start_index;
-  guint n_pages;
+  gint index;
+  GumBlockDetails * details;
+  guint n_pages, start_index, i;
 
-  start_index = find_start_index_for_address (self, mem);
-  if (start_index < 0)
+  index = find_start_index_for_address (self, mem);
+  if (index < 0)
     return FALSE;
 
-  n_pages = num_pages_needed_for (self, priv->block_details[start_index].size);
-  release_n_pages_at (self, n_pages, start_index);
+  details = &priv->block_details[index];
+  if (!details->allocated)
+    return TRUE;
+
+  n_pages = num_pages_needed_for (self, details->size);
+  start_index = (((guint8 *) details->guard - priv->pool) / priv->page_size) -
+      (n_pages - 1);
+
+  for (i = start_index; i != start_index + n_pages; i++)
+    priv->block_details[i].allocated = FALSE;
+
+  /*
+   * The guard page is inaccessible already, but including it lets the
+   * kernel apply a single change to the whole block, and callers may have
+   * opened it up to record metadata before freeing.
+   */
+  gum_mprotect (POOL_ADDRESS_FROM_PAGE_INDEX (start_index),
+      n_pages * priv->page_size, GUM_PAGE_NO_ACCESS);
+
+  if (priv->quarantine_size != 0)
+    quarantine_n_pages_at (self, n_pages, start_index);
+  else
+    release_n_pages_at (self, n_pages, start_index);
 
   return TRUE;
 }
@@ -296,7 +392,13 @@ gum_page_pool_peek_used (GumPagePool * self)
 {
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
 
-  return priv->size - priv->available;
+  return priv->size - priv->available - priv->quarantined;
+}
+
+guint
+gum_page_pool_peek_quarantined (GumPagePool * self)
+{
+  return self->priv->quarantined;
 }
 
 void
@@ -331,33 +433,30 @@ find_start_index_with_n_free_pages (GumPagePool * self,
                                     guint n_pages)
 {
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
-  gint result = -1;
-  guint first_index;
-  guint i, n;
+  guint bin, index;
 
-  first_index = priv->cur_offset;
+  bin = bin_for_n_pages (n_pages);
+  if (bin != GUM_PAGE_POOL_N_BINS - 1)
+  {
+    gint first_bin;
 
-start_over:
+    first_bin = g_bit_nth_lsf (priv->bin_bitmap, (gint) bin - 1);
+    if (first_bin == -1)
+      return -1;
 
-  for (i = first_index, n = 0; i < priv->size && n < n_pages; i++)
-  {
-    if (!priv->block_details[i].allocated)
-      n++;
-    else
-      n = 0;
+    if (first_bin != GUM_PAGE_POOL_N_BINS - 1)
+      return priv->bin_heads[first_bin];
   }
 
-  if (n == n_pages)
-  {
-    result = i - n_pages;
-  }
-  else if (first_index != 0)
+  for (index = priv->bin_heads[GUM_PAGE_POOL_N_BINS - 1];
+      index != GUM_PAGE_POOL_NIL;
+      index = priv->runs[index].next)
   {
-    first_index = 0;
-    goto start_over;
+    if (priv->runs[index].length >= n_pages)
+      return index;
   }
 
-  return result;
+  return -1;
 }
 
 static gint
@@ -366,7 +465,7 @@ find_start_index_for_address (GumPagePool * self,
 {
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
 
-  if (p < priv->pool || p > priv->pool_end)
+  if (p < priv->pool || p >= priv->pool_end)
     return -1;
 
   return (p - priv->pool) / priv->page_size;
@@ -386,8 +485,6 @@ num_pages_needed_for (GumPagePool * self,
   return n_pages;
 }
 
-#define POOL_ADDRESS_FROM_PAGE_INDEX(n) (priv->pool + (n * priv->page_size))
-
 static gpointer
 claim_n_pages_at (GumPagePool * self,
                   guint n_pages,
@@ -395,11 +492,16 @@ claim_n_pages_at (GumPagePool * self,
 {
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
   gpointer start_address;
-  guint i;
+  guint run_length, i;
 
   start_address = POOL_ADDRESS_FROM_PAGE_INDEX (start_index);
 
-  priv->cur_offset = start_index + n_pages;
+  run_length = priv->runs[start_index].length;
+  unlink_run (self, start_index);
+  if (run_length > n_pages)
+  {
+    link_run (self, start_index + n_pages, run_length - n_pages, TRUE);
+  }
   priv->available -= n_pages;
 
   for (i = start_index; i < start_index + n_pages; i++)
@@ -414,27 +516,169 @@ claim_n_pages_at (GumPagePool * self,
   return start_address;
 }
 
-static gpointer
+/*
+ * Returns pages that are already inaccessible to the free index, merging
+ * them with any free neighbors.
+ */
+static void
 release_n_pages_at (GumPagePool * self,
                     guint n_pages,
                     guint start_index)
 {
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
-  gpointer start_address;
-  guint i;
+  guint run_start = start_index;
+  guint run_length = n_pages;
 
   priv->available += n_pages;
 
-  for (i = start_index; i < start_index + n_pages; i++)
+  if (start_index != 0 && priv->runs[start_index - 1].length != 0)
   {
-    GumBlockDetails * details = &priv->block_details[i];
+    guint left_length = priv->runs[start_index - 1].length;
 
-    details->allocated = FALSE;
+    run_start -= left_length;
+    run_length += left_length;
+    unlink_run (self, run_start);
   }
 
-  start_address = POOL_ADDRESS_FROM_PAGE_INDEX (start_index);
-  gum_mprotect (start_address, n_pages - 1, GUM_PAGE_NO_ACCESS);
-  return start_address;
+  if (start_index + n_pages != priv->size &&
+      priv->runs[start_index + n_pages].length != 0)
+  {
+    guint right_length = priv->runs[start_index + n_pages].length;
+
+    run_length += right_length;
+    unlink_run (self, start_index + n_pages);
+  }
+
+  link_run (self, run_start, run_length, FALSE);
+}
+
+/*
+ * Holds on to freed blocks in FIFO order so that dangling pointers keep
+ * faulting for a while, instead of silently hitting a new allocation.
+ * Eviction happens in bulk once the quarantine overflows, and costs no
+ * protection changes as the pages are inaccessible already.
+ */
+static void
+quarantine_n_pages_at (GumPagePool * self,
+                       guint n_pages,
+                       guint start_index)
+{
+  GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
+  guint tail;
+
+  tail = (priv->quarantine_head + priv->quarantine_length) %
+      priv->quarantine_capacity;
+  priv->quarantine[tail] = start_index;
+  priv->quarantine_length++;
+  priv->quarantined += n_pages;
+
+  if (priv->quarantined > priv->quarantine_size)
+  {
+    guint low_watermark = priv->quarantine_size - (priv->quarantine_size / 4);
+
+    while (priv->quarantined > low_watermark)
+      evict_oldest_from_quarantine (self);
+  }
+}
+
+static gboolean
+evict_oldest_from_quarantine (GumPagePool * self)
+{
+  GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
+  guint start_index, n_pages;
+
+  if (priv->quarantine_length == 0)
+    return FALSE;
+
+  start_index = priv->quarantine[priv->quarantine_head];
+  priv->quarantine_head = (priv->quarantine_head + 1) %
+      priv->quarantine_capacity;
+  priv->quarantine_length--;
+
+  n_pages = num_pages_needed_for (self,
+      priv->block_details[start_index].size);
+  priv->quarantined -= n_pages;
+
+  release_n_pages_at (self, n_pages, start_index);
+
+  return TRUE;
+}
+
+/*
+ * Freed runs go to the back of their bin so that recently used pages are
+ * the last to be handed out again, while leftovers from splitting a run go
+ * to the front to keep consecutive allocations close together.
+ */
+static void
+link_run (GumPagePool * self,
+          guint start_index,
+          guint n_pages,
+          gboolean reuse_first)
+{
+  GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
+  GumPageRun * run = &priv->runs[start_index];
+  guint bin;
+
+  bin = bin_for_n_pages (n_pages);
+
+  run->length = n_pages;
+  priv->runs[start_index + n_pages - 1].length = n_pages;
+
+  if (reuse_first)
+  {
+    run->prev = GUM_PAGE_POOL_NIL;
+    run->next = priv->bin_heads[bin];
+    if (run->next != GUM_PAGE_POOL_NIL)
+      priv->runs[run->next].prev = start_index;
+    else
+      priv->bin_tails[bin] = start_index;
+    priv->bin_heads[bin] = start_index;
+  }
+  else
+  {
+    run->prev = priv->bin_tails[bin];
+    run->next = GUM_PAGE_POOL_NIL;
+    if (run->prev != GUM_PAGE_POOL_NIL)
+      priv->runs[run->prev].next = start_index;
+    else
+      priv->bin_heads[bin] = start_index;
+    priv->bin_tails[bin] = start_index;
+  }
+
+  priv->bin_bitmap |= 1U << bin;
+}
+
+static void
+unlink_run (GumPagePool * self,
+            guint start_index)
+{
+  GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
+  GumPageRun * run = &priv->runs[start_index];
+  guint bin;
+
+  bin = bin_for_n_pages (run->length);
+
+  if (run->prev != GUM_PAGE_POOL_NIL)
+    priv->runs[run->prev].next = run->next;
+  else
+    priv->bin_heads[bin] = run->next;
+
+  if (run->next != GUM_PAGE_POOL_NIL)
+    priv->runs[run->next].prev = run->prev;
+  else
+    priv->bin_tails[bin] = run->prev;
+
+  if (priv->bin_heads[bin] == GUM_PAGE_POOL_NIL)
+    priv->bin_bitmap &= ~(1U << bin);
+
+  priv->runs[start_index + run->length - 1].length = 0;
+  run->length = 0;
+}
+
+static guint
+bin_for_n_pages (guint n_pages)
+{
+  return MIN (n_pages, GUM_PAGE_POOL_N_BINS) - 1;
 }
 
 static void
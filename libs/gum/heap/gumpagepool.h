@@ -67,6 +67,7 @@ gboolean gum_page_pool_try_free (GumPagePool * self, gpointer mem);
 
 guint gum_page_pool_peek_available (GumPagePool * self);
 guint gum_page_pool_peek_used (GumPagePool * self);
+guint gum_page_pool_peek_quarantined (GumPagePool * self);
 void gum_page_pool_get_bounds (GumPagePool * self, guint8 ** lower,
     guint8 ** upper);
 gboolean gum_page_pool_query_block_details (GumPagePool * self,
@@ -6,6 +6,8 @@
 
 #include "gumbusycyclesampler.h"
 
+#include <time.h>
+
 static void gum_busy_cycle_sampler_iface_init (gpointer g_iface,
     gpointer iface_data);
 static GumSample gum_busy_cycle_sampler_sample (GumSampler * sampler);
@@ -49,12 +51,22 @@ gum_busy_cycle_sampler_new (void)
 gboolean
 gum_busy_cycle_sampler_is_available (GumBusyCycleSampler * self)
 {
-  return FALSE;
+  struct timespec ts;
+
+  return clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts) == 0;
 }
 
 static GumSample
 gum_busy_cycle_sampler_sample (GumSampler * sampler)
 {
-  /* TODO: implement */
-  return 0;
+  struct timespec ts;
+
+  /*
+   * Like on Darwin we measure the CPU time consumed by the calling thread
+   * rather than actual cycles, as GumSample is an abstract unit anyway.
+   */
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+
+  return ((GumSample) ts.tv_sec * G_GUINT64_CONSTANT (1000000000)) +
+      ts.tv_nsec;
 }
@@ -11,6 +11,12 @@
 #include "gumsymbolutil.h"
 #include "gumtls.h"
 
+#include <string.h>
+
+#define GUM_CACHE_LINE_SIZE 64
+
+typedef struct _GumCallCountThread GumCallCountThread;
+
 static void gum_call_count_sampler_sampler_iface_init (gpointer g_iface,
     gpointer iface_data);
 static void gum_call_count_sampler_listener_iface_init (gpointer g_iface,
@@ -26,17 +32,43 @@ static void gum_call_count_sampler_on_enter (
 static void gum_call_count_sampler_on_leave (
     GumInvocationListener * listener, GumInvocationContext * context);
 
+static GumCallCountThread * gum_call_count_sampler_register_thread (
+    GumCallCountSampler * self);
+static void gum_call_count_sampler_grow_thread (GumCallCountSampler * self,
+    GumCallCountThread * thread);
+
+static gpointer gum_cache_aligned_alloc0 (gsize size);
+static void gum_cache_aligned_free (gpointer mem);
+
 struct _GumCallCountSamplerPrivate
 {
   gboolean disposed;
 
   GumInterceptor * interceptor;
 
-  volatile gint total_count;
-
   GumTlsKey tls_key;
   GMutex mutex;
-  GSList * counters;
+  GArray * functions;
+  GSList * threads;
+};
+
+/*
+ * Counters owned by a single thread. Only the owner writes to them, without
+ * any atomics, and each thread's counters live on cache lines of their own,
+ * so that hot functions called from many threads don't bounce a shared line
+ * between cores. Readers simply sum them up, accepting that a count which is
+ * being incremented concurrently may be slightly stale.
+ *
+ * function_counts is indexed by the order in which functions were added,
+ * and grows on demand. It is only ever swapped out by its owner while
+ * holding the mutex, which readers also hold.
+ */
+struct _GumCallCountThread
+{
+  GumSample total_count;
+  GumSample * function_counts;
+  guint function_capacity;
+  GumThreadId thread_id;
 };
 
 G_DEFINE_TYPE_EXTENDED (GumCallCountSampler,
@@ -95,6 +127,7 @@ gum_call_count_sampler_init (GumCallCountSampler * self)
 
   priv->tls_key = gum_tls_key_new ();
   g_mutex_init (&priv->mutex);
+  priv->functions = g_array_new (FALSE, FALSE, sizeof (gpointer));
 }
 
 static void
@@ -124,8 +157,17 @@ gum_call_count_sampler_finalize (GObject * object)
   gum_tls_key_free (priv->tls_key);
   g_mutex_clear (&priv->mutex);
 
-  g_slist_foreach (priv->counters, (GFunc) g_free, NULL);
-  g_slist_free (priv->counters);
+  while (priv->threads != NULL)
+  {
+    GumCallCountThread * thread = priv->threads->data;
+
+    gum_cache_aligned_free (thread->function_counts);
+    gum_cache_aligned_free (thread);
+
+    priv->threads = g_slist_delete_link (priv->threads, priv->threads);
+  }
+
+  g_array_free (priv->functions, TRUE);
 
   G_OBJECT_CLASS (gum_call_count_sampler_parent_class)->finalize (object);
 }
@@ -225,28 +267,144 @@ gum_call_count_sampler_add_function (GumCallCountSampler * self,
                                      gpointer function)
 {
   GumCallCountSamplerPrivate * priv = self->priv;
+  guint index;
   GumAttachReturn attach_ret;
 
+  g_mutex_lock (&priv->mutex);
+  index = priv->functions->len;
+  g_array_append_val (priv->functions, function);
+  g_mutex_unlock (&priv->mutex);
+
   attach_ret = gum_interceptor_attach_listener (priv->interceptor,
-      function, GUM_INVOCATION_LISTENER (self), NULL);
+      function, GUM_INVOCATION_LISTENER (self), GSIZE_TO_POINTER (index));
   g_assert (attach_ret == GUM_ATTACH_OK);
 }
 
 GumSample
 gum_call_count_sampler_peek_total_count (GumCallCountSampler * self)
 {
-  return g_atomic_int_get (&self->priv->total_count);
+  GumCallCountSamplerPrivate * priv = self->priv;
+  GumSample total = 0;
+  GSList * cur;
+
+  g_mutex_lock (&priv->mutex);
+  for (cur = priv->threads; cur != NULL; cur = cur->next)
+  {
+    GumCallCountThread * thread = cur->data;
+
+    total += thread->total_count;
+  }
+  g_mutex_unlock (&priv->mutex);
+
+  return total;
+}
+
+GumSample
+gum_call_count_sampler_peek_thread_count (GumCallCountSampler * self,
+                                          GumThreadId thread_id)
+{
+  GumCallCountSamplerPrivate * priv = self->priv;
+  GumSample total = 0;
+  GSList * cur;
+
+  g_mutex_lock (&priv->mutex);
+  for (cur = priv->threads; cur != NULL; cur = cur->next)
+  {
+    GumCallCountThread * thread = cur->data;
+
+    if (thread->thread_id == thread_id)
+      total += thread->total_count;
+  }
+  g_mutex_unlock (&priv->mutex);
+
+  return total;
+}
+
+GumSample
+gum_call_count_sampler_peek_function_count (GumCallCountSampler * self,
+                                            gpointer function)
+{
+  GumCallCountSamplerPrivate * priv = self->priv;
+  GumSample total = 0;
+  guint index;
+  GSList * cur;
+
+  g_mutex_lock (&priv->mutex);
+
+  for (index = 0; index != priv->functions->len; index++)
+  {
+    if (g_array_index (priv->functions, gpointer, index) == function)
+      break;
+  }
+
+  for (cur = priv->threads; cur != NULL; cur = cur->next)
+  {
+    GumCallCountThread * thread = cur->data;
+
+    if (index < thread->function_capacity)
+      total += thread->function_counts[index];
+  }
+
+  g_mutex_unlock (&priv->mutex);
+
+  return total;
+}
+
+/*
+ * Reports the number of calls made by each thread to each function, skipping
+ * pairs that were never called. The counts are snapshotted first so that
+ * func is free to call instrumented functions.
+ */
+void
+gum_call_count_sampler_enumerate_counts (GumCallCountSampler * self,
+                                         GumFoundCallCountFunc func,
+                                         gpointer user_data)
+{
+  GumCallCountSamplerPrivate * priv = self->priv;
+  GArray * counts;
+  GSList * cur;
+  guint i;
+
+  counts = g_array_new (FALSE, FALSE, sizeof (GumCallCountDetails));
+
+  g_mutex_lock (&priv->mutex);
+  for (cur = priv->threads; cur != NULL; cur = cur->next)
+  {
+    GumCallCountThread * thread = cur->data;
+
+    for (i = 0; i != thread->function_capacity; i++)
+    {
+      GumCallCountDetails details;
+
+      if (thread->function_counts[i] == 0)
+        continue;
+
+      details.thread_id = thread->thread_id;
+      details.function = g_array_index (priv->functions, gpointer, i);
+      details.count = thread->function_counts[i];
+      g_array_append_val (counts, details);
+    }
+  }
+  g_mutex_unlock (&priv->mutex);
+
+  for (i = 0; i != counts->len; i++)
+  {
+    if (!func (&g_array_index (counts, GumCallCountDetails, i), user_data))
+      break;
+  }
+
+  g_array_free (counts, TRUE);
 }
 
 static GumSample
 gum_call_count_sampler_sample (GumSampler * sampler)
 {
   GumCallCountSampler * self = GUM_CALL_COUNT_SAMPLER_CAST (sampler);
-  GumSample * counter;
+  GumCallCountThread * thread;
 
-  counter = (GumSample *) gum_tls_key_get_value (self->priv->tls_key);
-  if (counter != NULL)
-    return *counter;
+  thread = (GumCallCountThread *) gum_tls_key_get_value (self->priv->tls_key);
+  if (thread != NULL)
+    return thread->total_count;
   else
     return 0;
 }
@@ -257,26 +415,21 @@ gum_call_count_sampler_on_enter (GumInvocationListener * listener,
 {
   GumCallCountSampler * self = GUM_CALL_COUNT_SAMPLER_CAST (listener);
   GumCallCountSamplerPrivate * priv = self->priv;
-  GumSample * counter;
-
-  (void) context;
+  GumCallCountThread * thread;
+  guint index;
 
   gum_interceptor_ignore_current_thread (priv->interceptor);
 
-  counter = (GumSample *) gum_tls_key_get_value (priv->tls_key);
-  if (counter == NULL)
-  {
-    counter = g_new0 (GumSample, 1);
-
-    g_mutex_lock (&priv->mutex);
-    priv->counters = g_slist_prepend (priv->counters, counter);
-    g_mutex_unlock (&priv->mutex);
+  thread = (GumCallCountThread *) gum_tls_key_get_value (priv->tls_key);
+  if (thread == NULL)
+    thread = gum_call_count_sampler_register_thread (self);
 
-    gum_tls_key_set_value (priv->tls_key, counter);
-  }
+  index = GPOINTER_TO_SIZE (GUM_LINCTX_GET_FUNC_DATA (context, gpointer));
+  if (index >= thread->function_capacity)
+    gum_call_count_sampler_grow_thread (self, thread);
 
-  g_atomic_int_inc (&priv->total_count);
-  (*counter)++;
+  thread->total_count++;
+  thread->function_counts[index]++;
 }
 
 static void
@@ -289,3 +442,76 @@ gum_call_count_sampler_on_leave (GumInvocationListener * listener,
 
   gum_interceptor_unignore_current_thread (self->priv->interceptor);
 }
+
+static GumCallCountThread *
+gum_call_count_sampler_register_thread (GumCallCountSampler * self)
+{
+  GumCallCountSamplerPrivate * priv = self->priv;
+  GumCallCountThread * thread;
+
+  thread = gum_cache_aligned_alloc0 (sizeof (GumCallCountThread));
+  thread->thread_id = gum_process_get_current_thread_id ();
+
+  g_mutex_lock (&priv->mutex);
+  priv->threads = g_slist_prepend (priv->threads, thread);
+  g_mutex_unlock (&priv->mutex);
+
+  gum_tls_key_set_value (priv->tls_key, thread);
+
+  return thread;
+}
+
+static void
+gum_call_count_sampler_grow_thread (GumCallCountSampler * self,
+                                    GumCallCountThread * thread)
+{
+  GumCallCountSamplerPrivate * priv = self->priv;
+  guint capacity;
+  GumSample * counts;
+
+  g_mutex_lock (&priv->mutex);
+
+  capacity = priv->functions->len;
+  counts = gum_cache_aligned_alloc0 (capacity * sizeof (GumSample));
+  if (thread->function_counts != NULL)
+  {
+    memcpy (counts, thread->function_counts,
+        thread->function_capacity * sizeof (GumSample));
+    gum_cache_aligned_free (thread->function_counts);
+  }
+
+  thread->function_counts = counts;
+  thread->function_capacity = capacity;
+
+  g_mutex_unlock (&priv->mutex);
+}
+
+/*
+ * Hands out zeroed memory that starts on a cache line boundary and is
+ * rounded up to a whole number of lines, so that nothing else ends up
+ * sharing them. The original allocation is stashed right before the block.
+ */
+static gpointer
+gum_cache_aligned_alloc0 (gsize size)
+{
+  gsize padded_size;
+  guint8 * allocation;
+  gpointer * mem;
+
+  padded_size = (size + GUM_CACHE_LINE_SIZE - 1) &
+      ~((gsize) GUM_CACHE_LINE_SIZE - 1);
+
+  allocation = g_malloc0 (padded_size + GUM_CACHE_LINE_SIZE);
+  mem = GSIZE_TO_POINTER ((GPOINTER_TO_SIZE (allocation) +
+      GUM_CACHE_LINE_SIZE) & ~((gsize) GUM_CACHE_LINE_SIZE - 1));
+  mem[-1] = allocation;
+
+  return mem;
+}
+
+static void
+gum_cache_aligned_free (gpointer mem)
+{
+  if (mem != NULL)
+    g_free (((gpointer *) mem)[-1]);
+}
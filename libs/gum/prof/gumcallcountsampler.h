@@ -10,6 +10,8 @@
 
 #include "gumsampler.h"
 
+#include <gum/gumprocess.h>
+
 #define GUM_TYPE_CALL_COUNT_SAMPLER (gum_call_count_sampler_get_type ())
 #define GUM_CALL_COUNT_SAMPLER(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj),\
     GUM_TYPE_CALL_COUNT_SAMPLER, GumCallCountSampler))
@@ -28,6 +30,10 @@ typedef struct _GumCallCountSamplerClass GumCallCountSamplerClass;
 
 typedef struct _GumCallCountSamplerPrivate GumCallCountSamplerPrivate;
 
+typedef struct _GumCallCountDetails GumCallCountDetails;
+typedef gboolean (* GumFoundCallCountFunc) (
+    const GumCallCountDetails * details, gpointer user_data);
+
 struct _GumCallCountSampler
 {
   GObject parent;
@@ -40,6 +46,13 @@ struct _GumCallCountSamplerClass
   GObjectClass parent_class;
 };
 
+struct _GumCallCountDetails
+{
+  GumThreadId thread_id;
+  gpointer function;
+  GumSample count;
+};
+
 G_BEGIN_DECLS
 
 GUM_API GType gum_call_count_sampler_get_type (void) G_GNUC_CONST;
@@ -57,6 +70,13 @@ GUM_API void gum_call_count_sampler_add_function (GumCallCountSampler * self,
 
 GUM_API GumSample gum_call_count_sampler_peek_total_count (
     GumCallCountSampler * self);
+GUM_API GumSample gum_call_count_sampler_peek_thread_count (
+    GumCallCountSampler * self, GumThreadId thread_id);
+GUM_API GumSample gum_call_count_sampler_peek_function_count (
+    GumCallCountSampler * self, gpointer function);
+GUM_API void gum_call_count_sampler_enumerate_counts (
+    GumCallCountSampler * self, GumFoundCallCountFunc func,
+    gpointer user_data);
 
 G_END_DECLS
 
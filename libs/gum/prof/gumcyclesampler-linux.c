@@ -6,60 +6,16 @@
 
 #include "gumcyclesampler.h"
 
-#include "gumlibc.h"
-
-#include <string.h>
-#include <unistd.h>
-#include <sys/syscall.h>
-
-# define PERF_TYPE_HARDWARE       0
-# define PERF_COUNT_HW_CPU_CYCLES 0
-
-struct perf_event_attr
-{
-  guint32 type;
-  guint32 size;
-  guint64 config;
-
-  union
-  {
-    guint64 sample_period;
-    guint64 sample_freq;
-  };
-
-  guint64 sample_type;
-  guint64 read_format;
-
-  guint64 disabled       :  1,
-          inherit        :  1,
-          pinned         :  1,
-          exclusive      :  1,
-          exclude_user   :  1,
-          exclude_kernel :  1,
-          exclude_hv     :  1,
-          exclude_idle   :  1,
-          mmap           :  1,
-          comm           :  1,
-          freq           :  1,
-          inherit_stat   :  1,
-          enable_on_exec :  1,
-          task           :  1,
-          watermark      :  1,
-          __reserved_1   : 49;
-
-  union
-  {
-    guint32 wakeup_events;
-    guint32 wakeup_watermark;
-  };
-
-  guint32 __reserved_2;
-  guint64 __reserved_3;
-};
+#include "gumperfcountersampler.h"
 
+/*
+ * Counting is delegated to a GumPerfCounterSampler, which gives each thread
+ * its own event and reads it from user space where the kernel allows it.
+ */
 struct _GumCycleSamplerPrivate
 {
-  gint device;
+  GumSampler * counter;
+  GumSamplerIface * counter_interface;
 };
 
 static void gum_cycle_sampler_iface_init (gpointer g_iface,
@@ -97,16 +53,13 @@ static void
 gum_cycle_sampler_init (GumCycleSampler * self)
 {
   GumCycleSamplerPrivate * priv;
-  struct perf_event_attr attr;
 
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, GUM_TYPE_CYCLE_SAMPLER,
       GumCycleSamplerPrivate);
   priv = self->priv;
 
-  gum_memset (&attr, 0, sizeof (attr));
-  attr.type = PERF_TYPE_HARDWARE;
-  attr.config = PERF_COUNT_HW_CPU_CYCLES;
-  priv->device = syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  priv->counter = gum_perf_counter_sampler_new (GUM_PERF_COUNTER_CYCLES);
+  priv->counter_interface = GUM_SAMPLER_GET_INTERFACE (priv->counter);
 }
 
 static void
@@ -115,10 +68,10 @@ gum_cycle_sampler_dispose (GObject * object)
   GumCycleSampler * self = GUM_CYCLE_SAMPLER (object);
   GumCycleSamplerPrivate * priv = self->priv;
 
-  if (priv->device != -1)
+  if (priv->counter != NULL)
   {
-    close (priv->device);
-    priv->device = -1;
+    g_object_unref (priv->counter);
+    priv->counter = NULL;
   }
 
   G_OBJECT_CLASS (gum_cycle_sampler_parent_class)->dispose (object);
@@ -133,17 +86,14 @@ gum_cycle_sampler_new (void)
 gboolean
 gum_cycle_sampler_is_available (GumCycleSampler * self)
 {
-  return self->priv->device != -1;
+  return gum_perf_counter_sampler_is_available (
+      GUM_PERF_COUNTER_SAMPLER (self->priv->counter));
 }
 
 static GumSample
 gum_cycle_sampler_sample (GumSampler * sampler)
 {
-  GumCycleSampler * self = GUM_CYCLE_SAMPLER_CAST (sampler);
-  long long result = 0;
-
-  if (read (self->priv->device, &result, sizeof (result)) < sizeof (result))
-    return 0;
+  GumCycleSamplerPrivate * priv = GUM_CYCLE_SAMPLER_CAST (sampler)->priv;
 
-  return result;
+  return priv->counter_interface->sample (priv->counter);
 }
@@ -0,0 +1,504 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumperfcountersampler.h"
+
+#include "gumlibc.h"
+#include "gummemory.h"
+#include "gumtls.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define PERF_TYPE_HARDWARE          0
+#define PERF_COUNT_HW_CPU_CYCLES    0
+#define PERF_COUNT_HW_INSTRUCTIONS  1
+#define PERF_COUNT_HW_CACHE_MISSES  3
+#define PERF_COUNT_HW_BRANCH_MISSES 5
+
+#define GUM_PERF_CAP_BIT0_IS_DEPRECATED (1 << 1)
+#define GUM_PERF_CAP_USER_RDPMC         (1 << 2)
+
+typedef struct _GumPerfEventMmapPage GumPerfEventMmapPage;
+typedef struct _GumPerfCounter GumPerfCounter;
+
+enum
+{
+  PROP_0,
+  PROP_EVENT
+};
+
+struct perf_event_attr
+{
+  guint32 type;
+  guint32 size;
+  guint64 config;
+
+  union
+  {
+    guint64 sample_period;
+    guint64 sample_freq;
+  };
+
+  guint64 sample_type;
+  guint64 read_format;
+
+  guint64 disabled       :  1,
+          inherit        :  1,
+          pinned         :  1,
+          exclusive      :  1,
+          exclude_user   :  1,
+          exclude_kernel :  1,
+          exclude_hv     :  1,
+          exclude_idle   :  1,
+          mmap           :  1,
+          comm           :  1,
+          freq           :  1,
+          inherit_stat   :  1,
+          enable_on_exec :  1,
+          task           :  1,
+          watermark      :  1,
+          __reserved_1   : 49;
+
+  union
+  {
+    guint32 wakeup_events;
+    guint32 wakeup_watermark;
+  };
+
+  guint32 __reserved_2;
+  guint64 __reserved_3;
+};
+
+/* The leading part of the kernel's struct perf_event_mmap_page. */
+struct _GumPerfEventMmapPage
+{
+  guint32 version;
+  guint32 compat_version;
+  guint32 lock;
+  guint32 index;
+  gint64 offset;
+  guint64 time_enabled;
+  guint64 time_running;
+  guint64 capabilities;
+  guint16 pmc_width;
+};
+
+/*
+ * Events count the thread that opened them, so every thread gets its own
+ * counter the first time it samples. With the event's page mapped, threads
+ * on x86 read the hardware counter directly through rdpmc instead of doing
+ * a read() syscall per sample.
+ *
+ * A counter is listed both by its sampler and by its thread. Whichever goes
+ * away first releases the fd and the mapping, and the thread frees the
+ * counter itself once the sampler no longer refers to it.
+ */
+struct _GumPerfCounter
+{
+  gint fd;
+  volatile GumPerfEventMmapPage * page;
+  GumPerfCounterSampler * sampler;
+};
+
+struct _GumPerfCounterSamplerPrivate
+{
+  gboolean disposed;
+
+  guint64 config;
+  gboolean available;
+
+  GumTlsKey counter_key;
+  GSList * counters;
+};
+
+static void gum_perf_counter_sampler_iface_init (gpointer g_iface,
+    gpointer iface_data);
+static void gum_perf_counter_sampler_constructed (GObject * object);
+static void gum_perf_counter_sampler_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gum_perf_counter_sampler_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gum_perf_counter_sampler_dispose (GObject * object);
+static void gum_perf_counter_sampler_finalize (GObject * object);
+static GumSample gum_perf_counter_sampler_sample (GumSampler * sampler);
+
+static GumPerfCounter * gum_perf_counter_sampler_get_counter (
+    GumPerfCounterSampler * self);
+static void gum_perf_counter_release_thread_counters (GSList * counters);
+
+static GumPerfCounter * gum_perf_counter_open (guint64 config);
+static void gum_perf_counter_close (GumPerfCounter * counter);
+static void gum_perf_counter_free (GumPerfCounter * counter);
+static GumSample gum_perf_counter_read (GumPerfCounter * counter);
+
+G_DEFINE_TYPE_EXTENDED (GumPerfCounterSampler,
+                        gum_perf_counter_sampler,
+                        G_TYPE_OBJECT,
+                        0,
+                        G_IMPLEMENT_INTERFACE (GUM_TYPE_SAMPLER,
+                            gum_perf_counter_sampler_iface_init));
+
+G_LOCK_DEFINE_STATIC (gum_perf_counter);
+static GPrivate gum_perf_counter_thread_counters = G_PRIVATE_INIT (
+    (GDestroyNotify) gum_perf_counter_release_thread_counters);
+
+static void
+gum_perf_counter_sampler_class_init (GumPerfCounterSamplerClass * klass)
+{
+  GObjectClass * object_class = G_OBJECT_CLASS (klass);
+  GParamSpec * pspec;
+
+  g_type_class_add_private (klass, sizeof (GumPerfCounterSamplerPrivate));
+
+  object_class->constructed = gum_perf_counter_sampler_constructed;
+  object_class->set_property = gum_perf_counter_sampler_set_property;
+  object_class->get_property = gum_perf_counter_sampler_get_property;
+  object_class->dispose = gum_perf_counter_sampler_dispose;
+  object_class->finalize = gum_perf_counter_sampler_finalize;
+
+  pspec = g_param_spec_uint ("event", "Event", "Event to count",
+      GUM_PERF_COUNTER_CYCLES, GUM_PERF_COUNTER_BRANCH_MISSES,
+      GUM_PERF_COUNTER_CYCLES,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT_ONLY);
+  g_object_class_install_property (object_class, PROP_EVENT, pspec);
+}
+
+static void
+gum_perf_counter_sampler_iface_init (gpointer g_iface,
+                                     gpointer iface_data)
+{
+  GumSamplerIface * iface = (GumSamplerIface *) g_iface;
+
+  (void) iface_data;
+
+  iface->sample = gum_perf_counter_sampler_sample;
+}
+
+static void
+gum_perf_counter_sampler_init (GumPerfCounterSampler * self)
+{
+  GumPerfCounterSamplerPrivate * priv;
+
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      GUM_TYPE_PERF_COUNTER_SAMPLER, GumPerfCounterSamplerPrivate);
+  priv = self->priv;
+
+  priv->counter_key = gum_tls_key_new ();
+}
+
+static void
+gum_perf_counter_sampler_constructed (GObject * object)
+{
+  GumPerfCounterSampler * self = GUM_PERF_COUNTER_SAMPLER (object);
+
+  self->priv->available =
+      gum_perf_counter_sampler_get_counter (self)->fd != -1;
+}
+
+static void
+gum_perf_counter_sampler_set_property (GObject * object,
+                                       guint property_id,
+                                       const GValue * value,
+                                       GParamSpec * pspec)
+{
+  GumPerfCounterSampler * self = GUM_PERF_COUNTER_SAMPLER (object);
+  GumPerfCounterSamplerPrivate * priv = self->priv;
+
+  switch (property_id)
+  {
+    case PROP_EVENT:
+      switch (g_value_get_uint (value))
+      {
+        case GUM_PERF_COUNTER_CYCLES:
+          priv->config = PERF_COUNT_HW_CPU_CYCLES;
+          break;
+        case GUM_PERF_COUNTER_INSTRUCTIONS:
+          priv->config = PERF_COUNT_HW_INSTRUCTIONS;
+          break;
+        case GUM_PERF_COUNTER_CACHE_MISSES:
+          priv->config = PERF_COUNT_HW_CACHE_MISSES;
+          break;
+        case GUM_PERF_COUNTER_BRANCH_MISSES:
+          priv->config = PERF_COUNT_HW_BRANCH_MISSES;
+          break;
+        default:
+          g_assert_not_reached ();
+      }
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+  }
+}
+
+static void
+gum_perf_counter_sampler_get_property (GObject * object,
+                                       guint property_id,
+                                       GValue * value,
+                                       GParamSpec * pspec)
+{
+  GumPerfCounterSampler * self = GUM_PERF_COUNTER_SAMPLER (object);
+  GumPerfCounterSamplerPrivate * priv = self->priv;
+
+  switch (property_id)
+  {
+    case PROP_EVENT:
+      switch (priv->config)
+      {
+        case PERF_COUNT_HW_INSTRUCTIONS:
+          g_value_set_uint (value, GUM_PERF_COUNTER_INSTRUCTIONS);
+          break;
+        case PERF_COUNT_HW_CACHE_MISSES:
+          g_value_set_uint (value, GUM_PERF_COUNTER_CACHE_MISSES);
+          break;
+        case PERF_COUNT_HW_BRANCH_MISSES:
+          g_value_set_uint (value, GUM_PERF_COUNTER_BRANCH_MISSES);
+          break;
+        default:
+          g_value_set_uint (value, GUM_PERF_COUNTER_CYCLES);
+          break;
+      }
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+  }
+}
+
+static void
+gum_perf_counter_sampler_dispose (GObject * object)
+{
+  GumPerfCounterSampler * self = GUM_PERF_COUNTER_SAMPLER (object);
+  GumPerfCounterSamplerPrivate * priv = self->priv;
+
+  if (!priv->disposed)
+  {
+    GSList * cur;
+
+    priv->disposed = TRUE;
+
+    G_LOCK (gum_perf_counter);
+    for (cur = priv->counters; cur != NULL; cur = cur->next)
+    {
+      GumPerfCounter * counter = cur->data;
+
+      gum_perf_counter_close (counter);
+      counter->sampler = NULL;
+    }
+    g_slist_free (priv->counters);
+    priv->counters = NULL;
+    G_UNLOCK (gum_perf_counter);
+  }
+
+  G_OBJECT_CLASS (gum_perf_counter_sampler_parent_class)->dispose (object);
+}
+
+static void
+gum_perf_counter_sampler_finalize (GObject * object)
+{
+  GumPerfCounterSampler * self = GUM_PERF_COUNTER_SAMPLER (object);
+  GumPerfCounterSamplerPrivate * priv = self->priv;
+
+  gum_tls_key_free (priv->counter_key);
+
+  G_OBJECT_CLASS (gum_perf_counter_sampler_parent_class)->finalize (object);
+}
+
+GumSampler *
+gum_perf_counter_sampler_new (GumPerfCounterEvent event)
+{
+  return GUM_SAMPLER_CAST (g_object_new (GUM_TYPE_PERF_COUNTER_SAMPLER,
+      "event", event,
+      NULL));
+}
+
+gboolean
+gum_perf_counter_sampler_is_available (GumPerfCounterSampler * self)
+{
+  return self->priv->available;
+}
+
+static GumSample
+gum_perf_counter_sampler_sample (GumSampler * sampler)
+{
+  GumPerfCounterSampler * self = GUM_PERF_COUNTER_SAMPLER_CAST (sampler);
+
+  return gum_perf_counter_read (gum_perf_counter_sampler_get_counter (self));
+}
+
+static GumPerfCounter *
+gum_perf_counter_sampler_get_counter (GumPerfCounterSampler * self)
+{
+  GumPerfCounterSamplerPrivate * priv = self->priv;
+  GumPerfCounter * counter;
+
+  counter = gum_tls_key_get_value (priv->counter_key);
+  if (counter == NULL)
+  {
+    GSList * thread_counters, * cur, * next;
+
+    counter = gum_perf_counter_open (priv->config);
+    counter->sampler = self;
+    gum_tls_key_set_value (priv->counter_key, counter);
+
+    G_LOCK (gum_perf_counter);
+
+    priv->counters = g_slist_prepend (priv->counters, counter);
+
+    /* Also drop the counters of samplers that are gone by now. */
+    thread_counters = g_private_get (&gum_perf_counter_thread_counters);
+    for (cur = thread_counters; cur != NULL; cur = next)
+    {
+      GumPerfCounter * c = cur->data;
+
+      next = cur->next;
+
+      if (c->sampler == NULL)
+      {
+        gum_perf_counter_free (c);
+        thread_counters = g_slist_delete_link (thread_counters, cur);
+      }
+    }
+    thread_counters = g_slist_prepend (thread_counters, counter);
+    g_private_set (&gum_perf_counter_thread_counters, thread_counters);
+
+    G_UNLOCK (gum_perf_counter);
+  }
+
+  return counter;
+}
+
+static void
+gum_perf_counter_release_thread_counters (GSList * counters)
+{
+  GSList * cur;
+
+  G_LOCK (gum_perf_counter);
+  for (cur = counters; cur != NULL; cur = cur->next)
+  {
+    GumPerfCounter * counter = cur->data;
+    GumPerfCounterSampler * sampler = counter->sampler;
+
+    if (sampler != NULL)
+    {
+      sampler->priv->counters =
+          g_slist_remove (sampler->priv->counters, counter);
+      gum_perf_counter_close (counter);
+    }
+
+    gum_perf_counter_free (counter);
+  }
+  G_UNLOCK (gum_perf_counter);
+
+  g_slist_free (counters);
+}
+
+static GumPerfCounter *
+gum_perf_counter_open (guint64 config)
+{
+  GumPerfCounter * counter;
+  struct perf_event_attr attr;
+  gpointer page;
+
+  counter = g_slice_new (GumPerfCounter);
+  counter->page = NULL;
+  counter->sampler = NULL;
+
+  gum_memset (&attr, 0, sizeof (attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof (attr);
+  attr.config = config;
+  /*
+   * Like GumCycleSampler always has, count in kernel mode too. This makes
+   * time spent in syscalls show up, at the price of the event not being
+   * available when perf_event_paranoid is 2 or above.
+   */
+  counter->fd = syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  if (counter->fd == -1)
+    return counter;
+
+  page = mmap (NULL, gum_query_page_size (), PROT_READ, MAP_SHARED,
+      counter->fd, 0);
+  if (page != MAP_FAILED)
+    counter->page = page;
+
+  return counter;
+}
+
+static void
+gum_perf_counter_close (GumPerfCounter * counter)
+{
+  if (counter->page != NULL)
+  {
+    munmap ((gpointer) counter->page, gum_query_page_size ());
+    counter->page = NULL;
+  }
+
+  if (counter->fd != -1)
+  {
+    close (counter->fd);
+    counter->fd = -1;
+  }
+}
+
+static void
+gum_perf_counter_free (GumPerfCounter * counter)
+{
+  g_slice_free (GumPerfCounter, counter);
+}
+
+static GumSample
+gum_perf_counter_read (GumPerfCounter * counter)
+{
+  long long result = 0;
+#if defined (HAVE_I386) && defined (__GNUC__)
+  volatile GumPerfEventMmapPage * page = counter->page;
+
+  /*
+   * The kernel bumps the lock around every update of the page, e.g. when
+   * the thread migrates, so retry until we have read a consistent view.
+   */
+  while (page != NULL)
+  {
+    guint32 seq, index, width;
+    guint64 caps;
+    gint64 count;
+    guint32 low, high;
+    gint64 pmc;
+
+    seq = page->lock;
+    __asm__ __volatile__ ("" ::: "memory");
+
+    /* older kernels advertised rdpmc through an ambiguous bit, skip those */
+    caps = page->capabilities;
+    index = page->index;
+    width = page->pmc_width;
+    if ((caps & GUM_PERF_CAP_BIT0_IS_DEPRECATED) == 0 ||
+        (caps & GUM_PERF_CAP_USER_RDPMC) == 0 ||
+        index == 0 || width == 0 || width > 64)
+      break;
+
+    count = page->offset;
+
+    __asm__ __volatile__ ("rdpmc" : "=a" (low), "=d" (high) : "c" (index - 1));
+    pmc = (gint64) ((((guint64) high << 32) | low) << (64 - width)) >>
+        (64 - width);
+
+    __asm__ __volatile__ ("" ::: "memory");
+    if (page->lock == seq)
+      return count + pmc;
+  }
+#endif
+
+  if (counter->fd == -1)
+    return 0;
+
+  if (read (counter->fd, &result, sizeof (result)) < sizeof (result))
+    return 0;
+
+  return result;
+}
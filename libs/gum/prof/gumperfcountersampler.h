@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_PERF_COUNTER_SAMPLER_H__
+#define __GUM_PERF_COUNTER_SAMPLER_H__
+
+#include "gumsampler.h"
+
+#define GUM_TYPE_PERF_COUNTER_SAMPLER (gum_perf_counter_sampler_get_type ())
+#define GUM_PERF_COUNTER_SAMPLER(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj),\
+    GUM_TYPE_PERF_COUNTER_SAMPLER, GumPerfCounterSampler))
+#define GUM_PERF_COUNTER_SAMPLER_CAST(obj) ((GumPerfCounterSampler *) (obj))
+#define GUM_PERF_COUNTER_SAMPLER_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST (\
+    (klass), GUM_TYPE_PERF_COUNTER_SAMPLER, GumPerfCounterSamplerClass))
+#define GUM_IS_PERF_COUNTER_SAMPLER(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj),\
+    GUM_TYPE_PERF_COUNTER_SAMPLER))
+#define GUM_IS_PERF_COUNTER_SAMPLER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE (\
+    (klass), GUM_TYPE_PERF_COUNTER_SAMPLER))
+#define GUM_PERF_COUNTER_SAMPLER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS (\
+    (obj), GUM_TYPE_PERF_COUNTER_SAMPLER, GumPerfCounterSamplerClass))
+
+typedef struct _GumPerfCounterSampler GumPerfCounterSampler;
+typedef struct _GumPerfCounterSamplerClass GumPerfCounterSamplerClass;
+typedef struct _GumPerfCounterSamplerPrivate GumPerfCounterSamplerPrivate;
+
+typedef enum
+{
+  GUM_PERF_COUNTER_CYCLES,
+  GUM_PERF_COUNTER_INSTRUCTIONS,
+  GUM_PERF_COUNTER_CACHE_MISSES,
+  GUM_PERF_COUNTER_BRANCH_MISSES
+} GumPerfCounterEvent;
+
+struct _GumPerfCounterSampler
+{
+  GObject parent;
+
+  GumPerfCounterSamplerPrivate * priv;
+};
+
+struct _GumPerfCounterSamplerClass
+{
+  GObjectClass parent_class;
+};
+
+G_BEGIN_DECLS
+
+GUM_API GType gum_perf_counter_sampler_get_type (void) G_GNUC_CONST;
+
+GUM_API GumSampler * gum_perf_counter_sampler_new (GumPerfCounterEvent event);
+
+GUM_API gboolean gum_perf_counter_sampler_is_available (
+    GumPerfCounterSampler * self);
+
+G_END_DECLS
+
+#endif
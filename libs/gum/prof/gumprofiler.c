@@ -9,6 +9,7 @@
 
 #include "guminterceptor.h"
 #include "gumsymbolutil.h"
+#include "gumtimestampsampler.h"
 
 #include <string.h>
 
@@ -29,8 +30,12 @@ struct _GumProfilerPrivate
   GMutex mutex;
 
   GumInterceptor * interceptor;
+  GumSampler * default_sampler;
   GHashTable * function_by_address;
+  guint function_count;
   GSList * stacks;
+  GSList * thread_tables;
+  GSList * call_trees;
 };
 
 struct _GumProfilerInvocation
@@ -38,13 +43,28 @@ struct _GumProfilerInvocation
   GumProfilerContext * profiler;
   GumFunctionContext * function;
   GumFunctionThreadContext * thread;
+  GumProfileReportCallNode * call_node;
+  GumProfileReportCallNode * parent_call_node;
 
   GumSample start_time;
 };
 
+/*
+ * Per-thread state. The thread table maps a function's index to this
+ * thread's GumFunctionThreadContext for it, so that looking it up on enter
+ * is O(1) and only (function, thread) pairs that actually occur cost memory.
+ *
+ * The call tree records every distinct call path taken by this thread, with
+ * call_node pointing at the node for the innermost active invocation. Only
+ * this thread modifies it; nodes are added under the profiler's mutex so
+ * that reports can safely take a snapshot.
+ */
 struct _GumProfilerContext
 {
   GArray * stack;
+  GPtrArray * thread_table;
+  GumProfileReportCallNode * call_tree;
+  GumProfileReportCallNode * call_node;
 };
 
 struct _GumWorstCaseInfo
@@ -79,14 +99,15 @@ struct _GumFunctionThreadContext
 struct _GumFunctionContext
 {
   gpointer function_address;
+  guint index;
 
   GumSamplerIface * sampler_interface;
   GumSampler * sampler_instance;
   GumWorstCaseInspectorFunc inspector_func;
   gpointer inspector_user_data;
 
-  GumFunctionThreadContext thread_contexts[GUM_MAX_THREADS];
-  volatile gint thread_context_count;
+  /* in order of first call, guarded by the profiler's mutex */
+  GPtrArray * thread_contexts;
 };
 
 #define GUM_PROFILER_GET_PRIVATE(o) ((o)->priv)
@@ -115,11 +136,20 @@ static void thread_context_register_child_timing (
     GumFunctionThreadContext * parent_ctx,
     GumFunctionThreadContext * child_ctx);
 
+static GumProfileReportCallNode * gum_profiler_context_enter_call_node (
+    GumProfilerContext * profiler_ctx, GumProfilerPrivate * priv,
+    gpointer function_address);
+
 static void get_number_of_threads_foreach (gpointer key, gpointer value,
     gpointer user_data);
 
 static GumFunctionThreadContext * gum_function_context_get_current_thread (
-    GumFunctionContext * function_ctx, GumInvocationContext * context);
+    GumFunctionContext * function_ctx, GumProfilerPrivate * priv,
+    GumProfilerContext * profiler_ctx, GumInvocationContext * context);
+static GumFunctionThreadContext * gum_function_context_get_nth_thread (
+    GumFunctionContext * function_ctx, guint n);
+static void gum_function_thread_context_free (
+    GumFunctionThreadContext * thread_ctx);
 
 G_DEFINE_TYPE_EXTENDED (GumProfiler,
                         gum_profiler,
@@ -186,6 +216,12 @@ gum_profiler_dispose (GObject * object)
 
     g_object_unref (priv->interceptor);
     priv->interceptor = NULL;
+
+    if (priv->default_sampler != NULL)
+    {
+      g_object_unref (priv->default_sampler);
+      priv->default_sampler = NULL;
+    }
   }
 
   G_OBJECT_CLASS (gum_profiler_parent_class)->dispose (object);
@@ -204,6 +240,18 @@ gum_profiler_finalize (GObject * object)
     priv->stacks = g_slist_delete_link (priv->stacks, priv->stacks);
   }
 
+  while (priv->thread_tables != NULL)
+  {
+    GPtrArray * table = (GPtrArray *) priv->thread_tables->data;
+    g_ptr_array_free (table, TRUE);
+    priv->thread_tables =
+        g_slist_delete_link (priv->thread_tables, priv->thread_tables);
+  }
+
+  g_slist_free_full (priv->call_trees,
+      (GDestroyNotify) _gum_profile_report_call_node_free);
+  priv->call_trees = NULL;
+
   g_hash_table_unref (priv->function_by_address);
 
   g_mutex_clear (&priv->mutex);
@@ -215,6 +263,7 @@ static void
 gum_profiler_on_enter (GumInvocationListener * listener,
                        GumInvocationContext * context)
 {
+  GumProfilerPrivate * priv = GUM_PROFILER_CAST (listener)->priv;
   GumProfilerInvocation * inv;
   GumFunctionContext * fctx;
   GumFunctionThreadContext * tctx;
@@ -224,19 +273,24 @@ gum_profiler_on_enter (GumInvocationListener * listener,
   inv->profiler = GUM_LINCTX_GET_THREAD_DATA (context, GumProfilerContext);
   if (inv->profiler->stack == NULL)
   {
-    GumProfilerPrivate * priv = GUM_PROFILER_CAST (listener)->priv;
-
     inv->profiler->stack = g_array_sized_new (FALSE, FALSE,
         sizeof (GumFunctionThreadContext *), GUM_MAX_CALL_DEPTH);
+    inv->profiler->thread_table = g_ptr_array_new ();
+    inv->profiler->call_tree = _gum_profile_report_call_node_new (NULL);
+    inv->profiler->call_node = inv->profiler->call_tree;
 
     GUM_PROFILER_LOCK ();
     priv->stacks = g_slist_prepend (priv->stacks, inv->profiler->stack);
+    priv->thread_tables =
+        g_slist_prepend (priv->thread_tables, inv->profiler->thread_table);
+    priv->call_trees =
+        g_slist_append (priv->call_trees, inv->profiler->call_tree);
     GUM_PROFILER_UNLOCK ();
   }
 
   inv->function = GUM_LINCTX_GET_FUNC_DATA (context, GumFunctionContext *);
   inv->thread = gum_function_context_get_current_thread (inv->function,
-      context);
+      priv, inv->profiler, context);
 
   fctx = inv->function;
   tctx = inv->thread;
@@ -245,6 +299,11 @@ gum_profiler_on_enter (GumInvocationListener * listener,
 
   tctx->total_calls++;
 
+  inv->parent_call_node = inv->profiler->call_node;
+  inv->call_node = gum_profiler_context_enter_call_node (inv->profiler, priv,
+      fctx->function_address);
+  inv->call_node->total_calls++;
+
   if (tctx->recurse_count == 0)
   {
     GumWorstCaseInspectorFunc inspector_func;
@@ -254,10 +313,10 @@ gum_profiler_on_enter (GumInvocationListener * listener,
       inspector_func (context, tctx->potential_info.buf,
           sizeof (tctx->potential_info.buf), fctx->inspector_user_data);
     }
-
-    inv->start_time = fctx->sampler_interface->sample (fctx->sampler_instance);
   }
 
+  inv->start_time = fctx->sampler_interface->sample (fctx->sampler_instance);
+
   tctx->recurse_count++;
 }
 
@@ -269,6 +328,7 @@ gum_profiler_on_leave (GumInvocationListener * listener,
   GumFunctionContext * fctx;
   GumFunctionThreadContext * tctx;
   GArray * stack;
+  GumSample now, duration;
 
   (void) listener;
 
@@ -278,15 +338,17 @@ gum_profiler_on_leave (GumInvocationListener * listener,
   tctx = inv->thread;
   stack = inv->profiler->stack;
 
+  now = fctx->sampler_interface->sample (fctx->sampler_instance);
+  duration = now - inv->start_time;
+
+  inv->call_node->total_duration += duration;
+  inv->profiler->call_node = inv->parent_call_node;
+
   if (tctx->recurse_count == 1)
   {
-    GumSample now, duration;
     GumFunctionThreadContext * parent;
     guint i;
 
-    now = fctx->sampler_interface->sample (fctx->sampler_instance);
-    duration = now - inv->start_time;
-
     tctx->total_duration += duration;
 
     if (duration > tctx->worst_case.duration)
@@ -384,18 +446,39 @@ gum_profiler_instrument_function_with_inspector (GumProfiler * self,
   GumFunctionContext * ctx;
   GumAttachReturn attach_ret;
 
+  /*
+   * Without an explicit sampler we time in nanoseconds using the cheapest
+   * clock available, so that the act of measuring doesn't swamp short
+   * functions.
+   */
+  if (sampler == NULL)
+  {
+    GUM_PROFILER_LOCK ();
+    if (priv->default_sampler == NULL)
+      priv->default_sampler = gum_timestamp_sampler_new ();
+    sampler = priv->default_sampler;
+    GUM_PROFILER_UNLOCK ();
+  }
+
   ctx = g_new0 (GumFunctionContext, 1);
+  ctx->function_address = function_address;
+  ctx->sampler_interface = GUM_SAMPLER_GET_INTERFACE (sampler);
+  ctx->sampler_instance = sampler;
+  ctx->inspector_func = inspector_func;
+  ctx->inspector_user_data = user_data;
+  ctx->thread_contexts = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gum_function_thread_context_free);
+
+  GUM_PROFILER_LOCK ();
+  ctx->index = priv->function_count++;
+  GUM_PROFILER_UNLOCK ();
 
   attach_ret = gum_interceptor_attach_listener (priv->interceptor,
       function_address, GUM_INVOCATION_LISTENER (self), ctx);
   if (attach_ret != GUM_ATTACH_OK)
     goto error;
 
-  ctx->function_address = function_address;
-  ctx->sampler_interface = GUM_SAMPLER_GET_INTERFACE (sampler);
-  ctx->sampler_instance = g_object_ref (sampler);
-  ctx->inspector_func = inspector_func;
-  ctx->inspector_user_data = user_data;
+  g_object_ref (sampler);
 
   GUM_PROFILER_LOCK ();
   g_hash_table_insert (priv->function_by_address, function_address, ctx);
@@ -404,6 +487,7 @@ gum_profiler_instrument_function_with_inspector (GumProfiler * self,
   return result;
 
 error:
+  g_ptr_array_free (ctx->thread_contexts, TRUE);
   g_free (ctx);
 
   if (attach_ret == GUM_ATTACH_WRONG_SIGNATURE)
@@ -427,6 +511,7 @@ unstrument_and_free_function (gpointer key,
   (void) user_data;
 
   g_object_unref (function_ctx->sampler_instance);
+  g_ptr_array_free (function_ctx->thread_contexts, TRUE);
   g_free (function_ctx);
 }
 
@@ -435,10 +520,18 @@ gum_profiler_generate_report (GumProfiler * self)
 {
   GumProfilerPrivate * priv = GUM_PROFILER_GET_PRIVATE (self);
   GumProfileReport * report;
+  GSList * cur;
 
   report = gum_profile_report_new ();
+  GUM_PROFILER_LOCK ();
   g_hash_table_foreach (priv->function_by_address, add_to_report_if_root_node,
       report);
+  for (cur = priv->call_trees; cur != NULL; cur = cur->next)
+  {
+    _gum_profile_report_append_thread_call_tree (report,
+        _gum_profile_report_call_node_copy (cur->data));
+  }
+  GUM_PROFILER_UNLOCK ();
   _gum_profile_report_sort (report);
 
   return report;
@@ -451,28 +544,24 @@ add_to_report_if_root_node (gpointer key,
 {
   GumProfileReport * report = GUM_PROFILE_REPORT (user_data);
   GumFunctionContext * function_ctx = (GumFunctionContext *) value;
+  guint i;
 
   (void) key;
 
-  if (function_ctx->thread_context_count > 0)
+  for (i = 0; i != function_ctx->thread_contexts->len; i++)
   {
-    gint i;
+    GumFunctionThreadContext * thread_ctx = (GumFunctionThreadContext *)
+        g_ptr_array_index (function_ctx->thread_contexts, i);
 
-    for (i = 0; i != function_ctx->thread_context_count; i++)
+    if (thread_ctx->is_root_node)
     {
-      GumFunctionThreadContext * thread_ctx =
-          &function_ctx->thread_contexts[i];
-
-      if (thread_ctx->is_root_node)
-      {
-        GHashTable * processed_nodes = NULL;
-        GumProfileReportNode * root_node;
-
-        root_node = make_node_from_thread_context (thread_ctx,
-            &processed_nodes);
-        _gum_profile_report_append_thread_root_node (report,
-            thread_ctx->thread_id, root_node);
-      }
+      GHashTable * processed_nodes = NULL;
+      GumProfileReportNode * root_node;
+
+      root_node = make_node_from_thread_context (thread_ctx,
+          &processed_nodes);
+      _gum_profile_report_append_thread_root_node (report,
+          thread_ctx->thread_id, root_node);
     }
   }
 }
@@ -564,15 +653,20 @@ gum_profiler_get_total_duration_of (GumProfiler * self,
 {
   GumProfilerPrivate * priv = GUM_PROFILER_GET_PRIVATE (self);
   GumFunctionContext * function_ctx;
+  GumFunctionThreadContext * thread_ctx = NULL;
 
   GUM_PROFILER_LOCK ();
   function_ctx = (GumFunctionContext *)
       g_hash_table_lookup (priv->function_by_address, function_address);
+  if (function_ctx != NULL)
+  {
+    thread_ctx =
+        gum_function_context_get_nth_thread (function_ctx, thread_index);
+  }
   GUM_PROFILER_UNLOCK ();
 
-  if (function_ctx != NULL
-      && (gint) thread_index < function_ctx->thread_context_count)
-    return function_ctx->thread_contexts[thread_index].total_duration;
+  if (thread_ctx != NULL)
+    return thread_ctx->total_duration;
   else
     return 0;
 }
@@ -584,15 +678,20 @@ gum_profiler_get_worst_case_duration_of (GumProfiler * self,
 {
   GumProfilerPrivate * priv = GUM_PROFILER_GET_PRIVATE (self);
   GumFunctionContext * function_ctx;
+  GumFunctionThreadContext * thread_ctx = NULL;
 
   GUM_PROFILER_LOCK ();
   function_ctx = (GumFunctionContext *)
       g_hash_table_lookup (priv->function_by_address, function_address);
+  if (function_ctx != NULL)
+  {
+    thread_ctx =
+        gum_function_context_get_nth_thread (function_ctx, thread_index);
+  }
   GUM_PROFILER_UNLOCK ();
 
-  if (function_ctx != NULL
-      && (gint) thread_index < function_ctx->thread_context_count)
-    return function_ctx->thread_contexts[thread_index].worst_case.duration;
+  if (thread_ctx != NULL)
+    return thread_ctx->worst_case.duration;
   else
     return 0;
 }
@@ -604,15 +703,20 @@ gum_profiler_get_worst_case_info_of (GumProfiler * self,
 {
   GumProfilerPrivate * priv = GUM_PROFILER_GET_PRIVATE (self);
   GumFunctionContext * function_ctx;
+  GumFunctionThreadContext * thread_ctx = NULL;
 
   GUM_PROFILER_LOCK ();
   function_ctx = (GumFunctionContext *)
       g_hash_table_lookup (priv->function_by_address, function_address);
+  if (function_ctx != NULL)
+  {
+    thread_ctx =
+        gum_function_context_get_nth_thread (function_ctx, thread_index);
+  }
   GUM_PROFILER_UNLOCK ();
 
-  if (function_ctx != NULL
-      && (gint) thread_index < function_ctx->thread_context_count)
-    return function_ctx->thread_contexts[thread_index].worst_case.info.buf;
+  if (thread_ctx != NULL)
+    return thread_ctx->worst_case.info.buf;
   else
     return "";
 }
@@ -634,6 +738,41 @@ thread_context_register_child_timing (GumFunctionThreadContext * parent_ctx,
   }
 }
 
+static GumProfileReportCallNode *
+gum_profiler_context_enter_call_node (GumProfilerContext * profiler_ctx,
+                                      GumProfilerPrivate * priv,
+                                      gpointer function_address)
+{
+  GumProfileReportCallNode * parent = profiler_ctx->call_node;
+  GumProfileReportCallNode * node;
+
+  if (parent->children != NULL)
+  {
+    guint i;
+
+    for (i = 0; i != parent->children->len; i++)
+    {
+      node = (GumProfileReportCallNode *)
+          g_ptr_array_index (parent->children, i);
+      if (node->function_address == function_address)
+        goto beach;
+    }
+  }
+
+  node = _gum_profile_report_call_node_new (function_address);
+
+  GUM_PROFILER_LOCK ();
+  if (parent->children == NULL)
+    parent->children = g_ptr_array_new ();
+  g_ptr_array_add (parent->children, node);
+  GUM_PROFILER_UNLOCK ();
+
+beach:
+  profiler_ctx->call_node = node;
+
+  return node;
+}
+
 static void
 get_number_of_threads_foreach (gpointer key,
                                gpointer value,
@@ -641,43 +780,67 @@ get_number_of_threads_foreach (gpointer key,
 {
   GumFunctionContext * function_ctx = value;
   GHashTable * unique_thread_id_set = user_data;
-  guint thread_count = function_ctx->thread_context_count;
   guint i;
 
   (void) key;
 
-  for (i = 0; i < thread_count; i++)
+  for (i = 0; i != function_ctx->thread_contexts->len; i++)
   {
+    GumFunctionThreadContext * thread_ctx = (GumFunctionThreadContext *)
+        g_ptr_array_index (function_ctx->thread_contexts, i);
+
     g_hash_table_insert (unique_thread_id_set,
-        GUINT_TO_POINTER (function_ctx->thread_contexts[i].thread_id), NULL);
+        GUINT_TO_POINTER (thread_ctx->thread_id), NULL);
   }
 }
 
-GumFunctionThreadContext *
+static GumFunctionThreadContext *
 gum_function_context_get_current_thread (GumFunctionContext * function_ctx,
+                                         GumProfilerPrivate * priv,
+                                         GumProfilerContext * profiler_ctx,
                                          GumInvocationContext * context)
 {
-  guint32 current_thread_id;
-  guint thread_count;
-  guint i;
+  GPtrArray * table = profiler_ctx->thread_table;
   GumFunctionThreadContext * thread_ctx;
 
-  current_thread_id = gum_invocation_context_get_thread_id (context);
-
-  thread_count = g_atomic_int_get (&function_ctx->thread_context_count);
-  for (i = 0; i != thread_count; i++)
+  if (function_ctx->index < table->len)
   {
-    thread_ctx = &function_ctx->thread_contexts[i];
-
-    if (thread_ctx->thread_id == current_thread_id)
+    thread_ctx = (GumFunctionThreadContext *)
+        g_ptr_array_index (table, function_ctx->index);
+    if (thread_ctx != NULL)
       return thread_ctx;
   }
+  else
+  {
+    g_ptr_array_set_size (table, function_ctx->index + 1);
+  }
 
-  i = g_atomic_int_add (&function_ctx->thread_context_count, 1);
-  g_assert (i < G_N_ELEMENTS (function_ctx->thread_contexts));
-  thread_ctx = &function_ctx->thread_contexts[i];
+  thread_ctx = g_slice_new0 (GumFunctionThreadContext);
   thread_ctx->function_ctx = function_ctx;
-  thread_ctx->thread_id = current_thread_id;
+  thread_ctx->thread_id = gum_invocation_context_get_thread_id (context);
+
+  g_ptr_array_index (table, function_ctx->index) = thread_ctx;
+
+  GUM_PROFILER_LOCK ();
+  g_ptr_array_add (function_ctx->thread_contexts, thread_ctx);
+  GUM_PROFILER_UNLOCK ();
 
   return thread_ctx;
 }
+
+static GumFunctionThreadContext *
+gum_function_context_get_nth_thread (GumFunctionContext * function_ctx,
+                                     guint n)
+{
+  if (n >= function_ctx->thread_contexts->len)
+    return NULL;
+
+  return (GumFunctionThreadContext *)
+      g_ptr_array_index (function_ctx->thread_contexts, n);
+}
+
+static void
+gum_function_thread_context_free (GumFunctionThreadContext * thread_ctx)
+{
+  g_slice_free (GumFunctionThreadContext, thread_ctx);
+}
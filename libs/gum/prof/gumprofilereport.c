@@ -6,14 +6,53 @@
  */
 
 #include "gumprofilereport.h"
+
+#include "gumsymbolutil.h"
+
 #include <string.h>
 
+#define GUM_PPROF_WIRE_VARINT           0
+#define GUM_PPROF_WIRE_LENGTH_DELIMITED 2
+
 G_DEFINE_TYPE (GumProfileReport, gum_profile_report, G_TYPE_OBJECT);
 
+typedef struct _GumFoldedStacksEmitter GumFoldedStacksEmitter;
+typedef struct _GumPprofEmitter GumPprofEmitter;
+
 struct _GumProfileReportPrivate
 {
   GHashTable * thread_id_to_node_list;
   GPtrArray * thread_root_nodes;
+  GPtrArray * call_trees;
+  GHashTable * function_names;
+};
+
+struct _GumFoldedStacksEmitter
+{
+  GumProfileReport * report;
+  GumProfileReportWriteFunc func;
+  gpointer user_data;
+
+  GString * line;
+};
+
+/*
+ * The pprof Profile message is written as a sequence of top-level fields,
+ * each flushed as soon as it is complete. Protobuf concatenates repeated
+ * fields regardless of how they are interleaved, so strings, functions and
+ * locations are introduced right before the first sample that needs them.
+ */
+struct _GumPprofEmitter
+{
+  GumProfileReport * report;
+  GumProfileReportWriteFunc func;
+  gpointer user_data;
+
+  GHashTable * function_ids;
+  guint64 next_string_index;
+  GArray * stack;
+  GByteArray * message;
+  GByteArray * field;
 };
 
 static void gum_profile_report_finalize (GObject * object);
@@ -22,6 +61,30 @@ static void gum_profile_report_node_free (GumProfileReportNode * node);
 
 static void append_node_to_xml_string (GumProfileReportNode * node,
     GString * xml);
+static const gchar * gum_profile_report_get_function_name (
+    GumProfileReport * self, gpointer function_address);
+static GumSample gum_profile_report_call_node_get_self_duration (
+    const GumProfileReportCallNode * node);
+
+static void gum_folded_stacks_emitter_emit_node (
+    GumFoldedStacksEmitter * self, const GumProfileReportCallNode * node);
+
+static void gum_pprof_emitter_emit_node (GumPprofEmitter * self,
+    const GumProfileReportCallNode * node);
+static guint64 gum_pprof_emitter_emit_string (GumPprofEmitter * self,
+    const gchar * str);
+static guint64 gum_pprof_emitter_get_function_id (GumPprofEmitter * self,
+    gpointer function_address);
+static void gum_pprof_emitter_emit_value_type (GumPprofEmitter * self,
+    guint field_number, const gchar * type, const gchar * unit);
+static void gum_pprof_emitter_flush_field (GumPprofEmitter * self,
+    guint field_number);
+
+static void gum_pprof_append_varint (GByteArray * buffer, guint64 value);
+static void gum_pprof_append_varint_field (GByteArray * buffer,
+    guint field_number, guint64 value);
+static void gum_pprof_append_bytes_field (GByteArray * buffer,
+    guint field_number, gconstpointer data, gsize size);
 static gint root_node_compare_func (gconstpointer a, gconstpointer b);
 static gint thread_compare_func (gconstpointer a, gconstpointer b);
 
@@ -44,6 +107,10 @@ gum_profile_report_init (GumProfileReport * self)
   self->priv->thread_id_to_node_list = g_hash_table_new (g_direct_hash,
       g_direct_equal);
   self->priv->thread_root_nodes = g_ptr_array_new ();
+  self->priv->call_trees = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) _gum_profile_report_call_node_free);
+  self->priv->function_names = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, NULL, g_free);
 }
 
 static void
@@ -75,6 +142,9 @@ gum_profile_report_finalize (GObject * object)
 
   g_ptr_array_free (priv->thread_root_nodes, TRUE);
 
+  g_ptr_array_free (priv->call_trees, TRUE);
+  g_hash_table_unref (priv->function_names);
+
   G_OBJECT_CLASS (gum_profile_report_parent_class)->finalize (object);
 }
 
@@ -117,6 +187,97 @@ gum_profile_report_emit_xml (GumProfileReport * self)
   return g_string_free (xml, FALSE);
 }
 
+/*
+ * Writes one line per distinct call stack in Brendan Gregg's folded format,
+ * e.g. "main;parse;lex 42", where the value is the time spent in the last
+ * function itself. Stacks whose self time is zero are left out, as their
+ * time is fully accounted for by their descendants.
+ */
+void
+gum_profile_report_emit_folded_stacks (GumProfileReport * self,
+                                       GumProfileReportWriteFunc func,
+                                       gpointer user_data)
+{
+  GumProfileReportPrivate * priv = self->priv;
+  GumFoldedStacksEmitter emitter;
+  guint thread_idx;
+
+  emitter.report = self;
+  emitter.func = func;
+  emitter.user_data = user_data;
+  emitter.line = g_string_sized_new (256);
+
+  for (thread_idx = 0; thread_idx < priv->call_trees->len; thread_idx++)
+  {
+    GumProfileReportCallNode * root;
+    guint child_idx;
+
+    root = (GumProfileReportCallNode *)
+        g_ptr_array_index (priv->call_trees, thread_idx);
+    if (root->children == NULL)
+      continue;
+
+    for (child_idx = 0; child_idx < root->children->len; child_idx++)
+    {
+      gum_folded_stacks_emitter_emit_node (&emitter,
+          (GumProfileReportCallNode *)
+          g_ptr_array_index (root->children, child_idx));
+    }
+  }
+
+  g_string_free (emitter.line, TRUE);
+}
+
+/*
+ * Writes an uncompressed pprof profile.proto message with two sample types:
+ * the number of calls and the self duration, in whatever unit the sampler
+ * used for the profiled functions produces.
+ */
+void
+gum_profile_report_emit_pprof (GumProfileReport * self,
+                               GumProfileReportWriteFunc func,
+                               gpointer user_data)
+{
+  GumProfileReportPrivate * priv = self->priv;
+  GumPprofEmitter emitter;
+  guint thread_idx;
+
+  emitter.report = self;
+  emitter.func = func;
+  emitter.user_data = user_data;
+  emitter.function_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  emitter.next_string_index = 0;
+  emitter.stack = g_array_new (FALSE, FALSE, sizeof (guint64));
+  emitter.message = g_byte_array_new ();
+  emitter.field = g_byte_array_new ();
+
+  gum_pprof_emitter_emit_string (&emitter, "");
+  gum_pprof_emitter_emit_value_type (&emitter, 1, "calls", "count");
+  gum_pprof_emitter_emit_value_type (&emitter, 1, "duration", "samples");
+
+  for (thread_idx = 0; thread_idx < priv->call_trees->len; thread_idx++)
+  {
+    GumProfileReportCallNode * root;
+    guint child_idx;
+
+    root = (GumProfileReportCallNode *)
+        g_ptr_array_index (priv->call_trees, thread_idx);
+    if (root->children == NULL)
+      continue;
+
+    for (child_idx = 0; child_idx < root->children->len; child_idx++)
+    {
+      gum_pprof_emitter_emit_node (&emitter, (GumProfileReportCallNode *)
+          g_ptr_array_index (root->children, child_idx));
+    }
+  }
+
+  g_byte_array_unref (emitter.field);
+  g_byte_array_unref (emitter.message);
+  g_array_free (emitter.stack, TRUE);
+  g_hash_table_unref (emitter.function_ids);
+}
+
 GPtrArray *
 gum_profile_report_get_root_nodes_for_thread (GumProfileReport * self,
                                               guint thread_index)
@@ -148,6 +309,14 @@ _gum_profile_report_append_thread_root_node (GumProfileReport * self,
   g_ptr_array_add (nodes, root_node);
 }
 
+void
+_gum_profile_report_append_thread_call_tree (
+    GumProfileReport * self,
+    GumProfileReportCallNode * root_node)
+{
+  g_ptr_array_add (self->priv->call_trees, root_node);
+}
+
 void
 _gum_profile_report_sort (GumProfileReport * self)
 {
@@ -165,6 +334,58 @@ _gum_profile_report_sort (GumProfileReport * self)
   g_ptr_array_sort (priv->thread_root_nodes, thread_compare_func);
 }
 
+GumProfileReportCallNode *
+_gum_profile_report_call_node_new (gpointer function_address)
+{
+  GumProfileReportCallNode * node;
+
+  node = g_slice_new0 (GumProfileReportCallNode);
+  node->function_address = function_address;
+
+  return node;
+}
+
+GumProfileReportCallNode *
+_gum_profile_report_call_node_copy (const GumProfileReportCallNode * node)
+{
+  GumProfileReportCallNode * copy;
+
+  copy = g_slice_dup (GumProfileReportCallNode, node);
+
+  if (node->children != NULL)
+  {
+    guint i;
+
+    copy->children = g_ptr_array_sized_new (node->children->len);
+    for (i = 0; i != node->children->len; i++)
+    {
+      g_ptr_array_add (copy->children, _gum_profile_report_call_node_copy (
+          (GumProfileReportCallNode *) g_ptr_array_index (node->children, i)));
+    }
+  }
+
+  return copy;
+}
+
+void
+_gum_profile_report_call_node_free (GumProfileReportCallNode * node)
+{
+  if (node->children != NULL)
+  {
+    guint i;
+
+    for (i = 0; i != node->children->len; i++)
+    {
+      _gum_profile_report_call_node_free ((GumProfileReportCallNode *)
+          g_ptr_array_index (node->children, i));
+    }
+
+    g_ptr_array_free (node->children, TRUE);
+  }
+
+  g_slice_free (GumProfileReportCallNode, node);
+}
+
 static void
 gum_profile_report_node_free (GumProfileReportNode * node)
 {
@@ -195,6 +416,256 @@ append_node_to_xml_string (GumProfileReportNode * node,
   g_string_append (xml, "</Node>");
 }
 
+static const gchar *
+gum_profile_report_get_function_name (GumProfileReport * self,
+                                      gpointer function_address)
+{
+  GHashTable * names = self->priv->function_names;
+  gchar * name;
+
+  name = (gchar *) g_hash_table_lookup (names, function_address);
+  if (name == NULL)
+  {
+    name = gum_symbol_name_from_address (function_address);
+    if (name == NULL)
+      name = g_strdup_printf ("%p", function_address);
+    g_hash_table_insert (names, function_address, name);
+  }
+
+  return name;
+}
+
+static GumSample
+gum_profile_report_call_node_get_self_duration (
+    const GumProfileReportCallNode * node)
+{
+  GumSample children_duration = 0;
+
+  if (node->children != NULL)
+  {
+    guint i;
+
+    for (i = 0; i != node->children->len; i++)
+    {
+      const GumProfileReportCallNode * child = (GumProfileReportCallNode *)
+          g_ptr_array_index (node->children, i);
+      children_duration += child->total_duration;
+    }
+  }
+
+  /* counters are sampled while other threads may still be updating them */
+  if (children_duration > node->total_duration)
+    return 0;
+
+  return node->total_duration - children_duration;
+}
+
+static void
+gum_folded_stacks_emitter_emit_node (GumFoldedStacksEmitter * self,
+                                     const GumProfileReportCallNode * node)
+{
+  GString * line = self->line;
+  gsize prefix_length;
+  GumSample self_duration;
+
+  prefix_length = line->len;
+
+  if (prefix_length != 0)
+    g_string_append_c (line, ';');
+  g_string_append (line, gum_profile_report_get_function_name (self->report,
+      node->function_address));
+
+  self_duration = gum_profile_report_call_node_get_self_duration (node);
+  if (self_duration != 0)
+  {
+    gsize stack_length = line->len;
+
+    g_string_append_printf (line, " %" G_GUINT64_FORMAT "\n", self_duration);
+    self->func (line->str, line->len, self->user_data);
+    g_string_truncate (line, stack_length);
+  }
+
+  if (node->children != NULL)
+  {
+    guint i;
+
+    for (i = 0; i != node->children->len; i++)
+    {
+      gum_folded_stacks_emitter_emit_node (self, (GumProfileReportCallNode *)
+          g_ptr_array_index (node->children, i));
+    }
+  }
+
+  g_string_truncate (line, prefix_length);
+}
+
+static void
+gum_pprof_emitter_emit_node (GumPprofEmitter * self,
+                             const GumProfileReportCallNode * node)
+{
+  GByteArray * message = self->message;
+  guint64 function_id;
+  GByteArray * packed;
+  gint i;
+
+  function_id = gum_pprof_emitter_get_function_id (self,
+      node->function_address);
+  g_array_append_val (self->stack, function_id);
+
+  packed = g_byte_array_new ();
+
+  /* Sample.location_id, leaf first */
+  for (i = (gint) self->stack->len - 1; i >= 0; i--)
+    gum_pprof_append_varint (packed, g_array_index (self->stack, guint64, i));
+  gum_pprof_append_bytes_field (message, 1, packed->data, packed->len);
+
+  /* Sample.value */
+  g_byte_array_set_size (packed, 0);
+  gum_pprof_append_varint (packed, node->total_calls);
+  gum_pprof_append_varint (packed,
+      gum_profile_report_call_node_get_self_duration (node));
+  gum_pprof_append_bytes_field (message, 2, packed->data, packed->len);
+
+  g_byte_array_unref (packed);
+
+  gum_pprof_emitter_flush_field (self, 2);
+
+  if (node->children != NULL)
+  {
+    guint child_idx;
+
+    for (child_idx = 0; child_idx != node->children->len; child_idx++)
+    {
+      gum_pprof_emitter_emit_node (self, (GumProfileReportCallNode *)
+          g_ptr_array_index (node->children, child_idx));
+    }
+  }
+
+  g_array_set_size (self->stack, self->stack->len - 1);
+}
+
+static guint64
+gum_pprof_emitter_emit_string (GumPprofEmitter * self,
+                               const gchar * str)
+{
+  gum_pprof_append_bytes_field (self->field, 6, str, strlen (str));
+  self->func ((const gchar *) self->field->data, self->field->len,
+      self->user_data);
+  g_byte_array_set_size (self->field, 0);
+
+  return self->next_string_index++;
+}
+
+static guint64
+gum_pprof_emitter_get_function_id (GumPprofEmitter * self,
+                                   gpointer function_address)
+{
+  GByteArray * message = self->message;
+  guint64 id, name_index;
+  GByteArray * line;
+
+  id = GPOINTER_TO_SIZE (g_hash_table_lookup (self->function_ids,
+      function_address));
+  if (id != 0)
+    return id;
+
+  id = g_hash_table_size (self->function_ids) + 1;
+  g_hash_table_insert (self->function_ids, function_address,
+      GSIZE_TO_POINTER (id));
+
+  name_index = gum_pprof_emitter_emit_string (self,
+      gum_profile_report_get_function_name (self->report, function_address));
+
+  /* Function { id, name, system_name } */
+  gum_pprof_append_varint_field (message, 1, id);
+  gum_pprof_append_varint_field (message, 2, name_index);
+  gum_pprof_append_varint_field (message, 3, name_index);
+  gum_pprof_emitter_flush_field (self, 5);
+
+  /* Location { id, address, line { function_id } } */
+  line = g_byte_array_new ();
+  gum_pprof_append_varint_field (line, 1, id);
+  gum_pprof_append_varint_field (message, 1, id);
+  gum_pprof_append_varint_field (message, 3,
+      GUM_ADDRESS (function_address));
+  gum_pprof_append_bytes_field (message, 4, line->data, line->len);
+  g_byte_array_unref (line);
+  gum_pprof_emitter_flush_field (self, 4);
+
+  return id;
+}
+
+static void
+gum_pprof_emitter_emit_value_type (GumPprofEmitter * self,
+                                   guint field_number,
+                                   const gchar * type,
+                                   const gchar * unit)
+{
+  guint64 type_index, unit_index;
+
+  type_index = gum_pprof_emitter_emit_string (self, type);
+  unit_index = gum_pprof_emitter_emit_string (self, unit);
+
+  gum_pprof_append_varint_field (self->message, 1, type_index);
+  gum_pprof_append_varint_field (self->message, 2, unit_index);
+  gum_pprof_emitter_flush_field (self, field_number);
+}
+
+static void
+gum_pprof_emitter_flush_field (GumPprofEmitter * self,
+                               guint field_number)
+{
+  gum_pprof_append_bytes_field (self->field, field_number,
+      self->message->data, self->message->len);
+  self->func ((const gchar *) self->field->data, self->field->len,
+      self->user_data);
+
+  g_byte_array_set_size (self->field, 0);
+  g_byte_array_set_size (self->message, 0);
+}
+
+static void
+gum_pprof_append_varint (GByteArray * buffer,
+                         guint64 value)
+{
+  guint8 bytes[10];
+  guint n = 0;
+
+  do
+  {
+    bytes[n] = value & 0x7f;
+    value >>= 7;
+    if (value != 0)
+      bytes[n] |= 0x80;
+    n++;
+  }
+  while (value != 0);
+
+  g_byte_array_append (buffer, bytes, n);
+}
+
+static void
+gum_pprof_append_varint_field (GByteArray * buffer,
+                               guint field_number,
+                               guint64 value)
+{
+  gum_pprof_append_varint (buffer,
+      (field_number << 3) | GUM_PPROF_WIRE_VARINT);
+  gum_pprof_append_varint (buffer, value);
+}
+
+static void
+gum_pprof_append_bytes_field (GByteArray * buffer,
+                              guint field_number,
+                              gconstpointer data,
+                              gsize size)
+{
+  gum_pprof_append_varint (buffer,
+      (field_number << 3) | GUM_PPROF_WIRE_LENGTH_DELIMITED);
+  gum_pprof_append_varint (buffer, size);
+  g_byte_array_append (buffer, data, size);
+}
+
 static gint
 root_node_compare_func (gconstpointer a,
                         gconstpointer b)
@@ -28,6 +28,10 @@ typedef struct _GumProfileReportClass GumProfileReportClass;
 typedef struct _GumProfileReportPrivate GumProfileReportPrivate;
 
 typedef struct _GumProfileReportNode GumProfileReportNode;
+typedef struct _GumProfileReportCallNode GumProfileReportCallNode;
+
+typedef void (* GumProfileReportWriteFunc) (const gchar * data, gsize size,
+    gpointer user_data);
 
 struct _GumProfileReport
 {
@@ -51,6 +55,14 @@ struct _GumProfileReportNode
   GumProfileReportNode * child;
 };
 
+struct _GumProfileReportCallNode
+{
+  gpointer function_address;
+  guint64 total_calls;
+  GumSample total_duration;
+  GPtrArray * children;
+};
+
 G_BEGIN_DECLS
 
 GUM_API GType gum_profile_report_get_type (void) G_GNUC_CONST;
@@ -58,6 +70,10 @@ GUM_API GType gum_profile_report_get_type (void) G_GNUC_CONST;
 GUM_API GumProfileReport * gum_profile_report_new (void);
 
 GUM_API gchar * gum_profile_report_emit_xml (GumProfileReport * self);
+GUM_API void gum_profile_report_emit_folded_stacks (GumProfileReport * self,
+    GumProfileReportWriteFunc func, gpointer user_data);
+GUM_API void gum_profile_report_emit_pprof (GumProfileReport * self,
+    GumProfileReportWriteFunc func, gpointer user_data);
 
 GUM_API GPtrArray * gum_profile_report_get_root_nodes_for_thread (
     GumProfileReport * self, guint thread_index);
@@ -65,8 +81,16 @@ GUM_API GPtrArray * gum_profile_report_get_root_nodes_for_thread (
 void _gum_profile_report_append_thread_root_node (
     GumProfileReport * self, guint thread_id,
     GumProfileReportNode * root_node);
+void _gum_profile_report_append_thread_call_tree (GumProfileReport * self,
+    GumProfileReportCallNode * root_node);
 void _gum_profile_report_sort (GumProfileReport * self);
 
+GumProfileReportCallNode * _gum_profile_report_call_node_new (
+    gpointer function_address);
+GumProfileReportCallNode * _gum_profile_report_call_node_copy (
+    const GumProfileReportCallNode * node);
+void _gum_profile_report_call_node_free (GumProfileReportCallNode * node);
+
 G_END_DECLS
 
 #endif
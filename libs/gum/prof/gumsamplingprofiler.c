@@ -0,0 +1,737 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumsamplingprofiler.h"
+
+#include "backend-linux/gumlinux.h"
+#include "gumlibc.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define GUM_SAMPLING_PROFILER_DEFAULT_INTERVAL 10000
+#define GUM_SAMPLING_PROFILER_COLLECT_INTERVAL (50 * G_TIME_SPAN_MILLISECOND)
+#define GUM_SAMPLING_BUFFER_SIZE               256
+
+#define GUM_SAMPLING_PROFILER_LOCK()   (g_mutex_lock (&priv->mutex))
+#define GUM_SAMPLING_PROFILER_UNLOCK() (g_mutex_unlock (&priv->mutex))
+
+/*
+ * The kernel encodes a thread's CPU-time clock as the bitwise inverse of its
+ * TID shifted left by three, tagged with CPUCLOCK_PERTHREAD_MASK (4) and
+ * CPUCLOCK_SCHED (2). This lets us arm timers on behalf of other threads.
+ */
+#define GUM_THREAD_CPUTIME_CLOCK(tid) ((clockid_t) ((~(tid) << 3) | 6))
+
+#ifndef SIGEV_THREAD_ID
+# define SIGEV_THREAD_ID 4
+#endif
+#ifndef sigev_notify_thread_id
+# define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+#if defined (__arm__) || defined (__aarch64__) || defined (__mips__)
+# define GUM_CPU_CONTEXT_PC(c) ((c)->pc)
+#else
+# define GUM_CPU_CONTEXT_PC(c) (GUM_CPU_CONTEXT_XIP (c))
+#endif
+
+typedef struct _GumSamplingThread GumSamplingThread;
+typedef struct _GumSampledStack GumSampledStack;
+
+enum
+{
+  PROP_0,
+  PROP_BACKTRACER
+};
+
+struct _GumSamplingProfilerPrivate
+{
+  gboolean disposed;
+
+  GMutex mutex;
+  GCond cond;
+
+  GumBacktracerIface * backtracer_interface;
+  GumBacktracer * backtracer_instance;
+
+  guint interval;
+
+  gboolean running;
+  GPtrArray * threads;
+  GThread * collector;
+  struct sigaction previous_action;
+
+  GHashTable * stacks;
+  guint64 sample_count;
+  guint64 dropped_count;
+};
+
+/*
+ * A single-producer single-consumer ring: only the signal handler running on
+ * the sampled thread advances head, and only the collector advances tail.
+ * Nothing on the producer side takes a lock or allocates, so it is safe to
+ * run from any point the thread might be interrupted at.
+ */
+struct _GumSamplingThread
+{
+  GumSamplingProfilerPrivate * profiler;
+  GumThreadId thread_id;
+  gint timer;
+  gboolean has_timer;
+
+  volatile guint head;
+  volatile guint tail;
+  volatile gint dropped;
+
+  GumReturnAddressArray records[GUM_SAMPLING_BUFFER_SIZE];
+};
+
+struct _GumSampledStack
+{
+  GumThreadId thread_id;
+  guint64 count;
+  GumReturnAddressArray frames;
+};
+
+static void gum_sampling_profiler_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gum_sampling_profiler_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gum_sampling_profiler_dispose (GObject * object);
+static void gum_sampling_profiler_finalize (GObject * object);
+
+static void gum_sampling_profiler_free_threads (GumSamplingProfiler * self);
+static gpointer gum_sampling_profiler_collect (GumSamplingProfiler * self);
+static void gum_sampling_profiler_drain (GumSamplingProfiler * self);
+static void gum_sampling_profiler_on_signal (gint sig, siginfo_t * info,
+    gpointer context);
+
+static gboolean gum_sampling_thread_arm (GumSamplingThread * thread,
+    guint interval);
+static void gum_sampling_thread_disarm (GumSamplingThread * thread);
+static gint gum_sampling_thread_id_compare (gconstpointer a,
+    gconstpointer b);
+
+static guint gum_sampled_stack_hash (const GumSampledStack * stack);
+static gboolean gum_sampled_stack_equal (const GumSampledStack * a,
+    const GumSampledStack * b);
+static void gum_sampled_stack_free (GumSampledStack * stack);
+
+static GumProfileReportCallNode * gum_call_node_get_child (
+    GumProfileReportCallNode * node, gpointer function_address);
+
+static volatile gint gum_sampling_profiler_active = FALSE;
+static volatile gint gum_sampling_handlers_running = 0;
+
+G_DEFINE_TYPE (GumSamplingProfiler, gum_sampling_profiler, G_TYPE_OBJECT);
+
+static void
+gum_sampling_profiler_class_init (GumSamplingProfilerClass * klass)
+{
+  GObjectClass * object_class = G_OBJECT_CLASS (klass);
+  GParamSpec * pspec;
+
+  g_type_class_add_private (klass, sizeof (GumSamplingProfilerPrivate));
+
+  object_class->set_property = gum_sampling_profiler_set_property;
+  object_class->get_property = gum_sampling_profiler_get_property;
+  object_class->dispose = gum_sampling_profiler_dispose;
+  object_class->finalize = gum_sampling_profiler_finalize;
+
+  pspec = g_param_spec_object ("backtracer", "Backtracer",
+      "Backtracer Implementation", GUM_TYPE_BACKTRACER,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT_ONLY);
+  g_object_class_install_property (object_class, PROP_BACKTRACER, pspec);
+}
+
+static void
+gum_sampling_profiler_init (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv;
+
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, GUM_TYPE_SAMPLING_PROFILER,
+      GumSamplingProfilerPrivate);
+  priv = self->priv;
+
+  g_mutex_init (&priv->mutex);
+  g_cond_init (&priv->cond);
+
+  priv->interval = GUM_SAMPLING_PROFILER_DEFAULT_INTERVAL;
+
+  priv->threads = g_ptr_array_new ();
+  priv->stacks = g_hash_table_new_full ((GHashFunc) gum_sampled_stack_hash,
+      (GEqualFunc) gum_sampled_stack_equal,
+      (GDestroyNotify) gum_sampled_stack_free, NULL);
+}
+
+static void
+gum_sampling_profiler_set_property (GObject * object,
+                                    guint property_id,
+                                    const GValue * value,
+                                    GParamSpec * pspec)
+{
+  GumSamplingProfiler * self = GUM_SAMPLING_PROFILER (object);
+  GumSamplingProfilerPrivate * priv = self->priv;
+
+  switch (property_id)
+  {
+    case PROP_BACKTRACER:
+      if (priv->backtracer_instance != NULL)
+        g_object_unref (priv->backtracer_instance);
+      priv->backtracer_instance = g_value_dup_object (value);
+
+      if (priv->backtracer_instance != NULL)
+      {
+        priv->backtracer_interface =
+            GUM_BACKTRACER_GET_INTERFACE (priv->backtracer_instance);
+      }
+      else
+      {
+        priv->backtracer_interface = NULL;
+      }
+
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+  }
+}
+
+static void
+gum_sampling_profiler_get_property (GObject * object,
+                                    guint property_id,
+                                    GValue * value,
+                                    GParamSpec * pspec)
+{
+  GumSamplingProfiler * self = GUM_SAMPLING_PROFILER (object);
+  GumSamplingProfilerPrivate * priv = self->priv;
+
+  switch (property_id)
+  {
+    case PROP_BACKTRACER:
+      g_value_set_object (value, priv->backtracer_instance);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+  }
+}
+
+static void
+gum_sampling_profiler_dispose (GObject * object)
+{
+  GumSamplingProfiler * self = GUM_SAMPLING_PROFILER (object);
+  GumSamplingProfilerPrivate * priv = self->priv;
+
+  if (!priv->disposed)
+  {
+    priv->disposed = TRUE;
+
+    gum_sampling_profiler_stop (self);
+
+    if (priv->backtracer_instance != NULL)
+    {
+      g_object_unref (priv->backtracer_instance);
+      priv->backtracer_instance = NULL;
+    }
+    priv->backtracer_interface = NULL;
+  }
+
+  G_OBJECT_CLASS (gum_sampling_profiler_parent_class)->dispose (object);
+}
+
+static void
+gum_sampling_profiler_finalize (GObject * object)
+{
+  GumSamplingProfiler * self = GUM_SAMPLING_PROFILER (object);
+  GumSamplingProfilerPrivate * priv = self->priv;
+
+  gum_sampling_profiler_free_threads (self);
+  g_ptr_array_free (priv->threads, TRUE);
+
+  g_hash_table_unref (priv->stacks);
+
+  g_cond_clear (&priv->cond);
+  g_mutex_clear (&priv->mutex);
+
+  G_OBJECT_CLASS (gum_sampling_profiler_parent_class)->finalize (object);
+}
+
+GumSamplingProfiler *
+gum_sampling_profiler_new (void)
+{
+  GumSamplingProfiler * profiler;
+  GumBacktracer * backtracer;
+
+  backtracer = gum_backtracer_make_fuzzy ();
+  profiler = gum_sampling_profiler_new_with_backtracer (backtracer);
+  if (backtracer != NULL)
+    g_object_unref (backtracer);
+
+  return profiler;
+}
+
+GumSamplingProfiler *
+gum_sampling_profiler_new_with_backtracer (GumBacktracer * backtracer)
+{
+  return GUM_SAMPLING_PROFILER (g_object_new (GUM_TYPE_SAMPLING_PROFILER,
+      "backtracer", backtracer,
+      NULL));
+}
+
+void
+gum_sampling_profiler_set_interval (GumSamplingProfiler * self,
+                                    guint interval_us)
+{
+  g_return_if_fail (interval_us != 0);
+
+  self->priv->interval = interval_us;
+}
+
+/*
+ * Arms a CPU-time timer for each thread that exists at this point. Threads
+ * created later are not sampled. Only one sampling profiler can be running
+ * at a time, as they share the process-wide SIGPROF disposition.
+ */
+gboolean
+gum_sampling_profiler_start (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  struct sigaction action;
+  GDir * dir;
+  const gchar * name;
+  guint i;
+
+  g_return_val_if_fail (!priv->running, FALSE);
+
+  if (!g_atomic_int_compare_and_exchange (&gum_sampling_profiler_active,
+      FALSE, TRUE))
+    return FALSE;
+
+  gum_sampling_profiler_free_threads (self);
+
+  dir = g_dir_open ("/proc/self/task", 0, NULL);
+  if (dir == NULL)
+    goto error;
+  while ((name = g_dir_read_name (dir)) != NULL)
+  {
+    GumSamplingThread * thread;
+
+    thread = g_new0 (GumSamplingThread, 1);
+    thread->profiler = priv;
+    thread->thread_id = atoi (name);
+    g_ptr_array_add (priv->threads, thread);
+  }
+  g_dir_close (dir);
+
+  gum_memset (&action, 0, sizeof (action));
+  action.sa_sigaction = gum_sampling_profiler_on_signal;
+  sigemptyset (&action.sa_mask);
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  if (sigaction (SIGPROF, &action, &priv->previous_action) != 0)
+    goto error;
+
+  priv->running = TRUE;
+
+  for (i = 0; i != priv->threads->len; i++)
+  {
+    /* threads may exit while we enumerate them, which is fine */
+    gum_sampling_thread_arm (g_ptr_array_index (priv->threads, i),
+        priv->interval);
+  }
+
+  priv->collector = g_thread_new ("gum-sampling-profiler",
+      (GThreadFunc) gum_sampling_profiler_collect, self);
+
+  return TRUE;
+
+error:
+  gum_sampling_profiler_free_threads (self);
+  g_atomic_int_set (&gum_sampling_profiler_active, FALSE);
+
+  return FALSE;
+}
+
+void
+gum_sampling_profiler_stop (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  struct sigaction ignore;
+  guint i;
+
+  if (!priv->running)
+    return;
+
+  for (i = 0; i != priv->threads->len; i++)
+    gum_sampling_thread_disarm (g_ptr_array_index (priv->threads, i));
+
+  /*
+   * Ignoring the signal discards any that are still pending, so restoring
+   * the previous disposition cannot deliver a stray SIGPROF to it.
+   */
+  gum_memset (&ignore, 0, sizeof (ignore));
+  ignore.sa_handler = SIG_IGN;
+  sigemptyset (&ignore.sa_mask);
+  sigaction (SIGPROF, &ignore, NULL);
+  sigaction (SIGPROF, &priv->previous_action, NULL);
+
+  while (g_atomic_int_get (&gum_sampling_handlers_running) != 0)
+    g_thread_yield ();
+
+  GUM_SAMPLING_PROFILER_LOCK ();
+  priv->running = FALSE;
+  g_cond_signal (&priv->cond);
+  GUM_SAMPLING_PROFILER_UNLOCK ();
+
+  g_thread_join (priv->collector);
+  priv->collector = NULL;
+
+  gum_sampling_profiler_drain (self);
+
+  g_atomic_int_set (&gum_sampling_profiler_active, FALSE);
+}
+
+guint64
+gum_sampling_profiler_get_sample_count (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  guint64 result;
+
+  gum_sampling_profiler_drain (self);
+
+  GUM_SAMPLING_PROFILER_LOCK ();
+  result = priv->sample_count;
+  GUM_SAMPLING_PROFILER_UNLOCK ();
+
+  return result;
+}
+
+guint64
+gum_sampling_profiler_get_dropped_count (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  guint64 result;
+
+  gum_sampling_profiler_drain (self);
+
+  GUM_SAMPLING_PROFILER_LOCK ();
+  result = priv->dropped_count;
+  GUM_SAMPLING_PROFILER_UNLOCK ();
+
+  return result;
+}
+
+/*
+ * Builds one call tree per thread from the stacks sampled so far. Node
+ * durations are sample counts, inclusive of the node's callees, so a flame
+ * graph of the report shows where CPU time was spent.
+ */
+GumProfileReport *
+gum_sampling_profiler_generate_report (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  GumProfileReport * report;
+  GHashTable * roots;
+  GHashTableIter iter;
+  GumSampledStack * stack;
+  GList * thread_ids, * cur;
+
+  gum_sampling_profiler_drain (self);
+
+  report = gum_profile_report_new ();
+  roots = g_hash_table_new (NULL, NULL);
+
+  GUM_SAMPLING_PROFILER_LOCK ();
+
+  g_hash_table_iter_init (&iter, priv->stacks);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &stack, NULL))
+  {
+    GumProfileReportCallNode * node;
+    gint i;
+
+    node = g_hash_table_lookup (roots, GSIZE_TO_POINTER (stack->thread_id));
+    if (node == NULL)
+    {
+      node = _gum_profile_report_call_node_new (NULL);
+      g_hash_table_insert (roots, GSIZE_TO_POINTER (stack->thread_id), node);
+    }
+
+    for (i = (gint) stack->frames.len - 1; i >= 0; i--)
+    {
+      node = gum_call_node_get_child (node, stack->frames.items[i]);
+      node->total_calls += stack->count;
+      node->total_duration += stack->count;
+    }
+  }
+
+  GUM_SAMPLING_PROFILER_UNLOCK ();
+
+  thread_ids = g_list_sort (g_hash_table_get_keys (roots),
+      (GCompareFunc) gum_sampling_thread_id_compare);
+  for (cur = thread_ids; cur != NULL; cur = cur->next)
+  {
+    _gum_profile_report_append_thread_call_tree (report,
+        g_hash_table_lookup (roots, cur->data));
+  }
+  g_list_free (thread_ids);
+
+  g_hash_table_unref (roots);
+
+  return report;
+}
+
+static void
+gum_sampling_profiler_free_threads (GumSamplingProfiler * self)
+{
+  GPtrArray * threads = self->priv->threads;
+  guint i;
+
+  for (i = 0; i != threads->len; i++)
+    g_free (g_ptr_array_index (threads, i));
+  g_ptr_array_set_size (threads, 0);
+}
+
+static gpointer
+gum_sampling_profiler_collect (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  gint64 deadline;
+
+  GUM_SAMPLING_PROFILER_LOCK ();
+  while (priv->running)
+  {
+    deadline = g_get_monotonic_time () + GUM_SAMPLING_PROFILER_COLLECT_INTERVAL;
+    if (g_cond_wait_until (&priv->cond, &priv->mutex, deadline))
+      continue;
+
+    GUM_SAMPLING_PROFILER_UNLOCK ();
+    gum_sampling_profiler_drain (self);
+    GUM_SAMPLING_PROFILER_LOCK ();
+  }
+  GUM_SAMPLING_PROFILER_UNLOCK ();
+
+  return NULL;
+}
+
+static void
+gum_sampling_profiler_drain (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  guint i;
+
+  GUM_SAMPLING_PROFILER_LOCK ();
+
+  for (i = 0; i != priv->threads->len; i++)
+  {
+    GumSamplingThread * thread = g_ptr_array_index (priv->threads, i);
+    guint head, tail;
+    gint dropped;
+
+    head = g_atomic_int_get (&thread->head);
+
+    for (tail = thread->tail; tail != head; tail++)
+    {
+      GumSampledStack key, * stack;
+      GumReturnAddressArray * frames;
+
+      frames = &thread->records[tail % GUM_SAMPLING_BUFFER_SIZE];
+
+      key.thread_id = thread->thread_id;
+      key.frames.len = frames->len;
+      memcpy (key.frames.items, frames->items,
+          frames->len * sizeof (GumReturnAddress));
+
+      stack = g_hash_table_lookup (priv->stacks, &key);
+      if (stack == NULL)
+      {
+        stack = g_slice_dup (GumSampledStack, &key);
+        stack->count = 0;
+        g_hash_table_insert (priv->stacks, stack, stack);
+      }
+      stack->count++;
+
+      priv->sample_count++;
+    }
+
+    g_atomic_int_set (&thread->tail, tail);
+
+    dropped = g_atomic_int_and (&thread->dropped, 0);
+    priv->dropped_count += dropped;
+  }
+
+  GUM_SAMPLING_PROFILER_UNLOCK ();
+}
+
+static void
+gum_sampling_profiler_on_signal (gint sig,
+                                 siginfo_t * info,
+                                 gpointer context)
+{
+  GumSamplingThread * thread;
+  GumSamplingProfilerPrivate * priv;
+  gint saved_errno;
+  guint head;
+  GumReturnAddressArray * record;
+  GumCpuContext cpu_context;
+
+  /*
+   * Announce ourselves before touching the thread so that stop() cannot
+   * observe zero handlers and free it while we are still using it.
+   */
+  g_atomic_int_inc (&gum_sampling_handlers_running);
+  saved_errno = errno;
+
+  thread = info->si_value.sival_ptr;
+  if (info->si_code != SI_TIMER || thread == NULL)
+    goto beach;
+
+  priv = thread->profiler;
+  head = thread->head;
+
+  if (head - g_atomic_int_get (&thread->tail) == GUM_SAMPLING_BUFFER_SIZE)
+  {
+    g_atomic_int_inc (&thread->dropped);
+    goto beach;
+  }
+
+  record = &thread->records[head % GUM_SAMPLING_BUFFER_SIZE];
+
+  gum_linux_parse_ucontext (context, &cpu_context);
+
+  if (priv->backtracer_interface != NULL)
+  {
+    priv->backtracer_interface->generate (priv->backtracer_instance,
+        &cpu_context, record);
+
+    if (record->len == G_N_ELEMENTS (record->items))
+      record->len--;
+    memmove (&record->items[1], &record->items[0],
+        record->len * sizeof (GumReturnAddress));
+    record->len++;
+  }
+  else
+  {
+    record->len = 1;
+  }
+  record->items[0] = GSIZE_TO_POINTER (GUM_CPU_CONTEXT_PC (&cpu_context));
+
+  g_atomic_int_set (&thread->head, head + 1);
+
+beach:
+  errno = saved_errno;
+  g_atomic_int_add (&gum_sampling_handlers_running, -1);
+}
+
+static gboolean
+gum_sampling_thread_arm (GumSamplingThread * thread,
+                         guint interval)
+{
+  struct sigevent event;
+  struct itimerspec spec;
+
+  gum_memset (&event, 0, sizeof (event));
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = SIGPROF;
+  event.sigev_value.sival_ptr = thread;
+  event.sigev_notify_thread_id = thread->thread_id;
+
+  if (syscall (__NR_timer_create, GUM_THREAD_CPUTIME_CLOCK (thread->thread_id),
+      &event, &thread->timer) != 0)
+    return FALSE;
+  thread->has_timer = TRUE;
+
+  spec.it_interval.tv_sec = interval / G_USEC_PER_SEC;
+  spec.it_interval.tv_nsec = (interval % G_USEC_PER_SEC) * 1000;
+  spec.it_value = spec.it_interval;
+
+  return syscall (__NR_timer_settime, thread->timer, 0, &spec, NULL) == 0;
+}
+
+static void
+gum_sampling_thread_disarm (GumSamplingThread * thread)
+{
+  if (!thread->has_timer)
+    return;
+
+  syscall (__NR_timer_delete, thread->timer);
+  thread->has_timer = FALSE;
+}
+
+static gint
+gum_sampling_thread_id_compare (gconstpointer a,
+                                gconstpointer b)
+{
+  GumThreadId id_a = GPOINTER_TO_SIZE (a);
+  GumThreadId id_b = GPOINTER_TO_SIZE (b);
+
+  if (id_a < id_b)
+    return -1;
+  else if (id_a > id_b)
+    return 1;
+  else
+    return 0;
+}
+
+static guint
+gum_sampled_stack_hash (const GumSampledStack * stack)
+{
+  guint result = (guint) stack->thread_id;
+  guint i;
+
+  for (i = 0; i != stack->frames.len; i++)
+  {
+    result = (result * 31) +
+        (guint) GPOINTER_TO_SIZE (stack->frames.items[i]);
+  }
+
+  return result;
+}
+
+static gboolean
+gum_sampled_stack_equal (const GumSampledStack * a,
+                         const GumSampledStack * b)
+{
+  return a->thread_id == b->thread_id &&
+      gum_return_address_array_is_equal (&a->frames, &b->frames);
+}
+
+static void
+gum_sampled_stack_free (GumSampledStack * stack)
+{
+  g_slice_free (GumSampledStack, stack);
+}
+
+static GumProfileReportCallNode *
+gum_call_node_get_child (GumProfileReportCallNode * node,
+                         gpointer function_address)
+{
+  GumProfileReportCallNode * child;
+
+  if (node->children != NULL)
+  {
+    guint i;
+
+    for (i = 0; i != node->children->len; i++)
+    {
+      child = g_ptr_array_index (node->children, i);
+      if (child->function_address == function_address)
+        return child;
+    }
+  }
+  else
+  {
+    node->children = g_ptr_array_new ();
+  }
+
+  child = _gum_profile_report_call_node_new (function_address);
+  g_ptr_array_add (node->children, child);
+
+  return child;
+}
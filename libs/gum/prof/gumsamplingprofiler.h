@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_SAMPLING_PROFILER_H__
+#define __GUM_SAMPLING_PROFILER_H__
+
+#include "gumprofilereport.h"
+
+#include <gum/gumbacktracer.h>
+
+#define GUM_TYPE_SAMPLING_PROFILER (gum_sampling_profiler_get_type ())
+#define GUM_SAMPLING_PROFILER(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj),\
+    GUM_TYPE_SAMPLING_PROFILER, GumSamplingProfiler))
+#define GUM_SAMPLING_PROFILER_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST ((klass),\
+    GUM_TYPE_SAMPLING_PROFILER, GumSamplingProfilerClass))
+#define GUM_IS_SAMPLING_PROFILER(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj),\
+    GUM_TYPE_SAMPLING_PROFILER))
+#define GUM_IS_SAMPLING_PROFILER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE (\
+    (klass), GUM_TYPE_SAMPLING_PROFILER))
+#define GUM_SAMPLING_PROFILER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS (\
+    (obj), GUM_TYPE_SAMPLING_PROFILER, GumSamplingProfilerClass))
+
+typedef struct _GumSamplingProfiler GumSamplingProfiler;
+typedef struct _GumSamplingProfilerClass GumSamplingProfilerClass;
+
+typedef struct _GumSamplingProfilerPrivate GumSamplingProfilerPrivate;
+
+struct _GumSamplingProfiler
+{
+  GObject parent;
+
+  GumSamplingProfilerPrivate * priv;
+};
+
+struct _GumSamplingProfilerClass
+{
+  GObjectClass parent_class;
+};
+
+G_BEGIN_DECLS
+
+GUM_API GType gum_sampling_profiler_get_type (void) G_GNUC_CONST;
+
+GUM_API GumSamplingProfiler * gum_sampling_profiler_new (void);
+GUM_API GumSamplingProfiler * gum_sampling_profiler_new_with_backtracer (
+    GumBacktracer * backtracer);
+
+GUM_API void gum_sampling_profiler_set_interval (GumSamplingProfiler * self,
+    guint interval_us);
+
+GUM_API gboolean gum_sampling_profiler_start (GumSamplingProfiler * self);
+GUM_API void gum_sampling_profiler_stop (GumSamplingProfiler * self);
+
+GUM_API guint64 gum_sampling_profiler_get_sample_count (
+    GumSamplingProfiler * self);
+GUM_API guint64 gum_sampling_profiler_get_dropped_count (
+    GumSamplingProfiler * self);
+
+GUM_API GumProfileReport * gum_sampling_profiler_generate_report (
+    GumSamplingProfiler * self);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumtimestampsampler.h"
+
+#if defined (HAVE_I386) && defined (__GNUC__)
+# define GUM_TIMESTAMP_SAMPLER_HAVE_TSC 1
+# include <cpuid.h>
+#endif
+#ifdef HAVE_LINUX
+# include <time.h>
+#endif
+
+#define GUM_TSC_CALIBRATION_PERIOD (10 * 1000)
+#define GUM_TSC_SCALE_SHIFT        24
+
+typedef struct _GumTscCalibration GumTscCalibration;
+
+/*
+ * Converts a TSC reading to nanoseconds as base_ns plus the elapsed ticks
+ * times mult, which is a fixed-point nanoseconds-per-tick ratio with
+ * GUM_TSC_SCALE_SHIFT fractional bits.
+ */
+struct _GumTscCalibration
+{
+  gboolean usable;
+  guint64 base_tsc;
+  guint64 base_ns;
+  guint64 mult;
+};
+
+static void gum_timestamp_sampler_iface_init (gpointer g_iface,
+    gpointer iface_data);
+static GumSample gum_timestamp_sampler_sample (GumSampler * sampler);
+
+static guint64 gum_read_clock_ns (void);
+#ifdef GUM_TIMESTAMP_SAMPLER_HAVE_TSC
+static gpointer gum_tsc_calibrate (gpointer data);
+static gboolean gum_tsc_is_invariant (void);
+static inline guint64 gum_tsc_read (void);
+#endif
+
+#ifdef GUM_TIMESTAMP_SAMPLER_HAVE_TSC
+static GumTscCalibration gum_tsc_calibration;
+#endif
+
+G_DEFINE_TYPE_EXTENDED (GumTimestampSampler,
+                        gum_timestamp_sampler,
+                        G_TYPE_OBJECT,
+                        0,
+                        G_IMPLEMENT_INTERFACE (GUM_TYPE_SAMPLER,
+                                               gum_timestamp_sampler_iface_init));
+
+static void
+gum_timestamp_sampler_class_init (GumTimestampSamplerClass * klass)
+{
+#ifdef GUM_TIMESTAMP_SAMPLER_HAVE_TSC
+  static GOnce calibrate_once = G_ONCE_INIT;
+
+  g_once (&calibrate_once, gum_tsc_calibrate, NULL);
+#endif
+
+  (void) klass;
+}
+
+static void
+gum_timestamp_sampler_iface_init (gpointer g_iface,
+                                  gpointer iface_data)
+{
+  GumSamplerIface * iface = (GumSamplerIface *) g_iface;
+
+  (void) iface_data;
+
+  iface->sample = gum_timestamp_sampler_sample;
+}
+
+static void
+gum_timestamp_sampler_init (GumTimestampSampler * self)
+{
+  (void) self;
+}
+
+/*
+ * Samples a monotonic clock in nanoseconds. Where the CPU has an invariant
+ * TSC, this is a single rdtsc scaled by a ratio calibrated once per process,
+ * which is cheap enough not to dominate the duration of short functions.
+ * Elsewhere it falls back to clock_gettime(), served by the vDSO on Linux.
+ */
+GumSampler *
+gum_timestamp_sampler_new (void)
+{
+  return GUM_SAMPLER (g_object_new (GUM_TYPE_TIMESTAMP_SAMPLER, NULL));
+}
+
+gboolean
+gum_timestamp_sampler_is_using_tsc (GumTimestampSampler * self)
+{
+  (void) self;
+
+#ifdef GUM_TIMESTAMP_SAMPLER_HAVE_TSC
+  return gum_tsc_calibration.usable;
+#else
+  return FALSE;
+#endif
+}
+
+static GumSample
+gum_timestamp_sampler_sample (GumSampler * sampler)
+{
+#ifdef GUM_TIMESTAMP_SAMPLER_HAVE_TSC
+  const GumTscCalibration * c = &gum_tsc_calibration;
+
+  (void) sampler;
+
+  if (c->usable)
+  {
+    guint64 delta = gum_tsc_read () - c->base_tsc;
+
+    /* split the multiplication so that it cannot overflow 64 bits */
+    return c->base_ns +
+        (((delta >> 32) * c->mult) << (32 - GUM_TSC_SCALE_SHIFT)) +
+        (((delta & G_MAXUINT32) * c->mult) >> GUM_TSC_SCALE_SHIFT);
+  }
+#else
+  (void) sampler;
+#endif
+
+  return gum_read_clock_ns ();
+}
+
+static guint64
+gum_read_clock_ns (void)
+{
+#ifdef HAVE_LINUX
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ((guint64) ts.tv_sec * G_GUINT64_CONSTANT (1000000000)) + ts.tv_nsec;
+#else
+  return (guint64) g_get_monotonic_time () * 1000;
+#endif
+}
+
+#ifdef GUM_TIMESTAMP_SAMPLER_HAVE_TSC
+
+static gpointer
+gum_tsc_calibrate (gpointer data)
+{
+  GumTscCalibration * c = &gum_tsc_calibration;
+  guint64 start_tsc, start_ns, end_tsc, end_ns;
+
+  (void) data;
+
+  if (!gum_tsc_is_invariant ())
+    return NULL;
+
+  start_ns = gum_read_clock_ns ();
+  start_tsc = gum_tsc_read ();
+  g_usleep (GUM_TSC_CALIBRATION_PERIOD);
+  end_ns = gum_read_clock_ns ();
+  end_tsc = gum_tsc_read ();
+
+  if (end_tsc <= start_tsc || end_ns <= start_ns)
+    return NULL;
+
+  c->base_tsc = end_tsc;
+  c->base_ns = end_ns;
+  c->mult = ((end_ns - start_ns) << GUM_TSC_SCALE_SHIFT) /
+      (end_tsc - start_tsc);
+  c->usable = c->mult != 0;
+
+  return NULL;
+}
+
+static gboolean
+gum_tsc_is_invariant (void)
+{
+  guint eax, ebx, ecx, edx;
+
+  if (!__get_cpuid (0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+    return FALSE;
+
+  __get_cpuid (0x80000007, &eax, &ebx, &ecx, &edx);
+
+  return (edx & (1 << 8)) != 0;
+}
+
+static inline guint64
+gum_tsc_read (void)
+{
+  guint32 low, high;
+
+  __asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+
+  return ((guint64) high << 32) | low;
+}
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_TIMESTAMP_SAMPLER_H__
+#define __GUM_TIMESTAMP_SAMPLER_H__
+
+#include "gumsampler.h"
+
+#define GUM_TYPE_TIMESTAMP_SAMPLER (gum_timestamp_sampler_get_type ())
+#define GUM_TIMESTAMP_SAMPLER(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj),\
+    GUM_TYPE_TIMESTAMP_SAMPLER, GumTimestampSampler))
+#define GUM_TIMESTAMP_SAMPLER_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST ((klass),\
+    GUM_TYPE_TIMESTAMP_SAMPLER, GumTimestampSamplerClass))
+#define GUM_IS_TIMESTAMP_SAMPLER(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj),\
+    GUM_TYPE_TIMESTAMP_SAMPLER))
+#define GUM_IS_TIMESTAMP_SAMPLER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE (\
+    (klass), GUM_TYPE_TIMESTAMP_SAMPLER))
+#define GUM_TIMESTAMP_SAMPLER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS (\
+    (obj), GUM_TYPE_TIMESTAMP_SAMPLER, GumTimestampSamplerClass))
+
+typedef struct _GumTimestampSampler GumTimestampSampler;
+typedef struct _GumTimestampSamplerClass GumTimestampSamplerClass;
+
+struct _GumTimestampSampler
+{
+  GObject parent;
+};
+
+struct _GumTimestampSamplerClass
+{
+  GObjectClass parent_class;
+};
+
+G_BEGIN_DECLS
+
+GUM_API GType gum_timestamp_sampler_get_type (void) G_GNUC_CONST;
+
+GUM_API GumSampler * gum_timestamp_sampler_new (void);
+
+GUM_API gboolean gum_timestamp_sampler_is_using_tsc (
+    GumTimestampSampler * self);
+
+G_END_DECLS
+
+#endif
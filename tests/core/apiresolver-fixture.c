@@ -19,6 +19,7 @@
 
 typedef struct _TestApiResolverFixture TestApiResolverFixture;
 typedef struct _TestForEachContext TestForEachContext;
+typedef struct _TestPrefixMatchContext TestPrefixMatchContext;
 
 struct _TestApiResolverFixture
 {
@@ -31,6 +32,14 @@ struct _TestForEachContext
   guint number_of_calls;
 };
 
+struct _TestPrefixMatchContext
+{
+  const gchar * prefix;
+  GHashTable * names_seen;
+  GHashTable * modules_seen;
+  gchar * current_module;
+};
+
 static void
 test_api_resolver_fixture_setup (TestApiResolverFixture * fixture,
                                  gconstpointer data)
@@ -44,6 +53,12 @@ test_api_resolver_fixture_teardown (TestApiResolverFixture * fixture,
   g_clear_object (&fixture->resolver);
 }
 
+static gboolean check_unique_match (const GumApiDetails * details,
+    gpointer user_data);
+static gboolean check_prefix_match (const GumApiDetails * details,
+    gpointer user_data);
+static gboolean collect_prefixed_name (const GumApiDetails * details,
+    gpointer user_data);
 static gboolean check_module_import (const GumApiDetails * details,
     gpointer user_data);
 static gboolean match_found_cb (const GumApiDetails * details,
@@ -8,6 +8,8 @@
 
 TEST_LIST_BEGIN (api_resolver)
   API_RESOLVER_TESTENTRY (module_exports_can_be_resolved)
+  API_RESOLVER_TESTENTRY (module_export_is_resolved_once_per_module)
+  API_RESOLVER_TESTENTRY (module_export_prefix_is_resolved_once_per_module)
   API_RESOLVER_TESTENTRY (module_imports_can_be_resolved)
   API_RESOLVER_TESTENTRY (objc_methods_can_be_resolved)
 TEST_LIST_END ()
@@ -40,6 +42,138 @@ API_RESOLVER_TESTCASE (module_exports_can_be_resolved)
   g_assert_cmpuint (ctx.number_of_calls, ==, 1);
 }
 
+API_RESOLVER_TESTCASE (module_export_is_resolved_once_per_module)
+{
+  GHashTable * names_seen;
+  GError * error = NULL;
+#ifdef G_OS_WIN32
+  const gchar * query = "exports:*!_open";
+#else
+  const gchar * query = "exports:*!open";
+#endif
+
+  fixture->resolver = gum_api_resolver_make ("module");
+  g_assert (fixture->resolver != NULL);
+
+  names_seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  gum_api_resolver_enumerate_matches (fixture->resolver, query,
+      check_unique_match, names_seen, &error);
+  g_assert (error == NULL);
+  g_assert_cmpuint (g_hash_table_size (names_seen), >=, 1);
+  g_hash_table_unref (names_seen);
+}
+
+static gboolean
+check_unique_match (const GumApiDetails * details,
+                    gpointer user_data)
+{
+  GHashTable * names_seen = user_data;
+
+  g_assert (!g_hash_table_contains (names_seen, details->name));
+  g_hash_table_add (names_seen, g_strdup (details->name));
+
+  return TRUE;
+}
+
+API_RESOLVER_TESTCASE (module_export_prefix_is_resolved_once_per_module)
+{
+  TestPrefixMatchContext ctx;
+  GHashTable * actual_names, * expected_names;
+  GHashTableIter iter;
+  const gchar * name;
+  GError * error = NULL;
+#ifdef G_OS_WIN32
+  const gchar * query = "exports:*!_open*";
+
+  ctx.prefix = "_open";
+#else
+  const gchar * query = "exports:*!open*";
+
+  ctx.prefix = "open";
+#endif
+
+  fixture->resolver = gum_api_resolver_make ("module");
+  g_assert (fixture->resolver != NULL);
+
+  ctx.names_seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      NULL);
+  ctx.modules_seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      NULL);
+  ctx.current_module = NULL;
+  gum_api_resolver_enumerate_matches (fixture->resolver, query,
+      check_prefix_match, &ctx, &error);
+  g_assert (error == NULL);
+  actual_names = ctx.names_seen;
+  g_assert_cmpuint (g_hash_table_size (actual_names), >, 1);
+
+  /* A plain glob takes the slow path, so it tells us what we should see */
+  expected_names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      NULL);
+  ctx.names_seen = expected_names;
+  gum_api_resolver_enumerate_matches (fixture->resolver, "exports:*!*open*",
+      collect_prefixed_name, &ctx, &error);
+  g_assert (error == NULL);
+
+  g_assert_cmpuint (g_hash_table_size (actual_names), ==,
+      g_hash_table_size (expected_names));
+  g_hash_table_iter_init (&iter, expected_names);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &name, NULL))
+    g_assert (g_hash_table_contains (actual_names, name));
+
+  g_hash_table_unref (expected_names);
+  g_free (ctx.current_module);
+  g_hash_table_unref (ctx.modules_seen);
+  g_hash_table_unref (actual_names);
+}
+
+static gboolean
+check_prefix_match (const GumApiDetails * details,
+                    gpointer user_data)
+{
+  TestPrefixMatchContext * ctx = user_data;
+  const gchar * separator;
+  gchar * module;
+
+  separator = strrchr (details->name, '!');
+  g_assert (separator != NULL);
+  g_assert (g_str_has_prefix (separator + 1, ctx->prefix));
+
+  g_assert (!g_hash_table_contains (ctx->names_seen, details->name));
+  g_hash_table_add (ctx->names_seen, g_strdup (details->name));
+
+  /* All of a module's matches must come from a single visit */
+  module = g_strndup (details->name, separator - details->name);
+  if (ctx->current_module == NULL ||
+      strcmp (module, ctx->current_module) != 0)
+  {
+    g_assert (!g_hash_table_contains (ctx->modules_seen, module));
+    g_hash_table_add (ctx->modules_seen, g_strdup (module));
+
+    g_free (ctx->current_module);
+    ctx->current_module = module;
+  }
+  else
+  {
+    g_free (module);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+collect_prefixed_name (const GumApiDetails * details,
+                       gpointer user_data)
+{
+  TestPrefixMatchContext * ctx = user_data;
+  const gchar * separator;
+
+  separator = strrchr (details->name, '!');
+  if (g_str_has_prefix (separator + 1, ctx->prefix))
+    g_hash_table_add (ctx->names_seen, g_strdup (details->name));
+
+  return TRUE;
+}
+
 API_RESOLVER_TESTCASE (module_imports_can_be_resolved)
 {
 #ifdef HAVE_DARWIN
@@ -24,6 +24,10 @@ TEST_LIST_BEGIN (memory)
   MEMORY_TESTENTRY (match_pattern_from_string_does_proper_validation)
   MEMORY_TESTENTRY (scan_range_finds_three_exact_matches)
   MEMORY_TESTENTRY (scan_range_finds_three_wildcarded_matches)
+  MEMORY_TESTENTRY (scan_range_finds_three_masked_matches)
+  MEMORY_TESTENTRY (scan_range_finds_long_exact_match_at_end_of_range)
+  MEMORY_TESTENTRY (scan_range_finds_long_anchor_followed_by_wildcards)
+  MEMORY_TESTENTRY (scan_multi_finds_matches_of_each_pattern)
   MEMORY_TESTENTRY (is_memory_readable_handles_mixed_page_protections)
   MEMORY_TESTENTRY (alloc_n_pages_returns_aligned_rw_address)
   MEMORY_TESTENTRY (alloc_n_pages_near_returns_aligned_rw_address_within_range)
@@ -38,8 +42,18 @@ typedef struct _TestForEachContext {
   guint expected_size;
 } TestForEachContext;
 
+typedef struct _TestScanMultiContext {
+  guint number_of_calls;
+
+  GumAddress address[4];
+  gsize size[4];
+  guint pattern_index[4];
+} TestScanMultiContext;
+
 static gboolean match_found_cb (GumAddress address, gsize size,
     gpointer user_data);
+static gboolean multi_match_found_cb (GumAddress address, gsize size,
+    guint pattern_index, gpointer user_data);
 
 MEMORY_TESTCASE (read_from_valid_address_should_succeed)
 {
@@ -216,6 +230,18 @@ MEMORY_TESTCASE (match_pattern_from_string_does_proper_validation)
   g_assert_cmphex (GUM_PATTERN_NTH_TOKEN_NTH_BYTE (pattern, 2, 0), ==, 0x37);
   gum_match_pattern_free (pattern);
 
+  pattern = gum_match_pattern_new_from_string ("4? ?7");
+  g_assert (pattern != NULL);
+  g_assert_cmpuint (pattern->size, ==, 2);
+  g_assert_cmpuint (pattern->tokens->len, ==, 1);
+  g_assert_cmpuint (GUM_PATTERN_NTH_TOKEN (pattern, 0)->type, ==,
+      GUM_MATCH_MASK);
+  g_assert_cmphex (pattern->bytes[0], ==, 0x40);
+  g_assert_cmphex (pattern->masks[0], ==, 0xf0);
+  g_assert_cmphex (pattern->bytes[1], ==, 0x07);
+  g_assert_cmphex (pattern->masks[1], ==, 0x0f);
+  gum_match_pattern_free (pattern);
+
   pattern = gum_match_pattern_new_from_string ("13 ? 37");
   g_assert (pattern == NULL);
 
@@ -304,6 +330,155 @@ MEMORY_TESTCASE (scan_range_finds_three_wildcarded_matches)
   gum_match_pattern_free (pattern);
 }
 
+MEMORY_TESTCASE (scan_range_finds_three_masked_matches)
+{
+  guint8 buf[] = {
+    0x12, 0x34, 0x13, 0x37,
+    0x12, 0x35, 0x13, 0x37,
+    0x12, 0xc4, 0x1f, 0x37,
+    0x12, 0x04, 0x10, 0x37
+  };
+  GumMemoryRange range;
+  GumMatchPattern * pattern;
+  TestForEachContext ctx;
+
+  range.base_address = GUM_ADDRESS (buf);
+  range.size = sizeof (buf);
+
+  pattern = gum_match_pattern_new_from_string ("12 ?4 1? 37");
+  g_assert (pattern != NULL);
+
+  ctx.number_of_calls = 0;
+  ctx.value_to_return = TRUE;
+
+  ctx.expected_address[0] = buf + 0;
+  ctx.expected_address[1] = buf + 4 + 4;
+  ctx.expected_address[2] = buf + 4 + 4 + 4;
+  ctx.expected_size = 4;
+
+  gum_memory_scan (&range, pattern, match_found_cb, &ctx);
+
+  g_assert_cmpuint (ctx.number_of_calls, ==, 3);
+
+  gum_match_pattern_free (pattern);
+}
+
+MEMORY_TESTCASE (scan_range_finds_long_exact_match_at_end_of_range)
+{
+  guint8 buf[] = {
+    0xde, 0xad, 0xbe, 0xef,
+    0xef, 0xbe, 0xad,
+    0xde, 0xad, 0xbe, 0xee,
+    0xad, 0xde, 0xad, 0xbe, 0xef,
+    0x00, 0xef,
+    0xde, 0xad, 0xbe, 0xef
+  };
+  GumMemoryRange range;
+  GumMatchPattern * pattern;
+  TestForEachContext ctx;
+
+  range.base_address = GUM_ADDRESS (buf);
+  range.size = sizeof (buf);
+
+  pattern = gum_match_pattern_new_from_string ("de ad be ef");
+  g_assert (pattern != NULL);
+  g_assert (pattern->anchor_skips != NULL);
+
+  ctx.number_of_calls = 0;
+  ctx.value_to_return = TRUE;
+
+  ctx.expected_address[0] = buf + 0;
+  ctx.expected_address[1] = buf + 4 + 3 + 4 + 1;
+  ctx.expected_address[2] = buf + sizeof (buf) - 4;
+  ctx.expected_size = 4;
+
+  gum_memory_scan (&range, pattern, match_found_cb, &ctx);
+
+  g_assert_cmpuint (ctx.number_of_calls, ==, 3);
+
+  range.size = sizeof (buf) - 1;
+  ctx.number_of_calls = 0;
+  gum_memory_scan (&range, pattern, match_found_cb, &ctx);
+  g_assert_cmpuint (ctx.number_of_calls, ==, 2);
+
+  gum_match_pattern_free (pattern);
+}
+
+MEMORY_TESTCASE (scan_range_finds_long_anchor_followed_by_wildcards)
+{
+  guint8 buf[] = {
+    0xca, 0xfe, 0xba, 0xbe, 0x11, 0x22, 0x37,
+    0xca, 0xfe, 0xba, 0xbe, 0x33, 0x44, 0x38,
+    0xfe, 0xca, 0xfe, 0xba, 0xbe, 0xca, 0xfe, 0x37,
+    0xca, 0xfe, 0xba, 0xbe, 0x00, 0x00, 0x37
+  };
+  GumMemoryRange range;
+  GumMatchPattern * pattern;
+  TestForEachContext ctx;
+
+  range.base_address = GUM_ADDRESS (buf);
+  range.size = sizeof (buf);
+
+  pattern = gum_match_pattern_new_from_string ("ca fe ba be ?? ?? 37");
+  g_assert (pattern != NULL);
+  g_assert (pattern->anchor_skips != NULL);
+
+  ctx.number_of_calls = 0;
+  ctx.value_to_return = TRUE;
+
+  ctx.expected_address[0] = buf + 0;
+  ctx.expected_address[1] = buf + 7 + 7 + 1;
+  ctx.expected_address[2] = buf + 7 + 7 + 8;
+  ctx.expected_size = 7;
+
+  gum_memory_scan (&range, pattern, match_found_cb, &ctx);
+
+  g_assert_cmpuint (ctx.number_of_calls, ==, 3);
+
+  gum_match_pattern_free (pattern);
+}
+
+MEMORY_TESTCASE (scan_multi_finds_matches_of_each_pattern)
+{
+  guint8 buf[] = {
+    0x12, 0x00, 0x13, 0x37,
+    0x13, 0x37,
+    0xaa, 0xbb, 0xcc, 0xdd
+  };
+  GumMemoryRange range;
+  GumMatchPattern * patterns[3];
+  TestScanMultiContext ctx;
+
+  range.base_address = GUM_ADDRESS (buf);
+  range.size = sizeof (buf);
+
+  patterns[0] = gum_match_pattern_new_from_string ("13 37");
+  patterns[1] = gum_match_pattern_new_from_string ("12 ?? 13");
+  patterns[2] = gum_match_pattern_new_from_string ("aa bb cc dd ee");
+
+  ctx.number_of_calls = 0;
+  gum_memory_scan_multi (&range, (const GumMatchPattern * const *) patterns,
+      G_N_ELEMENTS (patterns), multi_match_found_cb, &ctx);
+
+  g_assert_cmpuint (ctx.number_of_calls, ==, 3);
+
+  g_assert (ctx.address[0] == GUM_ADDRESS (buf + 0));
+  g_assert_cmpuint (ctx.size[0], ==, 3);
+  g_assert_cmpuint (ctx.pattern_index[0], ==, 1);
+
+  g_assert (ctx.address[1] == GUM_ADDRESS (buf + 2));
+  g_assert_cmpuint (ctx.size[1], ==, 2);
+  g_assert_cmpuint (ctx.pattern_index[1], ==, 0);
+
+  g_assert (ctx.address[2] == GUM_ADDRESS (buf + 4));
+  g_assert_cmpuint (ctx.size[2], ==, 2);
+  g_assert_cmpuint (ctx.pattern_index[2], ==, 0);
+
+  gum_match_pattern_free (patterns[2]);
+  gum_match_pattern_free (patterns[1]);
+  gum_match_pattern_free (patterns[0]);
+}
+
 MEMORY_TESTCASE (is_memory_readable_handles_mixed_page_protections)
 {
   guint8 * pages;
@@ -421,3 +596,22 @@ match_found_cb (GumAddress address,
 
   return ctx->value_to_return;
 }
+
+static gboolean
+multi_match_found_cb (GumAddress address,
+                      gsize size,
+                      guint pattern_index,
+                      gpointer user_data)
+{
+  TestScanMultiContext * ctx = (TestScanMultiContext *) user_data;
+
+  g_assert_cmpuint (ctx->number_of_calls, <, G_N_ELEMENTS (ctx->address));
+
+  ctx->address[ctx->number_of_calls] = address;
+  ctx->size[ctx->number_of_calls] = size;
+  ctx->pattern_index[ctx->number_of_calls] = pattern_index;
+
+  ctx->number_of_calls++;
+
+  return TRUE;
+}
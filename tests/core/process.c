@@ -25,6 +25,7 @@
 TEST_LIST_BEGIN (process)
 #ifndef HAVE_MIPS
   PROCESS_TESTENTRY (process_threads)
+  PROCESS_TESTENTRY (process_threads_can_be_modified_in_batch)
 #endif
   PROCESS_TESTENTRY (process_modules)
   PROCESS_TESTENTRY (process_ranges)
@@ -34,6 +35,10 @@ TEST_LIST_BEGIN (process)
   PROCESS_TESTENTRY (module_base)
   PROCESS_TESTENTRY (module_export_can_be_found)
   PROCESS_TESTENTRY (module_export_matches_system_lookup)
+#ifdef HAVE_GLIBC
+  PROCESS_TESTENTRY (module_export_lookup_agrees_with_dlsym)
+#endif
+  PROCESS_TESTENTRY (module_map_can_find_module)
 #ifdef G_OS_WIN32
   PROCESS_TESTENTRY (get_set_system_error)
   PROCESS_TESTENTRY (get_current_thread_id)
@@ -42,6 +47,14 @@ TEST_LIST_BEGIN (process)
   PROCESS_TESTENTRY (darwin_enumerate_modules)
   PROCESS_TESTENTRY (darwin_enumerate_ranges)
   PROCESS_TESTENTRY (darwin_module_exports)
+#endif
+#ifdef HAVE_LINUX
+  PROCESS_TESTENTRY (linux_maps_entries_can_be_parsed)
+  PROCESS_TESTENTRY (linux_maps_deleted_suffix_is_stripped)
+  PROCESS_TESTENTRY (linux_maps_entry_may_lack_path)
+  PROCESS_TESTENTRY (linux_maps_entries_can_span_reads)
+#endif
+#if defined (HAVE_DARWIN) || defined (HAVE_GLIBC)
   PROCESS_TESTENTRY (process_malloc_ranges)
 #endif
 TEST_LIST_END ()
@@ -57,6 +70,14 @@ typedef struct _TestRangeContext {
   gboolean found_exact;
 } TestRangeContext;
 
+typedef struct _TestIdentifiedDummy TestIdentifiedDummy;
+
+struct _TestIdentifiedDummy
+{
+  volatile gboolean * done;
+  volatile GumThreadId id;
+};
+
 #ifndef G_OS_WIN32
 static gboolean store_export_address_if_tricky_module_export (
     const GumExportDetails * details, gpointer user_data);
@@ -68,6 +89,9 @@ static gboolean store_export_address_if_mach_msg (
 #endif
 
 static gpointer sleeping_dummy (gpointer data);
+static gpointer identified_sleeping_dummy (gpointer data);
+static void count_modified_thread (GumThreadId thread_id,
+    GumCpuContext * cpu_context, gpointer user_data);
 static gboolean thread_found_cb (const GumThreadDetails * details,
     gpointer user_data);
 static gboolean module_found_cb (const GumModuleDetails * details,
@@ -80,7 +104,7 @@ static gboolean range_found_cb (const GumRangeDetails * details,
     gpointer user_data);
 static gboolean range_check_cb (const GumRangeDetails * details,
     gpointer user_data);
-#ifdef HAVE_DARWIN
+#if defined (HAVE_DARWIN) || defined (HAVE_GLIBC)
 static gboolean malloc_range_found_cb (
     const GumMallocRangeDetails * details, gpointer user_data);
 static gboolean malloc_range_check_cb (
@@ -113,6 +137,36 @@ PROCESS_TESTCASE (process_threads)
   g_thread_join (thread_a);
 }
 
+PROCESS_TESTCASE (process_threads_can_be_modified_in_batch)
+{
+  gboolean done = FALSE;
+  TestIdentifiedDummy dummy_a = { &done, 0 };
+  TestIdentifiedDummy dummy_b = { &done, 0 };
+  GThread * thread_a, * thread_b;
+  GumThreadId thread_ids[2];
+  guint n_modified, number_of_calls;
+
+  thread_a = g_thread_new ("process-test-sleeping-dummy-a",
+      identified_sleeping_dummy, &dummy_a);
+  thread_b = g_thread_new ("process-test-sleeping-dummy-b",
+      identified_sleeping_dummy, &dummy_b);
+  while (dummy_a.id == 0 || dummy_b.id == 0)
+    g_thread_yield ();
+
+  thread_ids[0] = dummy_a.id;
+  thread_ids[1] = dummy_b.id;
+
+  number_of_calls = 0;
+  n_modified = gum_process_modify_threads (thread_ids,
+      G_N_ELEMENTS (thread_ids), count_modified_thread, &number_of_calls);
+  g_assert_cmpuint (n_modified, ==, G_N_ELEMENTS (thread_ids));
+  g_assert_cmpuint (number_of_calls, ==, n_modified);
+
+  done = TRUE;
+  g_thread_join (thread_b);
+  g_thread_join (thread_a);
+}
+
 PROCESS_TESTCASE (process_modules)
 {
   TestForEachContext ctx;
@@ -179,7 +233,7 @@ PROCESS_TESTCASE (process_ranges)
   }
 }
 
-#ifdef HAVE_DARWIN
+#if defined (HAVE_DARWIN) || defined (HAVE_GLIBC)
 
 PROCESS_TESTCASE (process_malloc_ranges)
 {
@@ -238,6 +292,42 @@ PROCESS_TESTCASE (process_malloc_ranges)
     g_assert (!ctx.found);
     g_assert (!ctx.found_exact);
   }
+
+  {
+    TestRangeContext ctx;
+    const gsize large_buf_size = 4 * 1024 * 1024;
+    guint8 * large_buf;
+
+    large_buf = malloc (large_buf_size);
+
+    ctx.range.base_address = GUM_ADDRESS (large_buf);
+    ctx.range.size = large_buf_size;
+    ctx.found = FALSE;
+    ctx.found_exact = FALSE;
+    gum_process_enumerate_malloc_ranges (malloc_range_check_cb, &ctx);
+    g_assert (ctx.found_exact);
+
+    free (large_buf);
+  }
+
+#ifdef HAVE_LINUX
+  {
+    TestRangeContext ctx;
+    const gsize gum_buf_size = 100;
+    guint8 * gum_buf;
+
+    gum_buf = gum_malloc (gum_buf_size);
+
+    ctx.range.base_address = GUM_ADDRESS (gum_buf);
+    ctx.range.size = gum_buf_size;
+    ctx.found = FALSE;
+    ctx.found_exact = FALSE;
+    gum_process_enumerate_malloc_ranges (malloc_range_check_cb, &ctx);
+    g_assert (ctx.found_exact);
+
+    gum_free (gum_buf);
+  }
+#endif
 }
 
 #endif
@@ -329,6 +419,72 @@ PROCESS_TESTCASE (module_export_matches_system_lookup)
 #endif
 }
 
+#ifdef HAVE_GLIBC
+
+PROCESS_TESTCASE (module_export_lookup_agrees_with_dlsym)
+{
+  const gchar * libc_names[] = {
+    SYSTEM_MODULE_EXPORT,
+    "strlen",
+    "memcpy",
+    "gum_no_such_export"
+  };
+  void * libc, * libpthread;
+  guint i;
+
+  libc = dlopen (SYSTEM_MODULE_NAME, RTLD_LAZY);
+  g_assert (libc != NULL);
+
+  /* memcpy and strlen are usually IFUNCs. */
+  for (i = 0; i != G_N_ELEMENTS (libc_names); i++)
+  {
+    g_assert_cmphex (
+        gum_module_find_export_by_name (SYSTEM_MODULE_NAME, libc_names[i]),
+        ==, GPOINTER_TO_SIZE (dlsym (libc, libc_names[i])));
+  }
+
+  /*
+   * Depending on the glibc version, libpthread either defines this itself or
+   * only re-exports the one in libc.
+   */
+  libpthread = dlopen ("libpthread.so.0", RTLD_LAZY);
+  g_assert (libpthread != NULL);
+  g_assert_cmphex (
+      gum_module_find_export_by_name ("libpthread.so.0", "pthread_create"),
+      ==, GPOINTER_TO_SIZE (dlsym (libpthread, "pthread_create")));
+  dlclose (libpthread);
+
+  dlclose (libc);
+}
+
+#endif
+
+PROCESS_TESTCASE (module_map_can_find_module)
+{
+  GumAddress address;
+  GumModuleMap * map;
+  const GumModuleDetails * details;
+
+  address = gum_module_find_export_by_name (SYSTEM_MODULE_NAME,
+      SYSTEM_MODULE_EXPORT);
+  g_assert (address != 0);
+
+  map = gum_module_map_new ();
+
+  details = gum_module_map_find (map, address);
+  g_assert (details != NULL);
+  g_assert (GUM_MEMORY_RANGE_INCLUDES (details->range, address));
+  g_assert (gum_module_map_find (map, address + 1) == details);
+  g_assert (gum_module_map_find (map, 0) == NULL);
+
+  gum_module_map_refresh (map);
+  details = gum_module_map_find (map, address);
+  g_assert (details != NULL);
+  g_assert (GUM_MEMORY_RANGE_INCLUDES (details->range, address));
+
+  g_object_unref (map);
+}
+
 #ifndef G_OS_WIN32
 static gboolean
 store_export_address_if_tricky_module_export (const GumExportDetails * details,
@@ -462,6 +618,177 @@ store_export_address_if_mach_msg (const GumExportDetails * details,
 
 #endif
 
+#ifdef HAVE_LINUX
+
+#include <gum/backend-linux/gumlinuxmaps.h>
+#include <unistd.h>
+
+static gchar * write_maps_to_temp_file (const gchar * contents);
+
+PROCESS_TESTCASE (linux_maps_entries_can_be_parsed)
+{
+  gchar * path;
+  GumProcMapsIter iter;
+  GumProcMapsEntry entry;
+
+  path = write_maps_to_temp_file (
+      "00400000-0040b000 r-xp 00000000 08:01 1234       /usr/bin/foo\n"
+      "7f0a12345000-7f0a12346000 rw-s 0001f000 fd:02 98765432101 "
+          "/tmp/with space");
+  gum_proc_maps_iter_init_for_path (&iter, path);
+
+  g_assert (gum_proc_maps_iter_next (&iter, &entry));
+  g_assert_cmphex (entry.start, ==, 0x400000);
+  g_assert_cmphex (entry.end, ==, 0x40b000);
+  g_assert_cmpstr (entry.perms, ==, "r-xp");
+  g_assert_cmphex (entry.offset, ==, 0);
+  g_assert_cmpuint (entry.inode, ==, 1234);
+  g_assert_cmpstr (entry.path, ==, "/usr/bin/foo");
+
+  g_assert (gum_proc_maps_iter_next (&iter, &entry));
+  g_assert_cmphex (entry.start, ==, G_GUINT64_CONSTANT (0x7f0a12345000));
+  g_assert_cmphex (entry.end, ==, G_GUINT64_CONSTANT (0x7f0a12346000));
+  g_assert_cmpstr (entry.perms, ==, "rw-s");
+  g_assert_cmphex (entry.offset, ==, 0x1f000);
+  g_assert_cmpuint (entry.inode, ==, G_GUINT64_CONSTANT (98765432101));
+  g_assert_cmpstr (entry.path, ==, "/tmp/with space");
+
+  g_assert (!gum_proc_maps_iter_next (&iter, &entry));
+
+  gum_proc_maps_iter_destroy (&iter);
+
+  unlink (path);
+  g_free (path);
+}
+
+PROCESS_TESTCASE (linux_maps_deleted_suffix_is_stripped)
+{
+  gchar * path;
+  GumProcMapsIter iter;
+  GumProcMapsEntry entry;
+
+  path = write_maps_to_temp_file (
+      "7f0000000000-7f0000001000 r-xp 00000000 08:01 42 "
+          "/tmp/libfoo.so (deleted)\n"
+      "7f0000001000-7f0000002000 rw-s 00000000 00:05 43 "
+          "/dev/zero (deleted)\n"
+      "7f0000002000-7f0000003000 r--p 00000000 08:01 44 "
+          "/tmp/ (deleted)/libbar.so\n");
+  gum_proc_maps_iter_init_for_path (&iter, path);
+
+  g_assert (gum_proc_maps_iter_next (&iter, &entry));
+  g_assert_cmpstr (entry.path, ==, "/tmp/libfoo.so");
+
+  g_assert (gum_proc_maps_iter_next (&iter, &entry));
+  g_assert_cmpstr (entry.path, ==, "/dev/zero");
+
+  g_assert (gum_proc_maps_iter_next (&iter, &entry));
+  g_assert_cmpstr (entry.path, ==, "/tmp/ (deleted)/libbar.so");
+
+  g_assert (!gum_proc_maps_iter_next (&iter, &entry));
+
+  gum_proc_maps_iter_destroy (&iter);
+
+  unlink (path);
+  g_free (path);
+}
+
+PROCESS_TESTCASE (linux_maps_entry_may_lack_path)
+{
+  gchar * path;
+  GumProcMapsIter iter;
+  GumProcMapsEntry entry;
+
+  path = write_maps_to_temp_file (
+      "7ffd00000000-7ffd00021000 rw-p 00000000 00:00 0 \n"
+      "7ffd00021000-7ffd00022000 ---p 00000000 00:00 0\n"
+      "7ffd00022000-7ffd00023000 r--p 00000000 00:00 0                  "
+          "[vvar]\n");
+  gum_proc_maps_iter_init_for_path (&iter, path);
+
+  g_assert (gum_proc_maps_iter_next (&iter, &entry));
+  g_assert_cmphex (entry.end, ==, G_GUINT64_CONSTANT (0x7ffd00021000));
+  g_assert_cmpstr (entry.perms, ==, "rw-p");
+  g_assert_cmpuint (entry.inode, ==, 0);
+  g_assert_cmpstr (entry.path, ==, "");
+
+  g_assert (gum_proc_maps_iter_next (&iter, &entry));
+  g_assert_cmpstr (entry.perms, ==, "---p");
+  g_assert_cmpstr (entry.path, ==, "");
+
+  g_assert (gum_proc_maps_iter_next (&iter, &entry));
+  g_assert_cmpstr (entry.path, ==, "[vvar]");
+
+  g_assert (!gum_proc_maps_iter_next (&iter, &entry));
+
+  gum_proc_maps_iter_destroy (&iter);
+
+  unlink (path);
+  g_free (path);
+}
+
+PROCESS_TESTCASE (linux_maps_entries_can_span_reads)
+{
+  const guint n_entries = 1000;
+  GString * contents;
+  gchar * long_name, * path;
+  GumProcMapsIter iter;
+  GumProcMapsEntry entry;
+  guint i;
+
+  long_name = g_strnfill (PATH_MAX - 64, 'x');
+
+  contents = g_string_new (NULL);
+  for (i = 0; i != n_entries; i++)
+  {
+    g_string_append_printf (contents,
+        "%08x-%08x r--p 00000000 08:01 %u /%u/%s\n",
+        (i + 1) * 0x1000, (i + 2) * 0x1000, i, i, long_name);
+  }
+
+  path = write_maps_to_temp_file (contents->str);
+  gum_proc_maps_iter_init_for_path (&iter, path);
+
+  for (i = 0; i != n_entries; i++)
+  {
+    gchar * expected_path;
+
+    g_assert (gum_proc_maps_iter_next (&iter, &entry));
+    g_assert_cmphex (entry.start, ==, (i + 1) * 0x1000);
+    g_assert_cmpuint (entry.inode, ==, i);
+
+    expected_path = g_strdup_printf ("/%u/%s", i, long_name);
+    g_assert_cmpstr (entry.path, ==, expected_path);
+    g_free (expected_path);
+  }
+
+  g_assert (!gum_proc_maps_iter_next (&iter, &entry));
+
+  gum_proc_maps_iter_destroy (&iter);
+
+  unlink (path);
+  g_free (path);
+  g_string_free (contents, TRUE);
+  g_free (long_name);
+}
+
+static gchar *
+write_maps_to_temp_file (const gchar * contents)
+{
+  gchar * path;
+  gint fd;
+
+  fd = g_file_open_tmp ("gum-tests-XXXXXX", &path, NULL);
+  g_assert (fd != -1);
+  close (fd);
+
+  g_assert (g_file_set_contents (path, contents, -1, NULL));
+
+  return path;
+}
+
+#endif
+
 static gpointer
 sleeping_dummy (gpointer data)
 {
@@ -473,6 +800,32 @@ sleeping_dummy (gpointer data)
   return NULL;
 }
 
+static gpointer
+identified_sleeping_dummy (gpointer data)
+{
+  TestIdentifiedDummy * dummy = (TestIdentifiedDummy *) data;
+
+  dummy->id = gum_process_get_current_thread_id ();
+
+  while (!(*dummy->done))
+    g_thread_yield ();
+
+  return NULL;
+}
+
+static void
+count_modified_thread (GumThreadId thread_id,
+                       GumCpuContext * cpu_context,
+                       gpointer user_data)
+{
+  guint * number_of_calls = (guint *) user_data;
+
+  (void) thread_id;
+  (void) cpu_context;
+
+  (*number_of_calls)++;
+}
+
 static gboolean
 thread_found_cb (const GumThreadDetails * details,
                  gpointer user_data)
@@ -567,7 +920,7 @@ range_check_cb (const GumRangeDetails * details,
   return TRUE;
 }
 
-#ifdef HAVE_DARWIN
+#if defined (HAVE_DARWIN) || defined (HAVE_GLIBC)
 
 static gboolean
 malloc_range_found_cb (const GumMallocRangeDetails * details,
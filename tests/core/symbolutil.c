@@ -7,6 +7,32 @@
 
 #include "testutil.h"
 
+#ifdef HAVE_GLIBC
+# include <dlfcn.h>
+# include <sys/mman.h>
+# include <unistd.h>
+
+# if defined (HAVE_I386)
+#  if GLIB_SIZEOF_VOID_P == 4
+#   define GUM_TEST_SHLIB_ARCH "ia32"
+#  else
+#   define GUM_TEST_SHLIB_ARCH "amd64"
+#  endif
+# elif defined (HAVE_ARM)
+#  define GUM_TEST_SHLIB_ARCH "arm"
+# elif defined (HAVE_ARM64)
+#  define GUM_TEST_SHLIB_ARCH "arm64"
+# elif defined (HAVE_MIPS)
+#  if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#   define GUM_TEST_SHLIB_ARCH "mipsel"
+#  else
+#   define GUM_TEST_SHLIB_ARCH "mips"
+#  endif
+# else
+#  error Unknown CPU
+# endif
+#endif
+
 #ifdef HAVE_ANDROID
 # define SYMUTIL_TESTCASE(NAME) \
     static void test_symbolutil_run_ ## NAME (void); \
@@ -29,6 +55,11 @@
 
 TEST_LIST_BEGIN (symbolutil)
   SYMUTIL_TESTENTRY (symbol_details_from_address)
+  SYMUTIL_TESTENTRY (symbol_details_from_addresses)
+#ifdef HAVE_GLIBC
+  SYMUTIL_TESTENTRY (symbol_details_from_unreadable_module)
+  SYMUTIL_TESTENTRY (symbol_details_after_module_reload)
+#endif
   SYMUTIL_TESTENTRY (symbol_name_from_address)
   SYMUTIL_TESTENTRY (find_external_public_function)
   SYMUTIL_TESTENTRY (find_local_static_function)
@@ -39,6 +70,11 @@ TEST_LIST_END ()
 static void GUM_CDECL gum_dummy_function_0 (void);
 static void GUM_STDCALL gum_dummy_function_1 (void);
 
+#ifdef HAVE_GLIBC
+static gchar * copy_test_library_to_temp_file (const gchar * name);
+static void copy_test_library_to (const gchar * name, const gchar * path);
+#endif
+
 SYMUTIL_TESTCASE (symbol_details_from_address)
 {
   GumSymbolDetails details;
@@ -56,6 +92,137 @@ SYMUTIL_TESTCASE (symbol_details_from_address)
 #endif
 }
 
+SYMUTIL_TESTCASE (symbol_details_from_addresses)
+{
+  gpointer addresses[3];
+  GumSymbolDetails details[3];
+
+  addresses[0] = gum_dummy_function_1;
+  addresses[1] = gum_dummy_function_0;
+  addresses[2] = gum_dummy_function_1;
+
+  g_assert_cmpuint (gum_symbol_details_from_addresses (addresses, 3, details),
+      ==, 3);
+
+  g_assert_cmphex (details[0].address, ==,
+      GPOINTER_TO_SIZE (gum_dummy_function_1));
+  g_assert_cmpstr (details[0].symbol_name, ==, "gum_dummy_function_1");
+  g_assert_cmpstr (details[1].symbol_name, ==, "gum_dummy_function_0");
+  g_assert_cmpstr (details[2].symbol_name, ==, "gum_dummy_function_1");
+}
+
+#ifdef HAVE_GLIBC
+
+SYMUTIL_TESTCASE (symbol_details_from_unreadable_module)
+{
+  gchar * path, * name;
+  void * lib;
+  gpointer function;
+  guint i;
+
+  path = copy_test_library_to_temp_file ("targetfunctions");
+  name = g_path_get_basename (path);
+
+  lib = dlopen (path, RTLD_NOW | RTLD_LOCAL);
+  g_assert (lib != NULL);
+  function = dlsym (lib, "gum_test_target_function");
+  g_assert (function != NULL);
+
+  unlink (path);
+
+  /* The second lookup hits the cached module that failed to open. */
+  for (i = 0; i != 2; i++)
+  {
+    GumSymbolDetails details;
+
+    g_assert (gum_symbol_details_from_address (function, &details));
+    g_assert_cmpstr (details.module_name, ==, name);
+    g_assert_cmpstr (details.symbol_name, ==, "");
+  }
+
+  dlclose (lib);
+
+  g_free (name);
+  g_free (path);
+}
+
+SYMUTIL_TESTCASE (symbol_details_after_module_reload)
+{
+  gchar * path;
+  void * lib;
+  gpointer function, old_base, reservation;
+  Dl_info dl_info;
+  GumSymbolDetails details;
+
+  path = copy_test_library_to_temp_file ("targetfunctions");
+
+  lib = dlopen (path, RTLD_NOW | RTLD_LOCAL);
+  g_assert (lib != NULL);
+  function = dlsym (lib, "gum_test_target_function");
+  g_assert (gum_symbol_details_from_address (function, &details));
+  g_assert_cmpstr (details.symbol_name, ==, "gum_test_target_function");
+  g_assert (dladdr (function, &dl_info));
+  old_base = dl_info.dli_fbase;
+  dlclose (lib);
+
+  /* Keep the old base taken so the replacement has to land elsewhere. */
+  reservation = mmap (old_base, gum_query_page_size (), PROT_NONE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  g_assert (reservation != MAP_FAILED);
+
+  copy_test_library_to ("specialfunctions", path);
+
+  lib = dlopen (path, RTLD_NOW | RTLD_LOCAL);
+  g_assert (lib != NULL);
+  function = dlsym (lib, "gum_test_special_function");
+  g_assert (dladdr (function, &dl_info));
+  g_assert (dl_info.dli_fbase != old_base);
+  g_assert (gum_symbol_details_from_address (function, &details));
+  g_assert_cmpstr (details.symbol_name, ==, "gum_test_special_function");
+  dlclose (lib);
+
+  munmap (reservation, gum_query_page_size ());
+
+  unlink (path);
+  g_free (path);
+}
+
+static gchar *
+copy_test_library_to_temp_file (const gchar * name)
+{
+  gchar * path;
+  gint fd;
+
+  fd = g_file_open_tmp ("gum-tests-XXXXXX", &path, NULL);
+  g_assert (fd != -1);
+  close (fd);
+
+  copy_test_library_to (name, path);
+
+  return path;
+}
+
+static void
+copy_test_library_to (const gchar * name,
+                      const gchar * path)
+{
+  gchar * testdir, * filename, * contents;
+  gsize length;
+
+  testdir = test_util_get_data_dir ();
+  filename = g_strconcat (testdir, G_DIR_SEPARATOR_S, name,
+      "-linux-" GUM_TEST_SHLIB_ARCH "." G_MODULE_SUFFIX, NULL);
+
+  g_assert (g_file_get_contents (filename, &contents, &length, NULL));
+  g_assert (g_file_set_contents (path, contents, length, NULL));
+
+  g_free (contents);
+  g_free (filename);
+  g_free (testdir);
+}
+
+#endif
+
 SYMUTIL_TESTCASE (symbol_name_from_address)
 {
   gchar * symbol_name;
@@ -12,7 +12,10 @@ TEST_LIST_BEGIN (script)
   SCRIPT_TESTENTRY (array_buffer_can_be_created)
   SCRIPT_TESTENTRY (message_can_be_sent)
   SCRIPT_TESTENTRY (message_can_be_sent_with_data)
+  SCRIPT_TESTENTRY (message_can_be_sent_with_transferred_data)
+  SCRIPT_TESTENTRY (messages_sent_in_a_burst_are_delivered_in_order)
   SCRIPT_TESTENTRY (message_can_be_received)
+  SCRIPT_TESTENTRY (message_can_be_received_on_dedicated_js_thread)
   SCRIPT_TESTENTRY (recv_may_specify_desired_message_type)
   SCRIPT_TESTENTRY (recv_can_be_waited_for)
   SCRIPT_TESTENTRY (rpc_can_be_performed)
@@ -53,6 +56,10 @@ TEST_LIST_BEGIN (script)
   SCRIPT_TESTENTRY (memory_can_be_copied)
   SCRIPT_TESTENTRY (memory_can_be_duped)
   SCRIPT_TESTENTRY (memory_can_be_protected)
+  SCRIPT_TESTENTRY (memory_can_be_read_into_typed_array)
+  SCRIPT_TESTENTRY (memory_can_be_written_from_typed_array)
+  SCRIPT_TESTENTRY (pointers_can_be_read_in_bulk)
+  SCRIPT_TESTENTRY (memory_can_be_gathered)
   SCRIPT_TESTENTRY (s8_can_be_read)
   SCRIPT_TESTENTRY (s8_can_be_written)
   SCRIPT_TESTENTRY (u8_can_be_read)
@@ -103,6 +110,8 @@ TEST_LIST_BEGIN (script)
   SCRIPT_TESTENTRY (invalid_write_results_in_exception)
   SCRIPT_TESTENTRY (memory_can_be_scanned)
   SCRIPT_TESTENTRY (memory_can_be_scanned_synchronously)
+  SCRIPT_TESTENTRY (memory_ranges_can_be_scanned_in_parallel)
+  SCRIPT_TESTENTRY (memory_ranges_scan_handles_matches_across_chunks)
   SCRIPT_TESTENTRY (memory_scan_should_be_interruptible)
   SCRIPT_TESTENTRY (memory_scan_handles_unreadable_memory)
 #ifdef G_OS_WIN32
@@ -212,6 +221,10 @@ static void on_read_ready (GObject * source_object, GAsyncResult * res,
     gpointer user_data);
 #endif
 
+static GumScript * load_js_thread_id_script (TestScriptFixture * fixture);
+static gint query_js_thread_id (TestScriptFixture * fixture,
+    GumScript * script);
+
 static gpointer sleeping_dummy (gpointer data);
 
 static gpointer invoke_target_function_int_worker (gpointer data);
@@ -1603,6 +1616,35 @@ SCRIPT_TESTCASE (message_can_be_sent_with_data)
   EXPECT_SEND_MESSAGE_WITH_PAYLOAD_AND_DATA ("1234", "13 37");
 }
 
+SCRIPT_TESTCASE (message_can_be_sent_with_transferred_data)
+{
+  if (GUM_DUK_IS_SCRIPT_BACKEND (fixture->backend))
+  {
+    g_print ("<skipping, not yet implemented in the Duktape runtime> ");
+    return;
+  }
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "var buf = new ArrayBuffer(2);"
+      "var bytes = new Uint8Array(buf);"
+      "bytes[0] = 0x13;"
+      "bytes[1] = 0x37;"
+      "send(1234, buf, { transfer: true });"
+      "send(buf.byteLength);");
+  EXPECT_SEND_MESSAGE_WITH_PAYLOAD_AND_DATA ("1234", "13 37");
+  EXPECT_SEND_MESSAGE_WITH ("0");
+}
+
+SCRIPT_TESTCASE (messages_sent_in_a_burst_are_delivered_in_order)
+{
+  COMPILE_AND_LOAD_SCRIPT (
+      "for (var i = 0; i !== 3; i++)"
+      "  send(i);");
+  EXPECT_SEND_MESSAGE_WITH ("0");
+  EXPECT_SEND_MESSAGE_WITH ("1");
+  EXPECT_SEND_MESSAGE_WITH ("2");
+}
+
 SCRIPT_TESTCASE (message_can_be_received)
 {
   COMPILE_AND_LOAD_SCRIPT (
@@ -1615,6 +1657,73 @@ SCRIPT_TESTCASE (message_can_be_received)
   EXPECT_SEND_MESSAGE_WITH ("\"pong\"");
 }
 
+SCRIPT_TESTCASE (message_can_be_received_on_dedicated_js_thread)
+{
+  GumScript * first, * second, * shared;
+  gint first_id, second_id, shared_id;
+
+  gum_script_backend_set_dedicated_js_threads (fixture->backend, TRUE);
+  first = load_js_thread_id_script (fixture);
+  second = load_js_thread_id_script (fixture);
+  gum_script_backend_set_dedicated_js_threads (fixture->backend, FALSE);
+  shared = load_js_thread_id_script (fixture);
+
+  first_id = query_js_thread_id (fixture, first);
+  second_id = query_js_thread_id (fixture, second);
+  shared_id = query_js_thread_id (fixture, shared);
+
+  g_assert_cmpint (first_id, !=, second_id);
+  g_assert_cmpint (first_id, !=, shared_id);
+  g_assert_cmpint (second_id, !=, shared_id);
+
+  g_assert_cmpuint (gum_script_get_js_queue_depth (first), ==, 0);
+  g_assert_cmpuint (gum_script_get_js_queue_depth (second), ==, 0);
+
+  gum_script_unload_sync (shared, NULL);
+  g_object_unref (shared);
+  gum_script_unload_sync (second, NULL);
+  g_object_unref (second);
+  gum_script_unload_sync (first, NULL);
+  g_object_unref (first);
+}
+
+static GumScript *
+load_js_thread_id_script (TestScriptFixture * fixture)
+{
+  GumScript * script;
+
+  script = gum_script_backend_create_sync (fixture->backend, "testcase",
+      "recv('ping', function () {"
+      "  send(Process.getCurrentThreadId());"
+      "});", NULL, NULL);
+  g_assert (script != NULL);
+  gum_script_set_message_handler (script,
+      test_script_fixture_store_message, fixture, NULL);
+  gum_script_load_sync (script, NULL);
+
+  return script;
+}
+
+static gint
+query_js_thread_id (TestScriptFixture * fixture,
+                    GumScript * script)
+{
+  TestScriptMessageItem * item;
+  gint id;
+
+  EXPECT_NO_MESSAGES ();
+  gum_script_post_message (script, "{\"type\":\"ping\"}");
+
+  item = test_script_fixture_pop_message (fixture);
+  id = 0;
+  sscanf (item->message, "{\"type\":\"send\",\"payload\":%d}", &id);
+  g_assert (id != 0);
+  test_script_message_item_free (item);
+  g_assert_cmpint (id, !=, gum_process_get_current_thread_id ());
+
+  return id;
+}
+
 SCRIPT_TESTCASE (recv_may_specify_desired_message_type)
 {
   COMPILE_AND_LOAD_SCRIPT (
@@ -2423,6 +2532,78 @@ SCRIPT_TESTCASE (memory_can_be_scanned_synchronously)
   EXPECT_SEND_MESSAGE_WITH ("\"done\"");
 }
 
+SCRIPT_TESTCASE (memory_ranges_can_be_scanned_in_parallel)
+{
+  guint8 first[] = { 0x01, 0x02, 0x13, 0x37, 0x03 };
+  guint8 second[] = { 0x13, 0x37, 0x04 };
+
+  if (GUM_DUK_IS_SCRIPT_BACKEND (fixture->backend))
+  {
+    g_print ("<skipping, not yet implemented in the Duktape runtime> ");
+    return;
+  }
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "var first = " GUM_PTR_CONST ";"
+      "var second = " GUM_PTR_CONST ";"
+      "Memory.scanRanges(["
+          "{ base: second, size: 3 },"
+          "{ base: first, size: 5 }"
+        "], '13 37', {"
+        "onMatch: function (address, size) {"
+        "  send('onMatch ' + (address.equals(first.add(2)) ? 'first' :"
+        "      address.equals(second) ? 'second' : 'other') +"
+        "      ' size=' + size);"
+        "},"
+        "onComplete: function () {"
+        "  send('onComplete');"
+        "}"
+      "});", first, second);
+  if (first < second)
+  {
+    EXPECT_SEND_MESSAGE_WITH ("\"onMatch first size=2\"");
+    EXPECT_SEND_MESSAGE_WITH ("\"onMatch second size=2\"");
+  }
+  else
+  {
+    EXPECT_SEND_MESSAGE_WITH ("\"onMatch second size=2\"");
+    EXPECT_SEND_MESSAGE_WITH ("\"onMatch first size=2\"");
+  }
+  EXPECT_SEND_MESSAGE_WITH ("\"onComplete\"");
+}
+
+SCRIPT_TESTCASE (memory_ranges_scan_handles_matches_across_chunks)
+{
+  const gsize chunk_size = 4 * 1024 * 1024;
+  guint8 * haystack;
+
+  if (GUM_DUK_IS_SCRIPT_BACKEND (fixture->backend))
+  {
+    g_print ("<skipping, not yet implemented in the Duktape runtime> ");
+    return;
+  }
+
+  haystack = g_malloc0 (chunk_size + 16);
+  haystack[chunk_size - 1] = 0xaa;
+  haystack[chunk_size + 0] = 0xaa;
+  haystack[chunk_size + 1] = 0xaa;
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "var haystack = " GUM_PTR_CONST ";"
+      "Memory.scanRanges([{ base: haystack, size: %u }], 'aa aa', {"
+        "onMatch: function (address, size) {"
+        "  send('onMatch offset=' + address.sub(haystack).toInt32());"
+        "},"
+        "onComplete: function () {"
+        "  send('onComplete');"
+        "}"
+      "});", haystack, (guint) (chunk_size + 16));
+  EXPECT_SEND_MESSAGE_WITH ("\"onMatch offset=4194303\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"onComplete\"");
+
+  g_free (haystack);
+}
+
 SCRIPT_TESTCASE (memory_scan_should_be_interruptible)
 {
   guint8 haystack[] = { 0x01, 0x02, 0x13, 0x37, 0x03, 0x13, 0x37 };
@@ -2643,6 +2824,86 @@ SCRIPT_TESTCASE (memory_can_be_protected)
   gum_free_pages (buf);
 }
 
+SCRIPT_TESTCASE (memory_can_be_read_into_typed_array)
+{
+  guint32 values[3] = { 1, 2, 1337 };
+
+  if (GUM_DUK_IS_SCRIPT_BACKEND (fixture->backend))
+  {
+    g_print ("<skipping, not yet implemented in the Duktape runtime> ");
+    return;
+  }
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "var values = new Uint32Array(3);"
+      "Memory.readInto(" GUM_PTR_CONST ", values);"
+      "send(values[0] + values[1] + values[2]);",
+      values);
+  EXPECT_SEND_MESSAGE_WITH ("1340");
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "Memory.readInto(ptr(\"1337\"), new Uint8Array(1));");
+  EXPECT_ERROR_MESSAGE_WITH (1, "Error: access violation accessing 0x539");
+}
+
+SCRIPT_TESTCASE (memory_can_be_written_from_typed_array)
+{
+  guint32 values[3] = { 0, 0, 0 };
+
+  if (GUM_DUK_IS_SCRIPT_BACKEND (fixture->backend))
+  {
+    g_print ("<skipping, not yet implemented in the Duktape runtime> ");
+    return;
+  }
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "Memory.writeFrom(" GUM_PTR_CONST ", new Uint32Array([7, 8]));",
+      values);
+  EXPECT_NO_MESSAGES ();
+  g_assert_cmpuint (values[0], ==, 7);
+  g_assert_cmpuint (values[1], ==, 8);
+  g_assert_cmpuint (values[2], ==, 0);
+}
+
+SCRIPT_TESTCASE (pointers_can_be_read_in_bulk)
+{
+  gpointer pointers[2] = { GSIZE_TO_POINTER (0x1337), NULL };
+
+  if (GUM_DUK_IS_SCRIPT_BACKEND (fixture->backend))
+  {
+    g_print ("<skipping, not yet implemented in the Duktape runtime> ");
+    return;
+  }
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "var pointers = Memory.readPointers(" GUM_PTR_CONST ", 2);"
+      "send(pointers.length);"
+      "send(pointers[0].toString());"
+      "send(pointers[1].isNull());",
+      pointers);
+  EXPECT_SEND_MESSAGE_WITH ("2");
+  EXPECT_SEND_MESSAGE_WITH ("\"0x1337\"");
+  EXPECT_SEND_MESSAGE_WITH ("true");
+}
+
+SCRIPT_TESTCASE (memory_can_be_gathered)
+{
+  guint8 first[2] = { 0x13, 0x37 };
+  guint8 second[2] = { 0xca, 0xfe };
+
+  if (GUM_DUK_IS_SCRIPT_BACKEND (fixture->backend))
+  {
+    g_print ("<skipping, not yet implemented in the Duktape runtime> ");
+    return;
+  }
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "send('chunks', Memory.gather([" GUM_PTR_CONST ", " GUM_PTR_CONST "],"
+          " 2));",
+      first, second);
+  EXPECT_SEND_MESSAGE_WITH_PAYLOAD_AND_DATA ("\"chunks\"", "13 37 ca fe");
+}
+
 SCRIPT_TESTCASE (s8_can_be_read)
 {
   gint8 val = -42;
@@ -3224,68 +3485,45 @@ SCRIPT_TESTCASE (script_can_be_compiled_to_bytecode)
   GError * error;
   GBytes * code;
   GumScript * script;
+  TestScriptMessageItem * item;
 
   error = NULL;
-  code = gum_script_backend_compile_sync (fixture->backend, "send(1337);\noops;", NULL,
-      &error);
-  if (GUM_DUK_IS_SCRIPT_BACKEND (fixture->backend))
-  {
-    g_assert (code != NULL);
-    g_assert (error == NULL);
-
-    g_assert (gum_script_backend_compile_sync (fixture->backend, "'", NULL,
-        NULL) == NULL);
-
-    g_assert (gum_script_backend_compile_sync (fixture->backend, "'", NULL,
-        &error) == NULL);
-    g_assert (error != NULL);
-    g_assert (g_str_has_prefix (error->message,
-        "Script(line 1): SyntaxError: "));
-    g_clear_error (&error);
-  }
-  else
-  {
-    g_assert (code == NULL);
-    g_assert (error != NULL);
-    g_assert_cmpstr (error->message, ==, "Not yet supported by the V8 runtime");
-    g_clear_error (&error);
-
-    code = g_bytes_new (NULL, 0);
-  }
+  code = gum_script_backend_compile_sync (fixture->backend,
+      "send(1337);\noops;", NULL, &error);
+  g_assert (code != NULL);
+  g_assert (error == NULL);
+
+  g_assert (gum_script_backend_compile_sync (fixture->backend, "'", NULL,
+      NULL) == NULL);
+
+  g_assert (gum_script_backend_compile_sync (fixture->backend, "'", NULL,
+      &error) == NULL);
+  g_assert (error != NULL);
+  g_assert (g_str_has_prefix (error->message,
+      "Script(line 1): SyntaxError: "));
+  g_clear_error (&error);
 
   script = gum_script_backend_create_from_bytes_sync (fixture->backend,
       "testcase", code, NULL, &error);
-  if (GUM_DUK_IS_SCRIPT_BACKEND (fixture->backend))
-  {
-    TestScriptMessageItem * item;
+  g_assert (script != NULL);
+  g_assert (error == NULL);
 
-    g_assert (script != NULL);
-    g_assert (error == NULL);
+  gum_script_set_message_handler (script, test_script_fixture_store_message,
+      fixture, NULL);
 
-    gum_script_set_message_handler (script, test_script_fixture_store_message,
-        fixture, NULL);
+  gum_script_load_sync (script, NULL);
 
-    gum_script_load_sync (script, NULL);
-
-    EXPECT_SEND_MESSAGE_WITH ("1337");
+  EXPECT_SEND_MESSAGE_WITH ("1337");
 
-    item = test_script_fixture_pop_message (fixture);
-    g_assert (strstr (item->message, "ReferenceError") != NULL);
-    g_assert (strstr (item->message, "agent.js") == NULL);
-    g_assert (strstr (item->message, "testcase.js") != NULL);
-    test_script_message_item_free (item);
+  item = test_script_fixture_pop_message (fixture);
+  g_assert (strstr (item->message, "ReferenceError") != NULL);
+  g_assert (strstr (item->message, "agent.js") == NULL);
+  g_assert (strstr (item->message, "testcase.js") != NULL);
+  test_script_message_item_free (item);
 
-    EXPECT_NO_MESSAGES ();
+  EXPECT_NO_MESSAGES ();
 
-    g_object_unref (script);
-  }
-  else
-  {
-    g_assert (script == NULL);
-    g_assert (error != NULL);
-    g_assert_cmpstr (error->message, ==, "Not yet supported by the V8 runtime");
-    g_clear_error (&error);
-  }
+  g_object_unref (script);
 
   g_bytes_unref (code);
 }
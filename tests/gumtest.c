@@ -205,6 +205,9 @@ main (gint argc, gchar * argv[])
 #ifdef G_OS_WIN32
   TEST_RUN_LIST (profiler);
 #endif
+#ifdef HAVE_LINUX
+  TEST_RUN_LIST (sampling_profiler);
+#endif
 
 #if defined (HAVE_GUMJS)
   /* GumJS */
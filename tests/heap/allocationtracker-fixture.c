@@ -56,5 +56,19 @@ static const GumReturnAddress dummy_return_addresses_b[] =
   GUINT_TO_POINTER (0x4321),
 };
 
+typedef struct _TestConcurrentUpdatesContext
+{
+  GumAllocationTracker * tracker;
+  guint thread_index;
+} TestConcurrentUpdatesContext;
+
+typedef struct _TestCrossThreadFreeContext
+{
+  GumAllocationTracker * tracker;
+  volatile gint allocating;
+} TestCrossThreadFreeContext;
+
 static gboolean filter_cb (GumAllocationTracker * tracker, gpointer address,
     guint size, gpointer user_data);
+static gpointer perform_concurrent_updates (gpointer data);
+static gpointer perform_cross_thread_frees (gpointer data);
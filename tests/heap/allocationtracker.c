@@ -16,14 +16,20 @@ TEST_LIST_BEGIN (allocation_tracker)
   ALLOCTRACKER_TESTENTRY (block_list_sizes)
   ALLOCTRACKER_TESTENTRY (block_list_backtraces)
   ALLOCTRACKER_TESTENTRY (block_groups)
+  ALLOCTRACKER_TESTENTRY (call_sites)
 
   ALLOCTRACKER_TESTENTRY (filter_function)
+  ALLOCTRACKER_TESTENTRY (sampling_provides_unbiased_estimates)
+  ALLOCTRACKER_TESTENTRY (sampling_weight_survives_realloc)
 
   ALLOCTRACKER_TESTENTRY (realloc_new_block)
   ALLOCTRACKER_TESTENTRY (realloc_unknown_block)
   ALLOCTRACKER_TESTENTRY (realloc_zero_size)
   ALLOCTRACKER_TESTENTRY (realloc_backtrace)
 
+  ALLOCTRACKER_TESTENTRY (concurrent_updates_are_accounted_for)
+  ALLOCTRACKER_TESTENTRY (cross_thread_frees_are_accounted_for)
+
   ALLOCTRACKER_TESTENTRY (memory_usage_without_backtracer_should_be_sensible)
   ALLOCTRACKER_TESTENTRY (memory_usage_with_backtracer_should_be_sensible)
 
@@ -286,6 +292,67 @@ ALLOCTRACKER_TESTCASE (block_groups)
   gum_allocation_group_list_free (groups);
 }
 
+ALLOCTRACKER_TESTCASE (call_sites)
+{
+  GumBacktracer * backtracer;
+  GumAllocationTracker * t;
+  GList * sites, * cur;
+  guint trace_id_a = 0, trace_id_b = 0;
+
+  backtracer = gum_fake_backtracer_new (dummy_return_addresses_a,
+      G_N_ELEMENTS (dummy_return_addresses_a));
+  t = gum_allocation_tracker_new_with_backtracer (backtracer);
+
+  gum_allocation_tracker_begin (t);
+
+  gum_allocation_tracker_on_malloc (t, DUMMY_BLOCK_A, 42);
+  gum_allocation_tracker_on_malloc (t, DUMMY_BLOCK_B, 24);
+  gum_allocation_tracker_on_malloc (t, DUMMY_BLOCK_C, 10);
+
+  GUM_FAKE_BACKTRACER (backtracer)->ret_addrs = dummy_return_addresses_b;
+  GUM_FAKE_BACKTRACER (backtracer)->num_ret_addrs =
+      G_N_ELEMENTS (dummy_return_addresses_b);
+
+  gum_allocation_tracker_on_malloc (t, DUMMY_BLOCK_D, 1337);
+  gum_allocation_tracker_on_free (t, DUMMY_BLOCK_C);
+
+  sites = gum_allocation_tracker_peek_call_sites (t);
+  g_assert_cmpuint (g_list_length (sites), ==, 2);
+
+  for (cur = sites; cur != NULL; cur = cur->next)
+  {
+    GumAllocationCallSite * site = (GumAllocationCallSite *) cur->data;
+
+    g_assert_cmpuint (site->trace_id, !=, 0);
+    g_assert_cmpuint (site->return_addresses.len, ==, 2);
+
+    if (site->return_addresses.items[0] == dummy_return_addresses_a[0])
+    {
+      g_assert (site->return_addresses.items[1] ==
+          dummy_return_addresses_a[1]);
+      g_assert_cmpuint (site->alive_now, ==, 2);
+      g_assert_cmpuint (site->alive_size, ==, 42 + 24);
+      trace_id_a = site->trace_id;
+    }
+    else if (site->return_addresses.items[0] == dummy_return_addresses_b[0])
+    {
+      g_assert (site->return_addresses.items[1] ==
+          dummy_return_addresses_b[1]);
+      g_assert_cmpuint (site->alive_now, ==, 1);
+      g_assert_cmpuint (site->alive_size, ==, 1337);
+      trace_id_b = site->trace_id;
+    }
+    else
+      g_assert_not_reached ();
+  }
+  g_assert_cmpuint (trace_id_a, !=, trace_id_b);
+
+  gum_allocation_call_site_list_free (sites);
+
+  g_object_unref (t);
+  g_object_unref (backtracer);
+}
+
 ALLOCTRACKER_TESTCASE (filter_function)
 {
   GumBacktracer * backtracer;
@@ -329,6 +396,92 @@ filter_cb (GumAllocationTracker * tracker,
   return (size == 1337);
 }
 
+ALLOCTRACKER_TESTCASE (sampling_provides_unbiased_estimates)
+{
+  GumAllocationTracker * t = fixture->tracker;
+  const guint num_allocations = 10000;
+  guint i, count, total_size;
+  GList * blocks, * groups;
+  GumAllocationGroup * group;
+
+  gum_allocation_tracker_set_sample_interval (t, 1024);
+  gum_allocation_tracker_begin (t);
+
+  for (i = 0; i != num_allocations; i++)
+    gum_allocation_tracker_on_malloc (t, GUINT_TO_POINTER (0x50000 + (i * 64)),
+        64);
+
+  blocks = gum_allocation_tracker_peek_block_list (t);
+  g_assert_cmpuint (g_list_length (blocks), >, 0);
+  g_assert_cmpuint (g_list_length (blocks), <, num_allocations / 4);
+  gum_allocation_block_list_free (blocks);
+
+  count = gum_allocation_tracker_peek_block_count (t);
+  g_assert_cmpuint (count, >, num_allocations * 8 / 10);
+  g_assert_cmpuint (count, <, num_allocations * 12 / 10);
+
+  total_size = gum_allocation_tracker_peek_block_total_size (t);
+  g_assert_cmpuint (total_size, ==, count * 64);
+
+  groups = gum_allocation_tracker_peek_block_groups (t);
+  g_assert_cmpuint (g_list_length (groups), ==, 1);
+  group = (GumAllocationGroup *) groups->data;
+  g_assert_cmpuint (group->size, ==, 64);
+  g_assert_cmpuint (group->alive_now, ==, count);
+  gum_allocation_group_list_free (groups);
+
+  gum_allocation_tracker_end (t);
+}
+
+ALLOCTRACKER_TESTCASE (sampling_weight_survives_realloc)
+{
+  GumAllocationTracker * t = fixture->tracker;
+  const guint num_allocations = 10000;
+  guint i, count_before, count_after;
+  GList * blocks, * cur, * groups;
+  GumAllocationGroup * group;
+
+  gum_allocation_tracker_set_sample_interval (t, 1024);
+  gum_allocation_tracker_begin (t);
+
+  for (i = 0; i != num_allocations; i++)
+    gum_allocation_tracker_on_malloc (t, GUINT_TO_POINTER (0x50000 + (i * 64)),
+        64);
+
+  count_before = gum_allocation_tracker_peek_block_count (t);
+
+  blocks = gum_allocation_tracker_peek_block_list (t);
+  for (cur = blocks; cur != NULL; cur = cur->next)
+  {
+    GumAllocationBlock * block = (GumAllocationBlock *) cur->data;
+
+    gum_allocation_tracker_on_realloc (t, block->address, block->address,
+        4096);
+  }
+  gum_allocation_block_list_free (blocks);
+
+  count_after = gum_allocation_tracker_peek_block_count (t);
+  g_assert_cmpuint (count_after, >=, count_before - 1);
+  g_assert_cmpuint (count_after, <=, count_before + 1);
+
+  g_assert_cmpuint (gum_allocation_tracker_peek_block_total_size (t), ==,
+      count_after * 4096);
+
+  groups = gum_allocation_tracker_peek_block_groups (t);
+  g_assert_cmpuint (g_list_length (groups), ==, 2);
+  for (cur = groups; cur != NULL; cur = cur->next)
+  {
+    group = (GumAllocationGroup *) cur->data;
+    if (group->size == 64)
+      g_assert_cmpuint (group->alive_now, ==, 0);
+    else
+      g_assert_cmpuint (group->alive_now, ==, count_after);
+  }
+  gum_allocation_group_list_free (groups);
+
+  gum_allocation_tracker_end (t);
+}
+
 ALLOCTRACKER_TESTCASE (realloc_new_block)
 {
   GumAllocationTracker * t = fixture->tracker;
@@ -398,6 +551,167 @@ ALLOCTRACKER_TESTCASE (realloc_backtrace)
   g_object_unref (backtracer);
 }
 
+#define TEST_CONCURRENT_THREADS 4
+#define TEST_CONCURRENT_BLOCKS_PER_THREAD 1000
+
+ALLOCTRACKER_TESTCASE (concurrent_updates_are_accounted_for)
+{
+  GumAllocationTracker * t = fixture->tracker;
+  TestConcurrentUpdatesContext contexts[TEST_CONCURRENT_THREADS];
+  GThread * threads[TEST_CONCURRENT_THREADS];
+  GList * blocks, * groups, * cur;
+  guint i, expected_count;
+
+  gum_allocation_tracker_begin (t);
+
+  for (i = 0; i != TEST_CONCURRENT_THREADS; i++)
+  {
+    contexts[i].tracker = t;
+    contexts[i].thread_index = i;
+
+    threads[i] = g_thread_new ("allocationtracker-test-concurrency",
+        perform_concurrent_updates, &contexts[i]);
+  }
+  for (i = 0; i != TEST_CONCURRENT_THREADS; i++)
+    g_thread_join (threads[i]);
+
+  expected_count =
+      TEST_CONCURRENT_THREADS * (TEST_CONCURRENT_BLOCKS_PER_THREAD / 2);
+  g_assert_cmpuint (gum_allocation_tracker_peek_block_count (t), ==,
+      expected_count);
+  g_assert_cmpuint (gum_allocation_tracker_peek_block_total_size (t), ==,
+      expected_count * 32);
+
+  blocks = gum_allocation_tracker_peek_block_list (t);
+  g_assert_cmpuint (g_list_length (blocks), ==, expected_count);
+  gum_allocation_block_list_free (blocks);
+
+  groups = gum_allocation_tracker_peek_block_groups (t);
+  g_assert_cmpuint (g_list_length (groups), ==, 2);
+  for (cur = groups; cur != NULL; cur = cur->next)
+  {
+    GumAllocationGroup * group = (GumAllocationGroup *) cur->data;
+
+    if (group->size == 16)
+    {
+      g_assert_cmpuint (group->alive_now, ==, 0);
+      g_assert_cmpuint (group->total_peak, ==,
+          TEST_CONCURRENT_THREADS * TEST_CONCURRENT_BLOCKS_PER_THREAD);
+    }
+    else if (group->size == 32)
+    {
+      g_assert_cmpuint (group->alive_now, ==, expected_count);
+      g_assert_cmpuint (group->total_peak, ==, expected_count);
+    }
+    else
+      g_assert_not_reached ();
+  }
+  gum_allocation_group_list_free (groups);
+
+  gum_allocation_tracker_end (t);
+}
+
+static gpointer
+perform_concurrent_updates (gpointer data)
+{
+  TestConcurrentUpdatesContext * ctx = (TestConcurrentUpdatesContext *) data;
+  GumAllocationTracker * t = ctx->tracker;
+  guint i;
+
+  for (i = 0; i != TEST_CONCURRENT_BLOCKS_PER_THREAD; i++)
+  {
+    gsize address = 0x100000 +
+        (((ctx->thread_index * TEST_CONCURRENT_BLOCKS_PER_THREAD) + i) * 64);
+
+    gum_allocation_tracker_on_malloc (t, GSIZE_TO_POINTER (address), 16);
+
+    if (i % 2 == 0)
+    {
+      gum_allocation_tracker_on_realloc (t, GSIZE_TO_POINTER (address),
+          GSIZE_TO_POINTER (address + 32), 32);
+    }
+    else
+    {
+      gum_allocation_tracker_on_free (t, GSIZE_TO_POINTER (address));
+    }
+  }
+
+  return NULL;
+}
+
+#define TEST_CROSS_THREAD_BLOCKS 1000
+
+ALLOCTRACKER_TESTCASE (cross_thread_frees_are_accounted_for)
+{
+  GumAllocationTracker * t = fixture->tracker;
+  TestCrossThreadFreeContext ctx;
+  GThread * freeing_thread;
+  GList * blocks, * groups, * cur;
+  guint i;
+
+  gum_allocation_tracker_begin (t);
+
+  ctx.tracker = t;
+  ctx.allocating = TRUE;
+
+  freeing_thread = g_thread_new ("allocationtracker-test-free",
+      perform_cross_thread_frees, &ctx);
+
+  /*
+   * Each block gets a size of its own, so that every allocation also creates
+   * its group while the other thread is trying to free the block.
+   */
+  for (i = 0; i != TEST_CROSS_THREAD_BLOCKS; i++)
+  {
+    gum_allocation_tracker_on_malloc (t,
+        GSIZE_TO_POINTER (0x100000 + (i * 64)), i + 1);
+  }
+
+  g_atomic_int_set (&ctx.allocating, FALSE);
+  g_thread_join (freeing_thread);
+
+  g_assert_cmpuint (gum_allocation_tracker_peek_block_count (t), ==, 0);
+  g_assert_cmpuint (gum_allocation_tracker_peek_block_total_size (t), ==, 0);
+
+  blocks = gum_allocation_tracker_peek_block_list (t);
+  g_assert (blocks == NULL);
+
+  groups = gum_allocation_tracker_peek_block_groups (t);
+  g_assert_cmpuint (g_list_length (groups), ==, TEST_CROSS_THREAD_BLOCKS);
+  for (cur = groups; cur != NULL; cur = cur->next)
+  {
+    GumAllocationGroup * group = (GumAllocationGroup *) cur->data;
+
+    g_assert_cmpuint (group->alive_now, ==, 0);
+    g_assert_cmpuint (group->total_peak, ==, 1);
+  }
+  gum_allocation_group_list_free (groups);
+
+  gum_allocation_tracker_end (t);
+}
+
+static gpointer
+perform_cross_thread_frees (gpointer data)
+{
+  TestCrossThreadFreeContext * ctx = (TestCrossThreadFreeContext *) data;
+  gboolean done;
+  guint i;
+
+  do
+  {
+    done = !g_atomic_int_get (&ctx->allocating);
+
+    for (i = 0; i != TEST_CROSS_THREAD_BLOCKS; i++)
+    {
+      gum_allocation_tracker_on_free (ctx->tracker,
+          GSIZE_TO_POINTER (0x100000 + (i * 64)));
+    }
+  }
+  while (!done);
+
+  return NULL;
+}
+
 ALLOCTRACKER_TESTCASE (memory_usage_without_backtracer_should_be_sensible)
 {
   GumAllocationTracker * t = fixture->tracker;
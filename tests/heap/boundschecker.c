@@ -15,6 +15,7 @@ TEST_LIST_BEGIN (boundschecker)
   BOUNDSCHECKER_TESTENTRY (realloc_migration_pool_to_pool)
   BOUNDSCHECKER_TESTENTRY (realloc_migration_pool_to_heap)
   BOUNDSCHECKER_TESTENTRY (protected_after_free)
+  BOUNDSCHECKER_TESTENTRY (quarantine_delays_reuse)
   BOUNDSCHECKER_TESTENTRY (calloc_initializes_to_zero)
   BOUNDSCHECKER_TESTENTRY (custom_front_alignment)
 #ifndef HAVE_QNX
@@ -196,6 +197,28 @@ BOUNDSCHECKER_TESTCASE (protected_after_free)
   g_assert (exception_on_read && exception_on_write);
 }
 
+BOUNDSCHECKER_TESTCASE (quarantine_delays_reuse)
+{
+  guint8 * a, * b;
+  gboolean exception_on_read, exception_on_write;
+
+  g_object_set (fixture->checker,
+      "pool-size", 4,
+      "quarantine-size", 2,
+      NULL);
+
+  ATTACH_CHECKER ();
+  a = (guint8 *) malloc (1);
+  free (a);
+  b = (guint8 *) malloc (1);
+  free (b);
+  gum_try_read_and_write_at (a, 0, &exception_on_read, &exception_on_write);
+  DETACH_CHECKER ();
+
+  g_assert (b != a);
+  g_assert (exception_on_read && exception_on_write);
+}
+
 BOUNDSCHECKER_TESTCASE (calloc_initializes_to_zero)
 {
   guint8 * p;
@@ -12,6 +12,8 @@ TEST_LIST_BEGIN (pagepool)
   PAGEPOOL_TESTENTRY (alloc_protection)
   PAGEPOOL_TESTENTRY (free)
   PAGEPOOL_TESTENTRY (free_protection)
+  PAGEPOOL_TESTENTRY (free_coalesces)
+  PAGEPOOL_TESTENTRY (quarantine)
   PAGEPOOL_TESTENTRY (query_block_details)
   PAGEPOOL_TESTENTRY (peek_used)
   PAGEPOOL_TESTENTRY (alloc_and_fill_full_cycle)
@@ -122,6 +124,53 @@ PAGEPOOL_TESTCASE (free_protection)
   g_assert (!gum_memory_is_readable (address + 16, 1));
 }
 
+PAGEPOOL_TESTCASE (free_coalesces)
+{
+  GumPagePool * pool;
+  guint page_size;
+  gpointer p1, p2, p3;
+
+  SETUP_POOL (&pool, GUM_PROTECT_MODE_ABOVE, 6);
+  g_object_get (pool, "page-size", &page_size, NULL);
+
+  p1 = gum_page_pool_try_alloc (pool, 1);
+  p2 = gum_page_pool_try_alloc (pool, 1);
+  p3 = gum_page_pool_try_alloc (pool, 1);
+  g_assert_cmpuint (gum_page_pool_peek_available (pool), ==, 0);
+
+  g_assert (gum_page_pool_try_free (pool, p1));
+  g_assert (gum_page_pool_try_free (pool, p3));
+  g_assert (gum_page_pool_try_free (pool, p2));
+
+  p1 = gum_page_pool_try_alloc (pool, 4 * page_size);
+  g_assert (p1 != NULL);
+  g_assert_cmpuint (gum_page_pool_peek_available (pool), ==, 1);
+}
+
+PAGEPOOL_TESTCASE (quarantine)
+{
+  GumPagePool * pool;
+  gpointer p1, p2, p3;
+
+  SETUP_POOL (&pool, GUM_PROTECT_MODE_ABOVE, 4);
+  g_object_set (pool, "quarantine-size", 2, NULL);
+
+  p1 = gum_page_pool_try_alloc (pool, 1);
+  g_assert (gum_page_pool_try_free (pool, p1));
+  g_assert_cmpuint (gum_page_pool_peek_quarantined (pool), ==, 2);
+  g_assert_cmpuint (gum_page_pool_peek_available (pool), ==, 2);
+  g_assert_cmpuint (gum_page_pool_peek_used (pool), ==, 0);
+  g_assert (!gum_memory_is_readable (GUM_ADDRESS (p1), 1));
+
+  p2 = gum_page_pool_try_alloc (pool, 1);
+  g_assert (p2 != p1);
+
+  p3 = gum_page_pool_try_alloc (pool, 1);
+  g_assert (p3 == p1);
+  g_assert_cmpuint (gum_page_pool_peek_quarantined (pool), ==, 0);
+  g_assert_cmpuint (gum_page_pool_peek_available (pool), ==, 0);
+}
+
 PAGEPOOL_TESTCASE (query_block_details)
 {
   GumPagePool * pool;
@@ -39,6 +39,8 @@ typedef struct _TestProfilerFixture
   GumFakeSampler * fake_sampler;
 } TestProfilerFixture;
 
+typedef struct _TestPprofField TestPprofField;
+
 typedef struct _TestProfileReportFixture
 {
   GumProfiler * profiler;
@@ -50,6 +52,14 @@ typedef struct _TestProfileReportFixture
   const GPtrArray * root_nodes;
 } TestProfileReportFixture;
 
+struct _TestPprofField
+{
+  guint number;
+  guint64 value;
+  const guint8 * data;
+  gsize size;
+};
+
 static void
 test_profiler_fixture_setup (TestProfilerFixture * fixture,
                              gconstpointer data)
@@ -189,6 +199,247 @@ assert_same_xml (TestProfileReportFixture * fixture,
   g_free (generated_xml);
 }
 
+static void
+append_to_string (const gchar * data,
+                  gsize size,
+                  gpointer user_data)
+{
+  g_string_append_len ((GString *) user_data, data, size);
+}
+
+void
+assert_same_folded_stacks (TestProfileReportFixture * fixture,
+                           const gchar * expected_stacks)
+{
+  GString * generated_stacks;
+
+  fixture->report = gum_profiler_generate_report (fixture->profiler);
+  g_assert (fixture->report != NULL);
+
+  generated_stacks = g_string_new ("");
+  gum_profile_report_emit_folded_stacks (fixture->report, append_to_string,
+      generated_stacks);
+  g_assert_cmpstr (generated_stacks->str, ==, expected_stacks);
+  g_string_free (generated_stacks, TRUE);
+}
+
+static guint64
+pprof_read_varint (const guint8 ** cursor,
+                   const guint8 * end)
+{
+  guint64 value = 0;
+  guint shift = 0;
+  guint8 byte;
+
+  do
+  {
+    g_assert (*cursor != end);
+    g_assert_cmpuint (shift, <, 64);
+
+    byte = *(*cursor)++;
+    value |= (guint64) (byte & 0x7f) << shift;
+    shift += 7;
+  }
+  while ((byte & 0x80) != 0);
+
+  return value;
+}
+
+static gboolean
+pprof_read_field (const guint8 ** cursor,
+                  const guint8 * end,
+                  TestPprofField * field)
+{
+  guint64 key;
+
+  if (*cursor == end)
+    return FALSE;
+
+  key = pprof_read_varint (cursor, end);
+  field->number = key >> 3;
+
+  switch (key & 7)
+  {
+    case 0:
+      field->value = pprof_read_varint (cursor, end);
+      field->data = NULL;
+      field->size = 0;
+      break;
+    case 2:
+      field->value = 0;
+      field->size = pprof_read_varint (cursor, end);
+      g_assert_cmpuint (field->size, <=, end - *cursor);
+      field->data = *cursor;
+      *cursor += field->size;
+      break;
+    default:
+      g_assert_not_reached ();
+  }
+
+  return TRUE;
+}
+
+/*
+ * Decodes the samples of a pprof profile into one line per sample, listing
+ * the stack root first, followed by the number of calls and the duration,
+ * e.g. "main;parse 1 42".
+ */
+static gchar *
+pprof_decode_samples (const GString * profile)
+{
+  const guint8 * cursor, * end;
+  GPtrArray * strings;
+  GArray * samples;
+  GHashTable * name_by_function, * function_by_location;
+  GString * result;
+  TestPprofField field, sub;
+  guint i;
+
+  strings = g_ptr_array_new_with_free_func (g_free);
+  samples = g_array_new (FALSE, FALSE, sizeof (TestPprofField));
+  name_by_function = g_hash_table_new (NULL, NULL);
+  function_by_location = g_hash_table_new (NULL, NULL);
+
+  cursor = (const guint8 *) profile->str;
+  end = cursor + profile->len;
+  while (pprof_read_field (&cursor, end, &field))
+  {
+    const guint8 * c = field.data;
+    const guint8 * e = field.data + field.size;
+    guint64 id = 0, name = 0, function = 0;
+
+    switch (field.number)
+    {
+      case 2:
+        g_array_append_val (samples, field);
+        break;
+      case 4:
+        while (pprof_read_field (&c, e, &sub))
+        {
+          if (sub.number == 1)
+          {
+            id = sub.value;
+          }
+          else if (sub.number == 4)
+          {
+            const guint8 * lc = sub.data;
+            TestPprofField line;
+
+            while (pprof_read_field (&lc, sub.data + sub.size, &line))
+            {
+              if (line.number == 1)
+                function = line.value;
+            }
+          }
+        }
+        g_hash_table_insert (function_by_location, GSIZE_TO_POINTER (id),
+            GSIZE_TO_POINTER (function));
+        break;
+      case 5:
+        while (pprof_read_field (&c, e, &sub))
+        {
+          if (sub.number == 1)
+            id = sub.value;
+          else if (sub.number == 2)
+            name = sub.value;
+        }
+        g_hash_table_insert (name_by_function, GSIZE_TO_POINTER (id),
+            GSIZE_TO_POINTER (name));
+        break;
+      case 6:
+        g_ptr_array_add (strings, g_strndup ((const gchar *) field.data,
+            field.size));
+        break;
+      default:
+        break;
+    }
+  }
+
+  /* The string table must start out with the empty string */
+  g_assert_cmpuint (strings->len, >, 0);
+  g_assert_cmpstr (g_ptr_array_index (strings, 0), ==, "");
+
+  result = g_string_new ("");
+  for (i = 0; i != samples->len; i++)
+  {
+    const TestPprofField * sample =
+        &g_array_index (samples, TestPprofField, i);
+    const guint8 * c = sample->data;
+    GArray * locations;
+    GString * values;
+    gint j;
+
+    locations = g_array_new (FALSE, FALSE, sizeof (guint64));
+    values = g_string_new ("");
+
+    while (pprof_read_field (&c, sample->data + sample->size, &sub))
+    {
+      const guint8 * pc = sub.data;
+
+      while (pc != sub.data + sub.size)
+      {
+        guint64 value = pprof_read_varint (&pc, sub.data + sub.size);
+
+        if (sub.number == 1)
+          g_array_append_val (locations, value);
+        else if (sub.number == 2)
+          g_string_append_printf (values, " %" G_GUINT64_FORMAT, value);
+      }
+    }
+
+    /* Locations are stored leaf first */
+    for (j = (gint) locations->len - 1; j >= 0; j--)
+    {
+      gpointer function, name;
+      gboolean found;
+
+      found = g_hash_table_lookup_extended (function_by_location,
+          GSIZE_TO_POINTER (g_array_index (locations, guint64, j)), NULL,
+          &function);
+      g_assert (found);
+      found = g_hash_table_lookup_extended (name_by_function, function, NULL,
+          &name);
+      g_assert (found);
+      g_assert_cmpuint (GPOINTER_TO_SIZE (name), <, strings->len);
+
+      if (j != (gint) locations->len - 1)
+        g_string_append_c (result, ';');
+      g_string_append (result,
+          g_ptr_array_index (strings, GPOINTER_TO_SIZE (name)));
+    }
+    g_string_append (result, values->str);
+    g_string_append_c (result, '\n');
+
+    g_string_free (values, TRUE);
+    g_array_free (locations, TRUE);
+  }
+
+  g_hash_table_unref (function_by_location);
+  g_hash_table_unref (name_by_function);
+  g_array_free (samples, TRUE);
+  g_ptr_array_unref (strings);
+
+  return g_string_free (result, FALSE);
+}
+
+void
+assert_same_pprof_samples (TestProfileReportFixture * fixture,
+                           const gchar * expected_samples)
+{
+  GString * profile;
+  gchar * samples;
+
+  fixture->report = gum_profiler_generate_report (fixture->profiler);
+  g_assert (fixture->report != NULL);
+
+  profile = g_string_new ("");
+  gum_profile_report_emit_pprof (fixture->report, append_to_string, profile);
+  samples = pprof_decode_samples (profile);
+  g_assert_cmpstr (samples, ==, expected_samples);
+  g_free (samples);
+  g_string_free (profile, TRUE);
+}
+
 /*
  * Guinea pig functions:
  */
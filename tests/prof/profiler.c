@@ -17,6 +17,7 @@ TEST_LIST_BEGIN (profiler)
 
   PROFILER_TESTENTRY (flat_function)
   PROFILER_TESTENTRY (two_calls)
+  PROFILER_TESTENTRY (two_threads)
   PROFILER_TESTENTRY (profile_matching_functions)
   PROFILER_TESTENTRY (recursion)
   PROFILER_TESTENTRY (deep_recursion)
@@ -34,6 +35,10 @@ TEST_LIST_BEGIN (profiler)
   PROFILEREPORT_TESTENTRY (xml_multiple_threads)
   PROFILEREPORT_TESTENTRY (xml_worst_case_info)
   PROFILEREPORT_TESTENTRY (xml_thread_ordering)
+  PROFILEREPORT_TESTENTRY (folded_stacks_basic)
+  PROFILEREPORT_TESTENTRY (folded_stacks_recursion)
+  PROFILEREPORT_TESTENTRY (folded_stacks_multiple_threads)
+  PROFILEREPORT_TESTENTRY (pprof_basic)
 TEST_LIST_END ()
 
 #ifdef HAVE_I386
@@ -99,6 +104,25 @@ PROFILER_TESTCASE (two_calls)
       &sleepy_function), ==, 2 * 1000);
 }
 
+PROFILER_TESTCASE (two_threads)
+{
+  GumProfiler * prof = fixture->profiler;
+
+  gum_profiler_instrument_function (prof, &sleepy_function, fixture->sampler);
+
+  sleepy_function (fixture->fake_sampler);
+  g_thread_join (g_thread_new ("profiler-test-two-threads",
+      (GThreadFunc) sleepy_function, fixture->fake_sampler));
+
+  g_assert_cmpuint (gum_profiler_get_number_of_threads (prof), ==, 2);
+  g_assert_cmpuint (gum_profiler_get_total_duration_of (prof, 0,
+      &sleepy_function), ==, 1000);
+  g_assert_cmpuint (gum_profiler_get_total_duration_of (prof, 1,
+      &sleepy_function), ==, 1000);
+  g_assert_cmpuint (gum_profiler_get_total_duration_of (prof, 2,
+      &sleepy_function), ==, 0);
+}
+
 PROFILEREPORT_TESTCASE (bottleneck)
 {
   instrument_example_functions (fixture);
@@ -365,4 +389,56 @@ PROFILER_TESTCASE (worst_case_info_on_recursion)
       &example_worst_case_recursive), ==, "2");
 }
 
+PROFILEREPORT_TESTCASE (folded_stacks_basic)
+{
+  instrument_example_functions (fixture);
+
+  example_a (fixture->fake_sampler);
+
+  assert_same_folded_stacks (fixture,
+      "example_a 2\n"
+      "example_a;example_c 4\n"
+      "example_a;example_b 3\n");
+}
+
+PROFILEREPORT_TESTCASE (folded_stacks_recursion)
+{
+  instrument_example_functions (fixture);
+
+  example_cyclic_a (fixture->fake_sampler, 1);
+
+  assert_same_folded_stacks (fixture,
+      "example_cyclic_a 1\n"
+      "example_cyclic_a;example_cyclic_b 2\n"
+      "example_cyclic_a;example_cyclic_b;example_cyclic_a 1\n");
+}
+
+PROFILEREPORT_TESTCASE (folded_stacks_multiple_threads)
+{
+  instrument_example_functions (fixture);
+
+  example_a (fixture->fake_sampler);
+  g_thread_join (g_thread_new ("profiler-test-multiple-threads",
+      (GThreadFunc) example_d, fixture->fake_sampler));
+
+  assert_same_folded_stacks (fixture,
+      "example_a 2\n"
+      "example_a;example_c 4\n"
+      "example_a;example_b 3\n"
+      "example_d 7\n"
+      "example_d;example_c 4\n");
+}
+
+PROFILEREPORT_TESTCASE (pprof_basic)
+{
+  instrument_example_functions (fixture);
+
+  example_a (fixture->fake_sampler);
+
+  assert_same_pprof_samples (fixture,
+      "example_a 1 2\n"
+      "example_a;example_c 1 4\n"
+      "example_a;example_b 1 3\n");
+}
+
 #endif /* G_OS_WIN32 */
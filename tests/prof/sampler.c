@@ -12,13 +12,25 @@ TEST_LIST_BEGIN (sampler)
   SAMPLER_TESTENTRY (busy_cycle)
   SAMPLER_TESTENTRY (malloc_count)
   SAMPLER_TESTENTRY (multiple_call_counters)
+  SAMPLER_TESTENTRY (call_count_breakdown)
   SAMPLER_TESTENTRY (wallclock)
+  SAMPLER_TESTENTRY (timestamp)
+#ifdef HAVE_LINUX
+  SAMPLER_TESTENTRY (perf_counter)
+  SAMPLER_TESTENTRY (perf_counter_is_per_thread)
+#endif
 TEST_LIST_END ()
 
 static void spin_for_one_tenth_second (void);
 static gpointer malloc_count_helper_thread (gpointer data);
+static gpointer call_count_helper_thread (gpointer data);
+static gboolean count_call_count_entry (const GumCallCountDetails * details,
+    gpointer user_data);
 static void nop_function_a (void);
 static void nop_function_b (void);
+#ifdef HAVE_LINUX
+static gpointer perf_counter_helper_thread (gpointer data);
+#endif
 
 SAMPLER_TESTCASE (cycle)
 {
@@ -125,6 +137,62 @@ SAMPLER_TESTCASE (multiple_call_counters)
   g_object_unref (sampler1);
 }
 
+SAMPLER_TESTCASE (call_count_breakdown)
+{
+  GumCallCountSampler * sampler;
+  GumThreadId main_thread_id, helper_thread_id;
+  guint entry_count = 0;
+
+  fixture->sampler = gum_call_count_sampler_new (nop_function_a,
+      nop_function_b, NULL);
+  sampler = GUM_CALL_COUNT_SAMPLER (fixture->sampler);
+
+  main_thread_id = gum_process_get_current_thread_id ();
+
+  nop_function_a ();
+  nop_function_a ();
+  nop_function_b ();
+  helper_thread_id = GPOINTER_TO_SIZE (g_thread_join (g_thread_new (
+      "sampler-test-call-count", call_count_helper_thread, NULL)));
+
+  g_assert_cmpuint (gum_sampler_sample (fixture->sampler), ==, 3);
+  g_assert_cmpuint (gum_call_count_sampler_peek_total_count (sampler), ==, 4);
+  g_assert_cmpuint (gum_call_count_sampler_peek_thread_count (sampler,
+      main_thread_id), ==, 3);
+  g_assert_cmpuint (gum_call_count_sampler_peek_thread_count (sampler,
+      helper_thread_id), ==, 1);
+  g_assert_cmpuint (gum_call_count_sampler_peek_function_count (sampler,
+      nop_function_a), ==, 3);
+  g_assert_cmpuint (gum_call_count_sampler_peek_function_count (sampler,
+      nop_function_b), ==, 1);
+
+  gum_call_count_sampler_enumerate_counts (sampler, count_call_count_entry,
+      &entry_count);
+  g_assert_cmpuint (entry_count, ==, 3);
+}
+
+static gpointer
+call_count_helper_thread (gpointer data)
+{
+  (void) data;
+
+  nop_function_a ();
+
+  return GSIZE_TO_POINTER (gum_process_get_current_thread_id ());
+}
+
+static gboolean
+count_call_count_entry (const GumCallCountDetails * details,
+                        gpointer user_data)
+{
+  guint * entry_count = user_data;
+
+  g_assert_cmpuint (details->count, >, 0);
+  (*entry_count)++;
+
+  return TRUE;
+}
+
 SAMPLER_TESTCASE (wallclock)
 {
   GumSample sample_a, sample_b;
@@ -138,6 +206,104 @@ SAMPLER_TESTCASE (wallclock)
   g_assert_cmpuint (sample_b, >, sample_a);
 }
 
+SAMPLER_TESTCASE (timestamp)
+{
+  GumSample sample_a, sample_b, wall_a, wall_b, elapsed;
+
+  fixture->sampler = gum_timestamp_sampler_new ();
+
+  wall_a = g_get_monotonic_time ();
+  sample_a = gum_sampler_sample (fixture->sampler);
+  g_usleep (G_USEC_PER_SEC / 30);
+  sample_b = gum_sampler_sample (fixture->sampler);
+  wall_b = g_get_monotonic_time ();
+
+  g_assert_cmpuint (sample_b, >, sample_a);
+
+  elapsed = (sample_b - sample_a) / 1000;
+  g_assert_cmpuint (elapsed, >=, (G_USEC_PER_SEC / 30) * 9 / 10);
+  g_assert_cmpuint (elapsed, <=, (wall_b - wall_a) * 11 / 10);
+}
+
+#ifdef HAVE_LINUX
+
+SAMPLER_TESTCASE (perf_counter)
+{
+  GumPerfCounterEvent events[] = {
+    GUM_PERF_COUNTER_CYCLES,
+    GUM_PERF_COUNTER_INSTRUCTIONS,
+    GUM_PERF_COUNTER_CACHE_MISSES,
+    GUM_PERF_COUNTER_BRANCH_MISSES
+  };
+  guint i;
+
+  for (i = 0; i != G_N_ELEMENTS (events); i++)
+  {
+    GumSampler * sampler;
+    GumSample sample_a, sample_b;
+
+    sampler = gum_perf_counter_sampler_new (events[i]);
+
+    if (gum_perf_counter_sampler_is_available (
+        GUM_PERF_COUNTER_SAMPLER (sampler)))
+    {
+      sample_a = gum_sampler_sample (sampler);
+      spin_for_one_tenth_second ();
+      sample_b = gum_sampler_sample (sampler);
+      g_assert_cmpuint (sample_b, >=, sample_a);
+
+      if (events[i] == GUM_PERF_COUNTER_CYCLES ||
+          events[i] == GUM_PERF_COUNTER_INSTRUCTIONS)
+      {
+        g_assert_cmpuint (sample_b, >, sample_a);
+      }
+    }
+    else
+    {
+      g_test_message ("skipping event %u because it is not available",
+          events[i]);
+    }
+
+    g_object_unref (sampler);
+  }
+}
+
+SAMPLER_TESTCASE (perf_counter_is_per_thread)
+{
+  GumSample sample_a, sample_b, helper_diff;
+
+  fixture->sampler = gum_perf_counter_sampler_new (GUM_PERF_COUNTER_CYCLES);
+  if (!gum_perf_counter_sampler_is_available (
+      GUM_PERF_COUNTER_SAMPLER (fixture->sampler)))
+  {
+    g_test_message ("skipping test because of missing hardware support");
+    return;
+  }
+
+  sample_a = gum_sampler_sample (fixture->sampler);
+  helper_diff = GPOINTER_TO_SIZE (g_thread_join (g_thread_new (
+      "sampler-test-perf-counter", perf_counter_helper_thread,
+      fixture->sampler)));
+  sample_b = gum_sampler_sample (fixture->sampler);
+
+  g_assert_cmpuint (helper_diff, >, 0);
+  g_assert_cmpuint (sample_b - sample_a, <, helper_diff);
+}
+
+static gpointer
+perf_counter_helper_thread (gpointer data)
+{
+  GumSampler * sampler = data;
+  GumSample start;
+
+  start = gum_sampler_sample (sampler);
+  spin_for_one_tenth_second ();
+
+  return GSIZE_TO_POINTER (gum_sampler_sample (sampler) - start);
+}
+
+#endif
+
 static void
 spin_for_one_tenth_second (void)
 {
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumsamplingprofiler.h"
+
+#ifdef HAVE_LINUX
+
+#include "testutil.h"
+
+#include <string.h>
+
+#define SAMPLING_PROFILER_TESTCASE(NAME) \
+    void test_sampling_profiler_ ## NAME ( \
+        TestSamplingProfilerFixture * fixture, gconstpointer data)
+#define SAMPLING_PROFILER_TESTENTRY(NAME) \
+    TEST_ENTRY_WITH_FIXTURE ("Prof/SamplingProfiler", test_sampling_profiler, \
+        NAME, TestSamplingProfilerFixture)
+
+typedef struct _TestSamplingProfilerFixture
+{
+  GumSamplingProfiler * profiler;
+} TestSamplingProfilerFixture;
+
+static void
+test_sampling_profiler_fixture_setup (TestSamplingProfilerFixture * fixture,
+                                      gconstpointer data)
+{
+  fixture->profiler = gum_sampling_profiler_new ();
+  gum_sampling_profiler_set_interval (fixture->profiler, 1000);
+}
+
+static void
+test_sampling_profiler_fixture_teardown (TestSamplingProfilerFixture * fixture,
+                                         gconstpointer data)
+{
+  g_object_unref (fixture->profiler);
+}
+
+void GUM_NOINLINE sampling_profiler_spin_for_one_fifth_second (void);
+
+static void
+append_to_string (const gchar * data,
+                  gsize size,
+                  gpointer user_data)
+{
+  g_string_append_len ((GString *) user_data, data, size);
+}
+
+/*
+ * Guinea pig functions:
+ */
+
+void GUM_NOINLINE
+sampling_profiler_spin_for_one_fifth_second (void)
+{
+  GTimer * timer;
+  guint i;
+  volatile guint b = 0;
+
+  timer = g_timer_new ();
+
+  do
+  {
+    for (i = 0; i != 1000000; i++)
+      b += i * i;
+  }
+  while (g_timer_elapsed (timer, NULL) < 0.2);
+
+  g_timer_destroy (timer);
+}
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "samplingprofiler-fixture.c"
+
+#ifdef HAVE_LINUX
+
+TEST_LIST_BEGIN (sampling_profiler)
+  SAMPLING_PROFILER_TESTENTRY (busy_thread_gets_sampled)
+  SAMPLING_PROFILER_TESTENTRY (idle_thread_does_not_get_sampled)
+  SAMPLING_PROFILER_TESTENTRY (report_contains_busy_function)
+  SAMPLING_PROFILER_TESTENTRY (only_one_profiler_can_run)
+TEST_LIST_END ()
+
+SAMPLING_PROFILER_TESTCASE (busy_thread_gets_sampled)
+{
+  g_assert (gum_sampling_profiler_start (fixture->profiler));
+  sampling_profiler_spin_for_one_fifth_second ();
+  gum_sampling_profiler_stop (fixture->profiler);
+
+  g_assert_cmpuint (gum_sampling_profiler_get_sample_count (fixture->profiler),
+      >, 0);
+  g_assert_cmpuint (gum_sampling_profiler_get_dropped_count (
+      fixture->profiler), ==, 0);
+}
+
+SAMPLING_PROFILER_TESTCASE (idle_thread_does_not_get_sampled)
+{
+  g_assert (gum_sampling_profiler_start (fixture->profiler));
+  g_usleep (G_USEC_PER_SEC / 5);
+  gum_sampling_profiler_stop (fixture->profiler);
+
+  g_assert_cmpuint (gum_sampling_profiler_get_sample_count (fixture->profiler),
+      <, 20);
+}
+
+SAMPLING_PROFILER_TESTCASE (report_contains_busy_function)
+{
+  GumProfileReport * report;
+  GString * stacks;
+
+  g_assert (gum_sampling_profiler_start (fixture->profiler));
+  sampling_profiler_spin_for_one_fifth_second ();
+  gum_sampling_profiler_stop (fixture->profiler);
+
+  report = gum_sampling_profiler_generate_report (fixture->profiler);
+  stacks = g_string_new ("");
+  gum_profile_report_emit_folded_stacks (report, append_to_string, stacks);
+  g_assert (strstr (stacks->str,
+      "sampling_profiler_spin_for_one_fifth_second") != NULL);
+  g_string_free (stacks, TRUE);
+  g_object_unref (report);
+}
+
+SAMPLING_PROFILER_TESTCASE (only_one_profiler_can_run)
+{
+  GumSamplingProfiler * other;
+
+  other = gum_sampling_profiler_new ();
+
+  g_assert (gum_sampling_profiler_start (fixture->profiler));
+  g_assert (!gum_sampling_profiler_start (other));
+  gum_sampling_profiler_stop (fixture->profiler);
+
+  g_assert (gum_sampling_profiler_start (other));
+  gum_sampling_profiler_stop (other);
+
+  g_object_unref (other);
+}
+
+#endif